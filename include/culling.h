@@ -0,0 +1,51 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <rafgl.h>
+
+/* boxes one rafgl_parallel_for job tests */
+#define CULL_BATCH 1024
+/* sets with fewer boxes are tested on the calling thread, waking the workers costs more than the test */
+#define CULL_PARALLEL_MIN (8 * CULL_BATCH)
+
+typedef struct _cull_frustum_t
+{
+    /* a * x + b * y + c * z + d >= 0 inside, normals point inwards. Left, right, bottom, top, near, far,
+       with far in the place of near once that is dropped */
+    float planes[6][4];
+    int plane_count;
+} cull_frustum_t;
+
+typedef struct _cull_set_t
+{
+    /* one array per coordinate so the tests load four or eight boxes at a time, see aabbs_t */
+    float *min_x, *min_y, *min_z;
+    float *max_x, *max_y, *max_z;
+    int count, capacity;
+
+    /* left by the last cull_set_test: the indices of the boxes inside in ascending order, and per box 1 inside, 0 outside */
+    int *visible;
+    int visible_count;
+    unsigned char *inside;
+
+    /* boxes inside per CULL_BATCH, then where the visible ones of the batch start */
+    int *batch_visible;
+} cull_set_t;
+
+/* six planes of the clip volume of view_projection, works for the oblique and mirrored ones as well */
+cull_frustum_t cull_frustum_from_matrix(mat4_t view_projection);
+/* for depth clamped passes, where nothing in front of the near plane is lost */
+void cull_frustum_drop_near(cull_frustum_t *frustum);
+
+void cull_set_init(cull_set_t *set);
+/* returns the index of the box, they keep the order they were added in */
+int cull_set_add(cull_set_t *set, vec3_t min, vec3_t max);
+void cull_set_move(cull_set_t *set, int index, vec3_t min, vec3_t max);
+/* forgets every box, for sets refilled each frame */
+void cull_set_clear(cull_set_t *set);
+/* tests every box against frustum (on every core once there are CULL_PARALLEL_MIN of them) and returns how many are inside.
+   The inside and total counts are added to the profiler counters of those names, NULL skips one */
+int cull_set_test(cull_set_t *set, const cull_frustum_t *frustum, const char *visible_counter, const char *total_counter);
+void cull_set_cleanup(cull_set_t *set);
+
+#endif //CULLING_H
@@ -4,6 +4,19 @@
 #include <GLFW/glfw3.h>
 #include <rafgl.h>
 
+/* how the water gets its reflections, R switches between them at run time */
+#define WATER_REFLECTION_PLANAR 0
+#define WATER_REFLECTION_SSR 1
+
+typedef struct _main_state_args_t
+{
+    /* headless runs: camera pose script ("x y z target_x target_y target_z [time]" per line) and the printf pattern of the images */
+    const char *pose_script;
+    const char *output_pattern;
+    /* WATER_REFLECTION_* to start with */
+    int reflection_mode;
+} main_state_args_t;
+
 void main_state_init(GLFWwindow *window, void *args, int width, int height);
 void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args);
 void main_state_render(GLFWwindow *window, void *args);
@@ -76,6 +76,7 @@ v1.0  2016-02-15  Initial release
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 
 // Define PI directly because we would need to define the _BSD_SOURCE or
@@ -85,6 +86,27 @@ v1.0  2016-02-15  Initial release
 #define M_PI 3.14159265358979323846
 #endif
 
+// The batch functions below use the widest vector unit the compiler was told
+// about: AVX (-mavx), SSE (always there on x86-64) or NEON on AArch64. Define
+// MATH_3D_NO_SIMD to build them as plain loops over the scalar functions.
+// MATH_3D_SIMD names the one in use.
+#if !defined(MATH_3D_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define MATH_3D_USE_SSE
+#define MATH_3D_USE_AVX
+#define MATH_3D_SIMD "avx"
+#elif !defined(MATH_3D_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+#include <xmmintrin.h>
+#define MATH_3D_USE_SSE
+#define MATH_3D_SIMD "sse"
+#elif !defined(MATH_3D_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MATH_3D_USE_NEON
+#define MATH_3D_SIMD "neon"
+#else
+#define MATH_3D_SIMD "scalar"
+#endif
+
 
 //
 // 3D vectors
@@ -198,6 +220,31 @@ static inline mat4_t m4_mul          (mat4_t a, mat4_t b);
               void   m4_fprintp      (FILE* stream, mat4_t matrix, int width, int precision);
 
 
+//
+// Batches
+//
+// The same operation on many points, matrices or boxes at once, four or eight
+// at a time with the vector unit picked above. Each one gives what a loop over
+// its scalar counterpart gives, to the bit, as long as the compiler does not
+// fuse multiplies and adds in one path and not the other. The only other
+// difference is m4_mul_n() giving 0 where m4_mul() gives -0.
+//
+// Boxes are kept with one array per coordinate so a single load picks up the
+// same coordinate of consecutive boxes. Planes are (a, b, c, d) with the inside
+// where a*x + b*y + c*z + d >= 0.
+//
+
+typedef struct {
+	const float *min_x, *min_y, *min_z;
+	const float *max_x, *max_y, *max_z;
+} aabbs_t;
+
+              void   m4_mul_pos_n    (mat4_t matrix, const vec3_t* positions, vec3_t* results, int count);
+              void   m4_mul_n        (mat4_t a, const mat4_t* b, mat4_t* results, int count);
+              int    aabb_in_planes  (const float* planes, int plane_count, vec3_t min, vec3_t max);
+              int    aabbs_in_planes (const float* planes, int plane_count, aabbs_t boxes, int first, int count, unsigned char* inside);
+
+
 
 //
 // 3D vector functions header implementation
@@ -624,4 +671,202 @@ void m4_fprintp(FILE* stream, mat4_t matrix, int width, int precision) {
 	}
 }
 
+/**
+ * m4_mul_pos() for count positions, results may be positions.
+ *
+ * A vector holds the whole (x, y, z, w) of one point, built column by column in
+ * the order m4_mul_pos() adds the products up. The division by w is done for
+ * every point and kept only where m4_mul_pos() would have done it.
+ */
+void m4_mul_pos_n(mat4_t matrix, const vec3_t* positions, vec3_t* results, int count) {
+	int i = 0;
+	
+#if defined(MATH_3D_USE_SSE)
+	__m128 c0 = _mm_loadu_ps(matrix.m[0]), c1 = _mm_loadu_ps(matrix.m[1]);
+	__m128 c2 = _mm_loadu_ps(matrix.m[2]), c3 = _mm_loadu_ps(matrix.m[3]);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	
+	for(; i < count; i++) {
+		vec3_t p = positions[i];
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))),
+			_mm_mul_ps(c2, _mm_set1_ps(p.z))), c3);
+		__m128 w = _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 divide = _mm_and_ps(_mm_cmpneq_ps(w, zero), _mm_cmpneq_ps(w, one));
+		r = _mm_or_ps(_mm_and_ps(divide, _mm_div_ps(r, w)), _mm_andnot_ps(divide, r));
+		
+		_mm_storel_pi((__m64*)&results[i].x, r);
+		_mm_store_ss(&results[i].z, _mm_movehl_ps(r, r));
+	}
+#elif defined(MATH_3D_USE_NEON)
+	float32x4_t c0 = vld1q_f32(matrix.m[0]), c1 = vld1q_f32(matrix.m[1]);
+	float32x4_t c2 = vld1q_f32(matrix.m[2]), c3 = vld1q_f32(matrix.m[3]);
+	
+	for(; i < count; i++) {
+		vec3_t p = positions[i];
+		float32x4_t r = vaddq_f32(vaddq_f32(vaddq_f32(
+			vmulq_f32(c0, vdupq_n_f32(p.x)), vmulq_f32(c1, vdupq_n_f32(p.y))),
+			vmulq_f32(c2, vdupq_n_f32(p.z))), c3);
+		float w = vgetq_lane_f32(r, 3);
+		if (w != 0 && w != 1)
+			r = vdivq_f32(r, vdupq_n_f32(w));
+		
+		vst1_f32(&results[i].x, vget_low_f32(r));
+		results[i].z = vgetq_lane_f32(r, 2);
+	}
+#endif
+	
+	for(; i < count; i++)
+		results[i] = m4_mul_pos(matrix, positions[i]);
+}
+
+/**
+ * a * b[i] for count matrices, e.g. one view projection times many model
+ * matrices. results may be b.
+ *
+ * Every column of a result is the columns of a weighted by that column of
+ * b[i], the same sums m4_mul() does one member at a time.
+ */
+void m4_mul_n(mat4_t a, const mat4_t* b, mat4_t* results, int count) {
+	int i = 0;
+	
+#if defined(MATH_3D_USE_SSE)
+	__m128 a0 = _mm_loadu_ps(a.m[0]), a1 = _mm_loadu_ps(a.m[1]);
+	__m128 a2 = _mm_loadu_ps(a.m[2]), a3 = _mm_loadu_ps(a.m[3]);
+	
+	for(; i < count; i++) {
+		mat4_t m = b[i];
+		for(int c = 0; c < 4; c++) {
+			__m128 column = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(a0, _mm_set1_ps(m.m[c][0])), _mm_mul_ps(a1, _mm_set1_ps(m.m[c][1]))),
+				_mm_mul_ps(a2, _mm_set1_ps(m.m[c][2]))), _mm_mul_ps(a3, _mm_set1_ps(m.m[c][3])));
+			_mm_storeu_ps(results[i].m[c], column);
+		}
+	}
+#elif defined(MATH_3D_USE_NEON)
+	float32x4_t a0 = vld1q_f32(a.m[0]), a1 = vld1q_f32(a.m[1]);
+	float32x4_t a2 = vld1q_f32(a.m[2]), a3 = vld1q_f32(a.m[3]);
+	
+	for(; i < count; i++) {
+		mat4_t m = b[i];
+		for(int c = 0; c < 4; c++) {
+			float32x4_t column = vaddq_f32(vaddq_f32(vaddq_f32(
+				vmulq_f32(a0, vdupq_n_f32(m.m[c][0])), vmulq_f32(a1, vdupq_n_f32(m.m[c][1]))),
+				vmulq_f32(a2, vdupq_n_f32(m.m[c][2]))), vmulq_f32(a3, vdupq_n_f32(m.m[c][3])));
+			vst1q_f32(results[i].m[c], column);
+		}
+	}
+#endif
+	
+	for(; i < count; i++)
+		results[i] = m4_mul(a, b[i]);
+}
+
+/**
+ * 0 when the box lies completely on the outside of one of the planes.
+ *
+ * Only the corner furthest along the normal of a plane needs to be checked
+ * against it, if that one is outside all of them are.
+ */
+int aabb_in_planes(const float* planes, int plane_count, vec3_t min, vec3_t max) {
+	for(int i = 0; i < plane_count; i++) {
+		const float* p = planes + i * 4;
+		if (p[0] * (p[0] >= 0 ? max.x : min.x) + p[1] * (p[1] >= 0 ? max.y : min.y) + p[2] * (p[2] >= 0 ? max.z : min.z) + p[3] < 0)
+			return 0;
+	}
+	
+	return 1;
+}
+
+/**
+ * aabb_in_planes() for boxes first to first + count - 1, inside[i] gets the
+ * result for box first + i. Returns how many are inside.
+ *
+ * The furthest corner only depends on the signs of the plane, so for a plane
+ * it comes from the same arrays for all boxes and vectors of boxes load
+ * straight from them.
+ */
+int aabbs_in_planes(const float* planes, int plane_count, aabbs_t boxes, int first, int count, unsigned char* inside) {
+	int i = 0, visible = 0;
+	
+#if defined(MATH_3D_USE_SSE) || defined(MATH_3D_USE_NEON)
+	// The bytes of inside for four boxes, one bit of mask each.
+	static const unsigned char bytes[16][4] = {
+		{0,0,0,0}, {1,0,0,0}, {0,1,0,0}, {1,1,0,0}, {0,0,1,0}, {1,0,1,0}, {0,1,1,0}, {1,1,1,0},
+		{0,0,0,1}, {1,0,0,1}, {0,1,0,1}, {1,1,0,1}, {0,0,1,1}, {1,0,1,1}, {0,1,1,1}, {1,1,1,1}
+	};
+	static const unsigned char bits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+#endif
+	
+#if defined(MATH_3D_USE_AVX)
+	for(; i + 8 <= count; i += 8) {
+		int b = first + i;
+		__m256 outside = _mm256_setzero_ps();
+		for(int j = 0; j < plane_count; j++) {
+			const float* p = planes + j * 4;
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_set1_ps(p[0]), _mm256_loadu_ps((p[0] >= 0 ? boxes.max_x : boxes.min_x) + b)),
+				_mm256_mul_ps(_mm256_set1_ps(p[1]), _mm256_loadu_ps((p[1] >= 0 ? boxes.max_y : boxes.min_y) + b))),
+				_mm256_mul_ps(_mm256_set1_ps(p[2]), _mm256_loadu_ps((p[2] >= 0 ? boxes.max_z : boxes.min_z) + b))),
+				_mm256_set1_ps(p[3]));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+		
+		int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+		memcpy(inside + i, bytes[mask & 15], 4);
+		memcpy(inside + i + 4, bytes[mask >> 4], 4);
+		visible += bits[mask & 15] + bits[mask >> 4];
+	}
+#endif
+#if defined(MATH_3D_USE_SSE)
+	for(; i + 4 <= count; i += 4) {
+		int b = first + i;
+		__m128 outside = _mm_setzero_ps();
+		for(int j = 0; j < plane_count; j++) {
+			const float* p = planes + j * 4;
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(p[0]), _mm_loadu_ps((p[0] >= 0 ? boxes.max_x : boxes.min_x) + b)),
+				_mm_mul_ps(_mm_set1_ps(p[1]), _mm_loadu_ps((p[1] >= 0 ? boxes.max_y : boxes.min_y) + b))),
+				_mm_mul_ps(_mm_set1_ps(p[2]), _mm_loadu_ps((p[2] >= 0 ? boxes.max_z : boxes.min_z) + b))),
+				_mm_set1_ps(p[3]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+		}
+		
+		int mask = ~_mm_movemask_ps(outside) & 15;
+		memcpy(inside + i, bytes[mask], 4);
+		visible += bits[mask];
+	}
+#elif defined(MATH_3D_USE_NEON)
+	for(; i + 4 <= count; i += 4) {
+		int b = first + i;
+		uint32x4_t outside = vdupq_n_u32(0);
+		for(int j = 0; j < plane_count; j++) {
+			const float* p = planes + j * 4;
+			float32x4_t d = vaddq_f32(vaddq_f32(vaddq_f32(
+				vmulq_f32(vdupq_n_f32(p[0]), vld1q_f32((p[0] >= 0 ? boxes.max_x : boxes.min_x) + b)),
+				vmulq_f32(vdupq_n_f32(p[1]), vld1q_f32((p[1] >= 0 ? boxes.max_y : boxes.min_y) + b))),
+				vmulq_f32(vdupq_n_f32(p[2]), vld1q_f32((p[2] >= 0 ? boxes.max_z : boxes.min_z) + b))),
+				vdupq_n_f32(p[3]));
+			outside = vorrq_u32(outside, vcltq_f32(d, vdupq_n_f32(0)));
+		}
+		
+		uint32_t lanes[4];
+		vst1q_u32(lanes, outside);
+		int mask = !lanes[0] | !lanes[1] << 1 | !lanes[2] << 2 | !lanes[3] << 3;
+		memcpy(inside + i, bytes[mask], 4);
+		visible += bits[mask];
+	}
+#endif
+	
+	for(; i < count; i++) {
+		int b = first + i;
+		inside[i] = aabb_in_planes(planes, plane_count,
+			vec3(boxes.min_x[b], boxes.min_y[b], boxes.min_z[b]),
+			vec3(boxes.max_x[b], boxes.max_y[b], boxes.max_z[b]));
+		visible += inside[i];
+	}
+	
+	return visible;
+}
+
 #endif // MATH_3D_IMPLEMENTATION
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef OCEAN_H
+#define OCEAN_H
+
+#include <rafgl.h>
+
+/* height + choppy x, choppy z + slope x, slope z: three complex grids carry five real fields */
+#define OCEAN_GRIDS 3
+/* columns each FFT job transforms side by side, a multiple of the SSE width */
+#define OCEAN_STRIP 16
+
+typedef struct _ocean_t
+{
+    /* grid is size x size samples over a length x length world patch that tiles */
+    int size;
+    float length;
+    /* floats between rows of the FFT grids, padded off a power of two so the rows of a strip do not all land in the same cache sets */
+    int pitch;
+    /* horizontal displacement scale, 0 gives plain rolling waves */
+    float choppiness;
+
+    /* Phillips spectrum at t = 0 for k and its mirrored conjugate for -k, angular frequency per k, row major in [kx][kz] */
+    float *h0_re, *h0_im;
+    float *h0_mirror_re, *h0_mirror_im;
+    float *omega;
+    /* exp(2 pi i t / size) for t < size / 2 */
+    float *twiddle_re, *twiddle_im;
+
+    /* per grid the working spectrum and a transpose target */
+    float *re[OCEAN_GRIDS], *im[OCEAN_GRIDS];
+    float *scratch_re[OCEAN_GRIDS], *scratch_im[OCEAN_GRIDS];
+
+    /* RGBA32F (x, y, z displacement) and RGBA8 normals, filled through a ring of two pixel unpack buffers */
+    GLuint displacement_texture, normal_texture;
+    GLuint pbos[2];
+    int pbo_index;
+
+    int steps;
+    double total_ms;
+} ocean_t;
+
+/* a fixed number of vertices spread evenly over the screen, the vertex shader casts each one onto the water plane
+   so the density follows the camera whatever the resolution */
+typedef struct _ocean_grid_t
+{
+    GLuint vao, vbo, ebo;
+    int columns, rows;
+    int index_count;
+} ocean_grid_t;
+
+/* spectrum from a wind over the patch (metres per second, only x and z count), amplitude scales the Phillips spectrum */
+void ocean_init(ocean_t *ocean, int size, float length, vec3_t wind, float amplitude, float choppiness);
+/* the textures at time seconds: evolves the spectrum, runs the inverse FFTs and uploads both textures from a PBO */
+void ocean_step(ocean_t *ocean, float time);
+/* CPU side of ocean_step, displacement is size * size float4 and normals size * size RGBA8 */
+void ocean_simulate(ocean_t *ocean, float time, float *displacement, unsigned char *normals);
+/* sets ocean_displacement, ocean_normal (units first and first + 1) and ocean_length of program */
+void ocean_bind_uniforms(ocean_t *ocean, GLuint program, int texture_unit);
+void ocean_cleanup(ocean_t *ocean);
+
+/* columns x rows vertices over [0, 1] x [0, 1] in attribute 0, built in the frame arena. Without room there the grid is left empty */
+void ocean_grid_init(ocean_grid_t *grid, int columns, int rows);
+void ocean_grid_draw(ocean_grid_t *grid);
+void ocean_grid_cleanup(ocean_grid_t *grid);
+
+/* ms per ocean_simulate at size for 1, 2, 4 ... threads up to all of them */
+void ocean_benchmark(int size, int steps);
+
+#endif //OCEAN_H
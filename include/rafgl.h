@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -25,6 +26,23 @@
 #define RAFGL_FONT_LARGE 2
 #define RAFGL_FONT_COUNT 3
 
+#define RAFGL_CAPTURE_PNG   0
+#define RAFGL_CAPTURE_Y4M   1
+/* readbacks in flight and frames waiting for the encoder */
+#define RAFGL_CAPTURE_PBOS  2
+#define RAFGL_CAPTURE_QUEUE 8
+
+/* fixed timestep updates allowed to catch up in one frame, time past that is dropped rather than run ever more updates per frame */
+#define RAFGL_MAX_FIXED_UPDATES 5
+
+/* timer scopes per frame and frames of timer queries in flight */
+#define RAFGL_PROFILER_SCOPES   64
+#define RAFGL_PROFILER_LATENCY  4
+
+/* render targets in the pool, and the frames a free one is kept before it is deleted (a resize or a pass that stopped running left it behind) */
+#define RAFGL_RENDER_TARGETS_MAX        32
+#define RAFGL_RENDER_TARGET_IDLE_FRAMES 3
+
 #define RAFGL_ERROR         0
 #define RAFGL_WARNING       1
 #define RAFGL_INFO          2
@@ -119,10 +137,35 @@ typedef struct _rafgl_list_t
     int count;
 } rafgl_list_t;
 
+typedef struct _rafgl_vector_t
+{
+    void *data;
+    int element_size;
+    int count, capacity;
+    /* NULL for malloc, or what grows a block of old_size bytes to new_size (an arena), a new_size of 0 frees it */
+    void* (*reallocate)(void *allocator, void *block, size_t old_size, size_t new_size);
+    void *allocator;
+} rafgl_vector_t;
+
+#define RAFGL_ARENA_ALIGNMENT 64
+/* the reservation of the frame arena, address space only until it is committed. The terrain init peaks below 100 MB */
+#define RAFGL_FRAME_ARENA_SIZE ((size_t)1 << 30)
+/* without mmap there is nothing to reserve, the arena is a heap block of this size at most */
+#define RAFGL_ARENA_HEAP_SIZE ((size_t)128 << 20)
+/* the arena is made accessible in steps of this, one transparent huge page */
+#define RAFGL_ARENA_COMMIT_SIZE ((size_t)2 << 20)
+
+typedef struct _rafgl_arena_t
+{
+    char *base;
+    /* reserved, accessible, handed out, and the most ever handed out since the last trim */
+    size_t size, committed, used, peak;
+} rafgl_arena_t;
+
 
 typedef struct _rafgl_game_t
 {
-    rafgl_list_t game_states;
+    rafgl_vector_t game_states;
     int current_game_state;
     int next_game_state;
 
@@ -169,6 +212,8 @@ typedef struct _rafgl_meshPUN_t
     unsigned int triangle_count;
     int loaded;
     char name[64];
+    /* model space bounding box */
+    vec3_t bounds_min, bounds_max;
 } rafgl_meshPUN_t;
 
 typedef struct _rafgl_framebuffer_simple_t
@@ -184,10 +229,105 @@ typedef struct  _rafgl_framebuffer_multitarget_t
     int width, height;
 } rafgl_framebuffer_multitarget_t;
 
+typedef struct _rafgl_render_target_t
+{
+    /* colour and depth are textures so later passes can sample them, 0 when the target was made without one */
+    GLuint fbo_id, colour_id, depth_id;
+    /* the key of the pool: internal formats, size and samples (0 for plain 2D textures) */
+    GLenum colour_format, depth_format;
+    int width, height, samples;
+
+    int in_use, last_frame;
+    size_t bytes;
+} rafgl_render_target_t;
+
+typedef struct _rafgl_raster_primitive_t
+{
+    int type;
+    int x0, y0, x1, y1;
+    uint32_t colour;
+    /* line walk state, only used by the per tile pieces of diagonal lines */
+    int err, dx, dy;
+} rafgl_raster_primitive_t;
+
+typedef struct _rafgl_raster_batch_t
+{
+    rafgl_raster_primitive_t *primitives;
+    int primitive_count, primitive_capacity;
+
+    /* per tile lists of primitive indices, in submission order */
+    int **bins;
+    int *bin_counts, *bin_capacities;
+    int tiles_x, tiles_y;
+} rafgl_raster_batch_t;
+
+typedef struct _rafgl_capture_t
+{
+    int format;
+    int width, height, fps;
+    char path[256];
+    FILE *stream;
+    int stream_is_pipe;
+
+    /* frame n is read into pbos[n % RAFGL_CAPTURE_PBOS] and mapped once its fence has passed */
+    GLuint pbos[RAFGL_CAPTURE_PBOS];
+    GLsync fences[RAFGL_CAPTURE_PBOS];
+    int frames_read, frames_collected;
+
+    /* top-down RGBA frames handed from the GL thread to the encoder thread */
+    unsigned char *slots[RAFGL_CAPTURE_QUEUE];
+    int slot_frames[RAFGL_CAPTURE_QUEUE];
+    int queue_head, queue_count;
+    int running;
+    pthread_t worker;
+    pthread_mutex_t mutex;
+    pthread_cond_t filled, drained;
+
+    /* times the GL thread had to wait on the GPU or on the encoder */
+    int readback_waits, queue_waits;
+} rafgl_capture_t;
+
+typedef struct _rafgl_program_batch_entry_t
+{
+    GLuint program, vert, frag;
+    GLuint *target;
+    /* where the binary is saved once it has linked, NULL when the cache is off or it came from there */
+    char *cache_path;
+} rafgl_program_batch_entry_t;
+
+typedef struct _rafgl_program_batch_t
+{
+    rafgl_program_batch_entry_t *entries;
+    int count, capacity;
+    double submit_ms;
+} rafgl_program_batch_t;
+
+#define RAFGL_PROGRAM_VARIANTS_MAX 32
+
+typedef struct _rafgl_program_variants_t
+{
+    char name[64];
+    /* bit i of a mask defines features[i] in both stages */
+    const char **features;
+    int feature_count;
+    char *vertex_source, *fragment_source;
+
+    /* the combinations asked for so far, each compiled once */
+    unsigned int masks[RAFGL_PROGRAM_VARIANTS_MAX];
+    GLuint programs[RAFGL_PROGRAM_VARIANTS_MAX];
+    int count;
+} rafgl_program_variants_t;
+
 
 
 /* initializes the GLFW library, GLEW and the window. If full-screen mode is selected, width and hight are unused and the monitor resolution is used instead */
 int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int window_height, int fullscreen);
+/* same as rafgl_game_init, but the window stays hidden and every frame is rendered into an offscreen framebuffer of the given size */
+int rafgl_game_init_headless(rafgl_game_t *game, const char *title, int width, int height);
+/* the framebuffer a frame ends up in, 0 normally and the offscreen one in headless mode. Bind this instead of 0 when done with a render target */
+GLuint rafgl_framebuffer_default(void);
+/* the size of that framebuffer this frame, the same one the update got as raster_width and raster_height */
+void rafgl_framebuffer_size(int *width, int *height);
 /* creates a new game state based on the appropriate function pointers */
 void rafgl_game_add_game_state(rafgl_game_t *game, void (*init)(GLFWwindow *window, void *args), void (*update)(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args), void (*render)(GLFWwindow *window, void *args), void (*cleanup)(GLFWwindow *window, void *args));
 
@@ -207,7 +347,11 @@ int rafgl_raster_cleanup(rafgl_raster_t *raster);
 void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height);
 void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y);
 
+/* formats into a slot of a lock-free ring on the calling thread and leaves the writing to a flusher thread, which batches it
+   and puts the monotonic time since init in front of every file line. Before the game starts and after it ends it writes right away */
 void rafgl_log(int level, const char *format, ...);
+/* lets about per_second messages of level through a second, the rest are counted and the count is logged instead. 0 (the default) is no limit */
+void rafgl_log_set_rate_limit(int level, int per_second);
 
 
 /* helpers function declarations start */
@@ -226,17 +370,53 @@ void rafgl_texture_cleanup(rafgl_texture_t *texture);
 void rafgl_texture_load_cubemap_named(rafgl_texture_t *tex, const char *cubemap_name, const char *file_ext);
 void rafgl_texture_load_cubemap(rafgl_texture_t *tex, const char *cubemap_paths[]);
 
-/* allocates memory and reads the file content into it (requires free on the returned pointer later) */
+/* allocates memory and reads the file content into it (requires free on the returned pointer later), NULL when it can not be opened */
 char* rafgl_file_read_content(const char *filepath);
-/* checks the file size */
+/* checks the file size, -1 when it can not be opened */
 int rafgl_file_size(const char *filepath);
 
-/* creates a shader program from vertex and fragment files on the disk */
+/* creates a shader program from vertex and fragment files on the disk. A line '#include "name"' in one of them is replaced by
+   res/shaders/include/name (one level deep, an include can not include), the line numbers of errors stay those of the file */
 GLuint rafgl_program_create(const char *vertex_source_filepath, const char *fragment_source_filepath);
 /* creates a shader program from vertex and fragment source in memory */
 GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source);
 /* creates a shader program from vertex and fragment files with standardized names and locations */
 GLuint rafgl_program_create_from_name(const char *program_name);
+/* keeps the binary of every linked program in directory (created if missing) and links from it on the next start,
+   the key covers both sources and the driver so edits and driver updates compile again. NULL (the default) turns it off */
+void rafgl_program_cache_set_directory(const char *directory);
+
+/* programs compiled side by side: everything is submitted first and nothing asks the driver for a status until the finish,
+   so with KHR_parallel_shader_compile its compiler threads work while the caller goes on loading */
+void rafgl_program_batch_init(rafgl_program_batch_t *batch);
+/* *program is set by rafgl_program_batch_finish, the sources can be freed right away */
+void rafgl_program_batch_add(rafgl_program_batch_t *batch, const char *vertex_source, const char *fragment_source, GLuint *program);
+void rafgl_program_batch_add_from_name(rafgl_program_batch_t *batch, const char *program_name, GLuint *program);
+/* 1 once every program is done, without the extension it is 1 right away and the finish does the waiting */
+int rafgl_program_batch_ready(rafgl_program_batch_t *batch);
+/* waits for the rest, logs compile and link errors and fills in every program */
+void rafgl_program_batch_finish(rafgl_program_batch_t *batch);
+
+/* shader hot reload: an inotify thread watches the directories of the watched programs, a changed one is compiled again in a batch
+   and swapped in between two frames once it links (a program that does not keep the old one). Costs one atomic load per frame
+   while nothing changes. Off by default, Linux only */
+void rafgl_program_watch_enable(int b);
+/* watches res/shaders/<program_name>, *program is replaced (and the old one deleted) on reload */
+void rafgl_program_watch(const char *program_name, GLuint *program);
+/* called after the programs of a reload are swapped in, to look up uniform locations again */
+void rafgl_program_watch_callback(void (*reloaded)(void *data), void *data);
+
+/* shader permutations: one source per effect with #ifdef blocks for its optional features, a feature that is off is
+   not compiled in rather than skipped by a uniform branch. The defines go right after the #version line (followed by
+   a #line so the errors keep their line numbers), every variant goes through the program cache like any other program */
+void rafgl_program_variants_init(rafgl_program_variants_t *variants, const char *program_name, const char **features, int feature_count);
+/* the program with the features of mask, compiled the first time that mask is asked for */
+GLuint rafgl_program_variant(rafgl_program_variants_t *variants, unsigned int mask);
+/* compiles the variant of mask in batch, for the ones known to be needed at startup. rafgl_program_variant gives 0 for it until the finish */
+void rafgl_program_variants_add(rafgl_program_batch_t *batch, rafgl_program_variants_t *variants, unsigned int mask);
+/* watches res/shaders/<program_name> of the variants, a reload builds every variant compiled so far again and swaps them all or none */
+void rafgl_program_watch_variants(rafgl_program_variants_t *variants);
+void rafgl_program_variants_cleanup(rafgl_program_variants_t *variants);
 
 /* generic linked list */
 int rafgl_list_init(rafgl_list_t *list, int element_size);
@@ -246,7 +426,55 @@ int rafgl_list_remove(rafgl_list_t *list, int index);
 void* rafgl_list_get(rafgl_list_t *list, int index);
 int rafgl_list_free(rafgl_list_t *list);
 int rafgl_list_show(rafgl_list_t *list, void (*fun)(void *data, int last));
-int rafgl_list_test(void);
+/* times count appends and a full scan of a list against a vector and logs both */
+void rafgl_list_test(int count);
+/* times the math_3d batch functions against loops over the scalar ones on count random inputs, logs both and
+   how far apart their results are */
+void rafgl_math_test(int count);
+
+/* contiguous growable array, it grows by half again when full so appends are amortised O(1) and indexing is O(1) */
+void rafgl_vector_init(rafgl_vector_t *vector, int element_size);
+/* same, with the storage from reallocate(allocator, block, old_size, new_size) */
+void rafgl_vector_init_allocator(rafgl_vector_t *vector, int element_size, void* (*reallocate)(void *allocator, void *block, size_t old_size, size_t new_size), void *allocator);
+/* room for capacity elements without growing again */
+void rafgl_vector_reserve(rafgl_vector_t *vector, int capacity);
+/* copies element in at the end and returns its index */
+int rafgl_vector_append(rafgl_vector_t *vector, const void *element);
+/* copies count elements in at the end, or leaves them uninitialised when elements is NULL, and returns the first */
+void* rafgl_vector_append_many(rafgl_vector_t *vector, const void *elements, int count);
+/* negative indices count from the end, NULL outside the vector */
+void* rafgl_vector_get(rafgl_vector_t *vector, int index);
+/* moves the elements after index down by one, -1 outside the vector */
+int rafgl_vector_remove(rafgl_vector_t *vector, int index);
+void rafgl_vector_clear(rafgl_vector_t *vector);
+void rafgl_vector_free(rafgl_vector_t *vector);
+/* element index as a type, without the checks of rafgl_vector_get */
+#define rafgl_vector_at(vector, type, index) (((type*)(vector)->data)[index])
+
+/* bump pointer allocator over one reservation of address space (PROT_NONE, MAP_NORESERVE). It is committed RAFGL_ARENA_COMMIT_SIZE
+   at a time as allocations reach it, with transparent huge pages asked for, and pages are only backed once they are written */
+int rafgl_arena_init(rafgl_arena_t *arena, size_t size);
+/* size bytes aligned to RAFGL_ARENA_ALIGNMENT, NULL (and an error) once the reservation is used up */
+void* rafgl_arena_alloc(rafgl_arena_t *arena, size_t size);
+/* a scope: everything allocated after the mark is gone once the arena is reset to it, 0 empties it */
+size_t rafgl_arena_mark(rafgl_arena_t *arena);
+void rafgl_arena_reset(rafgl_arena_t *arena, size_t mark);
+/* hands the pages past what is in use back to the system and decommits them */
+void rafgl_arena_trim(rafgl_arena_t *arena);
+void rafgl_arena_cleanup(rafgl_arena_t *arena);
+/* rafgl_vector_init_allocator callback, the last block grows in place and anything else is copied to the top */
+void* rafgl_arena_reallocate(void *arena, void *block, size_t old_size, size_t new_size);
+/* scratch memory of the main thread: emptied and trimmed once the state init is done, and emptied before every frame.
+   With pipelined updates only render may use it */
+rafgl_arena_t* rafgl_frame_arena(void);
+
+/* worker pool, calls fn(ctx, i) for every i in [0, count) spread over all cores and returns once all calls finished.
+   Calls made from inside a job run serially on the calling thread */
+void rafgl_parallel_for(int count, void (*fn)(void *ctx, int index), void *ctx);
+/* number of threads rafgl_parallel_for spreads work over (including the calling thread) */
+int rafgl_parallel_thread_count(void);
+/* caps the threads later rafgl_parallel_for calls use, 0 lifts the cap, for measuring how work scales with cores */
+void rafgl_parallel_set_thread_limit(int threads);
 
 /* random float in the range of [0, 1) */
 float randf(void);
@@ -288,18 +516,94 @@ int rafgl_button_check(rafgl_button_t *btn, rafgl_game_data_t *game_data);
 
 void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius);
 
+/* copies the raster onto the target at (x, y), pixels equal to RAFGL_COLOUR_KEY are skipped */
 int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y);
+/* copies the raster onto the target at (x, y) row by row, for sources that contain no colour key pixels */
+int rafgl_raster_draw_raster_opaque(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y);
+/* composites a raster with premultiplied alpha onto the target at (x, y): dst = src + dst * (1 - src.a) */
+int rafgl_raster_draw_raster_blend(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y);
+/* times the blit paths on one thread and on every thread against the plain per pixel loop on a width x height raster,
+   checks the keyed one agrees with it and logs the results. RAFGL_COLOUR_KEY is left as it was */
+void rafgl_raster_blit_benchmark(int width, int height, int iterations);
 
 void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour);
 void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour);
 void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour);
 
+/* batched 2D drawing: primitives are queued, binned into screen tiles on flush and the tiles are rasterised in parallel.
+   Results are identical to calling the immediate functions in the same order (circles are clipped instead of unchecked) */
+void rafgl_raster_batch_init(rafgl_raster_batch_t *batch);
+void rafgl_raster_batch_line(rafgl_raster_batch_t *batch, int x0, int y0, int x1, int y1, uint32_t colour);
+/* outline, same pixels as rafgl_raster_draw_rectangle */
+void rafgl_raster_batch_rectangle(rafgl_raster_batch_t *batch, int x0, int y0, int w, int h, uint32_t colour);
+/* fills w x h pixels starting at (x0, y0) */
+void rafgl_raster_batch_fill_rectangle(rafgl_raster_batch_t *batch, int x0, int y0, int w, int h, uint32_t colour);
+/* outline, same pixels as rafgl_raster_draw_circle */
+void rafgl_raster_batch_circle(rafgl_raster_batch_t *batch, int cx, int cy, int r, uint32_t colour);
+void rafgl_raster_batch_fill_circle(rafgl_raster_batch_t *batch, int cx, int cy, int r, uint32_t colour);
+/* horizontal run of length pixels starting at (x, y) */
+void rafgl_raster_batch_span(rafgl_raster_batch_t *batch, int x, int y, int length, uint32_t colour);
+/* draws everything queued so far into the raster and empties the queue */
+void rafgl_raster_batch_flush(rafgl_raster_batch_t *batch, rafgl_raster_t *raster);
+/* free */
+void rafgl_raster_batch_cleanup(rafgl_raster_batch_t *batch);
+
 void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from);
 
 int rafgl_raster_draw_string(rafgl_raster_t *raster, const char *s, int x, int y, uint32_t colour, int font_size);
 
+/* queues a string for the GPU text pass, coordinates are in pixels of the target (origin in the upper left corner) */
+void rafgl_text_draw_string(const char *s, int x, int y, uint32_t colour, int font_size);
+/* draws every queued glyph as one instanced quad per glyph over the currently bound framebuffer and empties the queue */
+void rafgl_text_flush(int target_width, int target_height);
+
+/* starts recording the default framebuffer. RAFGL_CAPTURE_PNG writes one file per frame (path is a printf pattern such as "frame_%05d.png"),
+   RAFGL_CAPTURE_Y4M writes a YUV4MPEG2 stream to path, or to the standard input of a command when path starts with '|'. The size is fixed for the whole capture */
+int rafgl_capture_start(rafgl_capture_t *capture, const char *path, int format, int width, int height, int fps);
+/* queues a readback of the back buffer (of the offscreen framebuffer when headless), call it after rendering and before the buffer swap. Only waits when the GPU or the encoder are a whole queue behind */
+void rafgl_capture_frame(rafgl_capture_t *capture);
+/* waits for every queued frame to be written, closes the output and frees the buffers */
+void rafgl_capture_stop(rafgl_capture_t *capture);
+
 void rafgl_log_fps(int b);
 
+/* update gets step seconds at a time, as many times per frame as real time has moved on by, and render draws in between the last two.
+   0 (the default) calls update once per frame with the time the frame took */
+void rafgl_game_set_fixed_timestep(float step);
+/* how far real time is from the last update towards the next one, in [0, 1], for render to blend the last two update states.
+   Always 1 without a fixed timestep */
+float rafgl_game_interpolation(void);
+/* sleeps away what is left of 1 / fps after every frame, 0 (the default) does not wait */
+void rafgl_game_set_frame_limit(float fps);
+/* no vsync and no frame limit, every frame time is recorded and their percentiles are logged when the game ends.
+   The window closes after frames frames, 0 runs until it is closed */
+void rafgl_game_set_benchmark(int frames);
+
+/* runs the updates of the next frame on their own thread while render submits the one before, a frame more latency for up to twice the frames when both sides are CPU bound.
+   Update must not touch GL or the window then, everything render needs goes through the packets */
+void rafgl_game_set_pipelined(int b);
+/* two zeroed packets of size bytes for update to fill and render to draw from, call it from init */
+void rafgl_game_set_packet_size(int size);
+/* the packet the running update fills and the one render draws from, they are the same one when not pipelined.
+   Update fills the whole packet every time, the two swap after a frame that ran at least one update. A frame without one
+   (a fixed timestep slower than the frame rate) draws the same packet again */
+void* rafgl_game_update_packet(void);
+void* rafgl_game_render_packet(void);
+
+/* GPU and CPU time of named scopes, read back RAFGL_PROFILER_LATENCY frames later so nothing waits on the GPU.
+   Scopes nest, name must outlive the frame (string literals). Disabled scopes cost nothing */
+void rafgl_profiler_enable(int b);
+void rafgl_profiler_begin(const char *name);
+void rafgl_profiler_end(void);
+/* collects finished queries, rafgl_game_start calls this after every swap */
+void rafgl_profiler_frame(void);
+/* adds value to a named per frame counter (draws, state changes, ...), reported as an average per frame next to the scopes. Same naming rules as scopes */
+void rafgl_profiler_count(const char *name, int value);
+/* average GPU milliseconds per frame of the scope over the current reporting period, -1 if it has not been measured */
+float rafgl_profiler_get_ms(const char *name);
+/* logs the per frame averages of every scope and starts a new period, rafgl_game_start calls this every 2 seconds */
+void rafgl_profiler_report(void);
+
 void rafgl_meshPUN_init(rafgl_meshPUN_t *m);
 void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path);
 void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset);
@@ -309,6 +613,16 @@ void rafgl_meshPUN_load_terrain_from_heightmap(rafgl_meshPUN_t *m, float w, floa
 rafgl_framebuffer_simple_t rafgl_framebuffer_simple_create(int w, int h);
 rafgl_framebuffer_multitarget_t rafgl_framebuffer_multitarget_create(int w, int h, int num_attachments);
 
+/* a framebuffer with colour and depth textures of these internal formats (0 leaves one out). One with the same formats, size and samples
+   released earlier, even in the same frame, is handed out again, otherwise a new one is made. Samples above 1 make multisample textures */
+rafgl_render_target_t* rafgl_render_target_acquire(GLenum colour_format, GLenum depth_format, int width, int height, int samples);
+/* the same at scale times the framebuffer size of the frame, a resize is picked up by the next acquire */
+rafgl_render_target_t* rafgl_render_target_acquire_scaled(GLenum colour_format, GLenum depth_format, float scale, int samples);
+/* back to the pool, the contents are undefined once somebody else acquires it */
+void rafgl_render_target_release(rafgl_render_target_t *target);
+/* video memory the pooled textures take up, in use or not */
+size_t rafgl_render_target_pool_bytes(void);
+
 void rafgl_meshPUN_load_plane(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles);
 
 void rafgl_meshPUN_load_plane_offset(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles, vec3_t offset);
@@ -327,6 +641,26 @@ extern rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#if defined(__unix__)
+#include <sys/mman.h>
+#endif // __unix__
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <errno.h>
+#endif // __linux__
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif // __SSE2__
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif // __AVX2__
+
 /* rafgl core implementation */
 
 rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
@@ -334,6 +668,11 @@ rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
 static GLFWwindow *__window;
 static int __done = 0;
 static int __window_width = 0, __window_height = 0;
+/* what the frame renders into, the window in pixels or the offscreen target */
+static int __framebuffer_width = 0, __framebuffer_height = 0;
+
+/* headless mode renders here instead of into the (hidden) window */
+static GLuint __headless_fbo = 0, __headless_colour, __headless_depth;
 
 static uint8_t __keys_down[400];
 static uint8_t __keys_pressed[400];
@@ -341,6 +680,9 @@ static uint8_t __keys_pressed[400];
 static rafgl_spritesheet_t __mono_char_sheet[RAFGL_FONT_COUNT];
 static int __countx = 16, __county = 8;
 
+/* one 32 bit row mask per glyph row, bit i set when column i of the glyph is lit */
+static uint32_t *__mono_char_masks[RAFGL_FONT_COUNT];
+
 GLuint __flip;
 
 
@@ -388,6 +730,48 @@ static float __raster_corners[] = {
      1.0f, -1.0f
 };
 
+/* packs every glyph of the font sheet into row bitmasks so text drawing never has to look at the sheet pixels again */
+static void __rafgl_bake_glyph_masks(int font)
+{
+    rafgl_spritesheet_t *sheet = &__mono_char_sheet[font];
+    int glyph, row, col, sheet_x, sheet_y;
+    int glyph_count = sheet->sheet_width * sheet->sheet_height;
+    uint32_t bits;
+    rafgl_pixel_rgb_t sampled;
+
+    __mono_char_masks[font] = NULL;
+
+    if(sheet->sheet.data == NULL || sheet->frame_width <= 0 || sheet->frame_height <= 0)
+        return;
+
+    if(sheet->frame_width > 32)
+    {
+        rafgl_log(RAFGL_WARNING, "Font %d glyphs are %d pixels wide, glyph masks support up to 32, using the per pixel path!\n", font, sheet->frame_width);
+        return;
+    }
+
+    __mono_char_masks[font] = malloc(glyph_count * sheet->frame_height * sizeof(uint32_t));
+
+    for(glyph = 0; glyph < glyph_count; glyph++)
+    {
+        sheet_x = glyph % sheet->sheet_width;
+        sheet_y = glyph / sheet->sheet_width;
+        for(row = 0; row < sheet->frame_height; row++)
+        {
+            bits = 0;
+            for(col = 0; col < sheet->frame_width; col++)
+            {
+                sampled = pixel_at_m(sheet->sheet, sheet_x * sheet->frame_width + col, sheet_y * sheet->frame_height + row);
+                if(sampled.r || sampled.g || sampled.b)
+                {
+                    bits |= 1u << col;
+                }
+            }
+            __mono_char_masks[font][glyph * sheet->frame_height + row] = bits;
+        }
+    }
+}
+
 
 void __key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
@@ -407,29 +791,293 @@ char *__log_level_names[RAFGL_LOG_LEVELS] = {"error", "warning", "info"};
 FILE *__log_files[RAFGL_LOG_LEVELS];
 
 static float __rafgl_time_from_init = 0;
-void rafgl_log(int level, const char *format, ...)
+
+/* log ring: producers claim a slot with a CAS on the head and publish it through its sequence, the flusher is the only reader.
+   A slot holds sequence == position while free and position + 1 once written (Vyukov's bounded queue) */
+#define RAFGL_LOG_SLOTS 1024
+#define RAFGL_LOG_SLOT_TEXT 232
+#define RAFGL_LOG_FLUSH_MS 10
+
+typedef struct
+{
+    unsigned int sequence;
+    int level;
+    double time;
+    /* a message longer than text is formatted into its own allocation */
+    char *long_text;
+    char text[RAFGL_LOG_SLOT_TEXT];
+} __rafgl_log_slot_t;
+
+static __rafgl_log_slot_t __log_slots[RAFGL_LOG_SLOTS];
+static unsigned int __log_head = 0, __log_tail = 0;
+static int __log_running = 0, __log_dropped = 0;
+static pthread_t __log_thread;
+static pthread_mutex_t __log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __log_wake = PTHREAD_COND_INITIALIZER;
+static struct timespec __log_epoch;
+
+static int __log_rate_limits[RAFGL_LOG_LEVELS];
+static int __log_rate_windows[RAFGL_LOG_LEVELS], __log_rate_counts[RAFGL_LOG_LEVELS], __log_suppressed[RAFGL_LOG_LEVELS];
+
+void rafgl_log_set_rate_limit(int level, int per_second)
+{
+    __log_rate_limits[level] = per_second;
+}
+
+static double __rafgl_log_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - __log_epoch.tv_sec) + (now.tv_nsec - __log_epoch.tv_nsec) * 1e-9;
+}
+
+/* the windows are whole seconds of log time, two threads crossing into a new one together may let a message or two more through */
+static int __rafgl_log_allowed(int level, double time)
+{
+    int window = (int)time;
+
+    if(!__log_rate_limits[level])
+        return 1;
+
+    if(__atomic_load_n(&__log_rate_windows[level], __ATOMIC_RELAXED) != window)
+    {
+        __atomic_store_n(&__log_rate_windows[level], window, __ATOMIC_RELAXED);
+        __atomic_store_n(&__log_rate_counts[level], 0, __ATOMIC_RELAXED);
+    }
+    if(__atomic_add_fetch(&__log_rate_counts[level], 1, __ATOMIC_RELAXED) <= __log_rate_limits[level])
+        return 1;
+
+    __atomic_add_fetch(&__log_suppressed[level], 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void __rafgl_log_write(int level, double time, const char *text)
 {
-    va_list args;
-    va_start(args, format);
-    FILE* fd = __log_files[level];
     if(level == RAFGL_ERROR)
+        fprintf(stderr, "%s: %s", __log_level_names[level], text);
+    else
+        printf("%s : %s", __log_level_names[level], text);
+
+    /* the log files only open with the game, anything logged before goes to the console alone */
+    if(__log_files[level] != NULL)
+        fprintf(__log_files[level], "[%10.4f] %s", time, text);
+}
+
+/* writes out every published slot, the caller flushes */
+static int __rafgl_log_drain(void)
+{
+    __rafgl_log_slot_t *slot;
+    char text[128];
+    int written = 0, i, count;
+
+    for(;;)
     {
-        fprintf(stderr, "%s: ", __log_level_names[level]);
-        vfprintf(stderr, format, args);
+        slot = &__log_slots[__log_tail & (RAFGL_LOG_SLOTS - 1)];
+        if(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != __log_tail + 1)
+            break;
 
+        __rafgl_log_write(slot->level, slot->time, slot->long_text ? slot->long_text : slot->text);
+        free(slot->long_text);
+        slot->long_text = NULL;
+
+        __atomic_store_n(&slot->sequence, __log_tail + RAFGL_LOG_SLOTS, __ATOMIC_RELEASE);
+        __atomic_store_n(&__log_tail, __log_tail + 1, __ATOMIC_RELAXED);
+        written++;
     }
-    else
+
+    count = __atomic_exchange_n(&__log_dropped, 0, __ATOMIC_RELAXED);
+    if(count)
+    {
+        snprintf(text, sizeof(text), "The log ring was full, %d messages were dropped\n", count);
+        __rafgl_log_write(RAFGL_WARNING, __rafgl_log_time(), text);
+        written++;
+    }
+    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+    {
+        count = __atomic_exchange_n(&__log_suppressed[i], 0, __ATOMIC_RELAXED);
+        if(count)
+        {
+            snprintf(text, sizeof(text), "%d %s messages over the rate limit were not logged\n", count, __log_level_names[i]);
+            __rafgl_log_write(RAFGL_WARNING, __rafgl_log_time(), text);
+            written++;
+        }
+    }
+
+    return written;
+}
+
+static void __rafgl_log_flush(void)
+{
+    int i;
+
+    fflush(stdout);
+    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+        if(__log_files[i] != NULL)
+            fflush(__log_files[i]);
+}
+
+static void* __rafgl_log_worker(void *arg)
+{
+    struct timespec until;
+
+    while(__atomic_load_n(&__log_running, __ATOMIC_ACQUIRE))
+    {
+        if(__rafgl_log_drain())
+            __rafgl_log_flush();
+
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += RAFGL_LOG_FLUSH_MS * 1000000L;
+        if(until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&__log_mutex);
+        if(__atomic_load_n(&__log_running, __ATOMIC_ACQUIRE))
+            pthread_cond_timedwait(&__log_wake, &__log_mutex, &until);
+        pthread_mutex_unlock(&__log_mutex);
+    }
+
+    return NULL;
+}
+
+static void __rafgl_log_wake(void)
+{
+    pthread_mutex_lock(&__log_mutex);
+    pthread_cond_signal(&__log_wake);
+    pthread_mutex_unlock(&__log_mutex);
+}
+
+static void __rafgl_log_stop(void);
+
+/* from here on rafgl_log only queues */
+static void __rafgl_log_start(void)
+{
+    static int registered = 0;
+    unsigned int i;
+
+    if(__log_running)
+        return;
+
+    for(i = 0; i < RAFGL_LOG_SLOTS; i++)
+        __log_slots[i].sequence = __log_tail + i;
+    __log_head = __log_tail;
+
+    __atomic_store_n(&__log_running, 1, __ATOMIC_RELEASE);
+    if(pthread_create(&__log_thread, NULL, __rafgl_log_worker, NULL))
+    {
+        __atomic_store_n(&__log_running, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    /* whatever is queued when something calls exit still gets out */
+    if(!registered)
+        atexit(__rafgl_log_stop);
+    registered = 1;
+}
+
+/* writes out what is queued and goes back to writing on the calling thread */
+static void __rafgl_log_stop(void)
+{
+    if(!__atomic_load_n(&__log_running, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_mutex_lock(&__log_mutex);
+    __atomic_store_n(&__log_running, 0, __ATOMIC_RELEASE);
+    pthread_cond_signal(&__log_wake);
+    pthread_mutex_unlock(&__log_mutex);
+    pthread_join(__log_thread, NULL);
+
+    __rafgl_log_drain();
+    __rafgl_log_flush();
+}
+
+void rafgl_log(int level, const char *format, ...)
+{
+    __rafgl_log_slot_t *slot;
+    unsigned int position;
+    va_list args, long_args;
+    double time = __rafgl_log_time();
+    char text[RAFGL_LOG_SLOT_TEXT];
+    int length, difference;
+
+    if(!__rafgl_log_allowed(level, time))
+        return;
+
+    va_start(args, format);
+
+    /* a va_list can only be walked once, a message that does not fit is formatted again from a copy */
+    va_copy(long_args, args);
+
+    if(!__atomic_load_n(&__log_running, __ATOMIC_ACQUIRE))
+    {
+        length = vsnprintf(text, sizeof(text), format, args);
+        if(length < (int)sizeof(text))
+        {
+            __rafgl_log_write(level, time, text);
+        }
+        else
+        {
+            char *long_text = malloc(length + 1);
+            vsnprintf(long_text, length + 1, format, long_args);
+            __rafgl_log_write(level, time, long_text);
+            free(long_text);
+        }
+        va_end(long_args);
+        va_end(args);
+        return;
+    }
+
+    position = __atomic_load_n(&__log_head, __ATOMIC_RELAXED);
+    for(;;)
     {
-        printf("%s : ", __log_level_names[level]);
-        vprintf(format, args);
+        slot = &__log_slots[position & (RAFGL_LOG_SLOTS - 1)];
+        difference = (int)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if(difference == 0)
+        {
+            if(__atomic_compare_exchange_n(&__log_head, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(difference < 0)
+        {
+            /* the flusher is a whole ring behind, losing the message beats waiting on the disk */
+            __atomic_add_fetch(&__log_dropped, 1, __ATOMIC_RELAXED);
+            va_end(long_args);
+            va_end(args);
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n(&__log_head, __ATOMIC_RELAXED);
+        }
     }
 
-    vfprintf(fd, format, args);
+    slot->level = level;
+    slot->time = time;
+    slot->long_text = NULL;
+    length = vsnprintf(slot->text, sizeof(slot->text), format, args);
+    if(length >= (int)sizeof(slot->text))
+    {
+        slot->long_text = malloc(length + 1);
+        vsnprintf(slot->long_text, length + 1, format, long_args);
+    }
+    va_end(long_args);
     va_end(args);
+
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+
+    /* errors go out right away, and nothing waits for the next tick once half the ring is taken */
+    if(level == RAFGL_ERROR || position - __atomic_load_n(&__log_tail, __ATOMIC_RELAXED) == RAFGL_LOG_SLOTS / 2)
+        __rafgl_log_wake();
 }
 
 
-int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int window_height, int fullscreen)
+/* rafgl_frame_arena, set up with the logs */
+static rafgl_arena_t __frame_arena;
+
+static int __rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int window_height, int fullscreen, int headless)
 {
     if(__done) return -1;
     __done = 1;
@@ -442,6 +1090,8 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
         sprintf(fnames, "logs/%s.log", __log_level_names[i]);
         __log_files[i] = fopen(fnames, "w");
     }
+    clock_gettime(CLOCK_MONOTONIC, &__log_epoch);
+    __rafgl_log_start();
 
     __window_width = window_width;
     __window_height = window_height;
@@ -459,6 +1109,11 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
     glfwWindowHint(GLFW_SAMPLES, 4);
+    if(headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        fullscreen = 0;
+    }
 
     GLFWmonitor *mnt = glfwGetPrimaryMonitor();
 
@@ -493,10 +1148,36 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
         return -1;
     }
 
+    if(headless)
+    {
+        /* a hidden window's own pixels are not guaranteed to be rendered at all, so draw into a framebuffer we own */
+        glGenRenderbuffers(1, &__headless_colour);
+        glBindRenderbuffer(GL_RENDERBUFFER, __headless_colour);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, window_width, window_height);
+        glGenRenderbuffers(1, &__headless_depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, __headless_depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &__headless_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, __headless_fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, __headless_colour);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, __headless_depth);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            rafgl_log(RAFGL_ERROR, "Failed to create the headless framebuffer!\n");
+            glfwTerminate();
+            return -1;
+        }
+
+        /* nobody is looking, there is nothing to wait for */
+        glfwSwapInterval(0);
+    }
+
     game -> window = __window;
     game -> current_game_state = -1;
     game -> next_game_state = -1;
-    rafgl_list_init(&(game -> game_states), sizeof(rafgl_game_state_t));
+    rafgl_vector_init(&(game -> game_states), sizeof(rafgl_game_state_t));
 
     if(!__raster_vao)
     {
@@ -530,9 +1211,35 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
     rafgl_spritesheet_init(&__mono_char_sheet[1], "res/fonts/chars.png", __countx, __county);
     rafgl_spritesheet_init(&__mono_char_sheet[2], "res/fonts/chars-large.png", __countx, __county);
 
+    for(i = 0; i < RAFGL_FONT_COUNT; i++)
+    {
+        __rafgl_bake_glyph_masks(i);
+    }
+
     return 0;
 }
 
+int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int window_height, int fullscreen)
+{
+    return __rafgl_game_init(game, title, window_width, window_height, fullscreen, 0);
+}
+
+int rafgl_game_init_headless(rafgl_game_t *game, const char *title, int width, int height)
+{
+    return __rafgl_game_init(game, title, width, height, 0, 1);
+}
+
+GLuint rafgl_framebuffer_default(void)
+{
+    return __headless_fbo;
+}
+
+void rafgl_framebuffer_size(int *width, int *height)
+{
+    *width = __framebuffer_width;
+    *height = __framebuffer_height;
+}
+
 void rafgl_window_set_title(const char *name)
 {
     glfwSetWindowTitle(__window, name);
@@ -572,10 +1279,77 @@ void __rafgl_raster_draw_spritesheet_text(rafgl_raster_t *raster, rafgl_spritesh
 }
 
 
+/* writes colour to every pixel of the row whose bit is set in bits, whole lit nibbles go out as one 4 pixel store */
+static inline void __rafgl_raster_blit_mask_row(rafgl_pixel_rgb_t *dst, uint32_t bits, uint32_t colour)
+{
+#if defined(__SSE2__)
+    __m128i colour4 = _mm_set1_epi32((int)colour);
+    uint32_t nibble;
+
+    for(; bits; bits >>= 4, dst += 4)
+    {
+        nibble = bits & 0xf;
+        if(nibble == 0xf)
+        {
+            _mm_storeu_si128((__m128i*)dst, colour4);
+        }
+        else if(nibble)
+        {
+            if(nibble & 1) dst[0].rgba = colour;
+            if(nibble & 2) dst[1].rgba = colour;
+            if(nibble & 4) dst[2].rgba = colour;
+            if(nibble & 8) dst[3].rgba = colour;
+        }
+    }
+#else
+    while(bits)
+    {
+        dst[__builtin_ctz(bits)].rgba = colour;
+        bits &= bits - 1;
+    }
+#endif // __SSE2__
+}
+
+static void __rafgl_raster_draw_glyph(rafgl_raster_t *raster, int font, int glyph, int x, int y, uint32_t colour)
+{
+    rafgl_spritesheet_t *sheet = &__mono_char_sheet[font];
+    const uint32_t *mask = __mono_char_masks[font] + glyph * sheet->frame_height;
+    int fw = sheet->frame_width, fh = sheet->frame_height;
+    int yi, y_begin, y_end, skip_left, visible_width;
+    uint32_t clip_mask;
+
+    if(x >= raster->width || y >= raster->height || x + fw <= 0 || y + fh <= 0)
+        return;
+
+    /* fast path, the whole glyph is inside the raster */
+    if(x >= 0 && y >= 0 && x + fw <= raster->width && y + fh <= raster->height)
+    {
+        for(yi = 0; yi < fh; yi++)
+        {
+            __rafgl_raster_blit_mask_row(&pixel_at_pm(raster, x, y + yi), mask[yi], colour);
+        }
+        return;
+    }
+
+    skip_left = x < 0 ? -x : 0;
+    visible_width = rafgl_min_m(x + fw, raster->width) - (x + skip_left);
+    clip_mask = visible_width >= 32 ? 0xffffffffu : (1u << visible_width) - 1u;
+    y_begin = rafgl_max_m(0, -y);
+    y_end = rafgl_min_m(fh, raster->height - y);
+
+    for(yi = y_begin; yi < y_end; yi++)
+    {
+        __rafgl_raster_blit_mask_row(&pixel_at_pm(raster, x + skip_left, y + yi), (mask[yi] >> skip_left) & clip_mask, colour);
+    }
+}
+
 int rafgl_raster_draw_string(rafgl_raster_t *raster, const char *s, int x, int y, uint32_t colour, int font_size)
 {
+    int font = font_size % RAFGL_FONT_COUNT;
+    rafgl_spritesheet_t *sheet = &__mono_char_sheet[font];
+    int i = 0, index, xt, yt, ox = 0, oy = 0;
+    char c;
 
-    char c, i = 0, index, xt, yt, ox = 0, oy = 0;
     while((c = s[i++]) != '\0')
     {
         if(c == '\n')
@@ -590,1678 +1364,4860 @@ int rafgl_raster_draw_string(rafgl_raster_t *raster, const char *s, int x, int y
         }
 
         index = c - 32;
-        yt = index / __countx;
-        xt = index % __countx;
 
-        __rafgl_raster_draw_spritesheet_text(raster, &__mono_char_sheet[font_size % 3], xt, yt, x + ox * __mono_char_sheet[font_size % 3].frame_width, y + oy * __mono_char_sheet[font_size % 3].frame_height, colour);
+        if(__mono_char_masks[font])
+        {
+            __rafgl_raster_draw_glyph(raster, font, index, x + ox * sheet->frame_width, y + oy * sheet->frame_height, colour);
+        }
+        else
+        {
+            yt = index / __countx;
+            xt = index % __countx;
+            __rafgl_raster_draw_spritesheet_text(raster, sheet, xt, yt, x + ox * sheet->frame_width, y + oy * sheet->frame_height, colour);
+        }
         ox++;
-
-
-
-
     }
-}
-
-
-int rafgl_raster_init(rafgl_raster_t *raster, int width, int height)
-{
-    raster->data = calloc(width * height, sizeof(rafgl_pixel_rgb_t));
-    raster->width = width;
-    raster->height = height;
-    return 0;
-}
 
-int rafgl_raster_cleanup(rafgl_raster_t *raster)
-{
-    free(raster->data);
-    raster->height = 0;
-    raster->width = 0;
     return 0;
 }
 
+/* GPU text: the font sheets live in textures and every queued glyph becomes one instance of a 6 vertex quad */
 
-void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height)
-{
-    rafgl_raster_load_from_image(&(spritesheet->sheet), sheet_path);
-    spritesheet->sheet_width = sheet_width;
-    spritesheet->sheet_height = sheet_height;
-    spritesheet->frame_width = spritesheet->sheet.width / sheet_width;
-    spritesheet->frame_height = spritesheet->sheet.height / sheet_height;
-}
-
-
-
-void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y)
+typedef struct _rafgl_text_glyph_t
 {
-    int fl, fr, fu, fd;
-    int flc, frc, fuc, fdc;
-    int xi, yi;
+    float x, y;
+    float index;
+    uint32_t colour;
+} rafgl_text_glyph_t;
 
-    rafgl_pixel_rgb_t sampled;
+static const char *__text_vertex_shader_source = "\
+#version 330 core\n\
+\n\
+layout(location = 0) in vec2 glyph_position;\n\
+layout(location = 1) in float glyph_index;\n\
+layout(location = 2) in vec4 glyph_colour;\n\
+\n\
+uniform vec2 uni_target_size;\n\
+uniform vec2 uni_frame_size;\n\
+uniform vec2 uni_sheet_cells;\n\
+\n\
+out vec2 uv;\n\
+out vec4 colour;\n\
+\n\
+const vec2 corners[6] = vec2[6](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));\n\
+\n\
+void main()\n\
+{\n\
+    vec2 corner = corners[gl_VertexID];\n\
+    vec2 pixel = glyph_position + corner * uni_frame_size;\n\
+    gl_Position = vec4(pixel.x / uni_target_size.x * 2.0 - 1.0, 1.0 - pixel.y / uni_target_size.y * 2.0, 0.0, 1.0);\n\
+    vec2 cell = vec2(mod(glyph_index, uni_sheet_cells.x), floor(glyph_index / uni_sheet_cells.x));\n\
+    uv = (cell + corner) / uni_sheet_cells;\n\
+    colour = glyph_colour;\n\
+}\
+";
 
-    fl = x;
-    fr = x + spritesheet->frame_width;
-    fu = y;
-    fd = y + spritesheet->frame_height;
+static const char *__text_fragment_shader_source = "\
+#version 330 core\n\
+\n\
+in vec2 uv;\n\
+in vec4 colour;\n\
+out vec4 frag_colour;\n\
+uniform sampler2D sheet;\n\
+\n\
+void main()\n\
+{\n\
+    vec3 texel = texture(sheet, uv).rgb;\n\
+    if(max(texel.r, max(texel.g, texel.b)) == 0.0)\n\
+        discard;\n\
+    frag_colour = colour;\n\
+}\
+";
 
-    flc = rafgl_max_m(fl, 0);
-    frc = rafgl_min_m(fr, raster->width);
-    fuc = rafgl_max_m(fu, 0);
-    fdc = rafgl_min_m(fd, raster->height);
+static GLuint __text_program = 0, __text_vao = 0, __text_vbo = 0;
+static GLint __text_uni_target_size, __text_uni_frame_size, __text_uni_sheet_cells;
+static rafgl_texture_t __text_sheet_textures[RAFGL_FONT_COUNT];
 
-    for(yi = fuc; yi < fdc; yi++)
+static rafgl_text_glyph_t *__text_queue[RAFGL_FONT_COUNT];
+static int __text_queue_count[RAFGL_FONT_COUNT], __text_queue_capacity[RAFGL_FONT_COUNT];
+
+void rafgl_text_draw_string(const char *s, int x, int y, uint32_t colour, int font_size)
+{
+    int font = font_size % RAFGL_FONT_COUNT;
+    rafgl_spritesheet_t *sheet = &__mono_char_sheet[font];
+    rafgl_text_glyph_t *glyph;
+    int i = 0, ox = 0, oy = 0;
+    char c;
+
+    while((c = s[i++]) != '\0')
     {
-        for(xi = flc; xi < frc; xi++)
+        if(c == '\n')
         {
-            sampled = pixel_at_m(spritesheet->sheet, sheet_x * spritesheet->frame_width + xi - fl, sheet_y * spritesheet->frame_height + yi - fu);
-            if(sampled.rgba != RAFGL_COLOUR_KEY.rgba)
-            {
-                pixel_at_pm(raster, xi, yi) = sampled;
-            }
+            ox = -1;
+            oy++;
+        }
+        if(c < 32 || c >= 128 || c == ' ')
+        {
+            ox++;
+            continue;
         }
-    }
 
-}
+        if(__text_queue_count[font] == __text_queue_capacity[font])
+        {
+            __text_queue_capacity[font] = __text_queue_capacity[font] ? __text_queue_capacity[font] * 2 : 1024;
+            __text_queue[font] = realloc(__text_queue[font], __text_queue_capacity[font] * sizeof(rafgl_text_glyph_t));
+        }
 
+        glyph = &__text_queue[font][__text_queue_count[font]++];
+        glyph->x = x + ox * sheet->frame_width;
+        glyph->y = y + oy * sheet->frame_height;
+        glyph->index = c - 32;
+        glyph->colour = colour;
+        ox++;
+    }
+}
 
-int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
+static void __rafgl_text_init(void)
 {
+    int i;
 
-    if(raster_to->data == NULL)
+    __text_program = rafgl_program_create_from_source(__text_vertex_shader_source, __text_fragment_shader_source);
+    glUseProgram(__text_program);
+    glUniform1i(glGetUniformLocation(__text_program, "sheet"), 0);
+    __text_uni_target_size = glGetUniformLocation(__text_program, "uni_target_size");
+    __text_uni_frame_size = glGetUniformLocation(__text_program, "uni_frame_size");
+    __text_uni_sheet_cells = glGetUniformLocation(__text_program, "uni_sheet_cells");
+    glUseProgram(0);
+
+    glGenVertexArrays(1, &__text_vao);
+    glGenBuffers(1, &__text_vbo);
+    glBindVertexArray(__text_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, __text_vbo);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(rafgl_text_glyph_t), (void*)offsetof(rafgl_text_glyph_t, x));
+    glVertexAttribDivisor(0, 1);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(rafgl_text_glyph_t), (void*)offsetof(rafgl_text_glyph_t, index));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(rafgl_text_glyph_t), (void*)offsetof(rafgl_text_glyph_t, colour));
+    glVertexAttribDivisor(2, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    for(i = 0; i < RAFGL_FONT_COUNT; i++)
     {
-        /* new raster */
-        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+        rafgl_texture_init(&__text_sheet_textures[i]);
+        if(__mono_char_sheet[i].sheet.data == NULL)
+            continue;
+        rafgl_texture_load_from_raster(&__text_sheet_textures[i], &__mono_char_sheet[i].sheet);
+        glBindTexture(GL_TEXTURE_2D, __text_sheet_textures[i].tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
-    else if(raster_to -> width != raster_from -> width || raster_to -> height != raster_from -> height)
+}
+
+void rafgl_text_flush(int target_width, int target_height)
+{
+    int font;
+    GLboolean depth_test, blend;
+
+    if(!__text_program)
     {
-        /* resize */
-        rafgl_raster_cleanup(raster_to);
-        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+        __rafgl_text_init();
     }
 
-    /* just copy */
-    memcpy(raster_to->data, raster_from->data, raster_from->width * raster_from->height * sizeof(rafgl_pixel_rgb_t));
-    return 0;
-}
+    depth_test = glIsEnabled(GL_DEPTH_TEST);
+    blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
 
-int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path)
-{
-    int width, height, channels;
-    raster->data = (rafgl_pixel_rgb_t *) stbi_load(image_path, &width, &height, &channels, 4);
-    raster->width = width;
-    raster->height = height;
-    return 0;
-}
+    glUseProgram(__text_program);
+    glUniform2f(__text_uni_target_size, target_width, target_height);
+    glUniform2f(__text_uni_sheet_cells, __countx, __county);
+    glBindVertexArray(__text_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, __text_vbo);
+    glActiveTexture(GL_TEXTURE0);
 
-int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path)
-{
-    return stbi_write_png(image_path, raster->width, raster->height, 4, raster->data, 0);
-}
+    for(font = 0; font < RAFGL_FONT_COUNT; font++)
+    {
+        if(__text_queue_count[font] == 0)
+            continue;
 
-void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius)
-{
-    int x, y;
-    float xn, yn, offset;
-    int sample_count = 2 * radius + 1;
+        glUniform2f(__text_uni_frame_size, __mono_char_sheet[font].frame_width, __mono_char_sheet[font].frame_height);
+        glBindTexture(GL_TEXTURE_2D, __text_sheet_textures[font].tex_id);
+        /* orphan the previous contents so the driver does not wait for the last flush to finish reading them */
+        glBufferData(GL_ARRAY_BUFFER, __text_queue_count[font] * sizeof(rafgl_text_glyph_t), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, __text_queue_count[font] * sizeof(rafgl_text_glyph_t), __text_queue[font]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, __text_queue_count[font]);
 
-    rafgl_pixel_rgb_t sampled, resulting;
+        __text_queue_count[font] = 0;
+    }
 
-    int r, g, b;
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
 
+    if(depth_test) glEnable(GL_DEPTH_TEST);
+    if(blend) glEnable(GL_BLEND);
+}
 
-    for(y = 0; y < tmp->height; y++)
+/* frame capture: glReadPixels goes into a PBO behind a fence, the PBO is mapped a frame later when the copy is long done,
+   and the frame is passed on to a worker thread that does the encoding and the disk or pipe writes */
+
+static void __rafgl_capture_write_y4m(rafgl_capture_t *capture, unsigned char *rgba, unsigned char *planes)
+{
+    int x, y, dx, dy, r, g, b, n, xs, ys;
+    int w = capture->width, h = capture->height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    unsigned char *luma = planes, *cb = planes + w * h, *cr = cb + cw * ch;
+    unsigned char *p;
+
+    /* BT.601 studio range */
+    for(y = 0; y < h; y++)
     {
-        for(x = 0; x < tmp->width; x++)
+        for(x = 0; x < w; x++)
         {
+            p = rgba + (y * w + x) * 4;
+            luma[y * w + x] = 16 + ((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8);
+        }
+    }
 
-            r = 0;
-            g = 0;
-            b = 0;
-            for(offset = -radius; offset <= radius; offset++)
+    /* 4:2:0, chroma from the average of each 2x2 block */
+    for(y = 0; y < ch; y++)
+    {
+        for(x = 0; x < cw; x++)
+        {
+            r = g = b = n = 0;
+            for(dy = 0; dy < 2; dy++)
             {
-                sampled = rafgl_point_sample(from, 1.0f * (x + offset) / (tmp->width), 1.0f * (y) / (tmp->height));
-                r += sampled.r;
-                g += sampled.g;
-                b += sampled.b;
+                for(dx = 0; dx < 2; dx++)
+                {
+                    xs = x * 2 + dx;
+                    ys = y * 2 + dy;
+                    if(xs >= w || ys >= h)
+                        continue;
+                    p = rgba + (ys * w + xs) * 4;
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    n++;
+                }
             }
+            r /= n;
+            g /= n;
+            b /= n;
+            cb[y * cw + x] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+            cr[y * cw + x] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+        }
+    }
 
-            resulting.r = r / sample_count;
-            resulting.g = g / sample_count;
-            resulting.b = b / sample_count;
+    fputs("FRAME\n", capture->stream);
+    fwrite(planes, 1, w * h + 2 * cw * ch, capture->stream);
+}
 
-            pixel_at_pm(tmp, x, y) = resulting;
-        }
+static void* __rafgl_capture_worker(void *arg)
+{
+    rafgl_capture_t *capture = arg;
+    unsigned char *planes = NULL, *rgba;
+    char filename[512];
+    int slot, i;
+
+    if(capture->format == RAFGL_CAPTURE_Y4M)
+    {
+        planes = malloc(capture->width * capture->height + 2 * ((capture->width + 1) / 2) * ((capture->height + 1) / 2));
     }
 
-    for(y = 0; y < result->height; y++)
+    for(;;)
     {
-        for(x = 0; x < result->width; x++)
+        pthread_mutex_lock(&capture->mutex);
+        while(capture->queue_count == 0 && capture->running)
+            pthread_cond_wait(&capture->filled, &capture->mutex);
+        if(capture->queue_count == 0)
         {
-            r = g = b = 0;
-            for(offset = -radius; offset <= radius; offset++)
+            pthread_mutex_unlock(&capture->mutex);
+            break;
+        }
+        slot = capture->queue_head;
+        pthread_mutex_unlock(&capture->mutex);
+
+        rgba = capture->slots[slot];
+        if(capture->format == RAFGL_CAPTURE_Y4M)
+        {
+            __rafgl_capture_write_y4m(capture, rgba, planes);
+        }
+        else
+        {
+            /* the default framebuffer alpha is whatever the blending left there */
+            for(i = 3; i < capture->width * capture->height * 4; i += 4)
+                rgba[i] = 255;
+            snprintf(filename, sizeof(filename), capture->path, capture->slot_frames[slot]);
+            if(!stbi_write_png(filename, capture->width, capture->height, 4, rgba, capture->width * 4))
             {
-                sampled = rafgl_point_sample(tmp, 1.0f * (x) / result->width, 1.0f * (y + offset) / result->height);
-                r += sampled.r;
-                g += sampled.g;
-                b += sampled.b;
+                rafgl_log(RAFGL_WARNING, "Capture could not write %s\n", filename);
             }
-
-            resulting.r = r / sample_count;
-            resulting.g = g / sample_count;
-            resulting.b = b / sample_count;
-
-            pixel_at_pm(result, x, y) = resulting;
         }
+
+        pthread_mutex_lock(&capture->mutex);
+        capture->queue_head = (capture->queue_head + 1) % RAFGL_CAPTURE_QUEUE;
+        capture->queue_count--;
+        pthread_cond_signal(&capture->drained);
+        pthread_mutex_unlock(&capture->mutex);
     }
+
+    free(planes);
+    return NULL;
 }
 
-int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y)
+/* maps the oldest readbacks in order, waiting on the GPU only for frames up to wait_until */
+static void __rafgl_capture_collect(rafgl_capture_t *capture, int wait_until)
 {
+    int pbo, slot, row, stride = capture->width * 4;
+    GLenum status;
+    unsigned char *mapped;
 
-    int fl, fr, fu, fd;
-    int flc, frc, fuc, fdc;
-    int xi, yi;
-
-    rafgl_pixel_rgb_t sampled;
+    while(capture->frames_collected < capture->frames_read)
+    {
+        pbo = capture->frames_collected % RAFGL_CAPTURE_PBOS;
 
-    fl = x;
-    fr = x + from->width;
-    fu = y;
-    fd = y + from->height;
+        status = glClientWaitSync(capture->fences[pbo], 0, 0);
+        if(status == GL_TIMEOUT_EXPIRED)
+        {
+            if(capture->frames_collected > wait_until)
+                break;
+            capture->readback_waits++;
+            do
+            {
+                status = glClientWaitSync(capture->fences[pbo], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+            } while(status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(capture->fences[pbo]);
+        capture->fences[pbo] = 0;
 
-    flc = rafgl_max_m(fl, 0);
-    frc = rafgl_min_m(fr, to->width);
-    fuc = rafgl_max_m(fu, 0);
-    fdc = rafgl_min_m(fd, to->height);
+        /* only this thread adds frames, so the slot after the last queued one stays ours until queue_count says otherwise */
+        pthread_mutex_lock(&capture->mutex);
+        if(capture->queue_count == RAFGL_CAPTURE_QUEUE)
+        {
+            capture->queue_waits++;
+            while(capture->queue_count == RAFGL_CAPTURE_QUEUE)
+                pthread_cond_wait(&capture->drained, &capture->mutex);
+        }
+        slot = (capture->queue_head + capture->queue_count) % RAFGL_CAPTURE_QUEUE;
+        pthread_mutex_unlock(&capture->mutex);
 
-    for(yi = fuc; yi < fdc; yi++)
-    {
-        for(xi = flc; xi < frc; xi++)
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[pbo]);
+        mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, stride * capture->height, GL_MAP_READ_BIT);
+        if(mapped)
         {
-            sampled = pixel_at_pm(from, xi - fl, yi - fu);
-            if(sampled.rgba != RAFGL_COLOUR_KEY.rgba)
-            {
-                pixel_at_pm(to, xi, yi) = sampled;
-            }
+            /* GL rows start at the bottom */
+            for(row = 0; row < capture->height; row++)
+                memcpy(capture->slots[slot] + row * stride, mapped + (capture->height - 1 - row) * stride, stride);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
         }
-    }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        capture->slot_frames[slot] = capture->frames_collected;
 
+        pthread_mutex_lock(&capture->mutex);
+        capture->queue_count++;
+        pthread_cond_signal(&capture->filled);
+        pthread_mutex_unlock(&capture->mutex);
 
+        capture->frames_collected++;
+    }
 }
 
-/* Cohen-Sutherland line clipping algorithm constants */
-static const int __cohsuth_INSIDE = 0;     /* 0000 */
-static const int __cohsuth_LEFT   = 1;     /* 0001 */
-static const int __cohsuth_RIGHT  = 2;     /* 0010 */
-static const int __cohsuth_BOTTOM = 4;     /* 0100 */
-static const int __cohsuth_TOP    = 8;     /* 1000 */
-
-static int __compute_outcode(int x, int y, rafgl_raster_t *raster)
+int rafgl_capture_start(rafgl_capture_t *capture, const char *path, int format, int width, int height, int fps)
 {
-    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
-    int code = __cohsuth_INSIDE;
-    if(x < xmin)
-    {
-        code |= __cohsuth_LEFT;
-    }
-    else if(x > xmax)
+    int i;
+
+    memset(capture, 0, sizeof(*capture));
+    capture->format = format;
+    capture->width = width;
+    capture->height = height;
+    capture->fps = fps;
+    strncpy(capture->path, path, sizeof(capture->path) - 1);
+
+    if(format == RAFGL_CAPTURE_Y4M)
     {
-        code |= __cohsuth_RIGHT;
+        if(path[0] == '|')
+        {
+            capture->stream = popen(path + 1, "w");
+            capture->stream_is_pipe = 1;
+        }
+        else
+        {
+            capture->stream = fopen(path, "wb");
+        }
+
+        if(capture->stream == NULL)
+        {
+            rafgl_log(RAFGL_ERROR, "Capture could not open %s\n", path);
+            return -1;
+        }
+        fprintf(capture->stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
     }
 
-    if(y < ymin)
+    glGenBuffers(RAFGL_CAPTURE_PBOS, capture->pbos);
+    for(i = 0; i < RAFGL_CAPTURE_PBOS; i++)
     {
-        code |= __cohsuth_BOTTOM;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
     }
-    else if(y > ymax)
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for(i = 0; i < RAFGL_CAPTURE_QUEUE; i++)
     {
-        code |= __cohsuth_TOP;
+        capture->slots[i] = malloc(width * height * 4);
     }
 
-    return code;
+    pthread_mutex_init(&capture->mutex, NULL);
+    pthread_cond_init(&capture->filled, NULL);
+    pthread_cond_init(&capture->drained, NULL);
+    capture->running = 1;
+    pthread_create(&capture->worker, NULL, __rafgl_capture_worker, capture);
+
+    return 0;
 }
 
-void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
+void rafgl_capture_frame(rafgl_capture_t *capture)
 {
+    int pbo = capture->frames_read % RAFGL_CAPTURE_PBOS;
+    GLint read_framebuffer;
 
-    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
-    int outcode0 = __compute_outcode(x0, y0, raster);
-    int outcode1 = __compute_outcode(x1, y1, raster);
-    int accept = 0;
-    int xnew, ynew;
-    int outside_outcode;
+    if(!capture->running)
+        return;
 
-    while(1)
-    {
+    /* frees this frame's PBO (blocking only if the GPU is RAFGL_CAPTURE_PBOS frames behind) and picks up anything else that is done */
+    __rafgl_capture_collect(capture, capture->frames_read - RAFGL_CAPTURE_PBOS);
 
-        if(!(outcode0 | outcode1))
-        {
-            /* trivijalno prihvatanje */
-            accept = 1;
-            break;
-        }
-        else if(outcode0 & outcode1)
-        {
-            /* trivijalno odbacivanje */
-            break;
-        }
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, __headless_fbo);
+    glReadBuffer(__headless_fbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbos[pbo]);
+    glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+
+    capture->fences[pbo] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    capture->frames_read++;
+}
+
+void rafgl_capture_stop(rafgl_capture_t *capture)
+{
+    int i;
+
+    if(!capture->running)
+        return;
+
+    __rafgl_capture_collect(capture, capture->frames_read);
+
+    pthread_mutex_lock(&capture->mutex);
+    capture->running = 0;
+    pthread_cond_signal(&capture->filled);
+    pthread_mutex_unlock(&capture->mutex);
+    pthread_join(capture->worker, NULL);
+
+    if(capture->stream)
+    {
+        if(capture->stream_is_pipe)
+            pclose(capture->stream);
         else
-        {
-            outside_outcode = outcode0 ? outcode0 : outcode1;
-            if(outside_outcode & __cohsuth_TOP)
-            {
-                xnew = x0 + (x1 - x0) * (ymax - y0) / (y1 - y0);
-                ynew = ymax;
-            }
-            else if(outside_outcode & __cohsuth_BOTTOM)
-            {
-                xnew = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
-				ynew = ymin;
-            }
-            else if (outside_outcode & __cohsuth_RIGHT)
-            {
-				ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
-				xnew = xmax;
-			}
-			else if (outside_outcode & __cohsuth_LEFT)
-            {
-				ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
-				xnew = xmin;
-			}
-
-			if(outside_outcode == outcode0)
-            {
-                x0 = xnew;
-                y0 = ynew;
-                outcode0 = __compute_outcode(x0, y0, raster);
-            }
-            else
-            {
-                x1 = xnew;
-                y1 = ynew;
-                outcode1 = __compute_outcode(x1, y1, raster);
-            }
-        }
-
-
+            fclose(capture->stream);
+        capture->stream = NULL;
     }
 
-
-    if(!accept)
-        return;
-
-    x0 = rafgl_clampi(x0, 0, xmax);
-    y0 = rafgl_clampi(y0, 0, ymax);
-    x1 = rafgl_clampi(x1, 0, xmax);
-    y1 = rafgl_clampi(y1, 0, ymax);
-
-
-    /* printf("---\nx0: %d\ny0: %d\nx1: %d\ny1: %d\n", x0, y0, x1, y1); */
-
-    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
-    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
-    int err = dx+dy, e2; /* error value e_xy */
-
-    while(1)
+    glDeleteBuffers(RAFGL_CAPTURE_PBOS, capture->pbos);
+    for(i = 0; i < RAFGL_CAPTURE_QUEUE; i++)
     {
-        pixel_at_pm(raster, x0, y0).rgba = colour;
-        if (x0==x1 && y0==y1) break;
-        e2 = 2*err;
-        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
-        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
+        free(capture->slots[i]);
+        capture->slots[i] = NULL;
     }
+    pthread_mutex_destroy(&capture->mutex);
+    pthread_cond_destroy(&capture->filled);
+    pthread_cond_destroy(&capture->drained);
 
+    rafgl_log(RAFGL_INFO, "Captured %d frames (%d readback waits, %d encoder waits)\n",
+              capture->frames_collected, capture->readback_waits, capture->queue_waits);
 }
 
-/* DOES NOT DO CLIPPING! */
-void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour)
-{
-    int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */
-    do {
-        pixel_at_pm(raster, cx-x, cy+y).rgba = colour; /*   I. Quadrant */
-        pixel_at_pm(raster, cx-y, cy-x).rgba = colour; /*  II. Quadrant */
-        pixel_at_pm(raster, cx+x, cy-y).rgba = colour; /* III. Quadrant */
-        pixel_at_pm(raster, cx+y, cy+x).rgba = colour; /*  IV. Quadrant */
-        r = err;
-        if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
-        if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
-    } while (x < 0);
-}
 
-void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour)
+int rafgl_raster_init(rafgl_raster_t *raster, int width, int height)
 {
-    rafgl_raster_draw_line(raster, x0, y0, x0 + w, y0, colour);
-    rafgl_raster_draw_line(raster, x0, y0 + h, x0 + w, y0 + h, colour);
-    rafgl_raster_draw_line(raster, x0, y0, x0, y0 + h, colour);
-    rafgl_raster_draw_line(raster, x0 + w, y0, x0 + w, y0 + h, colour);
+    raster->data = calloc(width * height, sizeof(rafgl_pixel_rgb_t));
+    raster->width = width;
+    raster->height = height;
+    return 0;
 }
 
-void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from)
+int rafgl_raster_cleanup(rafgl_raster_t *raster)
 {
-    int x, y;
-    int w = to->width, h = to->height;
-    float xn, yn;
-
-    for(y = 0; y < h; y++)
-    {
-        yn = ((float)y) / h;
-        for(x = 0; x < w; x++)
-        {
-            xn = ((float)x) / w;
-            pixel_at_pm(to, x, y) = rafgl_bilinear_sample(from, xn, yn);
-        }
-    }
+    free(raster->data);
+    raster->height = 0;
+    raster->width = 0;
+    return 0;
 }
 
 
-void rafgl_game_add_game_state(rafgl_game_t *game, void (*init)(GLFWwindow *window, void *args), void (*update)(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args), void (*render)(GLFWwindow *window, void *args), void (*cleanup)(GLFWwindow *window, void *args))
+void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height)
 {
-    rafgl_game_state_t state;
-    state.init = init;
-    state.update = update;
-    state.render = render;
-    state.cleanup = cleanup;
-    state.id = 0;
-
-    rafgl_list_append(&game->game_states, &state);
+    rafgl_raster_load_from_image(&(spritesheet->sheet), sheet_path);
+    spritesheet->sheet_width = sheet_width;
+    spritesheet->sheet_height = sheet_height;
+    spritesheet->frame_width = spritesheet->sheet.width / sheet_width;
+    spritesheet->frame_height = spritesheet->sheet.height / sheet_height;
 }
 
-static int __rafgl_log_fps = 0;
-static int __game_state_change_request = -1;
-static void *__game_state_change_request_args = NULL;
 
-void rafgl_log_fps(int b)
-{
-    __rafgl_log_fps = b;
-}
 
-void rafgl_game_request_state_change(int state_index, void *args)
-{
-    __game_state_change_request = state_index;
-    __game_state_change_request_args = args;
-}
+/* compositing row kernels, every blit path goes through one of these per visible row */
 
-void rafgl_game_start(rafgl_game_t *game, void *_args)
+/* copies the pixels that differ from key, blocks with no key pixels are stored whole, blocks of only key pixels are skipped */
+static inline void __rafgl_blit_row_keyed(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key)
 {
-    int frame_count = 0;
-    void *args = _args;
-    rafgl_game_state_t *current_state = rafgl_list_get(&game->game_states, 0);
-    int current_game_state_index = 0, i;
-
-    rafgl_game_data_t game_data;
-    game_data.keys_down = __keys_down;
-    game_data.keys_pressed = __keys_pressed;
-
-    current_state->init(game->window, args, __window_width, __window_height);
-
-
-    double current_frame, last_frame;
-    float elapsed;
-
-    double last_fps_frame;
+    int i = 0;
 
-    last_fps_frame = last_frame = glfwGetTime();
-
-    int fbwidth, fbheight, fbwlast = 0, fbhlast = 0;
-
-    while(!glfwWindowShouldClose(game->window))
+#if defined(__AVX2__)
+    __m256i key8 = _mm256_set1_epi32((int)key);
+    __m256i ones8 = _mm256_set1_epi32(-1);
+    for(; i + 8 <= count; i += 8)
     {
-        for(i = 0; i < 400; i++)
-        {
-            __keys_pressed[i] = 0;
-        }
-        glfwPollEvents();
-
-        current_frame = glfwGetTime();
+        __m256i s8 = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i keyed = _mm256_cmpeq_epi32(s8, key8);
+        int mask = _mm256_movemask_epi8(keyed);
+        if(mask == -1)
+            continue;
+        if(mask == 0)
+            _mm256_storeu_si256((__m256i*)(dst + i), s8);
+        else
+            _mm256_maskstore_epi32((int*)(dst + i), _mm256_xor_si256(keyed, ones8), s8);
+    }
+#endif // __AVX2__
 
-        ++frame_count;
-        if(current_frame - last_fps_frame >= 2.0f)
+#if defined(__SSE2__)
+    __m128i key4 = _mm_set1_epi32((int)key);
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i s4 = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i keyed = _mm_cmpeq_epi32(s4, key4);
+        int mask = _mm_movemask_epi8(keyed);
+        if(mask == 0xffff)
+            continue;
+        if(mask == 0)
         {
-            if(__rafgl_log_fps)
-            {
-                rafgl_log(RAFGL_INFO, "[FPS = %.2f]\n", frame_count / 2.0f);
-            }
-            frame_count = 0;
-            last_fps_frame = current_frame;
+            _mm_storeu_si128((__m128i*)(dst + i), s4);
         }
-
-        elapsed = current_frame - last_frame;
-        last_frame = current_frame;
-
-
-        glfwGetFramebufferSize(game->window, &fbwidth, &fbheight);
-        if(fbwlast != fbwidth || fbhlast != fbheight)
+        else
         {
-            glViewport(0, 0, fbwidth, fbheight);
+            __m128i d4 = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(keyed, d4), _mm_andnot_si128(keyed, s4)));
         }
-        fbwlast = fbwidth;
-        fbhlast = fbheight;
-
-        game_data.raster_width = fbwidth;
-        game_data.raster_height = fbheight;
+    }
+#endif // __SSE2__
 
-        glfwGetCursorPos(game->window, &game_data.mouse_pos_x, &game_data.mouse_pos_y);
+    for(; i < count; i++)
+    {
+        if(src[i].rgba != key)
+            dst[i] = src[i];
+    }
+}
 
-        game_data.is_lmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_LEFT);
-        game_data.is_rmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_RIGHT);
-        game_data.is_mmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_MIDDLE);
+/* x * y / 255 rounded, exact for 16 bit products of two bytes */
+#define __rafgl_div255(x) ((((x) + 128) + (((x) + 128) >> 8)) >> 8)
 
-        current_state->update(game->window, elapsed, &game_data, args);
+/* premultiplied alpha over operator on every channel, alpha included */
+static inline void __rafgl_blit_row_blend(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count)
+{
+    int i = 0, c;
+    unsigned int inverse, scaled;
+
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i c255 = _mm_set1_epi16(255);
+    __m128i c128 = _mm_set1_epi16(128);
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i s4 = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d4 = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i s_lo = _mm_unpacklo_epi8(s4, zero), s_hi = _mm_unpackhi_epi8(s4, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d4, zero), d_hi = _mm_unpackhi_epi8(d4, zero);
 
+        /* broadcast each pixel's alpha over its four 16 bit lanes */
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xff), 0xff);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xff), 0xff);
 
-        current_state->render(game->window, args);
+        __m128i t_lo = _mm_add_epi16(_mm_mullo_epi16(d_lo, _mm_sub_epi16(c255, a_lo)), c128);
+        __m128i t_hi = _mm_add_epi16(_mm_mullo_epi16(d_hi, _mm_sub_epi16(c255, a_hi)), c128);
+        t_lo = _mm_srli_epi16(_mm_add_epi16(t_lo, _mm_srli_epi16(t_lo, 8)), 8);
+        t_hi = _mm_srli_epi16(_mm_add_epi16(t_hi, _mm_srli_epi16(t_hi, 8)), 8);
 
-        glfwSwapBuffers(game->window);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_add_epi16(s_lo, t_lo), _mm_add_epi16(s_hi, t_hi)));
+    }
+#endif // __SSE2__
 
-        if(__game_state_change_request == current_game_state_index)
+    for(; i < count; i++)
+    {
+        inverse = 255 - src[i].a;
+        for(c = 0; c < 4; c++)
         {
-            rafgl_log(RAFGL_WARNING, "Already in that state!\n");
-            __game_state_change_request = -1;
+            scaled = dst[i].components[c] * inverse;
+            dst[i].components[c] = rafgl_min_m(src[i].components[c] + __rafgl_div255(scaled), 255);
         }
+    }
+}
 
-        if(__game_state_change_request >= 0)
-        {
-            rafgl_log(RAFGL_INFO, "Changigng state!\n");
-            current_state->cleanup(game->window, args);
-
-            args = __game_state_change_request_args;
-            __game_state_change_request_args = NULL;
-
-            current_state = rafgl_list_get(&game->game_states, __game_state_change_request);
-
-            current_game_state_index = __game_state_change_request;
-            __game_state_change_request = -1;
+void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y)
+{
+    int fl, fr, fu, fd;
+    int flc, frc, fuc, fdc;
+    int yi;
 
-            current_state->init(game->window, args, __window_width, __window_height);
-            last_frame = glfwGetTime();
+    fl = x;
+    fr = x + spritesheet->frame_width;
+    fu = y;
+    fd = y + spritesheet->frame_height;
 
-        }
+    flc = rafgl_max_m(fl, 0);
+    frc = rafgl_min_m(fr, raster->width);
+    fuc = rafgl_max_m(fu, 0);
+    fdc = rafgl_min_m(fd, raster->height);
 
-    }
+    if(flc >= frc)
+        return;
 
-    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+    for(yi = fuc; yi < fdc; yi++)
     {
-        fclose(__log_files[i]);
+        __rafgl_blit_row_keyed(&pixel_at_pm(raster, flc, yi), &pixel_at_m(spritesheet->sheet, sheet_x * spritesheet->frame_width + flc - fl, sheet_y * spritesheet->frame_height + yi - fu), frc - flc, RAFGL_COLOUR_KEY.rgba);
     }
 
-
 }
 
 
+int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
+{
 
-/* Helpers implementation*/
+    if(raster_to->data == NULL)
+    {
+        /* new raster */
+        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+    }
+    else if(raster_to -> width != raster_from -> width || raster_to -> height != raster_from -> height)
+    {
+        /* resize */
+        rafgl_raster_cleanup(raster_to);
+        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+    }
 
-void rafgl_button_innit(rafgl_button_t *btn, int posx, int posy, int width, int height, uint32_t colour)
-{
-    btn->colour = colour;
-    btn->posx = posx;
-    btn->posy = posy;
-    btn->w = width;
-    btn->h = height;
+    /* just copy */
+    memcpy(raster_to->data, raster_from->data, raster_from->width * raster_from->height * sizeof(rafgl_pixel_rgb_t));
+    return 0;
 }
 
-int rafgl_button_check(rafgl_button_t *btn, rafgl_game_data_t *game_data)
+int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path)
 {
-    return (rafgl_distance1D(btn->posx, game_data->mouse_pos_x) <= btn->w / 2) && (rafgl_distance1D(btn->posy, game_data->mouse_pos_y) <= btn->h / 2) && game_data->is_lmb_down;
+    int width, height, channels;
+    raster->data = (rafgl_pixel_rgb_t *) stbi_load(image_path, &width, &height, &channels, 4);
+    raster->width = width;
+    raster->height = height;
+    return 0;
 }
 
-void rafgl_button_show(rafgl_raster_t *target, rafgl_button_t *btn)
+int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path)
 {
-    int x, y, X, Y;
+    return stbi_write_png(image_path, raster->width, raster->height, 4, raster->data, 0);
+}
 
-    for(Y = -btn->h/2; Y < btn->h/2; Y++)
+void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius)
+{
+    int x, y;
+    float xn, yn, offset;
+    int sample_count = 2 * radius + 1;
+
+    rafgl_pixel_rgb_t sampled, resulting;
+
+    int r, g, b;
+
+
+    for(y = 0; y < tmp->height; y++)
     {
-        for(X = -btn->w/2; X < btn->w/2; X++)
+        for(x = 0; x < tmp->width; x++)
         {
-            x = rafgl_clampi(btn->posx + X, 0, target->width - 1);
-            y = rafgl_clampi(btn->posy + Y, 0, target->height - 1);
 
-            pixel_at_pm(target, x, y).rgba = btn->colour;
+            r = 0;
+            g = 0;
+            b = 0;
+            for(offset = -radius; offset <= radius; offset++)
+            {
+                sampled = rafgl_point_sample(from, 1.0f * (x + offset) / (tmp->width), 1.0f * (y) / (tmp->height));
+                r += sampled.r;
+                g += sampled.g;
+                b += sampled.b;
+            }
+
+            resulting.r = r / sample_count;
+            resulting.g = g / sample_count;
+            resulting.b = b / sample_count;
 
+            pixel_at_pm(tmp, x, y) = resulting;
         }
+    }
+
+    for(y = 0; y < result->height; y++)
+    {
+        for(x = 0; x < result->width; x++)
+        {
+            r = g = b = 0;
+            for(offset = -radius; offset <= radius; offset++)
+            {
+                sampled = rafgl_point_sample(tmp, 1.0f * (x) / result->width, 1.0f * (y + offset) / result->height);
+                r += sampled.r;
+                g += sampled.g;
+                b += sampled.b;
+            }
+
+            resulting.r = r / sample_count;
+            resulting.g = g / sample_count;
+            resulting.b = b / sample_count;
 
+            pixel_at_pm(result, x, y) = resulting;
+        }
     }
 }
 
+/* blits covering more pixels than this are split into row bands and spread over the worker pool */
+#define RAFGL_BLIT_PARALLEL_PIXELS (256 * 256)
+#define RAFGL_BLIT_BAND_ROWS 32
 
-inline float randf(void)
+enum
 {
-    return 1.0f * rand() / (RAND_MAX + 1);
-}
+    __RAFGL_BLIT_KEYED,
+    __RAFGL_BLIT_OPAQUE,
+    __RAFGL_BLIT_BLEND
+};
 
-inline float rafgl_distance1D(float x1, float x2)
+typedef struct
 {
-    if(x1 > x2)
-        return x1 - x2;
-    else
-        return x2 - x1;
-}
+    rafgl_raster_t *to, *from;
+    int mode;
+    uint32_t key;
+    int dst_x, dst_y, src_x, src_y, width, height;
+} __rafgl_blit_t;
 
-inline float rafgl_distance2D(float x1, float y1, float x2, float y2)
+static void __rafgl_blit_rows(__rafgl_blit_t *blit, int row_begin, int row_end)
 {
-    float delta_x = x2 - x1;
-    float delta_y = y2 - y1;
+    int row;
+    rafgl_pixel_rgb_t *dst;
+    const rafgl_pixel_rgb_t *src;
 
-    return sqrtf(delta_x * delta_x + delta_y * delta_y);
-}
-
-inline float rafgl_distance3D(float x1, float y1, float z1, float x2, float y2, float z2)
-{
-    float delta_x = x2 - x1;
-    float delta_y = y2 - y1;
-    float delta_z = z2 - z1;
+    for(row = row_begin; row < row_end; row++)
+    {
+        dst = &pixel_at_pm(blit->to, blit->dst_x, blit->dst_y + row);
+        src = &pixel_at_pm(blit->from, blit->src_x, blit->src_y + row);
 
-    return sqrtf(delta_x * delta_x + delta_y * delta_y + delta_z * delta_z);
+        switch(blit->mode)
+        {
+        case __RAFGL_BLIT_KEYED:
+            __rafgl_blit_row_keyed(dst, src, blit->width, blit->key);
+            break;
+        case __RAFGL_BLIT_OPAQUE:
+            memcpy(dst, src, blit->width * sizeof(rafgl_pixel_rgb_t));
+            break;
+        case __RAFGL_BLIT_BLEND:
+            __rafgl_blit_row_blend(dst, src, blit->width);
+            break;
+        }
+    }
 }
 
-inline int rafgl_clampi(int value, int lower, int upper)
+static void __rafgl_blit_band_job(void *ctx, int band)
 {
-    if(value < lower)
-        return lower;
-    else if(value > upper)
-        return upper;
-    else return value;
+    __rafgl_blit_t *blit = ctx;
+    int row_begin = band * RAFGL_BLIT_BAND_ROWS;
+    __rafgl_blit_rows(blit, row_begin, rafgl_min_m(row_begin + RAFGL_BLIT_BAND_ROWS, blit->height));
 }
 
-inline float rafgl_clampf(float value, float lower, float upper)
+static int __rafgl_blit(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y, int mode)
 {
-    if(value < lower)
-        return lower;
-    else if(value > upper)
-        return upper;
-    else return value;
-}
+    __rafgl_blit_t blit;
+    int flc = rafgl_max_m(x, 0);
+    int frc = rafgl_min_m(x + from->width, to->width);
+    int fuc = rafgl_max_m(y, 0);
+    int fdc = rafgl_min_m(y + from->height, to->height);
+
+    if(flc >= frc || fuc >= fdc)
+        return 0;
+
+    blit.to = to;
+    blit.from = from;
+    blit.mode = mode;
+    blit.key = RAFGL_COLOUR_KEY.rgba;
+    blit.dst_x = flc;
+    blit.dst_y = fuc;
+    blit.src_x = flc - x;
+    blit.src_y = fuc - y;
+    blit.width = frc - flc;
+    blit.height = fdc - fuc;
+
+    if(blit.width * blit.height >= RAFGL_BLIT_PARALLEL_PIXELS)
+        rafgl_parallel_for((blit.height + RAFGL_BLIT_BAND_ROWS - 1) / RAFGL_BLIT_BAND_ROWS, __rafgl_blit_band_job, &blit);
+    else
+        __rafgl_blit_rows(&blit, 0, blit.height);
 
-inline int rafgl_saturatei(int value)
-{
-    return rafgl_clampi(value, 0, 255);
+    return 0;
 }
 
-inline float rafgl_saturatef(float value)
+int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y)
 {
-    return rafgl_clampf(value, 0.0f, 1.0f);
+    return __rafgl_blit(to, from, x, y, __RAFGL_BLIT_KEYED);
 }
 
-
-inline float rafgl_lerpf(float from, float to, float scale)
+int rafgl_raster_draw_raster_opaque(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y)
 {
-    return from + (to - from) * scale;
+    return __rafgl_blit(to, from, x, y, __RAFGL_BLIT_OPAQUE);
 }
 
-inline int rafgl_lerpi(int from, int to, float scale)
+int rafgl_raster_draw_raster_blend(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y)
 {
-    return from + (to - from) * scale;
+    return __rafgl_blit(to, from, x, y, __RAFGL_BLIT_BLEND);
 }
 
-inline int rafgl_calculate_pixel_brightness(rafgl_pixel_rgb_t pix)
+/* the per pixel loop rafgl_raster_draw_raster used to run, kept as the benchmark baseline */
+static void __rafgl_raster_draw_raster_reference(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y)
 {
-    return 0.3f * pix.r + 0.59f * pix.g + 0.11f * pix.b;
-}
+    int xi, yi;
+    int flc = rafgl_max_m(x, 0), frc = rafgl_min_m(x + from->width, to->width);
+    int fuc = rafgl_max_m(y, 0), fdc = rafgl_min_m(y + from->height, to->height);
+    rafgl_pixel_rgb_t sampled;
 
-inline rafgl_pixel_rgb_t rafgl_lerppix(rafgl_pixel_rgb_t from, rafgl_pixel_rgb_t to, float scale)
-{
-    from.r = rafgl_lerpi(from.r, to.r, scale);
-    from.g = rafgl_lerpi(from.g, to.g, scale);
-    from.b = rafgl_lerpi(from.b, to.b, scale);
-    from.a = rafgl_lerpi(from.a, to.a, scale);
-    return from;
+    for(yi = fuc; yi < fdc; yi++)
+    {
+        for(xi = flc; xi < frc; xi++)
+        {
+            sampled = pixel_at_pm(from, xi - x, yi - y);
+            if(sampled.rgba != RAFGL_COLOUR_KEY.rgba)
+            {
+                pixel_at_pm(to, xi, yi) = sampled;
+            }
+        }
+    }
 }
 
-rafgl_pixel_rgb_t rafgl_point_sample(rafgl_raster_t *src, float u, float v)
+static double __rafgl_raster_blit_benchmark_ms(rafgl_raster_t *to, rafgl_raster_t *from, int mode, int iterations)
 {
-    int x = rafgl_clampi(u * src -> width, 0, src -> width - 1);
-    int y = rafgl_clampi(v * src -> height, 0, src -> height - 1);
-    return pixel_at_pm(src, x, y);
+    double start = glfwGetTime();
+    int i;
+
+    for(i = 0; i < iterations; i++)
+        __rafgl_blit(to, from, 3, -2, mode);
+    return (glfwGetTime() - start) * 1000.0 / iterations;
 }
 
-rafgl_pixel_rgb_t rafgl_bilinear_sample(rafgl_raster_t *src, float u, float v)
+void rafgl_raster_blit_benchmark(int width, int height, int iterations)
 {
-    rafgl_pixel_rgb_t UL, UR, LL, LR, UM, LM;
-
-    int width = src->width, height = src->height;
-
-    u = rafgl_clampf((u * src -> width) - 0.5f, 0, src->width - 1.0f);
-    v = rafgl_clampf((v * src -> height)- 0.5f, 0, src->height - 1.0f);
-
-    int x0, y0, x1, y1;
-
-    x0 = u;
-    y0 = v;
-    x1 = x0 + 1;
-    y1 = y0 + 1;
-
-    if(x1 > width - 1) x1 = width - 1;
-    if(y1 > height - 1) y1 = height - 1;
-
-
-    float xscale = u - x0, yscale = v - y0;
+    rafgl_raster_t src, reference, fast;
+    rafgl_pixel_rgb_t saved_key = RAFGL_COLOUR_KEY;
+    double start, reference_ms, keyed_ms[2], opaque_ms[2], blend_ms[2];
+    int i, pixels = width * height, threads = rafgl_parallel_thread_count();
+    int parallel = (width - 3) * (height - 2) >= RAFGL_BLIT_PARALLEL_PIXELS && threads > 1;
+    uint32_t key = RAFGL_COLOUR_KEY.rgba;
+
+    if(key == 0)
+    {
+        key = RAFGL_COLOUR_KEY.rgba = rafgl_RGB(255, 0, 254);
+    }
 
-    UL = pixel_at_pm(src, x0, y0);
-    UR = pixel_at_pm(src, x1, y0);
-    LL = pixel_at_pm(src, x0, y1);
-    LR = pixel_at_pm(src, x1, y1);
+    rafgl_raster_init(&src, width, height);
+    rafgl_raster_init(&reference, width, height);
+    rafgl_raster_init(&fast, width, height);
 
-    UM = rafgl_lerppix(UL, UR, xscale);
-    LM = rafgl_lerppix(LL, LR, xscale);
+    /* a third of the sprite is transparent, in runs so every kernel path gets exercised */
+    srand(1);
+    for(i = 0; i < pixels; i++)
+    {
+        src.data[i].rgba = (i / 7) % 3 == 0 ? key : ((uint32_t)rand() << 8) ^ (uint32_t)rand();
+    }
 
-    return rafgl_lerppix(UM, LM, yscale);
-}
+    start = glfwGetTime();
+    for(i = 0; i < iterations; i++)
+        __rafgl_raster_draw_raster_reference(&reference, &src, 3, -2);
+    reference_ms = (glfwGetTime() - start) * 1000.0 / iterations;
 
+    /* the kernels on one thread first, then banded over the threads the caller allows when the blit is big enough to be split */
+    rafgl_parallel_set_thread_limit(1);
+    keyed_ms[0] = __rafgl_raster_blit_benchmark_ms(&fast, &src, __RAFGL_BLIT_KEYED, iterations);
+    rafgl_parallel_set_thread_limit(threads);
+    keyed_ms[1] = parallel ? __rafgl_raster_blit_benchmark_ms(&fast, &src, __RAFGL_BLIT_KEYED, iterations) : keyed_ms[0];
 
+    if(memcmp(reference.data, fast.data, pixels * sizeof(rafgl_pixel_rgb_t)))
+    {
+        rafgl_log(RAFGL_ERROR, "Keyed blit differs from the per pixel loop!\n");
+    }
 
-void rafgl_texture_init(rafgl_texture_t *tex)
-{
-    GLuint tx;
-    glGenTextures(1, &tx);
-    tex->channels = 0;
-    tex->width = 0;
-    tex->height = 0;
-    tex->tex_id = tx;
-    tex->tex_type = 0;
-}
+    rafgl_parallel_set_thread_limit(1);
+    opaque_ms[0] = __rafgl_raster_blit_benchmark_ms(&fast, &src, __RAFGL_BLIT_OPAQUE, iterations);
+    blend_ms[0] = __rafgl_raster_blit_benchmark_ms(&fast, &src, __RAFGL_BLIT_BLEND, iterations);
+    rafgl_parallel_set_thread_limit(threads);
+    opaque_ms[1] = parallel ? __rafgl_raster_blit_benchmark_ms(&fast, &src, __RAFGL_BLIT_OPAQUE, iterations) : opaque_ms[0];
+    blend_ms[1] = parallel ? __rafgl_raster_blit_benchmark_ms(&fast, &src, __RAFGL_BLIT_BLEND, iterations) : blend_ms[0];
+
+    rafgl_log(RAFGL_INFO, "[BLIT %dx%d] per pixel loop, 1 thread %.3f ms\n", width, height, reference_ms);
+    rafgl_log(RAFGL_INFO, "[BLIT %dx%d] 1 thread: keyed %.3f ms | opaque %.3f ms | blend %.3f ms\n",
+              width, height, keyed_ms[0], opaque_ms[0], blend_ms[0]);
+    if(parallel)
+    {
+        rafgl_log(RAFGL_INFO, "[BLIT %dx%d] %d threads: keyed %.3f ms | opaque %.3f ms | blend %.3f ms\n",
+                  width, height, threads, keyed_ms[1], opaque_ms[1], blend_ms[1]);
+    }
+    else
+    {
+        rafgl_log(RAFGL_INFO, "[BLIT %dx%d] not split over threads (below RAFGL_BLIT_PARALLEL_PIXELS or one core)\n", width, height);
+    }
 
-int rafgl_texture_load_basic(const char *texture_path, rafgl_texture_t *res)
-{
-    return -1;
+    RAFGL_COLOUR_KEY = saved_key;
+    rafgl_raster_cleanup(&src);
+    rafgl_raster_cleanup(&reference);
+    rafgl_raster_cleanup(&fast);
 }
 
+/* Cohen-Sutherland line clipping algorithm constants */
+static const int __cohsuth_INSIDE = 0;     /* 0000 */
+static const int __cohsuth_LEFT   = 1;     /* 0001 */
+static const int __cohsuth_RIGHT  = 2;     /* 0010 */
+static const int __cohsuth_BOTTOM = 4;     /* 0100 */
+static const int __cohsuth_TOP    = 8;     /* 1000 */
 
-
-void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *raster)
+static int __compute_outcode(int x, int y, rafgl_raster_t *raster)
 {
-    GLuint tex_slot = texture->tex_id;
-    glBindTexture(GL_TEXTURE_2D, tex_slot);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, raster->width, raster->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, raster->data);
+    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
+    int code = __cohsuth_INSIDE;
+    if(x < xmin)
+    {
+        code |= __cohsuth_LEFT;
+    }
+    else if(x > xmax)
+    {
+        code |= __cohsuth_RIGHT;
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if(y < ymin)
+    {
+        code |= __cohsuth_BOTTOM;
+    }
+    else if(y > ymax)
+    {
+        code |= __cohsuth_TOP;
+    }
 
-    texture->tex_id = tex_slot;
-    texture->width = raster->width;
-    texture->height = raster->height;
-    texture->channels = 3;
-    texture->tex_type = GL_TEXTURE_2D;
+    return code;
 }
 
-
-void rafgl_texture_show(const rafgl_texture_t *texture, int flip)
+/* clips the line to the raster, returns 0 when no part of it is visible */
+static int __rafgl_raster_clip_line(rafgl_raster_t *raster, int *px0, int *py0, int *px1, int *py1)
 {
+    int x0 = *px0, y0 = *py0, x1 = *px1, y1 = *py1;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
-
-    glBindVertexArray(__raster_vao);
-    glUseProgram(__raster_program);
-
-    glUniform1f(__flip, flip);
-
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-    glUseProgram(0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
+    int outcode0 = __compute_outcode(x0, y0, raster);
+    int outcode1 = __compute_outcode(x1, y1, raster);
+    int accept = 0;
+    int xnew, ynew;
+    int outside_outcode;
 
-}
+    while(1)
+    {
 
-void rafgl_texture_cleanup(rafgl_texture_t *texture)
-{
-    glDeleteTextures(1, &(texture->tex_id));
-    texture->channels = 0;
-    texture->height = 0;
-    texture->width = 0;
-    texture->tex_id = 0;
-    texture->tex_type = 0;
-    return;
+        if(!(outcode0 | outcode1))
+        {
+            /* trivijalno prihvatanje */
+            accept = 1;
+            break;
+        }
+        else if(outcode0 & outcode1)
+        {
+            /* trivijalno odbacivanje */
+            break;
+        }
+        else
+        {
+            outside_outcode = outcode0 ? outcode0 : outcode1;
+            if(outside_outcode & __cohsuth_TOP)
+            {
+                xnew = x0 + (x1 - x0) * (ymax - y0) / (y1 - y0);
+                ynew = ymax;
+            }
+            else if(outside_outcode & __cohsuth_BOTTOM)
+            {
+                xnew = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
+				ynew = ymin;
+            }
+            else if (outside_outcode & __cohsuth_RIGHT)
+            {
+				ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
+				xnew = xmax;
+			}
+			else if (outside_outcode & __cohsuth_LEFT)
+            {
+				ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
+				xnew = xmin;
+			}
+
+			if(outside_outcode == outcode0)
+            {
+                x0 = xnew;
+                y0 = ynew;
+                outcode0 = __compute_outcode(x0, y0, raster);
+            }
+            else
+            {
+                x1 = xnew;
+                y1 = ynew;
+                outcode1 = __compute_outcode(x1, y1, raster);
+            }
+        }
+
+
+    }
+
+
+    if(!accept)
+        return 0;
+
+    *px0 = rafgl_clampi(x0, 0, xmax);
+    *py0 = rafgl_clampi(y0, 0, ymax);
+    *px1 = rafgl_clampi(x1, 0, xmax);
+    *py1 = rafgl_clampi(y1, 0, ymax);
+    return 1;
 }
 
-void rafgl_texture_load_cubemap_named(rafgl_texture_t *tex, const char *cubemap_name, const char *file_ext)
+void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
 {
-    char cubemap_paths[6][128];
-    char *pcubemap_paths[6] = {&cubemap_paths[0][0], &cubemap_paths[1][0], &cubemap_paths[2][0], &cubemap_paths[3][0], &cubemap_paths[4][0], &cubemap_paths[5][0]};
-    char names[6][3] = {"/E", "/W", "/U", "/D", "/N", "/S"};
-    int i;
-    for(i = 0; i < 6; i++)
+    if(!__rafgl_raster_clip_line(raster, &x0, &y0, &x1, &y1))
+        return;
+
+    /* printf("---\nx0: %d\ny0: %d\nx1: %d\ny1: %d\n", x0, y0, x1, y1); */
+
+    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
+    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
+    int err = dx+dy, e2; /* error value e_xy */
+
+    while(1)
     {
-        strcpy(cubemap_paths[i], "res/cubemaps/");
-        strcat(cubemap_paths[i], cubemap_name);
-        strcat(cubemap_paths[i], names[i]);
-        strcat(cubemap_paths[i], ".");
-        strcat(cubemap_paths[i], file_ext);
+        pixel_at_pm(raster, x0, y0).rgba = colour;
+        if (x0==x1 && y0==y1) break;
+        e2 = 2*err;
+        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
+        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
     }
 
-    rafgl_texture_load_cubemap(tex, pcubemap_paths);
 }
 
-void rafgl_texture_load_cubemap(rafgl_texture_t *tex, const char *cubemap_paths[])
+/* DOES NOT DO CLIPPING! */
+void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour)
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, tex->tex_id);
+    int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */
+    do {
+        pixel_at_pm(raster, cx-x, cy+y).rgba = colour; /*   I. Quadrant */
+        pixel_at_pm(raster, cx-y, cy-x).rgba = colour; /*  II. Quadrant */
+        pixel_at_pm(raster, cx+x, cy-y).rgba = colour; /* III. Quadrant */
+        pixel_at_pm(raster, cx+y, cy+x).rgba = colour; /*  IV. Quadrant */
+        r = err;
+        if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
+        if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
+    } while (x < 0);
+}
 
-    int width, height, channels;
-    unsigned char *data;
-    GLuint i;
-    for(i = 0; i < 6; i++)
+void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour)
+{
+    rafgl_raster_draw_line(raster, x0, y0, x0 + w, y0, colour);
+    rafgl_raster_draw_line(raster, x0, y0 + h, x0 + w, y0 + h, colour);
+    rafgl_raster_draw_line(raster, x0, y0, x0, y0 + h, colour);
+    rafgl_raster_draw_line(raster, x0 + w, y0, x0 + w, y0 + h, colour);
+}
+
+/* fills count pixels with colour, grey levels go through memset, everything else through 4 pixel stores */
+static inline void __rafgl_raster_fill_span(rafgl_pixel_rgb_t *dst, int count, uint32_t colour)
+{
+    int i = 0;
+
+    if((colour & 0xff) * 0x01010101u == colour)
     {
-        data = stbi_load(cubemap_paths[i], &width, &height, &channels, 4);
-        if (!data)
-        {
-            rafgl_log(RAFGL_ERROR, "Failed to load texture at path [%s] intended for a cubemap!\n", cubemap_paths[i]);
-        }
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        free(data);
+        memset(dst, colour & 0xff, count * sizeof(rafgl_pixel_rgb_t));
+        return;
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+#if defined(__SSE2__)
+    __m128i colour4 = _mm_set1_epi32((int)colour);
+    for(; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i*)(dst + i), colour4);
+    }
+#endif // __SSE2__
 
-    tex->tex_type = GL_TEXTURE_CUBE_MAP;
+    for(; i < count; i++)
+    {
+        dst[i].rgba = colour;
+    }
+}
 
+#define RAFGL_RASTER_BATCH_TILE_SIZE 64
 
+enum
+{
+    __RAFGL_PRIMITIVE_NONE,
+    __RAFGL_PRIMITIVE_LINE,
+    __RAFGL_PRIMITIVE_LINE_PIECE,
+    __RAFGL_PRIMITIVE_FILL_RECTANGLE,
+    __RAFGL_PRIMITIVE_CIRCLE,
+    __RAFGL_PRIMITIVE_FILL_CIRCLE
+};
 
+void rafgl_raster_batch_init(rafgl_raster_batch_t *batch)
+{
+    memset(batch, 0, sizeof(*batch));
 }
 
-
-rafgl_framebuffer_multitarget_t rafgl_framebuffer_multitarget_create(int w, int h, int num_attachments)
+static int __rafgl_raster_batch_push(rafgl_raster_batch_t *batch, int type, int x0, int y0, int x1, int y1, uint32_t colour)
 {
-    if(num_attachments > 16)
+    rafgl_raster_primitive_t *p;
+
+    if(batch->primitive_count == batch->primitive_capacity)
     {
-        rafgl_log(RAFGL_WARNING, "Cant make %d attachments to a fbo, using 16 instead!\n", num_attachments);
-        num_attachments = 16;
+        batch->primitive_capacity = batch->primitive_capacity ? batch->primitive_capacity * 2 : 256;
+        batch->primitives = realloc(batch->primitives, batch->primitive_capacity * sizeof(rafgl_raster_primitive_t));
     }
-    GLuint framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-    rafgl_framebuffer_multitarget_t fb_mt;
 
-    fb_mt.width = w;
-    fb_mt.height = h;
+    p = &batch->primitives[batch->primitive_count++];
+    p->type = type;
+    p->x0 = x0;
+    p->y0 = y0;
+    p->x1 = x1;
+    p->y1 = y1;
+    p->colour = colour;
+    return batch->primitive_count - 1;
+}
 
-    fb_mt.fbo_id = framebuffer;
-    fb_mt.num_textures = num_attachments;
+void rafgl_raster_batch_line(rafgl_raster_batch_t *batch, int x0, int y0, int x1, int y1, uint32_t colour)
+{
+    __rafgl_raster_batch_push(batch, __RAFGL_PRIMITIVE_LINE, x0, y0, x1, y1, colour);
+}
 
-    GLuint texture_colour_buffer;
-    int i;
+void rafgl_raster_batch_rectangle(rafgl_raster_batch_t *batch, int x0, int y0, int w, int h, uint32_t colour)
+{
+    rafgl_raster_batch_line(batch, x0, y0, x0 + w, y0, colour);
+    rafgl_raster_batch_line(batch, x0, y0 + h, x0 + w, y0 + h, colour);
+    rafgl_raster_batch_line(batch, x0, y0, x0, y0 + h, colour);
+    rafgl_raster_batch_line(batch, x0 + w, y0, x0 + w, y0 + h, colour);
+}
 
-    for(i = 0; i < num_attachments; i++)
-    {
-        glGenTextures(1, &texture_colour_buffer);
-        glBindTexture(GL_TEXTURE_2D, texture_colour_buffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+void rafgl_raster_batch_fill_rectangle(rafgl_raster_batch_t *batch, int x0, int y0, int w, int h, uint32_t colour)
+{
+    if(w <= 0 || h <= 0)
+        return;
+    __rafgl_raster_batch_push(batch, __RAFGL_PRIMITIVE_FILL_RECTANGLE, x0, y0, x0 + w - 1, y0 + h - 1, colour);
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void rafgl_raster_batch_circle(rafgl_raster_batch_t *batch, int cx, int cy, int r, uint32_t colour)
+{
+    __rafgl_raster_batch_push(batch, __RAFGL_PRIMITIVE_CIRCLE, cx, cy, r, 0, colour);
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+void rafgl_raster_batch_fill_circle(rafgl_raster_batch_t *batch, int cx, int cy, int r, uint32_t colour)
+{
+    __rafgl_raster_batch_push(batch, __RAFGL_PRIMITIVE_FILL_CIRCLE, cx, cy, r, 0, colour);
+}
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+void rafgl_raster_batch_span(rafgl_raster_batch_t *batch, int x, int y, int length, uint32_t colour)
+{
+    rafgl_raster_batch_fill_rectangle(batch, x, y, length, 1, colour);
+}
 
-        glBindTexture(GL_TEXTURE_2D, 0);
+/* clips the primitive against the raster and returns its inclusive pixel bounds, 0 if nothing is visible */
+static int __rafgl_raster_batch_resolve(rafgl_raster_primitive_t *p, rafgl_raster_t *raster, int *bx0, int *by0, int *bx1, int *by1)
+{
+    int r;
 
-        // attach it to currently bound framebuffer object
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, texture_colour_buffer, 0);
-        fb_mt.tex_ids[i] = texture_colour_buffer;
+    switch(p->type)
+    {
+    case __RAFGL_PRIMITIVE_LINE:
+        if(!__rafgl_raster_clip_line(raster, &p->x0, &p->y0, &p->x1, &p->y1))
+            return 0;
+        *bx0 = rafgl_min_m(p->x0, p->x1);
+        *bx1 = rafgl_max_m(p->x0, p->x1);
+        *by0 = rafgl_min_m(p->y0, p->y1);
+        *by1 = rafgl_max_m(p->y0, p->y1);
+        return 1;
+
+    case __RAFGL_PRIMITIVE_FILL_RECTANGLE:
+        p->x0 = rafgl_max_m(p->x0, 0);
+        p->y0 = rafgl_max_m(p->y0, 0);
+        p->x1 = rafgl_min_m(p->x1, raster->width - 1);
+        p->y1 = rafgl_min_m(p->y1, raster->height - 1);
+        if(p->x0 > p->x1 || p->y0 > p->y1)
+            return 0;
+        *bx0 = p->x0;
+        *by0 = p->y0;
+        *bx1 = p->x1;
+        *by1 = p->y1;
+        return 1;
+
+    case __RAFGL_PRIMITIVE_CIRCLE:
+    case __RAFGL_PRIMITIVE_FILL_CIRCLE:
+        r = p->x1;
+        if(r < 0)
+            return 0;
+        *bx0 = rafgl_max_m(p->x0 - r, 0);
+        *by0 = rafgl_max_m(p->y0 - r, 0);
+        *bx1 = rafgl_min_m(p->x0 + r, raster->width - 1);
+        *by1 = rafgl_min_m(p->y0 + r, raster->height - 1);
+        return *bx0 <= *bx1 && *by0 <= *by1;
     }
 
+    return 0;
+}
 
+#define __rafgl_in_tile(x, y) ((x) >= tx0 && (x) <= tx1 && (y) >= ty0 && (y) <= ty1)
 
-    GLuint rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+/* draws the part of an already resolved primitive that falls into the inclusive tile rectangle */
+static void __rafgl_raster_batch_draw_in_tile(rafgl_raster_t *raster, const rafgl_raster_primitive_t *p, int tx0, int ty0, int tx1, int ty1)
+{
+    int x0 = p->x0, y0 = p->y0, x1 = p->x1, y1 = p->y1;
+    uint32_t colour = p->colour;
+    int xa, xb, ya, yb, x, y, r;
 
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+    switch(p->type)
+    {
+    case __RAFGL_PRIMITIVE_LINE:
+        if(y0 == y1)
+        {
+            xa = rafgl_max_m(rafgl_min_m(x0, x1), tx0);
+            xb = rafgl_min_m(rafgl_max_m(x0, x1), tx1);
+            if(y0 >= ty0 && y0 <= ty1 && xa <= xb)
+                __rafgl_raster_fill_span(&pixel_at_pm(raster, xa, y0), xb - xa + 1, colour);
+        }
+        else if(x0 == x1)
+        {
+            ya = rafgl_max_m(rafgl_min_m(y0, y1), ty0);
+            yb = rafgl_min_m(rafgl_max_m(y0, y1), ty1);
+            if(x0 >= tx0 && x0 <= tx1)
+                for(y = ya; y <= yb; y++)
+                    pixel_at_pm(raster, x0, y).rgba = colour;
+        }
+        break;
 
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-	{
-	    rafgl_log(RAFGL_ERROR, "Failed to create framebuffer!\n");
-	}
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    case __RAFGL_PRIMITIVE_LINE_PIECE:
+    {
+        /* continues the walk of rafgl_raster_draw_line from where the line entered this tile, until it leaves it.
+           The walk is monotonic in both axes so a line never comes back into a tile it has left */
+        int dx =  rafgl_abs_m(p->dx), sx = p->dx > 0 ? 1 : -1;
+        int dy = -rafgl_abs_m(p->dy), sy = p->dy > 0 ? 1 : -1;
+        int err = p->err, e2;
 
-    return fb_mt;
+        while(1)
+        {
+            pixel_at_pm(raster, x0, y0).rgba = colour;
+            if (x0==x1 && y0==y1) break;
+            e2 = 2*err;
+            if (e2 >= dy) { err += dy; x0 += sx; }
+            if (e2 <= dx) { err += dx; y0 += sy; }
+            if(x0 < tx0 || x0 > tx1 || y0 < ty0 || y0 > ty1) break;
+        }
+        break;
+    }
+
+    case __RAFGL_PRIMITIVE_FILL_RECTANGLE:
+        xa = rafgl_max_m(x0, tx0);
+        xb = rafgl_min_m(x1, tx1);
+        ya = rafgl_max_m(y0, ty0);
+        yb = rafgl_min_m(y1, ty1);
+        if(xa > xb)
+            break;
+        for(y = ya; y <= yb; y++)
+            __rafgl_raster_fill_span(&pixel_at_pm(raster, xa, y), xb - xa + 1, colour);
+        break;
 
+    case __RAFGL_PRIMITIVE_CIRCLE:
+    {
+        /* same walk as rafgl_raster_draw_circle */
+        int cx = x0, cy = y0, err;
+        r = x1;
+        x = -r;
+        y = 0;
+        err = 2-2*r;
+        do {
+            if(__rafgl_in_tile(cx-x, cy+y)) pixel_at_pm(raster, cx-x, cy+y).rgba = colour;
+            if(__rafgl_in_tile(cx-y, cy-x)) pixel_at_pm(raster, cx-y, cy-x).rgba = colour;
+            if(__rafgl_in_tile(cx+x, cy-y)) pixel_at_pm(raster, cx+x, cy-y).rgba = colour;
+            if(__rafgl_in_tile(cx+y, cy+x)) pixel_at_pm(raster, cx+y, cy+x).rgba = colour;
+            r = err;
+            if (r <= y) err += ++y*2+1;
+            if (r > x || err > y) err += ++x*2+1;
+        } while (x < 0);
+        break;
+    }
 
+    case __RAFGL_PRIMITIVE_FILL_CIRCLE:
+    {
+        int half, rest;
+        r = x1;
+        ya = rafgl_max_m(y0 - r, ty0);
+        yb = rafgl_min_m(y0 + r, ty1);
+        for(y = ya; y <= yb; y++)
+        {
+            /* widest half that still satisfies dx^2 + dy^2 <= r^2 */
+            rest = r * r - (y - y0) * (y - y0);
+            half = sqrtf(rest);
+            while(half * half > rest) half--;
+            while((half + 1) * (half + 1) <= rest) half++;
+
+            xa = rafgl_max_m(x0 - half, tx0);
+            xb = rafgl_min_m(x0 + half, tx1);
+            if(xa <= xb)
+                __rafgl_raster_fill_span(&pixel_at_pm(raster, xa, y), xb - xa + 1, colour);
+        }
+        break;
+    }
+    }
 }
 
-rafgl_framebuffer_simple_t rafgl_framebuffer_simple_create(int w, int h)
-{
+#undef __rafgl_in_tile
 
-    GLuint framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+static void __rafgl_raster_batch_bin(rafgl_raster_batch_t *batch, int tile, int index)
+{
+    if(batch->bin_counts[tile] == batch->bin_capacities[tile])
+    {
+        batch->bin_capacities[tile] = batch->bin_capacities[tile] ? batch->bin_capacities[tile] * 2 : 64;
+        batch->bins[tile] = realloc(batch->bins[tile], batch->bin_capacities[tile] * sizeof(int));
+    }
+    batch->bins[tile][batch->bin_counts[tile]++] = index;
+}
 
+/* walks a clipped diagonal line once and gives every tile it crosses a piece that starts with the walk state at the tile border */
+static void __rafgl_raster_batch_bin_line(rafgl_raster_batch_t *batch, int index)
+{
+    rafgl_raster_primitive_t line = batch->primitives[index];
+    int x0 = line.x0, y0 = line.y0, x1 = line.x1, y1 = line.y1;
+    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
+    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
+    int err = dx+dy, e2;
+    int tile = -1, current, piece;
 
-    GLuint texture_colour_buffer;
-    glGenTextures(1, &texture_colour_buffer);
-    glBindTexture(GL_TEXTURE_2D, texture_colour_buffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    while(1)
+    {
+        current = (y0 / RAFGL_RASTER_BATCH_TILE_SIZE) * batch->tiles_x + x0 / RAFGL_RASTER_BATCH_TILE_SIZE;
+        if(current != tile)
+        {
+            tile = current;
+            piece = __rafgl_raster_batch_push(batch, __RAFGL_PRIMITIVE_LINE_PIECE, x0, y0, x1, y1, line.colour);
+            batch->primitives[piece].err = err;
+            batch->primitives[piece].dx = line.x1 - line.x0;
+            batch->primitives[piece].dy = line.y1 - line.y0;
+            __rafgl_raster_batch_bin(batch, tile, piece);
+        }
+        if (x0==x1 && y0==y1) break;
+        e2 = 2*err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
 
-    // attach it to currently bound framebuffer object
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_colour_buffer, 0);
+typedef struct
+{
+    rafgl_raster_batch_t *batch;
+    rafgl_raster_t *raster;
+    int *tiles;
+} __rafgl_raster_batch_job_t;
 
-    GLuint rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+static void __rafgl_raster_batch_tile_job(void *ctx, int index)
+{
+    __rafgl_raster_batch_job_t *job = ctx;
+    rafgl_raster_batch_t *batch = job->batch;
+    int tile = job->tiles[index];
+    int tx0 = (tile % batch->tiles_x) * RAFGL_RASTER_BATCH_TILE_SIZE;
+    int ty0 = (tile / batch->tiles_x) * RAFGL_RASTER_BATCH_TILE_SIZE;
+    int tx1 = rafgl_min_m(tx0 + RAFGL_RASTER_BATCH_TILE_SIZE, job->raster->width) - 1;
+    int ty1 = rafgl_min_m(ty0 + RAFGL_RASTER_BATCH_TILE_SIZE, job->raster->height) - 1;
+    int i;
+
+    for(i = 0; i < batch->bin_counts[tile]; i++)
+    {
+        __rafgl_raster_batch_draw_in_tile(job->raster, &batch->primitives[batch->bins[tile][i]], tx0, ty0, tx1, ty1);
+    }
+}
+
+void rafgl_raster_batch_flush(rafgl_raster_batch_t *batch, rafgl_raster_t *raster)
+{
+    int tiles_x = (raster->width + RAFGL_RASTER_BATCH_TILE_SIZE - 1) / RAFGL_RASTER_BATCH_TILE_SIZE;
+    int tiles_y = (raster->height + RAFGL_RASTER_BATCH_TILE_SIZE - 1) / RAFGL_RASTER_BATCH_TILE_SIZE;
+    int i, tx, ty, tile, bx0, by0, bx1, by1, used_tiles = 0;
+    int submitted = batch->primitive_count;
+    rafgl_raster_primitive_t *p;
+    __rafgl_raster_batch_job_t job;
+
+    if(tiles_x != batch->tiles_x || tiles_y != batch->tiles_y)
+    {
+        for(i = 0; i < batch->tiles_x * batch->tiles_y; i++)
+        {
+            free(batch->bins[i]);
+        }
+        free(batch->bins);
+        free(batch->bin_counts);
+        free(batch->bin_capacities);
+
+        batch->tiles_x = tiles_x;
+        batch->tiles_y = tiles_y;
+        batch->bins = calloc(tiles_x * tiles_y, sizeof(int*));
+        batch->bin_counts = calloc(tiles_x * tiles_y, sizeof(int));
+        batch->bin_capacities = calloc(tiles_x * tiles_y, sizeof(int));
+    }
+    else
+    {
+        memset(batch->bin_counts, 0, tiles_x * tiles_y * sizeof(int));
+    }
+
+    /* pieces of diagonal lines get appended behind the submitted primitives while binning */
+    for(i = 0; i < submitted; i++)
+    {
+        p = &batch->primitives[i];
+        if(!__rafgl_raster_batch_resolve(p, raster, &bx0, &by0, &bx1, &by1))
+            continue;
+
+        if(p->type == __RAFGL_PRIMITIVE_LINE && p->x0 != p->x1 && p->y0 != p->y1)
+        {
+            __rafgl_raster_batch_bin_line(batch, i);
+            continue;
+        }
+
+        for(ty = by0 / RAFGL_RASTER_BATCH_TILE_SIZE; ty <= by1 / RAFGL_RASTER_BATCH_TILE_SIZE; ty++)
+        {
+            for(tx = bx0 / RAFGL_RASTER_BATCH_TILE_SIZE; tx <= bx1 / RAFGL_RASTER_BATCH_TILE_SIZE; tx++)
+            {
+                __rafgl_raster_batch_bin(batch, ty * tiles_x + tx, i);
+            }
+        }
+    }
+
+    job.batch = batch;
+    job.raster = raster;
+    job.tiles = malloc(tiles_x * tiles_y * sizeof(int));
+    for(tile = 0; tile < tiles_x * tiles_y; tile++)
+    {
+        if(batch->bin_counts[tile])
+            job.tiles[used_tiles++] = tile;
+    }
+
+    rafgl_parallel_for(used_tiles, __rafgl_raster_batch_tile_job, &job);
+
+    free(job.tiles);
+    batch->primitive_count = 0;
+}
+
+void rafgl_raster_batch_cleanup(rafgl_raster_batch_t *batch)
+{
+    int i;
+    for(i = 0; i < batch->tiles_x * batch->tiles_y; i++)
+    {
+        free(batch->bins[i]);
+    }
+    free(batch->bins);
+    free(batch->bin_counts);
+    free(batch->bin_capacities);
+    free(batch->primitives);
+    memset(batch, 0, sizeof(*batch));
+}
+
+void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from)
+{
+    int x, y;
+    int w = to->width, h = to->height;
+    float xn, yn;
+
+    for(y = 0; y < h; y++)
+    {
+        yn = ((float)y) / h;
+        for(x = 0; x < w; x++)
+        {
+            xn = ((float)x) / w;
+            pixel_at_pm(to, x, y) = rafgl_bilinear_sample(from, xn, yn);
+        }
+    }
+}
+
+
+void rafgl_game_add_game_state(rafgl_game_t *game, void (*init)(GLFWwindow *window, void *args), void (*update)(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args), void (*render)(GLFWwindow *window, void *args), void (*cleanup)(GLFWwindow *window, void *args))
+{
+    rafgl_game_state_t state;
+    state.init = init;
+    state.update = update;
+    state.render = render;
+    state.cleanup = cleanup;
+    state.id = 0;
+
+    rafgl_vector_append(&game->game_states, &state);
+}
+
+static int __rafgl_log_fps = 0;
+static int __game_state_change_request = -1;
+static void *__game_state_change_request_args = NULL;
+
+void rafgl_log_fps(int b)
+{
+    __rafgl_log_fps = b;
+}
+
+static float __fixed_timestep = 0.0f, __interpolation = 1.0f;
+static float __frame_limit = 0.0f;
+static int __benchmark = 0, __benchmark_frames = 0;
+static void __rafgl_program_cache_report(double init_ms);
+static void __rafgl_frame_arena_after_init(void);
+static void __rafgl_render_target_frame(void);
+static void __rafgl_render_target_cleanup(void);
+static void __rafgl_program_watch_frame(void);
+static void __rafgl_program_watch_stop(void);
+static float *__frame_times = NULL;
+static int __frame_time_count = 0, __frame_time_capacity = 0;
+
+void rafgl_game_set_fixed_timestep(float step)
+{
+    __fixed_timestep = step;
+    __interpolation = 1.0f;
+}
+
+float rafgl_game_interpolation(void)
+{
+    return __interpolation;
+}
+
+void rafgl_game_set_frame_limit(float fps)
+{
+    __frame_limit = fps;
+}
+
+void rafgl_game_set_benchmark(int frames)
+{
+    __benchmark = 1;
+    __benchmark_frames = frames;
+}
+
+static int __pipelined = 0;
+static void *__packets[2] = {NULL, NULL};
+static int __update_packet = 0, __render_packet = 0, __packet_size = 0;
+
+void rafgl_game_set_pipelined(int b)
+{
+    __pipelined = b;
+}
+
+void rafgl_game_set_packet_size(int size)
+{
+    free(__packets[0]);
+    free(__packets[1]);
+    __packets[0] = calloc(1, size);
+    __packets[1] = calloc(1, size);
+    __packet_size = size;
+    __update_packet = __render_packet = 0;
+}
+
+void* rafgl_game_update_packet(void)
+{
+    return __packets[__update_packet];
+}
+
+void* rafgl_game_render_packet(void)
+{
+    return __packets[__render_packet];
+}
+
+/* everything the updates of one frame need, the update thread gets it from the main thread once the input is in */
+typedef struct _rafgl_update_job_t
+{
+    GLFWwindow *window;
+    rafgl_game_state_t *state;
+    rafgl_game_data_t *game_data;
+    void *args;
+    float elapsed;
+    float accumulator;
+    float interpolation;
+    /* how many updates the last run made, the packets only swap when there was one */
+    int updates;
+} rafgl_update_job_t;
+
+static rafgl_update_job_t __update_job;
+static pthread_t __update_thread;
+static pthread_mutex_t __update_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __update_cond = PTHREAD_COND_INITIALIZER;
+static int __update_pending = 0, __update_quit = 0, __update_thread_running = 0;
+
+/* the cursor is read again before every update when it runs on the main thread, the one before may have moved it. A key press goes to the first update that runs after it */
+static void __rafgl_run_updates(rafgl_update_job_t *job, int read_cursor)
+{
+    int updates;
+
+    if(__fixed_timestep > 0.0f)
+    {
+        job->accumulator += job->elapsed;
+        for(updates = 0; job->accumulator >= __fixed_timestep && updates < RAFGL_MAX_FIXED_UPDATES; updates++)
+        {
+            if(read_cursor)
+                glfwGetCursorPos(job->window, &job->game_data->mouse_pos_x, &job->game_data->mouse_pos_y);
+            job->state->update(job->window, __fixed_timestep, job->game_data, job->args);
+            memset(__keys_pressed, 0, sizeof(__keys_pressed));
+            job->accumulator -= __fixed_timestep;
+        }
+        if(job->accumulator >= __fixed_timestep)
+            job->accumulator = fmodf(job->accumulator, __fixed_timestep);
+        job->interpolation = job->accumulator / __fixed_timestep;
+        job->updates = updates;
+    }
+    else
+    {
+        if(read_cursor)
+            glfwGetCursorPos(job->window, &job->game_data->mouse_pos_x, &job->game_data->mouse_pos_y);
+        job->state->update(job->window, job->elapsed, job->game_data, job->args);
+        memset(__keys_pressed, 0, sizeof(__keys_pressed));
+        job->interpolation = 1.0f;
+        job->updates = 1;
+    }
+}
+
+static void* __rafgl_update_worker(void *arg)
+{
+    pthread_mutex_lock(&__update_mutex);
+    for(;;)
+    {
+        while(!__update_pending && !__update_quit)
+            pthread_cond_wait(&__update_cond, &__update_mutex);
+        if(!__update_pending)
+            break;
+        pthread_mutex_unlock(&__update_mutex);
+
+        __rafgl_run_updates(&__update_job, 0);
+
+        pthread_mutex_lock(&__update_mutex);
+        __update_pending = 0;
+        pthread_cond_broadcast(&__update_cond);
+    }
+    pthread_mutex_unlock(&__update_mutex);
+    return NULL;
+}
+
+static void __rafgl_update_kick(void)
+{
+    pthread_mutex_lock(&__update_mutex);
+    __update_pending = 1;
+    pthread_cond_broadcast(&__update_cond);
+    pthread_mutex_unlock(&__update_mutex);
+}
+
+static void __rafgl_update_wait(void)
+{
+    pthread_mutex_lock(&__update_mutex);
+    while(__update_pending)
+        pthread_cond_wait(&__update_cond, &__update_mutex);
+    pthread_mutex_unlock(&__update_mutex);
+}
+
+/* what the last updates filled is drawn next, the packet render just finished with is filled next.
+   Without an update the update packet still holds what render drew two frames ago, render keeps the newer one */
+static void __rafgl_packets_flip(void)
+{
+    if(__update_job.updates)
+    {
+        __render_packet = __update_packet;
+        __update_packet = !__update_packet;
+    }
+    __interpolation = __update_job.interpolation;
+}
+
+/* one real update on the main thread, copied into both packets, so render has something filled to draw whether or not the next frame updates */
+static void __rafgl_update_prime(void)
+{
+    __update_packet = 1;
+    __update_job.elapsed = 0.0f;
+    __update_job.accumulator = __fixed_timestep;
+    __rafgl_run_updates(&__update_job, 1);
+    __update_job.accumulator = 0.0f;
+    if(__packets[0] && __packets[1])
+        memcpy(__packets[0], __packets[1], __packet_size);
+    __rafgl_packets_flip();
+}
+
+static void __rafgl_frame_time_add(float ms)
+{
+    if(__frame_time_count == __frame_time_capacity)
+    {
+        __frame_time_capacity = __frame_time_capacity ? __frame_time_capacity * 2 : 1024;
+        __frame_times = realloc(__frame_times, __frame_time_capacity * sizeof(float));
+    }
+    __frame_times[__frame_time_count++] = ms;
+}
+
+static int __rafgl_float_compare(const void *a, const void *b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+static void __rafgl_frame_time_report(void)
+{
+    static const float percentiles[] = {50.0f, 90.0f, 95.0f, 99.0f, 99.9f};
+    double total = 0.0;
+    int i;
+
+    if(__frame_time_count == 0)
+        return;
+
+    for(i = 0; i < __frame_time_count; i++)
+        total += __frame_times[i];
+    qsort(__frame_times, __frame_time_count, sizeof(float), __rafgl_float_compare);
+
+    rafgl_log(RAFGL_INFO, "[BENCHMARK] %d frames, %.3f ms average (%.1f FPS)\n", __frame_time_count, total / __frame_time_count, 1000.0 * __frame_time_count / total);
+    for(i = 0; i < (int)(sizeof(percentiles) / sizeof(percentiles[0])); i++)
+        rafgl_log(RAFGL_INFO, "[BENCHMARK] p%-5g %8.3f ms\n", percentiles[i], __frame_times[(int)(percentiles[i] / 100.0f * (__frame_time_count - 1) + 0.5f)]);
+    rafgl_log(RAFGL_INFO, "[BENCHMARK] max    %8.3f ms\n", __frame_times[__frame_time_count - 1]);
+
+    free(__frame_times);
+    __frame_times = NULL;
+    __frame_time_count = __frame_time_capacity = 0;
+}
+
+/* sleeps most of the way and spins the last stretch, sleeps overshoot by up to a scheduler tick */
+static void __rafgl_wait_until(double time)
+{
+    double remaining;
+
+    while((remaining = time - glfwGetTime()) > 0.002)
+        usleep((useconds_t)((remaining - 0.002) * 1000000.0));
+    while(glfwGetTime() < time);
+}
+
+/* profiler: every scope gets a pair of GL_TIMESTAMP queries (timestamps, unlike GL_TIME_ELAPSED, can nest),
+   results are added to per name totals once the frame that issued them is RAFGL_PROFILER_LATENCY frames old */
+typedef struct
+{
+    const char *name;
+    int depth;
+    double cpu_begin, cpu_ms;
+} __rafgl_profiler_scope_t;
+
+typedef struct
+{
+    const char *name;
+    int depth;
+    double gpu_ms, cpu_ms;
+    int samples;
+} __rafgl_profiler_stat_t;
+
+static int __profiler_enabled = 0;
+static GLuint __profiler_queries[RAFGL_PROFILER_LATENCY][RAFGL_PROFILER_SCOPES * 2];
+static __rafgl_profiler_scope_t __profiler_scopes[RAFGL_PROFILER_LATENCY][RAFGL_PROFILER_SCOPES];
+static int __profiler_scope_count[RAFGL_PROFILER_LATENCY];
+static int __profiler_frame = 0, __profiler_period_frames = 0;
+static int __profiler_stack[RAFGL_PROFILER_SCOPES], __profiler_stack_depth = 0;
+static __rafgl_profiler_stat_t __profiler_stats[RAFGL_PROFILER_SCOPES];
+static int __profiler_stat_count = 0;
+
+/* counters are CPU only and need no latency, they are averaged over the frames since the last report */
+typedef struct
+{
+    const char *name;
+    long long total;
+} __rafgl_profiler_counter_t;
+
+static __rafgl_profiler_counter_t __profiler_counters[RAFGL_PROFILER_SCOPES];
+static int __profiler_counter_count = 0, __profiler_counter_frames = 0;
+
+void rafgl_profiler_enable(int b)
+{
+    if(b && !__profiler_queries[0][0])
+    {
+        glGenQueries(RAFGL_PROFILER_LATENCY * RAFGL_PROFILER_SCOPES * 2, &__profiler_queries[0][0]);
+    }
+    __profiler_enabled = b;
+}
+
+void rafgl_profiler_begin(const char *name)
+{
+    int slot = __profiler_frame % RAFGL_PROFILER_LATENCY;
+    int scope = __profiler_scope_count[slot];
+
+    if(!__profiler_enabled)
+        return;
+
+    if(scope == RAFGL_PROFILER_SCOPES || __profiler_stack_depth == RAFGL_PROFILER_SCOPES)
+    {
+        /* still pushed so the matching end stays balanced */
+        __profiler_stack[__profiler_stack_depth++] = -1;
+        return;
+    }
+
+    __profiler_scopes[slot][scope].name = name;
+    __profiler_scopes[slot][scope].depth = __profiler_stack_depth;
+    __profiler_scopes[slot][scope].cpu_begin = glfwGetTime();
+    glQueryCounter(__profiler_queries[slot][scope * 2], GL_TIMESTAMP);
+
+    __profiler_stack[__profiler_stack_depth++] = scope;
+    __profiler_scope_count[slot]++;
+}
+
+void rafgl_profiler_end(void)
+{
+    int slot = __profiler_frame % RAFGL_PROFILER_LATENCY;
+    int scope;
+
+    if(!__profiler_enabled || __profiler_stack_depth == 0)
+        return;
+
+    scope = __profiler_stack[--__profiler_stack_depth];
+    if(scope < 0)
+        return;
+
+    glQueryCounter(__profiler_queries[slot][scope * 2 + 1], GL_TIMESTAMP);
+    __profiler_scopes[slot][scope].cpu_ms = (glfwGetTime() - __profiler_scopes[slot][scope].cpu_begin) * 1000.0;
+}
+
+void rafgl_profiler_count(const char *name, int value)
+{
+    int i;
+
+    if(!__profiler_enabled)
+        return;
+
+    for(i = 0; i < __profiler_counter_count; i++)
+    {
+        if(__profiler_counters[i].name == name || !strcmp(__profiler_counters[i].name, name))
+        {
+            __profiler_counters[i].total += value;
+            return;
+        }
+    }
+
+    if(__profiler_counter_count == RAFGL_PROFILER_SCOPES)
+        return;
+
+    __profiler_counters[__profiler_counter_count].name = name;
+    __profiler_counters[__profiler_counter_count].total = value;
+    __profiler_counter_count++;
+}
+
+static __rafgl_profiler_stat_t* __rafgl_profiler_stat(const char *name, int depth)
+{
+    int i;
+    for(i = 0; i < __profiler_stat_count; i++)
+    {
+        if(__profiler_stats[i].name == name || !strcmp(__profiler_stats[i].name, name))
+            return &__profiler_stats[i];
+    }
+
+    if(__profiler_stat_count == RAFGL_PROFILER_SCOPES)
+        return NULL;
+
+    memset(&__profiler_stats[__profiler_stat_count], 0, sizeof(__rafgl_profiler_stat_t));
+    __profiler_stats[__profiler_stat_count].name = name;
+    __profiler_stats[__profiler_stat_count].depth = depth;
+    return &__profiler_stats[__profiler_stat_count++];
+}
+
+void rafgl_profiler_frame(void)
+{
+    int slot, scope;
+    GLuint64 begin, end;
+    __rafgl_profiler_stat_t *stat;
+
+    if(!__profiler_enabled)
+        return;
+
+    /* scopes left open at the end of a frame are dropped */
+    __profiler_stack_depth = 0;
+    __profiler_frame++;
+    __profiler_counter_frames++;
+
+    /* the slot this frame is going to reuse was filled RAFGL_PROFILER_LATENCY frames ago, its results are in by now */
+    slot = __profiler_frame % RAFGL_PROFILER_LATENCY;
+    if(__profiler_frame >= RAFGL_PROFILER_LATENCY)
+        __profiler_period_frames++;
+    for(scope = 0; scope < __profiler_scope_count[slot]; scope++)
+    {
+        glGetQueryObjectui64v(__profiler_queries[slot][scope * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(__profiler_queries[slot][scope * 2 + 1], GL_QUERY_RESULT, &end);
+
+        stat = __rafgl_profiler_stat(__profiler_scopes[slot][scope].name, __profiler_scopes[slot][scope].depth);
+        if(stat == NULL)
+            continue;
+        stat->gpu_ms += (end - begin) / 1000000.0;
+        stat->cpu_ms += __profiler_scopes[slot][scope].cpu_ms;
+        stat->samples++;
+    }
+    __profiler_scope_count[slot] = 0;
+}
+
+float rafgl_profiler_get_ms(const char *name)
+{
+    int i;
+    for(i = 0; i < __profiler_stat_count; i++)
+    {
+        if(!strcmp(__profiler_stats[i].name, name))
+            return __profiler_period_frames ? __profiler_stats[i].gpu_ms / __profiler_period_frames : -1.0f;
+    }
+    return -1.0f;
+}
+
+void rafgl_profiler_report(void)
+{
+    int i;
+
+    if(!__profiler_enabled || __profiler_period_frames == 0 || __profiler_stat_count == 0)
+        return;
+
+    rafgl_log(RAFGL_INFO, "[PROFILER, ms per frame over %d frames]   gpu      cpu   calls\n", __profiler_period_frames);
+    for(i = 0; i < __profiler_stat_count; i++)
+    {
+        rafgl_log(RAFGL_INFO, "%*s%-*s %8.3f %8.3f %7.2f\n", __profiler_stats[i].depth * 2, "", 32 - __profiler_stats[i].depth * 2, __profiler_stats[i].name,
+                  __profiler_stats[i].gpu_ms / __profiler_period_frames, __profiler_stats[i].cpu_ms / __profiler_period_frames,
+                  (float)__profiler_stats[i].samples / __profiler_period_frames);
+    }
+
+    if(__profiler_counter_count && __profiler_counter_frames)
+    {
+        rafgl_log(RAFGL_INFO, "[PROFILER, counts per frame over %d frames]\n", __profiler_counter_frames);
+        for(i = 0; i < __profiler_counter_count; i++)
+            rafgl_log(RAFGL_INFO, "%-32s %8.1f\n", __profiler_counters[i].name, (double)__profiler_counters[i].total / __profiler_counter_frames);
+    }
+
+    __profiler_stat_count = 0;
+    __profiler_period_frames = 0;
+    __profiler_counter_count = 0;
+    __profiler_counter_frames = 0;
+}
+
+void rafgl_game_request_state_change(int state_index, void *args)
+{
+    __game_state_change_request = state_index;
+    __game_state_change_request_args = args;
+}
+
+void rafgl_game_start(rafgl_game_t *game, void *_args)
+{
+    int frame_count = 0;
+    void *args = _args;
+    rafgl_game_state_t *current_state = rafgl_vector_get(&game->game_states, 0);
+    int current_game_state_index = 0, i;
+
+    rafgl_game_data_t game_data;
+    game_data.keys_down = __keys_down;
+    game_data.keys_pressed = __keys_pressed;
+
+    glfwGetFramebufferSize(game->window, &__framebuffer_width, &__framebuffer_height);
+    if(__headless_fbo)
+    {
+        __framebuffer_width = __window_width;
+        __framebuffer_height = __window_height;
+    }
+
+    double init_start = glfwGetTime();
+    current_state->init(game->window, args, __window_width, __window_height);
+    __rafgl_program_cache_report((glfwGetTime() - init_start) * 1000.0);
+    __rafgl_frame_arena_after_init();
+
+
+    double current_frame, last_frame, next_frame;
+    float elapsed;
+    int benchmark_started = 0;
+
+    __update_job.window = game->window;
+    __update_job.state = current_state;
+    __update_job.game_data = &game_data;
+    __update_job.args = args;
+    /* real time not yet handed to a fixed timestep update, the first frame gets one so render never draws a state no update has set up */
+    __update_job.accumulator = __fixed_timestep;
+
+    double last_fps_frame;
+
+    last_fps_frame = last_frame = next_frame = glfwGetTime();
+
+    int fbwidth, fbheight, fbwlast = 0, fbhlast = 0;
+
+    if(__benchmark)
+        glfwSwapInterval(0);
+
+    if(__pipelined)
+    {
+        game_data.raster_width = __window_width;
+        game_data.raster_height = __window_height;
+        game_data.is_lmb_down = game_data.is_rmb_down = game_data.is_mmb_down = 0;
+        __rafgl_update_prime();
+        __update_quit = 0;
+        pthread_create(&__update_thread, NULL, __rafgl_update_worker, NULL);
+        __update_thread_running = 1;
+    }
+
+    while(!glfwWindowShouldClose(game->window))
+    {
+        glfwPollEvents();
+        rafgl_arena_reset(&__frame_arena, 0);
+
+        current_frame = glfwGetTime();
+
+        ++frame_count;
+        if(current_frame - last_fps_frame >= 2.0f)
+        {
+            if(__rafgl_log_fps)
+            {
+                rafgl_log(RAFGL_INFO, "[FPS = %.2f]\n", frame_count / 2.0f);
+            }
+            rafgl_profiler_report();
+            frame_count = 0;
+            last_fps_frame = current_frame;
+        }
+
+        elapsed = current_frame - last_frame;
+        last_frame = current_frame;
+
+        /* the first frame time is mostly init */
+        if(__benchmark && benchmark_started)
+        {
+            __rafgl_frame_time_add(elapsed * 1000.0f);
+            if(__benchmark_frames && __frame_time_count == __benchmark_frames)
+                glfwSetWindowShouldClose(game->window, 1);
+        }
+        benchmark_started = 1;
+
+
+        glfwGetFramebufferSize(game->window, &fbwidth, &fbheight);
+        if(__headless_fbo)
+        {
+            fbwidth = __window_width;
+            fbheight = __window_height;
+        }
+        if(fbwlast != fbwidth || fbhlast != fbheight)
+        {
+            glViewport(0, 0, fbwidth, fbheight);
+        }
+        fbwlast = fbwidth;
+        fbhlast = fbheight;
+
+        game_data.raster_width = __framebuffer_width = fbwidth;
+        game_data.raster_height = __framebuffer_height = fbheight;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, __headless_fbo);
+
+        game_data.is_lmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_LEFT);
+        game_data.is_rmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_RIGHT);
+        game_data.is_mmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_MIDDLE);
+
+        __update_job.elapsed = elapsed;
+        if(__pipelined)
+        {
+            /* the update thread only reads what is in game_data and the key arrays, nothing writes them until the next poll */
+            glfwGetCursorPos(game->window, &game_data.mouse_pos_x, &game_data.mouse_pos_y);
+            __rafgl_update_kick();
+        }
+        else
+        {
+            __rafgl_run_updates(&__update_job, 1);
+            __interpolation = __update_job.interpolation;
+        }
+
+
+        current_state->render(game->window, args);
+
+        glfwSwapBuffers(game->window);
+        rafgl_profiler_frame();
+        __rafgl_render_target_frame();
+
+        if(__pipelined)
+        {
+            __rafgl_update_wait();
+            __rafgl_packets_flip();
+        }
+
+        __rafgl_program_watch_frame();
+
+        if(__frame_limit > 0.0f && !__benchmark)
+        {
+            next_frame = rafgl_max_m(next_frame + 1.0 / __frame_limit, current_frame);
+            __rafgl_wait_until(next_frame);
+        }
+
+        if(__game_state_change_request == current_game_state_index)
+        {
+            rafgl_log(RAFGL_WARNING, "Already in that state!\n");
+            __game_state_change_request = -1;
+        }
+
+        if(__game_state_change_request >= 0)
+        {
+            rafgl_log(RAFGL_INFO, "Changigng state!\n");
+            current_state->cleanup(game->window, args);
+
+            args = __game_state_change_request_args;
+            __game_state_change_request_args = NULL;
+
+            current_state = rafgl_vector_get(&game->game_states, __game_state_change_request);
+
+            current_game_state_index = __game_state_change_request;
+            __game_state_change_request = -1;
+
+            current_state->init(game->window, args, __window_width, __window_height);
+            __rafgl_frame_arena_after_init();
+            last_frame = next_frame = glfwGetTime();
+
+            __update_job.state = current_state;
+            __update_job.args = args;
+            __update_job.accumulator = __fixed_timestep;
+            if(__pipelined)
+                __rafgl_update_prime();
+
+        }
+
+    }
+
+    if(__update_thread_running)
+    {
+        pthread_mutex_lock(&__update_mutex);
+        __update_quit = 1;
+        pthread_cond_broadcast(&__update_cond);
+        pthread_mutex_unlock(&__update_mutex);
+        pthread_join(__update_thread, NULL);
+        __update_thread_running = 0;
+    }
+
+    current_state->cleanup(game->window, args);
+    __rafgl_render_target_cleanup();
+    __rafgl_program_watch_stop();
+    __rafgl_frame_time_report();
+    rafgl_arena_cleanup(&__frame_arena);
+    __rafgl_log_stop();
+
+    for(i = 0; i < RAFGL_LOG_LEVELS; i++)
+    {
+        if(__log_files[i] != NULL)
+            fclose(__log_files[i]);
+        __log_files[i] = NULL;
+    }
+
+
+}
+
+
+
+/* Helpers implementation*/
+
+/* worker pool behind rafgl_parallel_for, workers sleep on a condition variable between dispatches */
+static pthread_once_t __pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t __pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __pool_dispatch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t __pool_done = PTHREAD_COND_INITIALIZER;
+static int __pool_thread_count = 1;
+static int __pool_thread_limit = 0, __pool_active_count = 1;
+static unsigned int __pool_generation = 0;
+static int __pool_busy_workers = 0;
+static void (*__pool_fn)(void *ctx, int index);
+static void *__pool_ctx;
+static int __pool_count, __pool_next;
+static __thread int __pool_inside_job = 0;
+
+static void __rafgl_pool_run(void)
+{
+    int index;
+    __pool_inside_job = 1;
+    while((index = __atomic_fetch_add(&__pool_next, 1, __ATOMIC_RELAXED)) < __pool_count)
+    {
+        __pool_fn(__pool_ctx, index);
+    }
+    __pool_inside_job = 0;
+}
+
+static void* __rafgl_pool_worker(void *arg)
+{
+    unsigned int seen = 0;
+    int id = (int)(intptr_t)arg;
+
+    while(1)
+    {
+        pthread_mutex_lock(&__pool_mutex);
+        while(__pool_generation == seen)
+        {
+            pthread_cond_wait(&__pool_wake, &__pool_mutex);
+        }
+        seen = __pool_generation;
+        /* sits this dispatch out under a thread limit */
+        if(id >= __pool_active_count)
+        {
+            pthread_mutex_unlock(&__pool_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&__pool_mutex);
+
+        __rafgl_pool_run();
+
+        pthread_mutex_lock(&__pool_mutex);
+        if(--__pool_busy_workers == 0)
+        {
+            pthread_cond_signal(&__pool_done);
+        }
+        pthread_mutex_unlock(&__pool_mutex);
+    }
+
+    return NULL;
+}
+
+static void __rafgl_pool_init(void)
+{
+    const char *requested = getenv("RAFGL_THREADS");
+    pthread_t thread;
+    int i;
+
+    __pool_thread_count = requested ? atoi(requested) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    __pool_thread_count = rafgl_clampi(__pool_thread_count, 1, 64);
+
+    for(i = 1; i < __pool_thread_count; i++)
+    {
+        if(pthread_create(&thread, NULL, __rafgl_pool_worker, (void*)(intptr_t)i) != 0)
+        {
+            rafgl_log(RAFGL_WARNING, "Could not start worker thread %d, using %d threads!\n", i, i);
+            __pool_thread_count = i;
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+int rafgl_parallel_thread_count(void)
+{
+    pthread_once(&__pool_once, __rafgl_pool_init);
+    return (__pool_thread_limit > 0 && __pool_thread_limit < __pool_thread_count) ? __pool_thread_limit : __pool_thread_count;
+}
+
+void rafgl_parallel_set_thread_limit(int threads)
+{
+    pthread_mutex_lock(&__pool_dispatch_mutex);
+    __pool_thread_limit = threads;
+    pthread_mutex_unlock(&__pool_dispatch_mutex);
+}
+
+void rafgl_parallel_for(int count, void (*fn)(void *ctx, int index), void *ctx)
+{
+    int i;
+
+    if(count <= 0)
+        return;
+
+    if(count == 1 || __pool_inside_job || rafgl_parallel_thread_count() == 1)
+    {
+        for(i = 0; i < count; i++)
+        {
+            fn(ctx, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&__pool_dispatch_mutex);
+
+    pthread_mutex_lock(&__pool_mutex);
+    __pool_fn = fn;
+    __pool_ctx = ctx;
+    __pool_count = count;
+    __pool_next = 0;
+    __pool_active_count = rafgl_parallel_thread_count();
+    __pool_busy_workers = __pool_active_count - 1;
+    __pool_generation++;
+    pthread_cond_broadcast(&__pool_wake);
+    pthread_mutex_unlock(&__pool_mutex);
+
+    /* the calling thread takes jobs too */
+    __rafgl_pool_run();
+
+    pthread_mutex_lock(&__pool_mutex);
+    while(__pool_busy_workers)
+    {
+        pthread_cond_wait(&__pool_done, &__pool_mutex);
+    }
+    pthread_mutex_unlock(&__pool_mutex);
+
+    pthread_mutex_unlock(&__pool_dispatch_mutex);
+}
+
+void rafgl_button_innit(rafgl_button_t *btn, int posx, int posy, int width, int height, uint32_t colour)
+{
+    btn->colour = colour;
+    btn->posx = posx;
+    btn->posy = posy;
+    btn->w = width;
+    btn->h = height;
+}
+
+int rafgl_button_check(rafgl_button_t *btn, rafgl_game_data_t *game_data)
+{
+    return (rafgl_distance1D(btn->posx, game_data->mouse_pos_x) <= btn->w / 2) && (rafgl_distance1D(btn->posy, game_data->mouse_pos_y) <= btn->h / 2) && game_data->is_lmb_down;
+}
+
+void rafgl_button_show(rafgl_raster_t *target, rafgl_button_t *btn)
+{
+    int x, y, X, Y;
+
+    for(Y = -btn->h/2; Y < btn->h/2; Y++)
+    {
+        for(X = -btn->w/2; X < btn->w/2; X++)
+        {
+            x = rafgl_clampi(btn->posx + X, 0, target->width - 1);
+            y = rafgl_clampi(btn->posy + Y, 0, target->height - 1);
+
+            pixel_at_pm(target, x, y).rgba = btn->colour;
+
+        }
+
+    }
+}
+
+
+inline float randf(void)
+{
+    return rand() / (RAND_MAX + 1.0f);
+}
+
+inline float rafgl_distance1D(float x1, float x2)
+{
+    if(x1 > x2)
+        return x1 - x2;
+    else
+        return x2 - x1;
+}
+
+inline float rafgl_distance2D(float x1, float y1, float x2, float y2)
+{
+    float delta_x = x2 - x1;
+    float delta_y = y2 - y1;
+
+    return sqrtf(delta_x * delta_x + delta_y * delta_y);
+}
+
+inline float rafgl_distance3D(float x1, float y1, float z1, float x2, float y2, float z2)
+{
+    float delta_x = x2 - x1;
+    float delta_y = y2 - y1;
+    float delta_z = z2 - z1;
+
+    return sqrtf(delta_x * delta_x + delta_y * delta_y + delta_z * delta_z);
+}
+
+inline int rafgl_clampi(int value, int lower, int upper)
+{
+    if(value < lower)
+        return lower;
+    else if(value > upper)
+        return upper;
+    else return value;
+}
+
+inline float rafgl_clampf(float value, float lower, float upper)
+{
+    if(value < lower)
+        return lower;
+    else if(value > upper)
+        return upper;
+    else return value;
+}
+
+inline int rafgl_saturatei(int value)
+{
+    return rafgl_clampi(value, 0, 255);
+}
+
+inline float rafgl_saturatef(float value)
+{
+    return rafgl_clampf(value, 0.0f, 1.0f);
+}
+
+
+inline float rafgl_lerpf(float from, float to, float scale)
+{
+    return from + (to - from) * scale;
+}
+
+inline int rafgl_lerpi(int from, int to, float scale)
+{
+    return from + (to - from) * scale;
+}
+
+inline int rafgl_calculate_pixel_brightness(rafgl_pixel_rgb_t pix)
+{
+    return 0.3f * pix.r + 0.59f * pix.g + 0.11f * pix.b;
+}
+
+inline rafgl_pixel_rgb_t rafgl_lerppix(rafgl_pixel_rgb_t from, rafgl_pixel_rgb_t to, float scale)
+{
+    from.r = rafgl_lerpi(from.r, to.r, scale);
+    from.g = rafgl_lerpi(from.g, to.g, scale);
+    from.b = rafgl_lerpi(from.b, to.b, scale);
+    from.a = rafgl_lerpi(from.a, to.a, scale);
+    return from;
+}
+
+rafgl_pixel_rgb_t rafgl_point_sample(rafgl_raster_t *src, float u, float v)
+{
+    int x = rafgl_clampi(u * src -> width, 0, src -> width - 1);
+    int y = rafgl_clampi(v * src -> height, 0, src -> height - 1);
+    return pixel_at_pm(src, x, y);
+}
+
+rafgl_pixel_rgb_t rafgl_bilinear_sample(rafgl_raster_t *src, float u, float v)
+{
+    rafgl_pixel_rgb_t UL, UR, LL, LR, UM, LM;
+
+    int width = src->width, height = src->height;
+
+    u = rafgl_clampf((u * src -> width) - 0.5f, 0, src->width - 1.0f);
+    v = rafgl_clampf((v * src -> height)- 0.5f, 0, src->height - 1.0f);
+
+    int x0, y0, x1, y1;
+
+    x0 = u;
+    y0 = v;
+    x1 = x0 + 1;
+    y1 = y0 + 1;
+
+    if(x1 > width - 1) x1 = width - 1;
+    if(y1 > height - 1) y1 = height - 1;
+
+
+    float xscale = u - x0, yscale = v - y0;
+
+    UL = pixel_at_pm(src, x0, y0);
+    UR = pixel_at_pm(src, x1, y0);
+    LL = pixel_at_pm(src, x0, y1);
+    LR = pixel_at_pm(src, x1, y1);
+
+    UM = rafgl_lerppix(UL, UR, xscale);
+    LM = rafgl_lerppix(LL, LR, xscale);
+
+    return rafgl_lerppix(UM, LM, yscale);
+}
+
+
+
+void rafgl_texture_init(rafgl_texture_t *tex)
+{
+    GLuint tx;
+    glGenTextures(1, &tx);
+    tex->channels = 0;
+    tex->width = 0;
+    tex->height = 0;
+    tex->tex_id = tx;
+    tex->tex_type = 0;
+}
+
+int rafgl_texture_load_basic(const char *texture_path, rafgl_texture_t *res)
+{
+    return -1;
+}
+
+
+
+void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *raster)
+{
+    GLuint tex_slot = texture->tex_id;
+    glBindTexture(GL_TEXTURE_2D, tex_slot);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, raster->width, raster->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, raster->data);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    texture->tex_id = tex_slot;
+    texture->width = raster->width;
+    texture->height = raster->height;
+    texture->channels = 3;
+    texture->tex_type = GL_TEXTURE_2D;
+}
+
+
+void rafgl_texture_show(const rafgl_texture_t *texture, int flip)
+{
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+
+    glBindVertexArray(__raster_vao);
+    glUseProgram(__raster_program);
+
+    glUniform1f(__flip, flip);
+
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+}
+
+void rafgl_texture_cleanup(rafgl_texture_t *texture)
+{
+    glDeleteTextures(1, &(texture->tex_id));
+    texture->channels = 0;
+    texture->height = 0;
+    texture->width = 0;
+    texture->tex_id = 0;
+    texture->tex_type = 0;
+    return;
+}
+
+void rafgl_texture_load_cubemap_named(rafgl_texture_t *tex, const char *cubemap_name, const char *file_ext)
+{
+    char cubemap_paths[6][128];
+    char *pcubemap_paths[6] = {&cubemap_paths[0][0], &cubemap_paths[1][0], &cubemap_paths[2][0], &cubemap_paths[3][0], &cubemap_paths[4][0], &cubemap_paths[5][0]};
+    char names[6][3] = {"/E", "/W", "/U", "/D", "/N", "/S"};
+    int i;
+    for(i = 0; i < 6; i++)
+    {
+        strcpy(cubemap_paths[i], "res/cubemaps/");
+        strcat(cubemap_paths[i], cubemap_name);
+        strcat(cubemap_paths[i], names[i]);
+        strcat(cubemap_paths[i], ".");
+        strcat(cubemap_paths[i], file_ext);
+    }
+
+    rafgl_texture_load_cubemap(tex, pcubemap_paths);
+}
+
+void rafgl_texture_load_cubemap(rafgl_texture_t *tex, const char *cubemap_paths[])
+{
+    glBindTexture(GL_TEXTURE_CUBE_MAP, tex->tex_id);
+
+    int width, height, channels;
+    unsigned char *data;
+    GLuint i;
+    for(i = 0; i < 6; i++)
+    {
+        data = stbi_load(cubemap_paths[i], &width, &height, &channels, 4);
+        if (!data)
+        {
+            rafgl_log(RAFGL_ERROR, "Failed to load texture at path [%s] intended for a cubemap!\n", cubemap_paths[i]);
+        }
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        free(data);
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    tex->tex_type = GL_TEXTURE_CUBE_MAP;
+
+
+
+}
+
+
+rafgl_framebuffer_multitarget_t rafgl_framebuffer_multitarget_create(int w, int h, int num_attachments)
+{
+    if(num_attachments > 16)
+    {
+        rafgl_log(RAFGL_WARNING, "Cant make %d attachments to a fbo, using 16 instead!\n", num_attachments);
+        num_attachments = 16;
+    }
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    rafgl_framebuffer_multitarget_t fb_mt;
+
+    fb_mt.width = w;
+    fb_mt.height = h;
+
+    fb_mt.fbo_id = framebuffer;
+    fb_mt.num_textures = num_attachments;
+
+    GLuint texture_colour_buffer;
+    int i;
+
+    for(i = 0; i < num_attachments; i++)
+    {
+        glGenTextures(1, &texture_colour_buffer);
+        glBindTexture(GL_TEXTURE_2D, texture_colour_buffer);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // attach it to currently bound framebuffer object
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, texture_colour_buffer, 0);
+        fb_mt.tex_ids[i] = texture_colour_buffer;
+    }
+
+
+
+    GLuint rbo;
+    glGenRenderbuffers(1, &rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+	    rafgl_log(RAFGL_ERROR, "Failed to create framebuffer!\n");
+	}
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return fb_mt;
+
+
+}
+
+rafgl_framebuffer_simple_t rafgl_framebuffer_simple_create(int w, int h)
+{
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+
+    GLuint texture_colour_buffer;
+    glGenTextures(1, &texture_colour_buffer);
+    glBindTexture(GL_TEXTURE_2D, texture_colour_buffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // attach it to currently bound framebuffer object
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_colour_buffer, 0);
+
+    GLuint rbo;
+    glGenRenderbuffers(1, &rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
 
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+	    rafgl_log(RAFGL_ERROR, "Failed to create framebuffer!\n");
+	}
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    rafgl_framebuffer_simple_t fb;
+    fb.fbo_id = framebuffer;
+    fb.tex_id = texture_colour_buffer;
+
+    return fb;
+}
+
+static rafgl_render_target_t __render_targets[RAFGL_RENDER_TARGETS_MAX];
+static int __render_target_count = 0, __render_target_frame = 0;
+static int __render_targets_created = 0, __render_targets_reused = 0;
+static size_t __render_target_bytes = 0, __render_target_peak_bytes = 0;
+
+/* the format and type glTexImage2D wants next to an internal format, and what a pixel of it takes */
+static size_t __rafgl_render_target_format(GLenum internal_format, GLenum *format, GLenum *type)
+{
+    switch(internal_format)
+    {
+        case GL_DEPTH_COMPONENT16: *format = GL_DEPTH_COMPONENT; *type = GL_UNSIGNED_SHORT; return 2;
+        case GL_DEPTH_COMPONENT24: *format = GL_DEPTH_COMPONENT; *type = GL_UNSIGNED_INT; return 4;
+        case GL_DEPTH_COMPONENT32F: *format = GL_DEPTH_COMPONENT; *type = GL_FLOAT; return 4;
+        case GL_DEPTH24_STENCIL8: *format = GL_DEPTH_STENCIL; *type = GL_UNSIGNED_INT_24_8; return 4;
+        case GL_DEPTH32F_STENCIL8: *format = GL_DEPTH_STENCIL; *type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV; return 8;
+        case GL_R8: *format = GL_RED; *type = GL_UNSIGNED_BYTE; return 1;
+        case GL_R16F: *format = GL_RED; *type = GL_FLOAT; return 2;
+        case GL_R32F: *format = GL_RED; *type = GL_FLOAT; return 4;
+        case GL_RG16F: *format = GL_RG; *type = GL_FLOAT; return 4;
+        case GL_R11F_G11F_B10F: *format = GL_RGB; *type = GL_FLOAT; return 4;
+        /* three channel ones are padded to four by every driver */
+        case GL_RGB8: *format = GL_RGB; *type = GL_UNSIGNED_BYTE; return 4;
+        case GL_RGB16F: *format = GL_RGB; *type = GL_FLOAT; return 8;
+        case GL_RGBA16F: *format = GL_RGBA; *type = GL_FLOAT; return 8;
+        case GL_RGBA32F: *format = GL_RGBA; *type = GL_FLOAT; return 16;
+        default: *format = GL_RGBA; *type = GL_UNSIGNED_BYTE; return 4;
+    }
+}
+
+static GLuint __rafgl_render_target_texture(rafgl_render_target_t *target, GLenum internal_format)
+{
+    GLuint texture;
+    GLenum format, type;
+    size_t bytes = __rafgl_render_target_format(internal_format, &format, &type);
+
+    glGenTextures(1, &texture);
+    if(target->samples > 1)
+    {
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, target->samples, internal_format, target->width, target->height, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        bytes *= target->samples;
+    }
+    else
+    {
+        /* no mip chain, only level 0 is ever rendered to so that is all the sampler may see */
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, target->width, target->height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL ? GL_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL ? GL_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    target->bytes += bytes * target->width * target->height;
+    return texture;
+}
+
+static void __rafgl_render_target_delete(rafgl_render_target_t *target)
+{
+    glDeleteFramebuffers(1, &target->fbo_id);
+    if(target->colour_id)
+        glDeleteTextures(1, &target->colour_id);
+    if(target->depth_id)
+        glDeleteTextures(1, &target->depth_id);
+    __render_target_bytes -= target->bytes;
+    memset(target, 0, sizeof(*target));
+}
+
+rafgl_render_target_t* rafgl_render_target_acquire(GLenum colour_format, GLenum depth_format, int width, int height, int samples)
+{
+    rafgl_render_target_t *target;
+    GLenum texture_target, format, type;
+    GLint previous;
+    int i;
+
+    width = rafgl_max_m(width, 1);
+    height = rafgl_max_m(height, 1);
+    samples = samples > 1 ? samples : 0;
+
+    for(i = 0; i < __render_target_count; i++)
+    {
+        target = __render_targets + i;
+        if(target->fbo_id && !target->in_use && target->colour_format == colour_format && target->depth_format == depth_format &&
+           target->width == width && target->height == height && target->samples == samples)
+        {
+            target->in_use = 1;
+            target->last_frame = __render_target_frame;
+            __render_targets_reused++;
+            return target;
+        }
+    }
+
+    /* a slot an evicted one left, the others never move so what was handed out stays valid */
+    for(i = 0; i < __render_target_count && __render_targets[i].fbo_id; i++);
+    if(i == RAFGL_RENDER_TARGETS_MAX)
+    {
+        rafgl_log(RAFGL_ERROR, "All %d render targets are in use!\n", RAFGL_RENDER_TARGETS_MAX);
+        return NULL;
+    }
+    if(i == __render_target_count)
+        __render_target_count++;
+
+    target = __render_targets + i;
+    memset(target, 0, sizeof(*target));
+    target->colour_format = colour_format;
+    target->depth_format = depth_format;
+    target->width = width;
+    target->height = height;
+    target->samples = samples;
+    target->in_use = 1;
+    target->last_frame = __render_target_frame;
+
+    /* whoever acquires in the middle of a pass keeps what they had bound */
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &target->fbo_id);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo_id);
+    texture_target = samples ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+
+    if(colour_format)
+    {
+        target->colour_id = __rafgl_render_target_texture(target, colour_format);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target, target->colour_id, 0);
+    }
+    else
+    {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    if(depth_format)
+    {
+        target->depth_id = __rafgl_render_target_texture(target, depth_format);
+        __rafgl_render_target_format(depth_format, &format, &type);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, format == GL_DEPTH_STENCIL ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, texture_target, target->depth_id, 0);
+    }
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        rafgl_log(RAFGL_ERROR, "Failed to create a %dx%d render target!\n", width, height);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    __render_targets_created++;
+    __render_target_bytes += target->bytes;
+    __render_target_peak_bytes = rafgl_max_m(__render_target_peak_bytes, __render_target_bytes);
+
+    return target;
+}
+
+rafgl_render_target_t* rafgl_render_target_acquire_scaled(GLenum colour_format, GLenum depth_format, float scale, int samples)
+{
+    return rafgl_render_target_acquire(colour_format, depth_format, (int)(__framebuffer_width * scale + 0.5f), (int)(__framebuffer_height * scale + 0.5f), samples);
+}
+
+void rafgl_render_target_release(rafgl_render_target_t *target)
+{
+    if(target)
+    {
+        target->in_use = 0;
+        target->last_frame = __render_target_frame;
+    }
+}
+
+size_t rafgl_render_target_pool_bytes(void)
+{
+    return __render_target_bytes;
+}
+
+static void __rafgl_render_target_frame(void)
+{
+    int i;
+
+    /* the ones nobody asked for in a while go, which is how targets of the size before a resize get dropped */
+    __render_target_frame++;
+    for(i = 0; i < __render_target_count; i++)
+    {
+        if(__render_targets[i].fbo_id && !__render_targets[i].in_use && __render_target_frame - __render_targets[i].last_frame > RAFGL_RENDER_TARGET_IDLE_FRAMES)
+            __rafgl_render_target_delete(__render_targets + i);
+    }
+}
+
+static void __rafgl_render_target_cleanup(void)
+{
+    int i;
+
+    if(__render_targets_created)
+    {
+        rafgl_log(RAFGL_INFO, "Render targets: %d made, %d reuses, peaked at %.1f MB\n", __render_targets_created, __render_targets_reused,
+                  __render_target_peak_bytes / (1024.0 * 1024.0));
+    }
+
+    for(i = 0; i < __render_target_count; i++)
+    {
+        if(!__render_targets[i].fbo_id)
+            continue;
+        if(__render_targets[i].in_use)
+            rafgl_log(RAFGL_WARNING, "A %dx%d render target was never released!\n", __render_targets[i].width, __render_targets[i].height);
+        __rafgl_render_target_delete(__render_targets + i);
+    }
+    __render_target_count = 0;
+}
+
+static void __rafgl_meshPUN_compute_bounds(rafgl_meshPUN_t *m, const rafgl_vertexPUN_t *vertices, int count)
+{
+    int i;
+
+    m->bounds_min = m->bounds_max = count ? vertices[0].position : vec3(0.0f, 0.0f, 0.0f);
+    for(i = 1; i < count; i++)
+    {
+        m->bounds_min = vec3(fminf(m->bounds_min.x, vertices[i].position.x), fminf(m->bounds_min.y, vertices[i].position.y), fminf(m->bounds_min.z, vertices[i].position.z));
+        m->bounds_max = vec3(fmaxf(m->bounds_max.x, vertices[i].position.x), fmaxf(m->bounds_max.y, vertices[i].position.y), fmaxf(m->bounds_max.z, vertices[i].position.z));
+    }
+}
+
+void rafgl_meshPUN_init(rafgl_meshPUN_t *m)
+{
+    m->loaded = 0;
+    m->triangle_count = 0;
+    m->vertex_count = 0;
+    m->vao_id = 0;
+    memset(m->name, 0, sizeof(m->name));
+    m->bounds_min = m->bounds_max = vec3(0.0f, 0.0f, 0.0f);
+}
+
+void rafgl_meshPUN_load_plane(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles)
+{
+    rafgl_meshPUN_load_plane_offset(m, w, h, wtiles, htiles, vec3(0.0f, 0.0f, 0.0f));
+}
+
+void rafgl_meshPUN_load_plane_offset(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles, vec3_t offset)
+{
+    int num_vertices = wtiles * htiles * 6;
+    float tilew = w / wtiles;
+    float tileh = h / htiles;
+
+    rafgl_vertexPUN_t *data = malloc(num_vertices * sizeof(rafgl_vertexPUN_t));
+
+    int vertex = 0, x, z;
+
+    for(z = 0; z < htiles; z++)
+    {
+        for(x = 0; x < wtiles; x++, vertex += 6)
+        {
+            data[vertex + 0].position = v3_add(vec3((x + 1) * tilew - w / 2, 0.0f, z * tileh - h / 2), offset);
+            data[vertex + 0].normal = vec3(0.0f, 1.0f, 0.0f);
+            data[vertex + 0].u = 1.0f / wtiles * (x + 1);
+            data[vertex + 0].v = 1.0f / htiles * z;
+
+            data[vertex + 1].position = v3_add(vec3(x  * tilew - w / 2, 0.0f, z * tileh - h / 2), offset);
+            data[vertex + 1].normal = vec3(0.0f, 1.0f, 0.0f);
+            data[vertex + 1].u = 1.0f / wtiles * x;
+            data[vertex + 1].v = 1.0f / htiles * z;
+
+            data[vertex + 2].position = v3_add(vec3(x  * tilew - w / 2, 0.0f, (z + 1) * tileh - h / 2), offset);
+            data[vertex + 2].normal = vec3(0.0f, 1.0f, 0.0f);
+            data[vertex + 2].u = 1.0f / wtiles * x;
+            data[vertex + 2].v = 1.0f / htiles * (z + 1);
+
+            data[vertex + 3].position = v3_add(vec3((x + 1) * tilew - w / 2, 0.0f, z * tileh - h / 2), offset);
+            data[vertex + 3].normal = vec3(0.0f, 1.0f, 0.0f);
+            data[vertex + 3].u = 1.0f / wtiles * (x + 1);
+            data[vertex + 3].v = 1.0f / htiles * z;
+
+            data[vertex + 4].position = v3_add(vec3(x  * tilew - w / 2, 0.0f, (z + 1) * tileh - h / 2), offset);
+            data[vertex + 4].normal = vec3(0.0f, 1.0f, 0.0f);
+            data[vertex + 4].u = 1.0f / wtiles * x;
+            data[vertex + 4].v = 1.0f / htiles * (z + 1);
+
+            data[vertex + 5].position = v3_add(vec3((x + 1)  * tilew - w / 2, 0.0f, (z + 1) * tileh - h / 2), offset);
+            data[vertex + 5].normal = vec3(0.0f, 1.0f, 0.0f);
+            data[vertex + 5].u = 1.0f / wtiles * (x + 1);
+            data[vertex + 5].v = 1.0f / htiles * (z + 1);
+        }
+    }
+
+    glGenVertexArrays(1, &m->vao_id);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(m->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    glBufferData(GL_ARRAY_BUFFER,num_vertices * sizeof(rafgl_vertexPUN_t), data, GL_STATIC_DRAW);
+
+    __rafgl_meshPUN_compute_bounds(m, data, num_vertices);
+    free(data);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDeleteBuffers(1, &vbo);
+
+    m->loaded = 1;
+    sprintf(m->name, "%d x %d plane", wtiles, htiles);
+    m->triangle_count = wtiles * htiles * 2;
+    m->vertex_count =  wtiles * htiles * 6;
+
+}
+
+static vec3_t calculate_normal(rafgl_raster_t *heightmap, int x, int z, float tilew, float tileh, float height)
+{
+    if(x == 0 || x == heightmap->width - 1 || z == 0 || z == heightmap->height - 1)
+    {
+        return vec3(0.0f, 1.0f, 0.0f);
+    }
+    vec3_t u = vec3(tilew, pixel_at_pm(heightmap, x + 1, z).r / 256.0f * height - pixel_at_pm(heightmap, x - 1, z).r / 256.0f * height, 0);
+    vec3_t v = vec3(0, pixel_at_pm(heightmap, x, z + 1).r / 256.0f * height - pixel_at_pm(heightmap, x, z - 1).r / 256.0f * height, -tileh);
+    return v3_cross(u, v);
+
+}
+
+void rafgl_meshPUN_load_terrain_from_heightmap(rafgl_meshPUN_t *m, float w, float h, const char *img_path, float height)
+{
+
+    rafgl_raster_t map_raster;
+    rafgl_raster_load_from_image(&map_raster, img_path);
+
+    int wtiles = map_raster.width - 1;
+    int htiles = map_raster.height - 1;
+
+    int num_vertices = wtiles * htiles * 6;
+    float tilew = w / wtiles;
+    float tileh = h / htiles;
+
+    rafgl_vertexPUN_t *data = malloc(num_vertices * sizeof(rafgl_vertexPUN_t));
+
+    int vertex = 0, x, z;
+    vec3_t direction, normal;
+
+    for(z = 0; z < htiles; z++)
+    {
+        for(x = 0; x < wtiles; x++, vertex += 6)
+        {
+            data[vertex + 0].position = vec3((x + 1) * tilew - w / 2, pixel_at_m(map_raster, x + 1, z).r / 256.0f * height, z * tileh - h / 2);
+            data[vertex + 0].u = 1.0f / wtiles * (x + 1);
+            data[vertex + 0].v = 1.0f / htiles * z;
+            data[vertex + 0].normal = calculate_normal(&map_raster, x + 1, z, tilew, tileh, height);
+
+            data[vertex + 1].position = vec3(x  * tilew - w / 2, pixel_at_m(map_raster, x, z).r / 256.0f * height, z * tileh - h / 2);
+            data[vertex + 1].u = 1.0f / wtiles * x;
+            data[vertex + 1].v = 1.0f / htiles * z;
+            data[vertex + 1].normal = calculate_normal(&map_raster, x, z, tilew, tileh, height);
+
+            data[vertex + 2].position = vec3(x  * tilew - w / 2, pixel_at_m(map_raster, x, z + 1).r / 256.0f * height, (z + 1) * tileh - h / 2);
+            data[vertex + 2].u = 1.0f / wtiles * x;
+            data[vertex + 2].v = 1.0f / htiles * (z + 1);
+            data[vertex + 2].normal = calculate_normal(&map_raster, x, z + 1, tilew, tileh, height);
+
+
+
+
+
+
+            data[vertex + 3].position = vec3((x + 1) * tilew - w / 2, pixel_at_m(map_raster, x + 1, z).r / 256.0f * height, z * tileh - h / 2);
+            data[vertex + 3].u = 1.0f / wtiles * (x + 1);
+            data[vertex + 3].v = 1.0f / htiles * z;
+            data[vertex + 3].normal = calculate_normal(&map_raster, x + 1, z, tilew, tileh, height);
+
+            data[vertex + 4].position = vec3(x  * tilew - w / 2, pixel_at_m(map_raster, x, z + 1).r / 256.0f * height, (z + 1) * tileh - h / 2);
+            data[vertex + 4].u = 1.0f / wtiles * x;
+            data[vertex + 4].v = 1.0f / htiles * (z + 1);
+            data[vertex + 4].normal = calculate_normal(&map_raster, x, z + 1, tilew, tileh, height);
+
+            data[vertex + 5].position = vec3((x + 1)  * tilew - w / 2, pixel_at_m(map_raster, x + 1, z + 1).r / 256.0f * height, (z + 1) * tileh - h / 2);
+            data[vertex + 5].u = 1.0f / wtiles * (x + 1);
+            data[vertex + 5].v = 1.0f / htiles * (z + 1);
+            data[vertex + 5].normal = calculate_normal(&map_raster, x + 1, z + 1, tilew, tileh, height);
+
+
+        }
+    }
+
+    glGenVertexArrays(1, &m->vao_id);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(m->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    glBufferData(GL_ARRAY_BUFFER,num_vertices * sizeof(rafgl_vertexPUN_t), data, GL_STATIC_DRAW);
+
+    __rafgl_meshPUN_compute_bounds(m, data, num_vertices);
+    free(data);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDeleteBuffers(1, &vbo);
+
+    m->loaded = 1;
+    sprintf(m->name, "%d x %d plane", wtiles, htiles);
+    m->triangle_count = wtiles * htiles * 2;
+    m->vertex_count =  wtiles * htiles * 6;
+
+}
+
+void rafgl_meshPUN_load_cube(rafgl_meshPUN_t *m, float coord)
+{
+    float coord_sign = coord > 0 ? 1.0f : -1.0f;
+    GLfloat cube_vertices[] = {
+        /* positions                   UV                              normals */
+         coord,  coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
+        -coord,  coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
+        -coord,  coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
+//y+
+         coord,  coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
+        -coord,  coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
+         coord,  coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
+
+
+         coord, -coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+        -coord, -coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+        -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+//y-
+         coord, -coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+        -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+         coord, -coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+
+
+
+
+
+         coord,  coord, -coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+         coord,  coord,  coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+         coord, -coord,  coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+//x+
+         coord,  coord, -coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+         coord, -coord,  coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+         coord, -coord, -coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+
+
+
+
+        -coord,  coord,  coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+        -coord,  coord, -coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+        -coord, -coord, -coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+//x-
+        -coord,  coord,  coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+        -coord, -coord, -coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+        -coord, -coord,  coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+
+
+
+
+
+         coord,  coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+        -coord,  coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+        -coord, -coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+//z+
+         coord,  coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+        -coord, -coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+         coord, -coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+
+
+
+
+        -coord,  coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
+         coord,  coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
+         coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
+//z-
+        -coord,  coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
+         coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
+        -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
+    };
+
+    glGenVertexArrays(1, &m->vao_id);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(m->vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    glBufferData(GL_ARRAY_BUFFER, 6 * 2 * 3 * (3 + 2 + 3) * sizeof(GLfloat), cube_vertices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDeleteBuffers(1, &vbo);
+
+    __rafgl_meshPUN_compute_bounds(m, (rafgl_vertexPUN_t*)cube_vertices, 6 * 2 * 3);
+
+    m->loaded = 1;
+    strcpy(m->name, "cube");
+    m->triangle_count = 6 * 2;
+    m->vertex_count = 6 * 2 * 3;
+
+
+}
+
+void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path)
+{
+    rafgl_meshPUN_load_from_OBJ_offset(m, obj_path, vec3(0.0f, 0.0f, 0.0f));
+}
+
+/* TODO: create cache system */
+void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset)
+{
+    if(m->loaded)
+    {
+        rafgl_log(RAFGL_WARNING, "Trying to load to already loaded mesh! Loading from [%s] to mesh taken by [%s]", obj_path, m->name);
+        return;
+    }
+    /* everything but the mesh itself is scratch, gone with the reset at the end */
+    rafgl_arena_t *scratch = rafgl_frame_arena();
+    size_t scope = rafgl_arena_mark(scratch);
+    rafgl_vector_t vertices, uv_coordinates, normals;
+    rafgl_vector_init_allocator(&vertices, sizeof(vec3_t), rafgl_arena_reallocate, scratch);
+    rafgl_vector_init_allocator(&uv_coordinates, sizeof(vec3_t), rafgl_arena_reallocate, scratch);
+    rafgl_vector_init_allocator(&normals, sizeof(vec3_t), rafgl_arena_reallocate, scratch);
+    vec3_t vectmp;
+
+    FILE *f = fopen(obj_path, "rt");
+    char line[256];
+
+
+    while(!feof(f))
+    {
+        fgets(line, 256, f);
+
+
+        if(line[0] == 'o' && line[1] == ' ')
+		{
+			strcpy(m->name, line + 2);
+			m->name[strlen(m->name) - 1] = '\0';
+		}
+
+		if(line[0] == 'v' && line[1] == ' ')
+		{
+			sscanf(line + 2, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
+			vectmp = v3_add(vectmp, position_offset);
+			rafgl_vector_append(&vertices, &vectmp);
+		}
+		else if (line[0] == 'v' && line[1] == 't')
+		{
+			sscanf(line + 3, "%f%f", &(vectmp.x), &(vectmp.y));
+			vectmp.z = 0;
+			rafgl_vector_append(&uv_coordinates, &vectmp);
+		}
+		else if (line[0] == 'v' && line[1] == 'n')
+		{
+			sscanf(line + 3, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
+			rafgl_vector_append(&normals, &vectmp);
+		}
+		else if (line[0] == 'f')
+		{
+			break;
+		}
+
+    }
+
+	int fake_uvs = 0;
+	rafgl_vector_t vertex_indices, uv_indices, normal_indices;
+    rafgl_vector_init_allocator(&vertex_indices, sizeof(int), rafgl_arena_reallocate, scratch);
+    rafgl_vector_init_allocator(&uv_indices, sizeof(int), rafgl_arena_reallocate, scratch);
+    rafgl_vector_init_allocator(&normal_indices, sizeof(int), rafgl_arena_reallocate, scratch);
+
+    int v1, v2, v3;
+    int n1, n2, n3;
+    int t1, t2, t3;
+
+    while(!feof(f))
 	{
-	    rafgl_log(RAFGL_ERROR, "Failed to create framebuffer!\n");
+		while(line[0] != 'f' && !feof(f))
+		{
+			fgets(line, 256, f);
+		}
+
+
+
+		int matches = sscanf(line + 2, "%d/%d/%d %d/%d/%d %d/%d/%d", &v1, &t1, &n1, &v2, &t2, &n2, &v3, &t3, &n3);
+		if(matches != 9)
+		{
+			matches = sscanf(line + 2, "%d//%d %d//%d %d//%d", &v1, &n1, &v2, &n2, &v3, &n3);
+			if(matches != 6)
+			{
+				rafgl_log(RAFGL_WARNING, "File can't be read, try exporting with other options [matches = %d]", matches);
+				rafgl_log(RAFGL_WARNING, "error on: %s\n", line);
+				rafgl_arena_reset(scratch, scope);
+				return;
+			}
+			else
+			{
+				t1 = t2 = t3 = 1;
+				if(!fake_uvs)
+				{
+				    fake_uvs = 1;
+                    rafgl_log(RAFGL_WARNING, "Using fake uvs for model on path [%s]\n", obj_path);
+				}
+			}
+
+
+		}
+
+		rafgl_vector_append(&vertex_indices, &v1);
+		rafgl_vector_append(&vertex_indices, &v2);
+		rafgl_vector_append(&vertex_indices, &v3);
+
+		rafgl_vector_append(&uv_indices, &t1);
+		rafgl_vector_append(&uv_indices, &t2);
+		rafgl_vector_append(&uv_indices, &t3);
+
+		rafgl_vector_append(&normal_indices, &n1);
+		rafgl_vector_append(&normal_indices, &n2);
+		rafgl_vector_append(&normal_indices, &n3);
+		fgets(line, 256, f);
+
+
+
 	}
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    rafgl_framebuffer_simple_t fb;
-    fb.fbo_id = framebuffer;
-    fb.tex_id = texture_colour_buffer;
+	/* the faces without uvs all point at the first one */
+	if(fake_uvs)
+    {
+        vectmp = vec3(0.0f, 0.0f, 0.0f);
+        rafgl_vector_append(&uv_coordinates, &vectmp);
+    }
 
-    return fb;
+    rafgl_vertexPUN_t *vertex_buffer = rafgl_arena_alloc(scratch, vertex_indices.count * sizeof(rafgl_vertexPUN_t));
+    int i;
+    int vert_ind;
+    int uv_ind;
+    int norm_ind;
+
+    vec3_t vertex_data, uv_data, normal_data;
+
+    int vcount = vertex_indices.count;
+    for(i = 0; i < vcount; i++)
+    {
+        vert_ind = rafgl_vector_at(&vertex_indices, int, i);
+		uv_ind = rafgl_vector_at(&uv_indices, int, i);
+		norm_ind = rafgl_vector_at(&normal_indices, int, i);
+
+		vertex_data = rafgl_vector_at(&vertices, vec3_t, vert_ind - 1);
+		uv_data = rafgl_vector_at(&uv_coordinates, vec3_t, uv_ind - 1);
+		normal_data = rafgl_vector_at(&normals, vec3_t, norm_ind - 1);
+
+		vertex_buffer[i].position = vertex_data;
+        vertex_buffer[i].normal = normal_data;
+        vertex_buffer[i].u = uv_data.x;
+        vertex_buffer[i].v = 1.0f - uv_data.y;
+
+
+
+    }
+
+    /* GL BUFFER DATA */
+
+	int vao;
+	glGenVertexArrays(1, &vao);
+
+	m -> vao_id = vao;
+	m -> vertex_count = vcount;
+	m -> triangle_count = vcount / 3;
+
+	glBindVertexArray(vao);
+
+	int data_buffer;
+	glGenBuffers(1, &data_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, data_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vcount * sizeof(rafgl_vertexPUN_t), vertex_buffer, GL_STATIC_DRAW);
+	__rafgl_meshPUN_compute_bounds(m, vertex_buffer, vcount);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(5 * sizeof(float)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+
+    /* free RAM */
+	rafgl_arena_reset(scratch, scope);
+	m->loaded = 1;
+
+    fclose(f);
+
+}
+
+
+int rafgl_list_init(rafgl_list_t *list, int element_size)
+{
+    list -> count = 0;
+    list -> element_size = element_size;
+    list -> head = NULL;
+    list -> tail = NULL;
+    return 0;
+}
+
+int rafgl_list_append(rafgl_list_t *list, void *data)
+{
+    return rafgl_list_append_sized(list, list -> element_size, data);
+}
+
+int rafgl_list_append_sized(rafgl_list_t *list, int size, void *data)
+{
+    if(list -> head == NULL && list -> tail == NULL)
+    {
+        list -> head = list -> tail = malloc(sizeof(void*) + size);
+        memcpy(list -> tail + sizeof(void*), data, size);
+        *((void**)list -> tail) = NULL;
+        list -> count++;
+    }
+    else
+    {
+        *((void**)list -> tail) = malloc(sizeof(void*) + size);
+        list -> tail = *((void**)list -> tail);
+        memcpy(list -> tail + sizeof(void*), data, size);
+        *((void**)list -> tail) = NULL;
+        list -> count++;
+    }
+    return 0;
+}
+
+int rafgl_list_remove(rafgl_list_t *list, int index)
+{
+    void *target, *i = list -> head;
+    if(index >= list -> count) return -1;
+    if(index < 0) index = list -> count + index;
+    if(index < 0) return -1;
+
+    if(index == 0)
+    {
+        target = list -> head;
+        list -> head = *((void**) list -> head);
+    }
+    else
+    {
+        index--;
+        while(index--)
+        {
+            i = *((void**)i);
+        }
+        target = *((void**)i);
+        *((void**)i) = *((void**)(*((void**)i)));
+
+    }
+    list -> count--;
+    free(target);
+    return 0;
+}
+
+void* rafgl_list_get(rafgl_list_t *list, int index)
+{
+    void *i = list -> head;
+
+    if(index >= list -> count) return NULL;
+    if(index < 0) index = list -> count + index;
+    if(index < 0) return NULL;
+
+    while(index--)
+    {
+        i = *((void**)i);
+    }
+
+    return i + sizeof(void*);
+}
+
+int rafgl_list_free(rafgl_list_t *list)
+{
+    void **i = list -> head;
+    void *curr;
+    while(i)
+    {
+        curr = i;
+        i = *i;
+        free(curr);
+    }
+    return 0;
 }
 
-void rafgl_meshPUN_init(rafgl_meshPUN_t *m)
+int rafgl_list_show(rafgl_list_t *list, void (*fun)(void*, int))
 {
-    m->loaded = 0;
-    m->triangle_count = 0;
-    m->vertex_count = 0;
-    m->vao_id = 0;
-    memset(m->name, 0, sizeof(m->name));
+    void **i = list -> head;
+    void *curr_data;
+    while(i)
+    {
+        curr_data = i + 1;
+        i = *i;
+        fun(curr_data, i == NULL);
+    }
+    return 0;
 }
 
-void rafgl_meshPUN_load_plane(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles)
+void rafgl_vector_init(rafgl_vector_t *vector, int element_size)
 {
-    rafgl_meshPUN_load_plane_offset(m, w, h, wtiles, htiles, vec3(0.0f, 0.0f, 0.0f));
+    rafgl_vector_init_allocator(vector, element_size, NULL, NULL);
 }
 
-void rafgl_meshPUN_load_plane_offset(rafgl_meshPUN_t *m, float w, float h, int wtiles, int htiles, vec3_t offset)
+void rafgl_vector_init_allocator(rafgl_vector_t *vector, int element_size, void* (*reallocate)(void *allocator, void *block, size_t old_size, size_t new_size), void *allocator)
 {
-    int num_vertices = wtiles * htiles * 6;
-    float tilew = w / wtiles;
-    float tileh = h / htiles;
+    memset(vector, 0, sizeof(*vector));
+    vector->element_size = element_size;
+    vector->reallocate = reallocate;
+    vector->allocator = allocator;
+}
 
-    rafgl_vertexPUN_t *data = malloc(num_vertices * sizeof(rafgl_vertexPUN_t));
+void rafgl_vector_reserve(rafgl_vector_t *vector, int capacity)
+{
+    size_t old_size = (size_t)vector->capacity * vector->element_size, new_size = (size_t)capacity * vector->element_size;
 
-    int vertex = 0, x, z;
+    if(capacity <= vector->capacity)
+        return;
 
-    for(z = 0; z < htiles; z++)
-    {
-        for(x = 0; x < wtiles; x++, vertex += 6)
-        {
-            data[vertex + 0].position = v3_add(vec3((x + 1) * tilew - w / 2, 0.0f, z * tileh - h / 2), offset);
-            data[vertex + 0].normal = vec3(0.0f, 1.0f, 0.0f);
-            data[vertex + 0].u = 1.0f / wtiles * (x + 1);
-            data[vertex + 0].v = 1.0f / htiles * z;
+    if(vector->reallocate)
+        vector->data = vector->reallocate(vector->allocator, vector->data, old_size, new_size);
+    else
+        vector->data = realloc(vector->data, new_size);
+    vector->capacity = capacity;
+}
 
-            data[vertex + 1].position = v3_add(vec3(x  * tilew - w / 2, 0.0f, z * tileh - h / 2), offset);
-            data[vertex + 1].normal = vec3(0.0f, 1.0f, 0.0f);
-            data[vertex + 1].u = 1.0f / wtiles * x;
-            data[vertex + 1].v = 1.0f / htiles * z;
+/* half again what there is, so a run of appends copies every element about twice in total */
+static void __rafgl_vector_grow(rafgl_vector_t *vector, int count)
+{
+    int capacity = vector->capacity + vector->capacity / 2;
 
-            data[vertex + 2].position = v3_add(vec3(x  * tilew - w / 2, 0.0f, (z + 1) * tileh - h / 2), offset);
-            data[vertex + 2].normal = vec3(0.0f, 1.0f, 0.0f);
-            data[vertex + 2].u = 1.0f / wtiles * x;
-            data[vertex + 2].v = 1.0f / htiles * (z + 1);
+    if(capacity < 16)
+        capacity = 16;
+    if(capacity < count)
+        capacity = count;
+    rafgl_vector_reserve(vector, capacity);
+}
 
-            data[vertex + 3].position = v3_add(vec3((x + 1) * tilew - w / 2, 0.0f, z * tileh - h / 2), offset);
-            data[vertex + 3].normal = vec3(0.0f, 1.0f, 0.0f);
-            data[vertex + 3].u = 1.0f / wtiles * (x + 1);
-            data[vertex + 3].v = 1.0f / htiles * z;
+int rafgl_vector_append(rafgl_vector_t *vector, const void *element)
+{
+    if(vector->count == vector->capacity)
+        __rafgl_vector_grow(vector, vector->count + 1);
 
-            data[vertex + 4].position = v3_add(vec3(x  * tilew - w / 2, 0.0f, (z + 1) * tileh - h / 2), offset);
-            data[vertex + 4].normal = vec3(0.0f, 1.0f, 0.0f);
-            data[vertex + 4].u = 1.0f / wtiles * x;
-            data[vertex + 4].v = 1.0f / htiles * (z + 1);
+    memcpy((char*)vector->data + (size_t)vector->count * vector->element_size, element, vector->element_size);
+    return vector->count++;
+}
 
-            data[vertex + 5].position = v3_add(vec3((x + 1)  * tilew - w / 2, 0.0f, (z + 1) * tileh - h / 2), offset);
-            data[vertex + 5].normal = vec3(0.0f, 1.0f, 0.0f);
-            data[vertex + 5].u = 1.0f / wtiles * (x + 1);
-            data[vertex + 5].v = 1.0f / htiles * (z + 1);
-        }
-    }
+void* rafgl_vector_append_many(rafgl_vector_t *vector, const void *elements, int count)
+{
+    char *first;
 
-    glGenVertexArrays(1, &m->vao_id);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
+    if(vector->count + count > vector->capacity)
+        __rafgl_vector_grow(vector, vector->count + count);
 
-    glBindVertexArray(m->vao_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    first = (char*)vector->data + (size_t)vector->count * vector->element_size;
+    if(elements)
+        memcpy(first, elements, (size_t)count * vector->element_size);
+    vector->count += count;
+    return first;
+}
 
-    glBufferData(GL_ARRAY_BUFFER,num_vertices * sizeof(rafgl_vertexPUN_t), data, GL_STATIC_DRAW);
+void* rafgl_vector_get(rafgl_vector_t *vector, int index)
+{
+    if(index < 0)
+        index += vector->count;
+    if(index < 0 || index >= vector->count)
+        return NULL;
 
-    free(data);
+    return (char*)vector->data + (size_t)index * vector->element_size;
+}
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+int rafgl_vector_remove(rafgl_vector_t *vector, int index)
+{
+    char *element = rafgl_vector_get(vector, index);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+    if(element == NULL)
+        return -1;
 
+    memmove(element, element + vector->element_size, (char*)vector->data + (size_t)vector->count * vector->element_size - element - vector->element_size);
+    vector->count--;
+    return 0;
+}
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+void rafgl_vector_clear(rafgl_vector_t *vector)
+{
+    vector->count = 0;
+}
 
-    glDeleteBuffers(1, &vbo);
+void rafgl_vector_free(rafgl_vector_t *vector)
+{
+    if(vector->reallocate)
+        vector->reallocate(vector->allocator, vector->data, (size_t)vector->capacity * vector->element_size, 0);
+    else
+        free(vector->data);
+    vector->data = NULL;
+    vector->count = vector->capacity = 0;
+}
 
-    m->loaded = 1;
-    sprintf(m->name, "%d x %d plane", wtiles, htiles);
-    m->triangle_count = wtiles * htiles * 2;
-    m->vertex_count =  wtiles * htiles * 6;
+rafgl_arena_t* rafgl_frame_arena(void)
+{
+    if(__frame_arena.base == NULL)
+        rafgl_arena_init(&__frame_arena, RAFGL_FRAME_ARENA_SIZE);
+    return &__frame_arena;
+}
 
+/* loading is the big user, the frames only need what their peak was since */
+static void __rafgl_frame_arena_after_init(void)
+{
+    if(__frame_arena.peak)
+        rafgl_log(RAFGL_INFO, "Init scratch peaked at %.1f MB\n", __frame_arena.peak / 1048576.0);
+    rafgl_arena_reset(&__frame_arena, 0);
+    rafgl_arena_trim(&__frame_arena);
 }
 
-static vec3_t calculate_normal(rafgl_raster_t *heightmap, int x, int z, float tilew, float tileh, float height)
+int rafgl_arena_init(rafgl_arena_t *arena, size_t size)
 {
-    if(x == 0 || x == heightmap->width - 1 || z == 0 || z == heightmap->height - 1)
+    memset(arena, 0, sizeof(*arena));
+    size = (size + RAFGL_ARENA_COMMIT_SIZE - 1) & ~(RAFGL_ARENA_COMMIT_SIZE - 1);
+
+#if defined(__unix__)
+    /* address space only, nothing is charged to the process until __rafgl_arena_commit opens it up */
+    void *base = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED)
     {
-        return vec3(0.0f, 1.0f, 0.0f);
+        rafgl_log(RAFGL_ERROR, "Could not reserve %zu MB for an arena\n", size >> 20);
+        return -1;
     }
-    vec3_t u = vec3(tilew, pixel_at_pm(heightmap, x + 1, z).r / 256.0f * height - pixel_at_pm(heightmap, x - 1, z).r / 256.0f * height, 0);
-    vec3_t v = vec3(0, pixel_at_pm(heightmap, x, z + 1).r / 256.0f * height - pixel_at_pm(heightmap, x, z - 1).r / 256.0f * height, -tileh);
-    return v3_cross(u, v);
+    arena->base = base;
+#else
+    size = rafgl_min_m(size, RAFGL_ARENA_HEAP_SIZE);
+    arena->base = malloc(size);
+    if(arena->base == NULL)
+    {
+        rafgl_log(RAFGL_ERROR, "Could not allocate %zu MB for an arena\n", size >> 20);
+        return -1;
+    }
+    arena->committed = size;
+#endif // __unix__
 
+    arena->size = size;
+    return 0;
 }
 
-void rafgl_meshPUN_load_terrain_from_heightmap(rafgl_meshPUN_t *m, float w, float h, const char *img_path, float height)
+/* makes the arena accessible up to at least end, end is within the reservation */
+static int __rafgl_arena_commit(rafgl_arena_t *arena, size_t end)
 {
+#if defined(__unix__)
+    size_t committed = rafgl_min_m((end + RAFGL_ARENA_COMMIT_SIZE - 1) & ~(RAFGL_ARENA_COMMIT_SIZE - 1), arena->size);
 
-    rafgl_raster_t map_raster;
-    rafgl_raster_load_from_image(&map_raster, img_path);
+    if(mprotect(arena->base + arena->committed, committed - arena->committed, PROT_READ | PROT_WRITE))
+    {
+        rafgl_log(RAFGL_ERROR, "Could not commit %zu MB of an arena\n", committed >> 20);
+        return -1;
+    }
+#if defined(MADV_HUGEPAGE)
+    madvise(arena->base + arena->committed, committed - arena->committed, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+    arena->committed = committed;
+#endif // __unix__
+    return 0;
+}
 
-    int wtiles = map_raster.width - 1;
-    int htiles = map_raster.height - 1;
+void* rafgl_arena_alloc(rafgl_arena_t *arena, size_t size)
+{
+    size_t start = (arena->used + RAFGL_ARENA_ALIGNMENT - 1) & ~(size_t)(RAFGL_ARENA_ALIGNMENT - 1);
 
-    int num_vertices = wtiles * htiles * 6;
-    float tilew = w / wtiles;
-    float tileh = h / htiles;
+    if(start + size > arena->size)
+    {
+        rafgl_log(RAFGL_ERROR, "Arena of %zu MB can not fit %zu more bytes\n", arena->size >> 20, size);
+        return NULL;
+    }
+    if(start + size > arena->committed && __rafgl_arena_commit(arena, start + size))
+        return NULL;
 
-    rafgl_vertexPUN_t *data = malloc(num_vertices * sizeof(rafgl_vertexPUN_t));
+    arena->used = start + size;
+    if(arena->used > arena->peak)
+        arena->peak = arena->used;
+    return arena->base + start;
+}
 
-    int vertex = 0, x, z;
-    vec3_t direction, normal;
+size_t rafgl_arena_mark(rafgl_arena_t *arena)
+{
+    return arena->used;
+}
 
-    for(z = 0; z < htiles; z++)
-    {
-        for(x = 0; x < wtiles; x++, vertex += 6)
-        {
-            data[vertex + 0].position = vec3((x + 1) * tilew - w / 2, pixel_at_m(map_raster, x + 1, z).r / 256.0f * height, z * tileh - h / 2);
-            data[vertex + 0].u = 1.0f / wtiles * (x + 1);
-            data[vertex + 0].v = 1.0f / htiles * z;
-            data[vertex + 0].normal = calculate_normal(&map_raster, x + 1, z, tilew, tileh, height);
+void rafgl_arena_reset(rafgl_arena_t *arena, size_t mark)
+{
+    arena->used = mark;
+}
 
-            data[vertex + 1].position = vec3(x  * tilew - w / 2, pixel_at_m(map_raster, x, z).r / 256.0f * height, z * tileh - h / 2);
-            data[vertex + 1].u = 1.0f / wtiles * x;
-            data[vertex + 1].v = 1.0f / htiles * z;
-            data[vertex + 1].normal = calculate_normal(&map_raster, x, z, tilew, tileh, height);
+void rafgl_arena_trim(rafgl_arena_t *arena)
+{
+#if defined(__unix__)
+    size_t start = (arena->used + RAFGL_ARENA_COMMIT_SIZE - 1) & ~(RAFGL_ARENA_COMMIT_SIZE - 1);
 
-            data[vertex + 2].position = vec3(x  * tilew - w / 2, pixel_at_m(map_raster, x, z + 1).r / 256.0f * height, (z + 1) * tileh - h / 2);
-            data[vertex + 2].u = 1.0f / wtiles * x;
-            data[vertex + 2].v = 1.0f / htiles * (z + 1);
-            data[vertex + 2].normal = calculate_normal(&map_raster, x, z + 1, tilew, tileh, height);
+    if(start < arena->committed)
+    {
+        madvise(arena->base + start, arena->committed - start, MADV_DONTNEED);
+        mprotect(arena->base + start, arena->committed - start, PROT_NONE);
+        arena->committed = start;
+    }
+#endif // __unix__
+    arena->peak = arena->used;
+}
 
+void rafgl_arena_cleanup(rafgl_arena_t *arena)
+{
+#if defined(__unix__)
+    if(arena->base)
+        munmap(arena->base, arena->size);
+#else
+    free(arena->base);
+#endif // __unix__
+    memset(arena, 0, sizeof(*arena));
+}
 
+void* rafgl_arena_reallocate(void *allocator, void *block, size_t old_size, size_t new_size)
+{
+    rafgl_arena_t *arena = allocator;
+    char *grown;
+    size_t end;
 
+    /* freeing is the reset of the scope the block was made in */
+    if(new_size == 0)
+        return NULL;
 
+    if(block && (char*)block + old_size == arena->base + arena->used)
+    {
+        end = (char*)block - arena->base + new_size;
+        if(end <= arena->size && (end <= arena->committed || !__rafgl_arena_commit(arena, end)))
+        {
+            arena->used = end;
+            if(arena->used > arena->peak)
+                arena->peak = arena->used;
+            return block;
+        }
+    }
 
+    grown = rafgl_arena_alloc(arena, new_size);
+    if(grown && block)
+        memcpy(grown, block, old_size < new_size ? old_size : new_size);
+    return grown;
+}
 
-            data[vertex + 3].position = vec3((x + 1) * tilew - w / 2, pixel_at_m(map_raster, x + 1, z).r / 256.0f * height, z * tileh - h / 2);
-            data[vertex + 3].u = 1.0f / wtiles * (x + 1);
-            data[vertex + 3].v = 1.0f / htiles * z;
-            data[vertex + 3].normal = calculate_normal(&map_raster, x + 1, z, tilew, tileh, height);
+static float __list_test_sum;
 
-            data[vertex + 4].position = vec3(x  * tilew - w / 2, pixel_at_m(map_raster, x, z + 1).r / 256.0f * height, (z + 1) * tileh - h / 2);
-            data[vertex + 4].u = 1.0f / wtiles * x;
-            data[vertex + 4].v = 1.0f / htiles * (z + 1);
-            data[vertex + 4].normal = calculate_normal(&map_raster, x, z + 1, tilew, tileh, height);
+static void __rafgl_list_test_scan(void *element, int last)
+{
+    __list_test_sum += ((vec3_t*)element)->x;
+}
 
-            data[vertex + 5].position = vec3((x + 1)  * tilew - w / 2, pixel_at_m(map_raster, x + 1, z + 1).r / 256.0f * height, (z + 1) * tileh - h / 2);
-            data[vertex + 5].u = 1.0f / wtiles * (x + 1);
-            data[vertex + 5].v = 1.0f / htiles * (z + 1);
-            data[vertex + 5].normal = calculate_normal(&map_raster, x + 1, z + 1, tilew, tileh, height);
+void rafgl_list_test(int count)
+{
+    rafgl_list_t list;
+    rafgl_vector_t vector;
+    vec3_t element = vec3(0.0f, 0.0f, 0.0f);
+    double start, list_append_ms, list_scan_ms, list_get_ms, vector_append_ms, vector_scan_ms, vector_get_ms;
+    float list_sum, vector_sum;
+    int i, gets = rafgl_min_m(count, 10000);
+
+    rafgl_list_init(&list, sizeof(vec3_t));
+    start = glfwGetTime();
+    for(i = 0; i < count; i++)
+    {
+        element.x = i & 1023;
+        rafgl_list_append(&list, &element);
+    }
+    list_append_ms = (glfwGetTime() - start) * 1000.0;
+
+    __list_test_sum = 0.0f;
+    start = glfwGetTime();
+    rafgl_list_show(&list, __rafgl_list_test_scan);
+    list_scan_ms = (glfwGetTime() - start) * 1000.0;
+    list_sum = __list_test_sum;
+
+    /* every get walks from the head, only the first few thousand */
+    start = glfwGetTime();
+    for(i = 0; i < gets; i++)
+        __list_test_sum += ((vec3_t*)rafgl_list_get(&list, i))->x;
+    list_get_ms = (glfwGetTime() - start) * 1000.0;
+
+    rafgl_vector_init(&vector, sizeof(vec3_t));
+    start = glfwGetTime();
+    for(i = 0; i < count; i++)
+    {
+        element.x = i & 1023;
+        rafgl_vector_append(&vector, &element);
+    }
+    vector_append_ms = (glfwGetTime() - start) * 1000.0;
 
+    vector_sum = 0.0f;
+    start = glfwGetTime();
+    for(i = 0; i < vector.count; i++)
+        vector_sum += rafgl_vector_at(&vector, vec3_t, i).x;
+    vector_scan_ms = (glfwGetTime() - start) * 1000.0;
 
-        }
-    }
+    start = glfwGetTime();
+    for(i = 0; i < gets; i++)
+        __list_test_sum += ((vec3_t*)rafgl_vector_get(&vector, i))->x;
+    vector_get_ms = (glfwGetTime() - start) * 1000.0;
 
-    glGenVertexArrays(1, &m->vao_id);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
+    if(list_sum != vector_sum)
+        rafgl_log(RAFGL_ERROR, "List and vector scans differ (%f, %f)!\n", list_sum, vector_sum);
 
-    glBindVertexArray(m->vao_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    rafgl_log(RAFGL_INFO, "[LIST %d] append %.3f ms | scan %.3f ms | %d gets %.3f ms\n", count, list_append_ms, list_scan_ms, gets, list_get_ms);
+    rafgl_log(RAFGL_INFO, "[VECTOR %d] append %.3f ms | scan %.3f ms | %d gets %.3f ms\n", count, vector_append_ms, vector_scan_ms, gets, vector_get_ms);
 
-    glBufferData(GL_ARRAY_BUFFER,num_vertices * sizeof(rafgl_vertexPUN_t), data, GL_STATIC_DRAW);
+    rafgl_list_free(&list);
+    rafgl_vector_free(&vector);
+}
 
-    free(data);
+/* distance between two floats in units in the last place, 0 for 0 and -0 */
+static int __rafgl_math_test_ulps(float a, float b)
+{
+    int32_t x, y;
+
+    if(a == b)
+        return 0;
+    memcpy(&x, &a, sizeof(x));
+    memcpy(&y, &b, sizeof(y));
+    if(x < 0) x = INT32_MIN - x;
+    if(y < 0) y = INT32_MIN - y;
+    return abs(x - y);
+}
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+void rafgl_math_test(int count)
+{
+    vec3_t *positions = malloc(count * sizeof(vec3_t)), *scalar_positions = malloc(count * sizeof(vec3_t)), *batch_positions = malloc(count * sizeof(vec3_t));
+    mat4_t *models = malloc(count * sizeof(mat4_t)), *scalar_models = malloc(count * sizeof(mat4_t)), *batch_models = malloc(count * sizeof(mat4_t));
+    float *bounds = malloc(6 * count * sizeof(float));
+    unsigned char *scalar_inside = malloc(count), *batch_inside = malloc(count);
+    aabbs_t boxes = {bounds, bounds + count, bounds + 2 * count, bounds + 3 * count, bounds + 4 * count, bounds + 5 * count};
+    mat4_t view_projection = m4_mul(m4_perspective(60.0f, 16.0f / 9.0f, 0.1f, 500.0f), m4_look_at(vec3(0.0f, 20.0f, 0.0f), vec3(50.0f, 0.0f, 50.0f), vec3(0.0f, 1.0f, 0.0f)));
+    float planes[6][4];
+    double start, scalar_ms[3], batch_ms[3];
+    int i, c, r, position_ulps = 0, matrix_ulps = 0, box_mismatches = 0, scalar_visible = 0, batch_visible;
+
+    /* the clip planes the same way cull_frustum_from_matrix gets them, left unnormalised */
+    for(i = 0; i < 6; i++)
+        for(c = 0; c < 4; c++)
+            planes[i][c] = view_projection.m[c][3] + (i & 1 ? -1.0f : 1.0f) * view_projection.m[c][i / 2];
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+    for(i = 0; i < count; i++)
+    {
+        vec3_t at = vec3(randf() * 1000.0f - 500.0f, randf() * 100.0f - 50.0f, randf() * 1000.0f - 500.0f);
+        positions[i] = at;
+        models[i] = m4_mul(m4_translation(at), m4_mul(m4_rotation_y(randf() * 6.2831853f), m4_scaling(vec3(1.0f + randf(), 1.0f + randf(), 1.0f + randf()))));
+        for(c = 0; c < 3; c++)
+        {
+            bounds[c * count + i] = (&at.x)[c];
+            bounds[(c + 3) * count + i] = (&at.x)[c] + randf() * 10.0f;
+        }
+    }
 
+    /* the first write to a page faults, neither side should pay for that */
+    memset(scalar_positions, 0, count * sizeof(vec3_t));
+    memset(batch_positions, 0, count * sizeof(vec3_t));
+    memset(scalar_models, 0, count * sizeof(mat4_t));
+    memset(batch_models, 0, count * sizeof(mat4_t));
+    memset(scalar_inside, 0, count);
+    memset(batch_inside, 0, count);
+
+    start = glfwGetTime();
+    for(i = 0; i < count; i++)
+        scalar_positions[i] = m4_mul_pos(view_projection, positions[i]);
+    scalar_ms[0] = (glfwGetTime() - start) * 1000.0;
+    start = glfwGetTime();
+    m4_mul_pos_n(view_projection, positions, batch_positions, count);
+    batch_ms[0] = (glfwGetTime() - start) * 1000.0;
+
+    start = glfwGetTime();
+    for(i = 0; i < count; i++)
+        scalar_models[i] = m4_mul(view_projection, models[i]);
+    scalar_ms[1] = (glfwGetTime() - start) * 1000.0;
+    start = glfwGetTime();
+    m4_mul_n(view_projection, models, batch_models, count);
+    batch_ms[1] = (glfwGetTime() - start) * 1000.0;
+
+    start = glfwGetTime();
+    for(i = 0; i < count; i++)
+    {
+        scalar_inside[i] = aabb_in_planes(planes[0], 6, vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]), vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]));
+        scalar_visible += scalar_inside[i];
+    }
+    scalar_ms[2] = (glfwGetTime() - start) * 1000.0;
+    start = glfwGetTime();
+    batch_visible = aabbs_in_planes(planes[0], 6, boxes, 0, count, batch_inside);
+    batch_ms[2] = (glfwGetTime() - start) * 1000.0;
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for(i = 0; i < count; i++)
+    {
+        position_ulps = rafgl_max_m(position_ulps, __rafgl_math_test_ulps(scalar_positions[i].x, batch_positions[i].x));
+        position_ulps = rafgl_max_m(position_ulps, __rafgl_math_test_ulps(scalar_positions[i].y, batch_positions[i].y));
+        position_ulps = rafgl_max_m(position_ulps, __rafgl_math_test_ulps(scalar_positions[i].z, batch_positions[i].z));
+        for(c = 0; c < 4; c++)
+            for(r = 0; r < 4; r++)
+                matrix_ulps = rafgl_max_m(matrix_ulps, __rafgl_math_test_ulps(scalar_models[i].m[c][r], batch_models[i].m[c][r]));
+        box_mismatches += scalar_inside[i] != batch_inside[i];
+    }
 
-    glDeleteBuffers(1, &vbo);
+    if(position_ulps || matrix_ulps || box_mismatches || scalar_visible != batch_visible)
+        rafgl_log(RAFGL_ERROR, "Batch math differs from scalar: points %d ulps, matrices %d ulps, %d boxes\n", position_ulps, matrix_ulps, box_mismatches);
 
-    m->loaded = 1;
-    sprintf(m->name, "%d x %d plane", wtiles, htiles);
-    m->triangle_count = wtiles * htiles * 2;
-    m->vertex_count =  wtiles * htiles * 6;
+    rafgl_log(RAFGL_INFO, "[MATH %d, %s] points %.3f -> %.3f ms | matrices %.3f -> %.3f ms | boxes %.3f -> %.3f ms (%d inside)\n", count, MATH_3D_SIMD,
+              scalar_ms[0], batch_ms[0], scalar_ms[1], batch_ms[1], scalar_ms[2], batch_ms[2], batch_visible);
 
+    free(positions); free(scalar_positions); free(batch_positions);
+    free(models); free(scalar_models); free(batch_models);
+    free(bounds); free(scalar_inside); free(batch_inside);
 }
 
-void rafgl_meshPUN_load_cube(rafgl_meshPUN_t *m, float coord)
+int rafgl_file_size(const char *filepath)
 {
-    float coord_sign = coord > 0 ? 1.0f : -1.0f;
-    GLfloat cube_vertices[] = {
-        /* positions                   UV                              normals */
-         coord,  coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
-        -coord,  coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
-        -coord,  coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
-//y+
-         coord,  coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
-        -coord,  coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
-         coord,  coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign *  1.0f, 0.0f,
-
-
-         coord, -coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
-        -coord, -coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
-        -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
-//y-
-         coord, -coord,  coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
-        -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
-         coord, -coord, -coord,         0.0f, 0.0f,                    0.0f,  coord_sign * -1.0f, 0.0f,
+    int size = 0;
+    FILE *f = fopen(filepath, "rt");
 
+    if(f == NULL)
+        return -1;
 
+    fseek(f, 0L, SEEK_END);
 
+    size = ftell(f);
 
+    fclose(f);
 
-         coord,  coord, -coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
-         coord,  coord,  coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
-         coord, -coord,  coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
-//x+
-         coord,  coord, -coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
-         coord, -coord,  coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
-         coord, -coord, -coord,         0.0f, 0.0f,                    coord_sign *  1.0f,  0.0f,  0.0f,
+    return size;
+}
 
+char* rafgl_file_read_content(const char *filepath)
+{
+    int fsize = rafgl_file_size(filepath);
+    FILE *f = fsize < 0 ? NULL : fopen(filepath, "rt");
 
+    if(f == NULL)
+        return NULL;
 
+    fseek(f, 0, SEEK_SET);
 
-        -coord,  coord,  coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
-        -coord,  coord, -coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
-        -coord, -coord, -coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
-//x-
-        -coord,  coord,  coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
-        -coord, -coord, -coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
-        -coord, -coord,  coord,         0.0f, 0.0f,                    coord_sign * -1.0f,  0.0f,  0.0f,
+    char *content = calloc(sizeof(char), fsize + 10);          /* This must later be freed */
 
+    fread(content, 1, fsize, f);
 
+    fclose(f);
 
+    *(content + fsize) = 0;
+    return content;
+}
 
+/* program binary cache: ARB_get_program_binary (core in 4.1) is not in the 3.3 loader, its entry points are looked up by hand */
+#define RAFGL_GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define RAFGL_GL_PROGRAM_BINARY_LENGTH 0x8741
+#define RAFGL_GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
 
-         coord,  coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
-        -coord,  coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
-        -coord, -coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
-//z+
-         coord,  coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
-        -coord, -coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
-         coord, -coord,  coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign *  1.0f,
+typedef void (APIENTRYP __rafgl_get_program_binary_t)(GLuint program, GLsizei size, GLsizei *length, GLenum *format, void *binary);
+typedef void (APIENTRYP __rafgl_program_binary_t)(GLuint program, GLenum format, const void *binary, GLsizei length);
+typedef void (APIENTRYP __rafgl_program_parameteri_t)(GLuint program, GLenum name, GLint value);
 
+static __rafgl_get_program_binary_t __rafgl_glGetProgramBinary = NULL;
+static __rafgl_program_binary_t __rafgl_glProgramBinary = NULL;
+static __rafgl_program_parameteri_t __rafgl_glProgramParameteri = NULL;
 
+static char __program_cache_directory[256] = "";
+/* -1 until the first program is created, the driver has to be current to ask */
+static int __program_binary_support = -1;
+static unsigned long long __program_driver_hash = 0;
+static int __program_cache_hits = 0, __program_compiles = 0;
+static double __program_cache_hit_ms = 0.0, __program_compile_ms = 0.0;
 
+void rafgl_program_cache_set_directory(const char *directory)
+{
+    __program_cache_directory[0] = 0;
+    if(directory == NULL)
+        return;
 
-        -coord,  coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
-         coord,  coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
-         coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
-//z-
-        -coord,  coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
-         coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
-        -coord, -coord, -coord,         0.0f, 0.0f,                    0.0f, 0.0f,  coord_sign * -1.0f,
-    };
+    if(mkdir(directory, 0755) && access(directory, W_OK))
+    {
+        rafgl_log(RAFGL_WARNING, "Program cache directory %s can not be written, programs are compiled on every start\n", directory);
+        return;
+    }
+    snprintf(__program_cache_directory, sizeof(__program_cache_directory), "%s", directory);
+}
 
-    glGenVertexArrays(1, &m->vao_id);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
+/* cold (compiled) against warm (linked from the cache) starts */
+static void __rafgl_program_cache_report(double init_ms)
+{
+    rafgl_log(RAFGL_INFO, "[STARTUP] init %.1f ms, %d programs linked from the cache in %.1f ms, %d compiled in %.1f ms\n", init_ms,
+              __program_cache_hits, __program_cache_hit_ms, __program_compiles, __program_compile_ms);
+}
 
-    glBindVertexArray(m->vao_id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+/* FNV-1a over the string and its terminator, so the boundaries between the strings hashed one after another count */
+static unsigned long long __rafgl_hash_string(unsigned long long hash, const char *s)
+{
+    do
+    {
+        hash ^= (unsigned char)*s;
+        hash *= 0x100000001b3ULL;
+    } while(*s++);
+    return hash;
+}
 
-    glBufferData(GL_ARRAY_BUFFER, 6 * 2 * 3 * (3 + 2 + 3) * sizeof(GLfloat), cube_vertices, GL_STATIC_DRAW);
+static int __rafgl_program_binary_supported(void)
+{
+    GLint formats = 0;
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+    if(__program_binary_support >= 0)
+        return __program_binary_support;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (3 + 2 + 3) *sizeof(GLfloat), (void*)(5 * sizeof(float)));
+    __program_binary_support = 0;
+    if(GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1) || glfwExtensionSupported("GL_ARB_get_program_binary"))
+    {
+        __rafgl_glGetProgramBinary = (__rafgl_get_program_binary_t)glfwGetProcAddress("glGetProgramBinary");
+        __rafgl_glProgramBinary = (__rafgl_program_binary_t)glfwGetProcAddress("glProgramBinary");
+        __rafgl_glProgramParameteri = (__rafgl_program_parameteri_t)glfwGetProcAddress("glProgramParameteri");
+        if(__rafgl_glGetProgramBinary && __rafgl_glProgramBinary && __rafgl_glProgramParameteri)
+            glGetIntegerv(RAFGL_GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        __program_binary_support = formats > 0;
+    }
 
+    if(!__program_binary_support)
+    {
+        rafgl_log(RAFGL_INFO, "The driver has no program binary formats, programs are compiled on every start\n");
+        return 0;
+    }
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    __program_driver_hash = __rafgl_hash_string(0xcbf29ce484222325ULL, (const char*)glGetString(GL_VENDOR));
+    __program_driver_hash = __rafgl_hash_string(__program_driver_hash, (const char*)glGetString(GL_RENDERER));
+    __program_driver_hash = __rafgl_hash_string(__program_driver_hash, (const char*)glGetString(GL_VERSION));
+    return 1;
+}
 
-    glDeleteBuffers(1, &vbo);
+/* the file is the binary format and length followed by the binary, a program the driver refuses to link from it is compiled again */
+static GLuint __rafgl_program_cache_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    GLenum format;
+    GLint length, success = 0;
+    GLuint program = 0;
+    void *binary;
 
-    m->loaded = 1;
-    strcpy(m->name, "cube");
-    m->triangle_count = 6 * 2;
-    m->vertex_count = 6 * 2 * 3;
+    if(f == NULL)
+        return 0;
 
+    if(fread(&format, sizeof(format), 1, f) == 1 && fread(&length, sizeof(length), 1, f) == 1 && length > 0)
+    {
+        binary = malloc(length);
+        if(fread(binary, 1, length, f) == (size_t)length)
+        {
+            program = glCreateProgram();
+            __rafgl_glProgramBinary(program, format, binary, length);
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if(!success)
+            {
+                rafgl_log(RAFGL_WARNING, "Cached program %s was rejected, compiling it again\n", path);
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        free(binary);
+    }
 
+    fclose(f);
+    return program;
 }
 
-void rafgl_meshPUN_load_from_OBJ(rafgl_meshPUN_t *m, const char *obj_path)
+/* written next to the final name and renamed over it, a start that dies halfway never leaves half a binary behind */
+static void __rafgl_program_cache_save(GLuint program, const char *path)
 {
-    rafgl_meshPUN_load_from_OBJ_offset(m, obj_path, vec3(0.0f, 0.0f, 0.0f));
-}
+    char temporary[sizeof(__program_cache_directory) + 64];
+    GLenum format;
+    GLint length = 0, success = 0;
+    void *binary;
+    FILE *f;
 
-/* TODO: create cache system */
-void rafgl_meshPUN_load_from_OBJ_offset(rafgl_meshPUN_t *m, const char *obj_path, vec3_t position_offset)
-{
-    if(m->loaded)
-    {
-        rafgl_log(RAFGL_WARNING, "Trying to load to already loaded mesh! Loading from [%s] to mesh taken by [%s]", obj_path, m->name);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, RAFGL_GL_PROGRAM_BINARY_LENGTH, &length);
+    if(!success || length <= 0)
         return;
+
+    binary = malloc(length);
+    __rafgl_glGetProgramBinary(program, length, &length, &format, binary);
+
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    f = fopen(temporary, "wb");
+    if(f != NULL)
+    {
+        fwrite(&format, sizeof(format), 1, f);
+        fwrite(&length, sizeof(length), 1, f);
+        fwrite(binary, 1, length, f);
+        fclose(f);
+        rename(temporary, path);
     }
-    rafgl_list_t vertices, uv_coordinates, normals;
-    rafgl_list_init(&vertices, sizeof(vec3_t));
-    rafgl_list_init(&uv_coordinates, sizeof(vec3_t));
-    rafgl_list_init(&normals, sizeof(vec3_t));
-    vec3_t vectmp;
+    free(binary);
+}
 
-    FILE *f = fopen(obj_path, "rt");
-    char line[256];
+/* compiles and links without asking for a status, so nothing waits on the driver */
+static GLuint __rafgl_program_start(const char *vertex_source, const char *fragment_source, int retrievable, GLuint *vert, GLuint *frag)
+{
+    GLuint program;
 
+    *vert = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(*vert, 1, &vertex_source, NULL);
+    glCompileShader(*vert);
 
-    while(!feof(f))
-    {
-        fgets(line, 256, f);
+    *frag = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(*frag, 1, &fragment_source, NULL);
+    glCompileShader(*frag);
 
+    program = glCreateProgram();
 
-        if(line[0] == 'o' && line[1] == ' ')
-		{
-			strcpy(m->name, line + 2);
-			m->name[strlen(m->name) - 1] = '\0';
-		}
+    glAttachShader(program, *vert);
+    glAttachShader(program, *frag);
 
-		if(line[0] == 'v' && line[1] == ' ')
-		{
-			sscanf(line + 2, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
-			vectmp = v3_add(vectmp, position_offset);
-			rafgl_list_append(&vertices, &vectmp);
-		}
-		else if (line[0] == 'v' && line[1] == 't')
-		{
-			sscanf(line + 3, "%f%f", &(vectmp.x), &(vectmp.y));
-			vectmp.z = 0;
-			rafgl_list_append(&uv_coordinates, &vectmp);
-		}
-		else if (line[0] == 'v' && line[1] == 'n')
-		{
-			sscanf(line + 3, "%f%f%f", &(vectmp.x), &(vectmp.y), &(vectmp.z));
-			rafgl_list_append(&normals, &vectmp);
-		}
-		else if (line[0] == 'f')
-		{
-			break;
-		}
+    if(retrievable)
+        __rafgl_glProgramParameteri(program, RAFGL_GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
 
-    }
+    return program;
+}
 
-    vec3_t *vertices_buffer, *uv_buffer, *normals_buffer;
+/* logs what failed to compile or link and lets go of the shaders, waits for the driver if it is still at it. 1 if the program linked */
+static int __rafgl_program_check(GLuint program, GLuint vert, GLuint frag)
+{
+    int success, linked;
+    char info_log[512];
 
-    vertices_buffer = malloc(vertices.count * sizeof(vec3_t));
-    uv_buffer = malloc(uv_coordinates.count * sizeof(vec3_t));
-    normals_buffer = malloc(normals.count * sizeof(vec3_t));
+    glGetShaderiv(vert, GL_COMPILE_STATUS, &success);
 
-    vec3_t *vb1, *vb2, *vb3;
-    int o1 = 0, o2 = 0, o3 = 0;
-    while((vb1 = rafgl_list_get(&vertices, 0)) != NULL && (vb2 = rafgl_list_get(&uv_coordinates, 0)) != NULL && (vb3 = rafgl_list_get(&normals, 0)) != NULL)
+    if(!success)
     {
-        vertices_buffer[o1++] = *vb1;
-        uv_buffer[o2++] = *vb2;
-        normals_buffer[o3++] = *vb3;
-        rafgl_list_remove(&vertices, 0);
-        rafgl_list_remove(&uv_coordinates, 0);
-        rafgl_list_remove(&normals, 0);
+        glGetShaderInfoLog(vert, 512, NULL, info_log);
+        fprintf(stderr, "ERROR::SHADER::VERTEX::COMPILE_FAILED\n%s\n", info_log);
     }
 
-    while((vb1 = rafgl_list_get(&vertices, 0)) != NULL)
-    {
-        vertices_buffer[o1++] = *vb1;
-        rafgl_list_remove(&vertices, 0);
-    }
+    glGetShaderiv(frag, GL_COMPILE_STATUS, &success);
 
-    while((vb1 = rafgl_list_get(&uv_coordinates, 0)) != NULL)
+    if(!success)
     {
-        uv_buffer[o2++] = *vb1;
-        rafgl_list_remove(&uv_coordinates, 0);
+        glGetShaderInfoLog(frag, 512, NULL, info_log);
+        fprintf(stderr, "ERROR::SHADER::FRAGMENT::COMPILE_FAILED\n%s\n", info_log);
     }
 
-    while((vb1 = rafgl_list_get(&normals, 0)) != NULL)
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked)
     {
-        normals_buffer[o3++] = *vb1;
-        rafgl_list_remove(&normals, 0);
+        glGetProgramInfoLog(program, 512, NULL, info_log);
+        fprintf(stderr, "ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", info_log);
     }
 
-	int fake_uvs = 0;
-	rafgl_list_t vertex_indices, uv_indices, normal_indices;
-    rafgl_list_init(&vertex_indices, sizeof(int));
-    rafgl_list_init(&uv_indices, sizeof(int));
-    rafgl_list_init(&normal_indices, sizeof(int));
 
-    int v1, v2, v3;
-    int n1, n2, n3;
-    int t1, t2, t3;
+    glDeleteShader(vert);
+    glDeleteShader(frag);
 
-    while(!feof(f))
-	{
-		while(line[0] != 'f' && !feof(f))
-		{
-			fgets(line, 256, f);
-		}
+    return linked;
+}
 
+/* a program from the cache, or 0 with path set to where it should be saved ("" when the cache is off) */
+static GLuint __rafgl_program_cache_find(const char *vertex_source, const char *fragment_source, char *path)
+{
+    unsigned long long key;
 
+    path[0] = 0;
+    if(!__program_cache_directory[0] || !__rafgl_program_binary_supported())
+        return 0;
 
-		int matches = sscanf(line + 2, "%d/%d/%d %d/%d/%d %d/%d/%d", &v1, &t1, &n1, &v2, &t2, &n2, &v3, &t3, &n3);
-		if(matches != 9)
-		{
-			matches = sscanf(line + 2, "%d//%d %d//%d %d//%d", &v1, &n1, &v2, &n2, &v3, &n3);
-			if(matches != 6)
-			{
-				rafgl_log(RAFGL_WARNING, "File can't be read, try exporting with other options [matches = %d]", matches);
-				rafgl_log(RAFGL_WARNING, "error on: %s\n", line);
-				return;
-			}
-			else
-			{
-				t1 = t2 = t3 = 1;
-				if(!fake_uvs)
-				{
-				    fake_uvs = 1;
-                    rafgl_log(RAFGL_WARNING, "Using fake uvs for model on path [%s]\n", obj_path);
-				}
-			}
+    key = __rafgl_hash_string(__rafgl_hash_string(__program_driver_hash, vertex_source), fragment_source);
+    snprintf(path, sizeof(__program_cache_directory) + 32, "%s" SYSTEM_SEPARATOR "%016llx.bin", __program_cache_directory, key);
 
+    return __rafgl_program_cache_load(path);
+}
 
-		}
 
-		rafgl_list_append(&vertex_indices, &v1);
-		rafgl_list_append(&vertex_indices, &v2);
-		rafgl_list_append(&vertex_indices, &v3);
+GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source)
+{
+    char path[sizeof(__program_cache_directory) + 32];
+    double start = glfwGetTime();
+    GLuint program, vert, frag;
 
-		rafgl_list_append(&uv_indices, &t1);
-		rafgl_list_append(&uv_indices, &t2);
-		rafgl_list_append(&uv_indices, &t3);
+    program = __rafgl_program_cache_find(vertex_source, fragment_source, path);
+    if(program)
+    {
+        __program_cache_hits++;
+        __program_cache_hit_ms += (glfwGetTime() - start) * 1000.0;
+        return program;
+    }
 
-		rafgl_list_append(&normal_indices, &n1);
-		rafgl_list_append(&normal_indices, &n2);
-		rafgl_list_append(&normal_indices, &n3);
-		fgets(line, 256, f);
+    program = __rafgl_program_start(vertex_source, fragment_source, path[0] != 0, &vert, &frag);
+    if(__rafgl_program_check(program, vert, frag) && path[0])
+        __rafgl_program_cache_save(program, path);
 
+    __program_compiles++;
+    __program_compile_ms += (glfwGetTime() - start) * 1000.0;
+    return program;
+}
 
+/* a shader file with its #include lines expanded, NULL when the file can not be read. An include that can not be read is left
+   in place for the compiler to reject */
+static char* __rafgl_program_read_source(const char *filepath)
+{
+    char *source = rafgl_file_read_content(filepath), *include, *line, *next, *name_end;
+    char path[255];
+    rafgl_vector_t expanded;
+    int line_number = 1, length;
 
-	}
+    if(source == NULL || strstr(source, "#include") == NULL)
+        return source;
 
-	if(fake_uvs)
+    rafgl_vector_init(&expanded, 1);
+    for(line = source; *line; line = next, line_number++)
     {
-        vectmp = vec3(0.0f, 0.0f, 0.0f);
-        rafgl_list_append(&uv_coordinates, &vectmp);
+        next = strchr(line, '\n');
+        next = next ? next + 1 : line + strlen(line);
+
+        include = line + strspn(line, " \t");
+        if(strncmp(include, "#include", 8) == 0 && (include = strchr(include, '"')) && (name_end = strchr(include + 1, '"')) && name_end < next)
+        {
+            snprintf(path, sizeof(path), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "include" SYSTEM_SEPARATOR "%.*s", (int)(name_end - include - 1), include + 1);
+            include = rafgl_file_read_content(path);
+            if(include)
+            {
+                rafgl_vector_append_many(&expanded, "#line 1\n", 8);
+                rafgl_vector_append_many(&expanded, include, strlen(include));
+                length = snprintf(path, sizeof(path), "\n#line %d\n", line_number + 1);
+                rafgl_vector_append_many(&expanded, path, length);
+                free(include);
+                continue;
+            }
+            rafgl_log(RAFGL_ERROR, "%s: can not read %s\n", filepath, path);
+        }
+        rafgl_vector_append_many(&expanded, line, next - line);
     }
+    rafgl_vector_append_many(&expanded, "", 1);
+    free(source);
 
-    rafgl_vertexPUN_t *vertex_buffer = malloc(vertex_indices.count * sizeof(rafgl_vertexPUN_t));
-    int i;
-    int vert_ind;
-    int uv_ind;
-    int norm_ind;
+    /* handed out as a plain string, freed like any other source */
+    return expanded.data;
+}
 
-    vec3_t vertex_data, uv_data, normal_data;
+GLuint rafgl_program_create(const char *vertex_source_filepath, const char *fragment_source_filepath)
+{
+    GLuint program;
 
-    int vcount = vertex_indices.count;
-    for(i = 0; i < vcount; i++)
-    {
-        vert_ind = *((int*)rafgl_list_get(&vertex_indices, 0));
-		uv_ind = *((int*)rafgl_list_get(&uv_indices, 0));
-		norm_ind = *((int*)rafgl_list_get(&normal_indices, 0));
+    char *vert_source = __rafgl_program_read_source(vertex_source_filepath);
+    char *frag_source = __rafgl_program_read_source(fragment_source_filepath);
 
-		rafgl_list_remove(&vertex_indices, 0);
-		rafgl_list_remove(&uv_indices, 0);
-		rafgl_list_remove(&normal_indices, 0);
 
-		vertex_data = vertices_buffer[vert_ind - 1];
-		uv_data = uv_buffer[uv_ind - 1];
-		normal_data = normals_buffer[norm_ind - 1];
+    program = rafgl_program_create_from_source(vert_source, frag_source);
 
-		vertex_buffer[i].position = vertex_data;
-        vertex_buffer[i].normal = normal_data;
-        vertex_buffer[i].u = uv_data.x;
-        vertex_buffer[i].v = 1.0f - uv_data.y;
+    free(vert_source);
+    free(frag_source);
 
+    return program;
+}
 
+GLuint rafgl_program_create_from_name(const char *program_name)
+{
+    char v[255], f[255];
+    v[0] = 0;
+    f[0] = 0;
 
-    }
+    strcat(v, "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR);
+    strcat(v, program_name);
+    strcat(v, SYSTEM_SEPARATOR "vert.glsl");
 
-    /* GL BUFFER DATA */
+    strcat(f, "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR);
+    strcat(f, program_name);
+    strcat(f, SYSTEM_SEPARATOR "frag.glsl");
 
-	int vao;
-	glGenVertexArrays(1, &vao);
+    return rafgl_program_create(v, f);
+}
 
-	m -> vao_id = vao;
-	m -> vertex_count = vcount;
-	m -> triangle_count = vcount / 3;
+/* KHR_parallel_shader_compile, or the ARB one it came from, lets the driver compile on its own threads and answer
+   GL_COMPLETION_STATUS without waiting. Neither is in the 3.3 loader */
+#define RAFGL_GL_COMPLETION_STATUS 0x91B1
 
-	glBindVertexArray(vao);
+typedef void (APIENTRYP __rafgl_max_shader_compiler_threads_t)(GLuint count);
 
-	int data_buffer;
-	glGenBuffers(1, &data_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, data_buffer);
-	glBufferData(GL_ARRAY_BUFFER, vcount * sizeof(rafgl_vertexPUN_t), vertex_buffer, GL_STATIC_DRAW);
+static int __parallel_compile_support = -1;
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+static int __rafgl_parallel_compile_supported(void)
+{
+    __rafgl_max_shader_compiler_threads_t max_threads = NULL;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(3 * sizeof(float)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(rafgl_vertexPUN_t), (void*)(5 * sizeof(float)));
+    if(__parallel_compile_support >= 0)
+        return __parallel_compile_support;
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    if(glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        max_threads = (__rafgl_max_shader_compiler_threads_t)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if(glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        max_threads = (__rafgl_max_shader_compiler_threads_t)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+
+    /* as many threads as the driver likes */
+    if(max_threads)
+        max_threads(0xFFFFFFFF);
+    __parallel_compile_support = max_threads != NULL;
+    return __parallel_compile_support;
+}
+
+void rafgl_program_batch_init(rafgl_program_batch_t *batch)
+{
+    memset(batch, 0, sizeof(*batch));
+    __rafgl_parallel_compile_supported();
+}
 
+void rafgl_program_batch_add(rafgl_program_batch_t *batch, const char *vertex_source, const char *fragment_source, GLuint *program)
+{
+    char path[sizeof(__program_cache_directory) + 32];
+    double start = glfwGetTime();
+    rafgl_program_batch_entry_t *entry;
+
+    if(batch->count == batch->capacity)
+    {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+        batch->entries = realloc(batch->entries, batch->capacity * sizeof(rafgl_program_batch_entry_t));
+    }
+    entry = &batch->entries[batch->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->target = program;
 
-    /* free RAM */
-	free(vertex_buffer);
+    entry->program = __rafgl_program_cache_find(vertex_source, fragment_source, path);
+    if(entry->program)
+    {
+        __program_cache_hits++;
+        __program_cache_hit_ms += (glfwGetTime() - start) * 1000.0;
+        return;
+    }
 
-	rafgl_list_free(&vertices);
-	rafgl_list_free(&uv_coordinates);
-	rafgl_list_free(&normals);
+    entry->program = __rafgl_program_start(vertex_source, fragment_source, path[0] != 0, &entry->vert, &entry->frag);
+    if(path[0])
+        entry->cache_path = strdup(path);
 
-	rafgl_list_free(&vertex_indices);
-	rafgl_list_free(&uv_indices);
-	rafgl_list_free(&normal_indices);
-	m->loaded = 1;
+    __program_compiles++;
+    batch->submit_ms += (glfwGetTime() - start) * 1000.0;
+}
 
-	free(vertices_buffer);
-	free(uv_buffer);
-	free(normals_buffer);
+void rafgl_program_batch_add_from_name(rafgl_program_batch_t *batch, const char *program_name, GLuint *program)
+{
+    char v[255], f[255];
+    char *vert_source, *frag_source;
 
-    fclose(f);
+    snprintf(v, sizeof(v), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "vert.glsl", program_name);
+    snprintf(f, sizeof(f), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "frag.glsl", program_name);
 
-}
+    vert_source = __rafgl_program_read_source(v);
+    frag_source = __rafgl_program_read_source(f);
 
+    rafgl_program_batch_add(batch, vert_source, frag_source, program);
 
-int rafgl_list_init(rafgl_list_t *list, int element_size)
-{
-    list -> count = 0;
-    list -> element_size = element_size;
-    list -> head = NULL;
-    list -> tail = NULL;
-    return 0;
+    free(vert_source);
+    free(frag_source);
 }
 
-int rafgl_list_append(rafgl_list_t *list, void *data)
+int rafgl_program_batch_ready(rafgl_program_batch_t *batch)
 {
-    return rafgl_list_append_sized(list, list -> element_size, data);
-}
+    GLint done;
+    int i;
 
-int rafgl_list_append_sized(rafgl_list_t *list, int size, void *data)
-{
-    if(list -> head == NULL && list -> tail == NULL)
-    {
-        list -> head = list -> tail = malloc(sizeof(void*) + size);
-        memcpy(list -> tail + sizeof(void*), data, size);
-        *((void**)list -> tail) = NULL;
-        list -> count++;
-    }
-    else
+    if(!__rafgl_parallel_compile_supported())
+        return 1;
+
+    for(i = 0; i < batch->count; i++)
     {
-        *((void**)list -> tail) = malloc(sizeof(void*) + size);
-        list -> tail = *((void**)list -> tail);
-        memcpy(list -> tail + sizeof(void*), data, size);
-        *((void**)list -> tail) = NULL;
-        list -> count++;
+        if(!batch->entries[i].vert)
+            continue;
+        glGetProgramiv(batch->entries[i].program, RAFGL_GL_COMPLETION_STATUS, &done);
+        if(!done)
+            return 0;
     }
-    return 0;
+    return 1;
 }
 
-int rafgl_list_remove(rafgl_list_t *list, int index)
+void rafgl_program_batch_finish(rafgl_program_batch_t *batch)
 {
-    void *target, *i = list -> head;
-    if(index >= list -> count) return -1;
-    if(index < 0) index = list -> count + index;
-    if(index < 0) return -1;
+    rafgl_program_batch_entry_t *entry;
+    double start = glfwGetTime();
+    int i, compiled = 0, ready = rafgl_program_batch_ready(batch);
 
-    if(index == 0)
-    {
-        target = list -> head;
-        list -> head = *((void**) list -> head);
-    }
-    else
+    for(i = 0; i < batch->count; i++)
     {
-        index--;
-        while(index--)
+        entry = &batch->entries[i];
+        if(entry->vert)
         {
-            i = *((void**)i);
+            compiled++;
+            if(__rafgl_program_check(entry->program, entry->vert, entry->frag) && entry->cache_path)
+                __rafgl_program_cache_save(entry->program, entry->cache_path);
+            free(entry->cache_path);
         }
-        target = *((void**)i);
-        *((void**)i) = *((void**)(*((void**)i)));
-
+        *entry->target = entry->program;
     }
-    list -> count--;
-    free(target);
-    return 0;
+
+    __program_compile_ms += batch->submit_ms + (glfwGetTime() - start) * 1000.0;
+    if(compiled)
+        rafgl_log(RAFGL_INFO, "Program batch: %d compiled in %.1f ms of submitting and %.1f ms of waiting at the end (%s, %s by then)\n", compiled, batch->submit_ms,
+                  (glfwGetTime() - start) * 1000.0, __parallel_compile_support ? "parallel compile" : "no parallel compile", ready ? "done" : "not done");
+
+    free(batch->entries);
+    memset(batch, 0, sizeof(*batch));
 }
 
-void* rafgl_list_get(rafgl_list_t *list, int index)
+/* source with a #define for every feature of mask, after the #version line when there is one */
+static char* __rafgl_program_specialise(const char *source, const char **features, int feature_count, unsigned int mask)
 {
-    void *i = list -> head;
-
-    if(index >= list -> count) return NULL;
-    if(index < 0) index = list -> count + index;
-    if(index < 0) return NULL;
+    const char *body = source;
+    size_t length = strlen(source) + 16;
+    char *result, *p;
+    int i;
 
-    while(index--)
+    if(strncmp(source, "#version", 8) == 0)
     {
-        i = *((void**)i);
+        body = strchr(source, '\n');
+        body = body ? body + 1 : source + strlen(source);
     }
 
-    return i + sizeof(void*);
+    for(i = 0; i < feature_count; i++)
+        if(mask & (1u << i))
+            length += strlen(features[i]) + 12;
+
+    result = malloc(length);
+    memcpy(result, source, body - source);
+    p = result + (body - source);
+    if(p > result && p[-1] != '\n')
+        *p++ = '\n';
+    for(i = 0; i < feature_count; i++)
+        if(mask & (1u << i))
+            p += sprintf(p, "#define %s 1\n", features[i]);
+    p += sprintf(p, "#line %d\n", body == source ? 1 : 2);
+    strcpy(p, body);
+
+    return result;
 }
 
-int rafgl_list_free(rafgl_list_t *list)
+void rafgl_program_variants_init(rafgl_program_variants_t *variants, const char *program_name, const char **features, int feature_count)
 {
-    void **i = list -> head;
-    void *curr;
-    while(i)
-    {
-        curr = i;
-        i = *i;
-        free(curr);
-    }
-    return 0;
+    char v[255], f[255];
+
+    memset(variants, 0, sizeof(*variants));
+    snprintf(variants->name, sizeof(variants->name), "%s", program_name);
+    variants->features = features;
+    variants->feature_count = feature_count;
+
+    snprintf(v, sizeof(v), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "vert.glsl", program_name);
+    snprintf(f, sizeof(f), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "frag.glsl", program_name);
+    variants->vertex_source = __rafgl_program_read_source(v);
+    variants->fragment_source = __rafgl_program_read_source(f);
 }
 
-int rafgl_list_show(rafgl_list_t *list, void (*fun)(void*, int))
+/* index of the variant of mask, a new empty one if there is none yet and -1 when there is no room left */
+static int __rafgl_program_variant_slot(rafgl_program_variants_t *variants, unsigned int mask, int *found)
 {
-    void **i = list -> head;
-    void *curr_data;
-    while(i)
+    int i;
+
+    for(i = 0; i < variants->count; i++)
     {
-        curr_data = i + 1;
-        i = *i;
-        fun(curr_data, i == NULL);
+        if(variants->masks[i] == mask)
+        {
+            *found = 1;
+            return i;
+        }
     }
-    return 0;
+
+    *found = 0;
+    if(variants->count == RAFGL_PROGRAM_VARIANTS_MAX)
+    {
+        rafgl_log(RAFGL_ERROR, "Program %s already has %d variants, %#x is not built\n", variants->name, RAFGL_PROGRAM_VARIANTS_MAX, mask);
+        return -1;
+    }
+
+    variants->masks[variants->count] = mask;
+    variants->programs[variants->count] = 0;
+    return variants->count++;
 }
 
-int rafgl_file_size(const char *filepath)
+GLuint rafgl_program_variant(rafgl_program_variants_t *variants, unsigned int mask)
 {
-    int size = 0;
-    FILE *f = fopen(filepath, "rt");
+    char *vert_source, *frag_source;
+    int slot, found;
+
+    mask &= (1u << variants->feature_count) - 1;
+    slot = __rafgl_program_variant_slot(variants, mask, &found);
+    if(slot < 0)
+        return 0;
+    if(found)
+        return variants->programs[slot];
+
+    vert_source = __rafgl_program_specialise(variants->vertex_source, variants->features, variants->feature_count, mask);
+    frag_source = __rafgl_program_specialise(variants->fragment_source, variants->features, variants->feature_count, mask);
+    variants->programs[slot] = rafgl_program_create_from_source(vert_source, frag_source);
+    free(vert_source);
+    free(frag_source);
 
-    fseek(f, 0L, SEEK_END);
+    return variants->programs[slot];
+}
 
-    size = ftell(f);
+void rafgl_program_variants_add(rafgl_program_batch_t *batch, rafgl_program_variants_t *variants, unsigned int mask)
+{
+    char *vert_source, *frag_source;
+    int slot, found;
 
-    fclose(f);
+    mask &= (1u << variants->feature_count) - 1;
+    slot = __rafgl_program_variant_slot(variants, mask, &found);
+    if(slot < 0 || found)
+        return;
 
-    return size;
+    vert_source = __rafgl_program_specialise(variants->vertex_source, variants->features, variants->feature_count, mask);
+    frag_source = __rafgl_program_specialise(variants->fragment_source, variants->features, variants->feature_count, mask);
+    rafgl_program_batch_add(batch, vert_source, frag_source, &variants->programs[slot]);
+    free(vert_source);
+    free(frag_source);
 }
 
-char* rafgl_file_read_content(const char *filepath)
+void rafgl_program_variants_cleanup(rafgl_program_variants_t *variants)
 {
-    int fsize = rafgl_file_size(filepath);
-    FILE *f = fopen(filepath, "rt");
-
-    fseek(f, 0, SEEK_SET);
+    int i;
 
-    char *content = calloc(sizeof(char), fsize + 10);          /* This must later be freed */
+    for(i = 0; i < variants->count; i++)
+        glDeleteProgram(variants->programs[i]);
+    free(variants->vertex_source);
+    free(variants->fragment_source);
+    memset(variants, 0, sizeof(*variants));
+}
 
-    fread(content, 1, fsize, f);
+#define RAFGL_PROGRAM_WATCH_MAX 32
 
-    fclose(f);
+typedef struct
+{
+    char name[64];
+    GLuint *program;
+    int wd;
+    /* set by the watcher thread */
+    int dirty;
+    /* the program being compiled to replace *program */
+    GLuint pending;
+    /* or every variant of a set, built from the sources they will be swapped in with */
+    rafgl_program_variants_t *variants;
+    GLuint pending_variants[RAFGL_PROGRAM_VARIANTS_MAX];
+    int pending_count;
+    char *vertex_source, *fragment_source;
+} __rafgl_watched_program_t;
+
+static int __program_watch_enabled = 0;
+static __rafgl_watched_program_t __watched_programs[RAFGL_PROGRAM_WATCH_MAX];
+static int __watched_program_count = 0;
+/* any program dirty, the only thing the frame looks at while nothing changes */
+static int __program_watch_dirty = 0;
+static int __program_watch_fd = -1, __program_watch_wake[2] = {-1, -1};
+/* res/shaders/include, anything in it may be pulled into every program */
+static int __program_watch_include_wd = -1;
+static pthread_t __program_watch_thread;
+static pthread_mutex_t __program_watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static rafgl_program_batch_t __program_reload_batch;
+static int __program_reload_running = 0;
+static void (*__program_watch_reloaded)(void *data) = NULL;
+static void *__program_watch_data = NULL;
+
+void rafgl_program_watch_enable(int b)
+{
+    __program_watch_enabled = b;
+}
 
-    *(content + fsize) = 0;
-    return content;
+void rafgl_program_watch_callback(void (*reloaded)(void *data), void *data)
+{
+    __program_watch_reloaded = reloaded;
+    __program_watch_data = data;
 }
 
-GLuint rafgl_program_create_from_source(const char *vertex_source, const char *fragment_source)
+#if defined(__linux__)
+
+static void* __rafgl_program_watch_worker(void *arg)
 {
-    GLuint vert, frag, program;
-    int success;
-    char info_log[512];
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2];
+    const struct inotify_event *event;
+    ssize_t length;
+    char *p;
+    int i, any;
+
+    fds[0].fd = __program_watch_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = __program_watch_wake[0];
+    fds[1].events = POLLIN;
+
+    for(;;)
+    {
+        if(poll(fds, 2, -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        if(fds[1].revents)
+            break;
 
-    vert = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vert, 1, &vertex_source, NULL);
-    glCompileShader(vert);
+        length = read(__program_watch_fd, buffer, sizeof(buffer));
+        if(length <= 0)
+            continue;
 
-    glGetShaderiv(vert, GL_COMPILE_STATUS, &success);
+        any = 0;
+        pthread_mutex_lock(&__program_watch_mutex);
+        for(p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event*)p;
+            /* swap files, backups and the probes editors write next to the sources are not the program */
+            if(!event->len)
+                continue;
+            if(event->wd == __program_watch_include_wd)
+            {
+                if(strlen(event->name) < 5 || strcmp(event->name + strlen(event->name) - 5, ".glsl"))
+                    continue;
+            }
+            else if(strcmp(event->name, "vert.glsl") && strcmp(event->name, "frag.glsl"))
+            {
+                continue;
+            }
+            for(i = 0; i < __watched_program_count; i++)
+            {
+                if(__watched_programs[i].wd == event->wd || event->wd == __program_watch_include_wd)
+                {
+                    __atomic_store_n(&__watched_programs[i].dirty, 1, __ATOMIC_RELAXED);
+                    any = 1;
+                }
+            }
+        }
+        pthread_mutex_unlock(&__program_watch_mutex);
 
-    if(!success)
-    {
-        glGetShaderInfoLog(vert, 512, NULL, info_log);
-        fprintf(stderr, "ERROR::SHADER::VERTEX::COMPILE_FAILED\n%s\n", info_log);
+        if(any)
+            __atomic_store_n(&__program_watch_dirty, 1, __ATOMIC_RELEASE);
     }
 
-    frag = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(frag, 1, &fragment_source, NULL);
-    glCompileShader(frag);
+    return NULL;
+}
 
-    glGetShaderiv(frag, GL_COMPILE_STATUS, &success);
+static void __rafgl_program_watch_add(const char *program_name, GLuint *program, rafgl_program_variants_t *variants)
+{
+    __rafgl_watched_program_t *watched;
+    char directory[255];
 
-    if(!success)
+    if(!__program_watch_enabled)
+        return;
+
+    if(__program_watch_fd < 0)
     {
-        glGetShaderInfoLog(frag, 512, NULL, info_log);
-        fprintf(stderr, "ERROR::SHADER::FRAGMENT::COMPILE_FAILED\n%s\n", info_log);
+        __program_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(__program_watch_fd < 0 || pipe(__program_watch_wake))
+        {
+            rafgl_log(RAFGL_WARNING, "No inotify, shaders are not reloaded\n");
+            __program_watch_enabled = 0;
+            return;
+        }
+        __program_watch_include_wd = inotify_add_watch(__program_watch_fd, "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "include", IN_CLOSE_WRITE | IN_MOVED_TO);
+        pthread_create(&__program_watch_thread, NULL, __rafgl_program_watch_worker, NULL);
     }
 
+    if(__watched_program_count == RAFGL_PROGRAM_WATCH_MAX)
+    {
+        rafgl_log(RAFGL_WARNING, "Already watching %d programs, %s is not reloaded\n", RAFGL_PROGRAM_WATCH_MAX, program_name);
+        return;
+    }
 
-    program = glCreateProgram();
+    snprintf(directory, sizeof(directory), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s", program_name);
+
+    pthread_mutex_lock(&__program_watch_mutex);
+    watched = &__watched_programs[__watched_program_count];
+    memset(watched, 0, sizeof(*watched));
+    snprintf(watched->name, sizeof(watched->name), "%s", program_name);
+    watched->program = program;
+    watched->variants = variants;
+    /* editors either write the file in place or rename a new one over it */
+    watched->wd = inotify_add_watch(__program_watch_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if(watched->wd < 0)
+        rafgl_log(RAFGL_WARNING, "Can not watch %s, it is not reloaded\n", directory);
+    else
+        __watched_program_count++;
+    pthread_mutex_unlock(&__program_watch_mutex);
+}
 
-    glAttachShader(program, vert);
-    glAttachShader(program, frag);
+void rafgl_program_watch(const char *program_name, GLuint *program)
+{
+    __rafgl_program_watch_add(program_name, program, NULL);
+}
 
-    glLinkProgram(program);
+void rafgl_program_watch_variants(rafgl_program_variants_t *variants)
+{
+    __rafgl_program_watch_add(variants->name, NULL, variants);
+}
 
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if(!success)
+/* the variants of a reload swap in together, a source that does not build for one of them keeps all the old ones */
+static int __rafgl_program_watch_swap_variants(__rafgl_watched_program_t *watched)
+{
+    rafgl_program_variants_t *variants = watched->variants;
+    GLint linked = 1;
+    int i;
+
+    for(i = 0; i < watched->pending_count && linked; i++)
+        glGetProgramiv(watched->pending_variants[i], GL_LINK_STATUS, &linked);
+
+    if(!linked)
     {
-        glGetProgramInfoLog(program, 512, NULL, info_log);
-        fprintf(stderr, "ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", info_log);
+        for(i = 0; i < watched->pending_count; i++)
+            glDeleteProgram(watched->pending_variants[i]);
+        free(watched->vertex_source);
+        free(watched->fragment_source);
+        rafgl_log(RAFGL_WARNING, "Program %s did not build, keeping the one before\n", watched->name);
+    }
+    else
+    {
+        for(i = 0; i < watched->pending_count; i++)
+        {
+            glDeleteProgram(variants->programs[i]);
+            variants->programs[i] = watched->pending_variants[i];
+        }
+        /* variants first asked for while the reload was compiling came from the old sources, they are built again when next asked for */
+        for(; i < variants->count; i++)
+            glDeleteProgram(variants->programs[i]);
+        variants->count = watched->pending_count;
+
+        free(variants->vertex_source);
+        free(variants->fragment_source);
+        variants->vertex_source = watched->vertex_source;
+        variants->fragment_source = watched->fragment_source;
+        rafgl_log(RAFGL_INFO, "Reloaded program %s (%d variants)\n", watched->name, watched->pending_count);
     }
 
+    watched->vertex_source = watched->fragment_source = NULL;
+    watched->pending_count = 0;
+    return linked;
+}
 
-    glDeleteShader(vert);
-    glDeleteShader(frag);
+/* both sources of watched as they are on the disk now. An editor saving by renaming may have one of them away for a moment,
+   that reload is skipped and the rename back brings another one */
+static int __rafgl_program_watch_read(__rafgl_watched_program_t *watched, char **vertex_source, char **fragment_source)
+{
+    char v[255], f[255];
 
-    return program;
+    snprintf(v, sizeof(v), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "vert.glsl", watched->name);
+    snprintf(f, sizeof(f), "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR "%s" SYSTEM_SEPARATOR "frag.glsl", watched->name);
+    *vertex_source = __rafgl_program_read_source(v);
+    *fragment_source = __rafgl_program_read_source(f);
+
+    if(*vertex_source == NULL || *fragment_source == NULL)
+    {
+        free(*vertex_source);
+        free(*fragment_source);
+        *vertex_source = *fragment_source = NULL;
+        rafgl_log(RAFGL_WARNING, "Sources of %s can not be read, keeping the program before\n", watched->name);
+        return 0;
+    }
+    return 1;
 }
 
-GLuint rafgl_program_create(const char *vertex_source_filepath, const char *fragment_source_filepath)
+/* puts every variant compiled so far into the reload batch, from the sources on the disk now */
+static int __rafgl_program_watch_build_variants(__rafgl_watched_program_t *watched)
 {
-    GLuint program;
+    rafgl_program_variants_t *variants = watched->variants;
+    char *vert_source, *frag_source;
+    int i;
 
-    char *vert_source = rafgl_file_read_content(vertex_source_filepath);
-    char *frag_source = rafgl_file_read_content(fragment_source_filepath);
+    if(!__rafgl_program_watch_read(watched, &watched->vertex_source, &watched->fragment_source))
+        return 0;
+
+    watched->pending_count = variants->count;
+    for(i = 0; i < variants->count; i++)
+    {
+        vert_source = __rafgl_program_specialise(watched->vertex_source, variants->features, variants->feature_count, variants->masks[i]);
+        frag_source = __rafgl_program_specialise(watched->fragment_source, variants->features, variants->feature_count, variants->masks[i]);
+        rafgl_program_batch_add(&__program_reload_batch, vert_source, frag_source, &watched->pending_variants[i]);
+        free(vert_source);
+        free(frag_source);
+    }
+    return 1;
+}
 
+static int __rafgl_program_watch_build(__rafgl_watched_program_t *watched)
+{
+    char *vert_source, *frag_source;
 
-    program = rafgl_program_create_from_source(vert_source, frag_source);
+    if(!__rafgl_program_watch_read(watched, &vert_source, &frag_source))
+        return 0;
 
+    rafgl_program_batch_add(&__program_reload_batch, vert_source, frag_source, &watched->pending);
     free(vert_source);
     free(frag_source);
-
-    return program;
+    return 1;
 }
 
-GLuint rafgl_program_create_from_name(const char *program_name)
+/* between two frames: swaps in what finished compiling, then starts on whatever changed since */
+static void __rafgl_program_watch_frame(void)
 {
-    char v[255], f[255];
-    v[0] = 0;
-    f[0] = 0;
+    __rafgl_watched_program_t *watched;
+    GLint linked;
+    int i, swapped = 0;
 
-    strcat(v, "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR);
-    strcat(v, program_name);
-    strcat(v, SYSTEM_SEPARATOR "vert.glsl");
+    if(__program_reload_running)
+    {
+        if(!rafgl_program_batch_ready(&__program_reload_batch))
+            return;
+        rafgl_program_batch_finish(&__program_reload_batch);
+        __program_reload_running = 0;
 
-    strcat(f, "res" SYSTEM_SEPARATOR "shaders" SYSTEM_SEPARATOR);
-    strcat(f, program_name);
-    strcat(f, SYSTEM_SEPARATOR "frag.glsl");
+        for(i = 0; i < __watched_program_count; i++)
+        {
+            watched = &__watched_programs[i];
+            if(watched->variants && watched->vertex_source)
+            {
+                swapped += __rafgl_program_watch_swap_variants(watched);
+                continue;
+            }
+            if(!watched->pending)
+                continue;
 
-    return rafgl_program_create(v, f);
+            glGetProgramiv(watched->pending, GL_LINK_STATUS, &linked);
+            if(linked)
+            {
+                glDeleteProgram(*watched->program);
+                *watched->program = watched->pending;
+                swapped++;
+                rafgl_log(RAFGL_INFO, "Reloaded program %s\n", watched->name);
+            }
+            else
+            {
+                glDeleteProgram(watched->pending);
+                rafgl_log(RAFGL_WARNING, "Program %s did not build, keeping the one before\n", watched->name);
+            }
+            watched->pending = 0;
+        }
+
+        if(swapped && __program_watch_reloaded)
+            __program_watch_reloaded(__program_watch_data);
+    }
+
+    if(!__atomic_load_n(&__program_watch_dirty, __ATOMIC_ACQUIRE))
+        return;
+    __atomic_store_n(&__program_watch_dirty, 0, __ATOMIC_RELAXED);
+
+    rafgl_program_batch_init(&__program_reload_batch);
+    for(i = 0; i < __watched_program_count; i++)
+    {
+        watched = &__watched_programs[i];
+        if(__atomic_exchange_n(&watched->dirty, 0, __ATOMIC_ACQUIRE))
+        {
+            if(watched->variants ? __rafgl_program_watch_build_variants(watched) : __rafgl_program_watch_build(watched))
+                __program_reload_running = 1;
+        }
+    }
 }
 
-/*
-void test_show(void *element, int last)
+static void __rafgl_program_watch_stop(void)
 {
-    vec3f data = *((vec3f*)element);
-    vec3f_show(data);
-    if(!last) printf(" -> ");
+    if(__program_watch_fd < 0)
+        return;
+
+    if(write(__program_watch_wake[1], "", 1) == 1)
+        pthread_join(__program_watch_thread, NULL);
+    close(__program_watch_fd);
+    close(__program_watch_wake[0]);
+    close(__program_watch_wake[1]);
+    __program_watch_fd = -1;
+    __program_watch_include_wd = -1;
+    __watched_program_count = 0;
 }
 
-int rafgl_list_test(void)
-{
-    rafgl_list_t list;
-    rafgl_list_init(&list, sizeof(vec3f));
-    vec3f tmp = vec3f_create(0.0f, 0.0f, 0.0f);
+#else
 
-    int i;
-    for(i = 0; i < 10; i++)
-    {
-        tmp.x = i;
-        tmp.z = 2.0f * i;
-        rafgl_list_append(&list, &tmp);
-    }
+void rafgl_program_watch(const char *program_name, GLuint *program)
+{
+}
 
-    rafgl_list_show(&list, test_show);
-    rafgl_list_remove(&list, 0);
-    rafgl_list_remove(&list, 1);
-    rafgl_list_remove(&list, -1);
-    rafgl_list_show(&list, test_show);
+void rafgl_program_watch_variants(rafgl_program_variants_t *variants)
+{
+}
 
-    rafgl_list_free(&list);
+static void __rafgl_program_watch_frame(void)
+{
+}
 
+static void __rafgl_program_watch_stop(void)
+{
 }
-*/
+
+#endif // __linux__
 
 #endif // RAFGL_IMPLEMENTATION
 #endif // RAFGL_H_INCLUDED
@@ -0,0 +1,69 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <rafgl.h>
+#include <stdint.h>
+
+/* texture units a command can bind, the 16 every GL 3.3 fragment shader gets */
+#define RENDER_QUEUE_TEXTURES 16
+
+/* alpha blending (SRC_ALPHA, ONE_MINUS_SRC_ALPHA), off otherwise */
+#define RENDER_QUEUE_BLEND 1
+
+typedef struct _render_command_t
+{
+    /* draws go in ascending key order, render_queue_key packs one */
+    uint64_t key;
+    int sequence;
+
+    GLuint program, vao;
+    int flags;
+    GLenum texture_targets[RENDER_QUEUE_TEXTURES];
+    GLuint textures[RENDER_QUEUE_TEXTURES];
+
+    /* GL_TRIANGLES of count vertices, or of count GL_UNSIGNED_INT indices from the element buffer of the vao */
+    int count;
+    int indexed;
+    /* or, when set, count indexed draws of counts[i] indices from byte offsets[i] of the element buffer in one call.
+       Both have to live until the submit */
+    const GLsizei *counts;
+    const GLvoid *const *offsets;
+
+    /* sets the uniforms with the program bound and the textures in place, it may bind textures on units the command
+       leaves empty. data has to live until the submit */
+    void (*uniforms)(GLuint program, void *data);
+    void *data;
+} render_command_t;
+
+typedef struct _render_queue_t
+{
+    render_command_t *commands;
+    int count, capacity;
+
+    /* what the last replay left bound, 0 valid means nothing is known */
+    int valid;
+    GLuint program, vao;
+    int flags, active_unit;
+    GLenum texture_targets[RENDER_QUEUE_TEXTURES];
+    GLuint textures[RENDER_QUEUE_TEXTURES];
+
+    /* binds and enables the replays of this frame made and the ones the cache skipped */
+    int state_changes, redundant_changes, draws;
+} render_queue_t;
+
+/* pass in the top 4 bits, then 12 of program, 16 of material and 32 of distance from the eye.
+   Back to front flips the distance so the farthest draw of the pass comes first */
+uint64_t render_queue_key(int pass, GLuint program, int material, float distance, int back_to_front);
+
+void render_queue_init(render_queue_t *queue);
+/* a zeroed command with key that stays valid until the next push */
+render_command_t* render_queue_push(render_queue_t *queue, uint64_t key);
+/* sorts what was pushed, replays it and empties the queue */
+void render_queue_submit(render_queue_t *queue);
+/* code outside the queue changed programs, VAOs, textures or blending, the next replay binds everything again */
+void render_queue_invalidate(render_queue_t *queue);
+/* hands the counts of the frame to the profiler and zeroes them */
+void render_queue_frame(render_queue_t *queue);
+void render_queue_cleanup(render_queue_t *queue);
+
+#endif //RENDER_QUEUE_H
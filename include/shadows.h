@@ -0,0 +1,92 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <rafgl.h>
+#include <culling.h>
+
+#define SHADOW_CASCADES 4
+/* terrain chunks are this many quads on a side, each one is culled against every cascade on its own */
+#define SHADOW_GRID_CHUNK 64
+/* index buffers of the terrain for the shadow maps, every 2nd, 4th and 8th vertex */
+#define SHADOW_GRID_LODS 3
+/* a cached cascade is re-rendered once the sun has turned this many degrees since, at most one such cascade per frame */
+#define SHADOW_CACHE_LIGHT_ANGLE 1.0f
+/* cached cascades cover this much more than their slice so the camera can move a while before they have to be re-rendered */
+#define SHADOW_CACHE_MARGIN 1.25f
+
+typedef struct _shadow_cascades_t
+{
+    /* static casters go into static_array and are only re-rendered when a cascade goes stale,
+       depth_array (the one receivers sample) is a copy of it with the dynamic casters on top */
+    GLuint fbo, depth_array;
+    GLuint static_fbo, static_array;
+    int size;
+
+    vec3_t light_direction;
+    /* 0 while the sun is below the horizon, nothing is rendered and the receivers are drawn without SHADOWS */
+    int enabled;
+
+    /* view space distance at which each cascade ends */
+    float splits[SHADOW_CASCADES];
+    mat4_t light_view_projection[SHADOW_CASCADES];
+    /* world units covered by one texel and by the whole depth range of each cascade */
+    float texel_size[SHADOW_CASCADES];
+    float depth_range[SHADOW_CASCADES];
+    /* how far off the real surface the casters of each cascade can be, in world units, added to the depth bias */
+    float caster_error[SHADOW_CASCADES];
+    /* without the near plane, the casters in front of it are clamped onto it */
+    cull_frustum_t frustum[SHADOW_CASCADES];
+
+    /* what the static layer of each cascade was rendered with */
+    int cached[SHADOW_CASCADES];
+    mat4_t cached_light_view[SHADOW_CASCADES];
+    vec3_t cached_light_direction[SHADOW_CASCADES];
+    vec3_t cached_center[SHADOW_CASCADES];
+    float cached_radius[SHADOW_CASCADES];
+    int cached_frame[SHADOW_CASCADES];
+    /* depth_array layer is an exact copy of the static one */
+    int composite_clean[SHADOW_CASCADES];
+
+    int frame, static_renders, composites;
+} shadow_cascades_t;
+
+typedef struct _shadow_grid_t
+{
+    GLuint vao, ebo;
+    int chunks_x, chunks_z;
+    /* bounds of every chunk, cull_set_test against a cascade picks the ones shadow_grid_draw draws */
+    cull_set_t chunks;
+    /* per lod and chunk: index count and byte offset into ebo */
+    GLsizei *counts[SHADOW_GRID_LODS];
+    GLvoid **offsets[SHADOW_GRID_LODS];
+
+    /* scratch for the chunks that survive culling */
+    GLsizei *visible_counts;
+    GLvoid **visible_offsets;
+} shadow_grid_t;
+
+/* creates the depth texture arrays, the sampled one is attached to fbo */
+void shadow_cascades_init(shadow_cascades_t *shadows, GLuint fbo, int size);
+/* splits [near, distance] of the camera frustum between the cascades. A cascade whose cached projection no longer covers its slice,
+   or, one per frame, whose light direction is off by more than SHADOW_CACHE_LIGHT_ANGLE gets a new texel snapped projection.
+   Returns the bit mask of the cascades whose static casters have to be rendered again */
+int shadow_cascades_update(shadow_cascades_t *shadows, mat4_t view, float fov, float aspect, float near, float distance, vec3_t light_direction);
+/* binds the static layer of the cascade for rendering static casters with a depth only program */
+void shadow_cascades_begin(shadow_cascades_t *shadows, int cascade);
+/* copies the static layer into the sampled one and binds it for the dynamic casters, skipped (returns 0) when
+   there are no dynamic casters and the sampled layer is still a copy of the static one */
+int shadow_cascades_composite(shadow_cascades_t *shadows, int cascade, int dynamic_casters);
+/* back to the default framebuffer, the caller restores its viewport */
+void shadow_cascades_end(shadow_cascades_t *shadows);
+/* sets the receiver uniforms (shadow_map, light_view_projection, cascade_splits, cascade_bias, shadow_view) of program, one built with SHADOWS */
+void shadow_cascades_bind_uniforms(shadow_cascades_t *shadows, GLuint program, mat4_t view, int texture_unit);
+void shadow_cascades_cleanup(shadow_cascades_t *shadows);
+
+/* reduced resolution, chunked index buffers over a width x height vertex grid already uploaded to vbo (position at offset 0 of each stride byte vertex).
+   The indices are built in the frame arena, without room there the grid has no chunks and draws nothing */
+void shadow_grid_init(shadow_grid_t *grid, GLuint vbo, const void *vertices, int stride, int width, int height);
+/* draws the chunks the last cull_set_test of grid->chunks left visible at lod (0 = every 2nd vertex), returns the number of chunks drawn */
+int shadow_grid_draw(shadow_grid_t *grid, int lod);
+void shadow_grid_cleanup(shadow_grid_t *grid);
+
+#endif //SHADOWS_H
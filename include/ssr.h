@@ -0,0 +1,38 @@
+#ifndef SSR_H
+#define SSR_H
+
+#include <rafgl.h>
+
+/* at most this many levels in the depth pyramid, 2^13 covers any screen */
+#define SSR_MAX_LEVELS 14
+
+typedef struct _ssr_t
+{
+    /* the size of the last capture */
+    int width, height;
+
+    /* copy of the opaque main pass (RGBA8 colour, D24S8 depth) so it can be sampled while the water is drawn over the original,
+       the water refracts it and the screen space reflections march through it. Pooled, held from ssr_capture to ssr_release */
+    rafgl_render_target_t *scene;
+
+    /* R32F mip chain of the nearest depth in every 2^level x 2^level block, level 0 is the depth buffer itself.
+       Made by the first ssr_build_pyramid and again when the capture size changes */
+    GLuint hiz_fbo, hiz_texture;
+    int hiz_width, hiz_height, levels;
+
+    GLuint hiz_program, vao;
+} ssr_t;
+
+/* only the pyramid program, the textures follow the size of what is captured */
+void ssr_init(ssr_t *ssr);
+/* blits colour and depth of framebuffer (rafgl_framebuffer_default() for the main pass) of width x height, leaves framebuffer bound */
+void ssr_capture(ssr_t *ssr, GLuint framebuffer, int width, int height);
+/* rebuilds the depth pyramid from the last capture, only the reflection march needs it. Leaves framebuffer bound */
+void ssr_build_pyramid(ssr_t *ssr, GLuint framebuffer);
+/* sets scene_colour, scene_depth, scene_hiz (units first to first + 2) and hiz_levels of program */
+void ssr_bind_uniforms(ssr_t *ssr, GLuint program, int texture_unit);
+/* hands the copy back to the pool once the water that samples it is drawn */
+void ssr_release(ssr_t *ssr);
+void ssr_cleanup(ssr_t *ssr);
+
+#endif //SSR_H
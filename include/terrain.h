@@ -0,0 +1,22 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <rafgl.h>
+
+/* horizon directions searched around every heightfield sample */
+#define TERRAIN_AO_DIRECTIONS 16
+/* samples along each direction, spaced further apart the further out they go */
+#define TERRAIN_AO_STEPS 10
+/* the furthest sample, in heightfield samples */
+#define TERRAIN_AO_RADIUS 32
+/* rows of the heightfield per rafgl_parallel_for job */
+#define TERRAIN_AO_BAND_ROWS 16
+
+/* how much of the sky each sample of a width x height heightfield (row major, spacing world units apart) sees,
+   averaged over the horizon angle in every direction, 255 on open ground. Its scratch comes from the frame arena,
+   without room there everything is left at 255 */
+void terrain_bake_ambient(const float *heights, int width, int height, float spacing, unsigned char *ambient);
+/* single channel linear texture of the bake, one texel per heightfield sample */
+GLuint terrain_ambient_texture(const unsigned char *ambient, int width, int height);
+
+#endif //TERRAIN_H
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,15 +11,97 @@
 
 #include <game_constants.h>
 #include <main_state.h>
+#include <ocean.h>
 
 int main(int argc, char *argv[])
 {
 
     rafgl_game_t game;
+    main_state_args_t state_args = {NULL, "Screenshots/pose_%05d.png", WATER_REFLECTION_PLANAR};
+    int width = 1920, height = 1080;
+    int profile = 0;
+    /* updates per second, 0 updates once per frame with the frame time */
+    float update_rate = 60.0f, frame_limit = 0.0f;
+    int benchmark_frames = -1;
+    int pipelined = 0;
+    const char *program_cache = "cache";
+    int i;
 
-    rafgl_game_init(&game, "main", 1920, 1080, 0);
+    /* main [--headless poses.txt] [--output pattern_%05d.png] [--size 1280x720] [--reflections planar|ssr] [--profile]
+            [--update-rate 60] [--fps-limit 144] [--benchmark frames] [--benchmark-ocean] [--pipelined]
+            [--no-program-cache] [--benchmark-list] [--benchmark-math] */
+    for(i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--headless") && i + 1 < argc)
+            state_args.pose_script = argv[++i];
+        else if(!strcmp(argv[i], "--output") && i + 1 < argc)
+            state_args.output_pattern = argv[++i];
+        else if(!strcmp(argv[i], "--size") && i + 1 < argc)
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        else if(!strcmp(argv[i], "--reflections") && i + 1 < argc)
+            state_args.reflection_mode = strcmp(argv[++i], "ssr") ? WATER_REFLECTION_PLANAR : WATER_REFLECTION_SSR;
+        else if(!strcmp(argv[i], "--profile"))
+            profile = 1;
+        else if(!strcmp(argv[i], "--update-rate") && i + 1 < argc)
+            update_rate = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--fps-limit") && i + 1 < argc)
+            frame_limit = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--benchmark") && i + 1 < argc)
+            benchmark_frames = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--pipelined"))
+            pipelined = 1;
+        else if(!strcmp(argv[i], "--no-program-cache"))
+            program_cache = NULL;
+        else if(!strcmp(argv[i], "--benchmark-list"))
+        {
+            glfwInit();
+            rafgl_list_test(1000000);
+            glfwTerminate();
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--benchmark-blit"))
+        {
+            glfwInit();
+            rafgl_raster_blit_benchmark(1920, 1080, 50);
+            rafgl_raster_blit_benchmark(256, 256, 2000);
+            glfwTerminate();
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--benchmark-math"))
+        {
+            glfwInit();
+            rafgl_math_test(1000000);
+            glfwTerminate();
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--benchmark-ocean"))
+        {
+            glfwInit();
+            ocean_benchmark(256, 60);
+            ocean_benchmark(512, 20);
+            glfwTerminate();
+            return 0;
+        }
+    }
+
+    if(state_args.pose_script)
+        rafgl_game_init_headless(&game, "main", width, height);
+    else
+        rafgl_game_init(&game, "main", width, height, 0);
+    rafgl_profiler_enable(profile);
+    rafgl_program_cache_set_directory(program_cache);
+    /* nobody edits shaders under a pose script */
+    rafgl_program_watch_enable(!state_args.pose_script);
+
+    /* a pose script sets the time of every frame itself */
+    if(update_rate > 0.0f && !state_args.pose_script)
+        rafgl_game_set_fixed_timestep(1.0f / update_rate);
+    rafgl_game_set_frame_limit(frame_limit);
+    if(benchmark_frames >= 0)
+        rafgl_game_set_benchmark(benchmark_frames);
+    rafgl_game_set_pipelined(pipelined);
     rafgl_game_add_named_game_state(&game, main_state);
-    rafgl_game_start(&game, NULL);
+    rafgl_game_start(&game, &state_args);
 
     return 0;
 }
@@ -14,27 +14,27 @@ uniform sampler2D hillTexture;
 uniform sampler2D sandTexture;
 uniform sampler2D grassTexture;
 uniform sampler2D cloudTexture;
+// baked sky visibility, one texel per terrain vertex
+uniform sampler2D ambientTexture;
 uniform vec3 light_color;
+// FOG while the density is above 0
+#ifdef FOG
 uniform vec3 fog_color;
 uniform float fog_density;
+#endif
 uniform float water_height;
 
+#include "shadows.glsl"
+#include "lighting.glsl"
+
 void main() {
     float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * light_color;
-
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(LightPos - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * light_color;
+    float occlusion = texture(ambientTexture, TexCoord + 0.5 / vec2(textureSize(ambientTexture, 0))).r;
+    vec3 ambient = ambientStrength * occlusion * light_color;
 
+    vec2 light = phong(FragPos, normalize(Normal), LightPos, ViewPos);
     float specularStrength = 0.5;
-    vec3 viewDir = normalize(ViewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * light_color;
-
-    vec3 lighting = ambient + diffuse + specular;
+    vec3 lighting = ambient + shadow_factor(FragPos) * (light.x + specularStrength * light.y) * light_color;
 
     vec2 scaledTexCoord = TexCoord;
     vec4 sandColor = texture(sandTexture, scaledTexCoord * 100.0);
@@ -60,15 +60,16 @@ void main() {
 
     vec3 result = texColor.rgb * lighting;
 
-    vec3 finalColor;
-    if (height > 30.0) {
-        finalColor = result;
-    } else {
+    vec3 finalColor = result;
+#ifdef FOG
+    // the peaks stand out of the fog
+    if (height <= 30.0) {
         float distance = length(FragPos - ViewPos);
         float fog_factor = exp(-fog_density * distance * distance); // Exponential fog
         fog_factor = clamp(fog_factor, 0.0, 1.0);
         finalColor = mix(fog_color, result, fog_factor);
     }
+#endif
 
     FragColor = vec4(finalColor, texColor.a * ourAlpha);
 }
\ No newline at end of file
@@ -0,0 +1,37 @@
+#version 330 core
+
+// the depth buffer when copy is set, otherwise the previous level of the pyramid as its only level
+uniform sampler2D source;
+uniform int copy;
+
+layout(location = 0) out float nearest;
+
+float fetch(ivec2 texel, ivec2 size)
+{
+    return texelFetch(source, min(texel, size - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    if (copy != 0) {
+        nearest = texelFetch(source, texel, 0).r;
+        return;
+    }
+
+    ivec2 size = textureSize(source, 0);
+    ivec2 corner = texel * 2;
+    nearest = min(min(fetch(corner, size), fetch(corner + ivec2(1, 0), size)),
+                  min(fetch(corner + ivec2(0, 1), size), fetch(corner + ivec2(1, 1), size)));
+
+    // odd sizes round down, the last texel of a row or column also takes the one left over above it
+    bool odd_x = (size.x & 1) != 0 && texel.x == size.x / 2 - 1;
+    bool odd_y = (size.y & 1) != 0 && texel.y == size.y / 2 - 1;
+    if (odd_x)
+        nearest = min(nearest, min(fetch(corner + ivec2(2, 0), size), fetch(corner + ivec2(2, 1), size)));
+    if (odd_y)
+        nearest = min(nearest, min(fetch(corner + ivec2(0, 2), size), fetch(corner + ivec2(1, 2), size)));
+    if (odd_x && odd_y)
+        nearest = min(nearest, fetch(corner + ivec2(2, 2), size));
+}
@@ -10,26 +10,31 @@ uniform vec3 view_pos;
 uniform vec3 object_color;
 uniform samplerCube environmentMap;
 
+#include "shadows.glsl"
+
+#ifdef PER_VERTEX
+in vec2 vertex_light;
+#else
+#include "lighting.glsl"
+#endif
+
 void main()
 {
     float ambientStrength = 0.1;
     vec3 ambient = ambientStrength * light_color;
 
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(light_pos - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * light_color;
-
-    float specularStrength = 1.0;
     vec3 viewDir = normalize(view_pos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * light_color;
+#ifdef PER_VERTEX
+    vec2 light = vertex_light;
+#else
+    vec2 light = phong(FragPos, norm, light_pos, view_pos);
+#endif
 
     vec3 reflected = reflect(-viewDir, norm);
     vec3 envColor = texture(environmentMap, reflected).rgb;
 
-    vec3 result = (ambient + diffuse + specular) * object_color;
+    vec3 result = (ambient + shadow_factor(FragPos) * (light.x + light.y) * light_color) * object_color;
 
     vec3 finalColor = mix(result, envColor, 0.5);
 
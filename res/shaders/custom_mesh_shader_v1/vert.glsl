@@ -8,9 +8,22 @@ out vec3 Normal;
 uniform mat4 uni_M;
 uniform mat4 uni_VP;
 
+// PER_VERTEX lights the vertices and leaves the blending to the rasteriser, the fragments only add shadows and the environment
+#ifdef PER_VERTEX
+#include "lighting.glsl"
+
+uniform vec3 light_pos;
+uniform vec3 view_pos;
+
+out vec2 vertex_light;
+#endif
+
 void main()
 {
     FragPos = vec3(uni_M * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(uni_M))) * aNormal;
     gl_Position = uni_VP * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+#ifdef PER_VERTEX
+    vertex_light = phong(FragPos, normalize(Normal), light_pos, view_pos);
+#endif
+}
@@ -10,51 +10,192 @@ in vec3 pass_world_position;
 out vec4 final_colour;
 
 uniform sampler2D normal_map;
+
+// SSR ray marches through the main pass, without it reflection_texture holds the scene rendered from under the water
+#ifdef SSR
+uniform sampler2D scene_hiz;
+uniform int hiz_levels;
+uniform samplerCube skybox;
+#else
 uniform sampler2D reflection_texture;
-uniform sampler2D refraction_texture;
+#endif
+// colour and depth of the opaque main pass, scene_hiz is the nearest depth pyramid of it, hiz_levels deep
+uniform sampler2D scene_colour;
+uniform sampler2D scene_depth;
+
+// FFT ocean patch, xyz displacement and world space normals, tiled every ocean_length units
+uniform sampler2D ocean_displacement;
+uniform sampler2D ocean_normal;
+uniform float ocean_length;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat4 uni_VP;
+uniform float water_distance;
 
 uniform float uni_phase;
 uniform vec3 uni_camera_pos;
+#ifdef FOG
 uniform vec3 fog_colour;
 uniform float fog_density;
+#endif
 uniform vec3 light_position;
 uniform vec3 light_color;
 
+const int SSR_ITERATIONS = 64;
+// light lost per unit travelled through the water, red goes first
+const vec3 WATER_ABSORPTION = vec3(0.45, 0.09, 0.06);
+const vec3 WATER_DEEP_COLOUR = vec3(0.02, 0.02, 0.5);
+
+// window depth back to the distance in front of the camera
+float view_distance(float depth)
+{
+    return projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+}
+
+#ifdef SSR
+// uv and window depth of a world position in the main pass
+vec3 to_screen(vec3 world)
+{
+    vec4 clip = uni_VP * vec4(world, 1.0);
+    return clip.xyz / clip.w * 0.5 + 0.5;
+}
+
+// window depth changes linearly along a straight line on the screen, so the ray is walked in (uv, depth) from start to end.
+// Cells of the pyramid the ray passes in front of are skipped whole and the next one is tried a level coarser,
+// a cell it goes behind is refined a level finer until a single pixel is hit. Returns the uv of the hit and how much it can be trusted
+vec3 trace_screen_space(vec3 origin, vec3 direction)
+{
+    vec4 clip_origin = uni_VP * vec4(origin, 1.0);
+    vec4 clip_direction = uni_VP * vec4(direction, 0.0);
+
+    // stop short of the camera plane
+    float ray_length = water_distance;
+    if (clip_direction.w < 0.0)
+        ray_length = min(ray_length, (0.1 - clip_origin.w) / clip_direction.w);
+
+    vec3 start = to_screen(origin);
+    vec3 delta = to_screen(origin + direction * ray_length) - start;
+
+    // rays coming back towards the camera would also need the furthest depth of every cell, they get the sky
+    if (delta.z <= 0.0 || length(delta.xy) < 1e-6)
+        return vec3(0.0);
+
+    float t_end = 1.0;
+    if (delta.x > 0.0) t_end = min(t_end, (1.0 - start.x) / delta.x);
+    if (delta.x < 0.0) t_end = min(t_end, -start.x / delta.x);
+    if (delta.y > 0.0) t_end = min(t_end, (1.0 - start.y) / delta.y);
+    if (delta.y < 0.0) t_end = min(t_end, -start.y / delta.y);
+
+    vec2 size = vec2(textureSize(scene_hiz, 0));
+    // kept on the same side of zero as step() below, or the cell boundaries of a vertical or horizontal ray end up behind it
+    vec2 safe_delta = mix(vec2(-1.0), vec2(1.0), greaterThanEqual(delta.xy, vec2(0.0))) * max(abs(delta.xy), vec2(1e-7));
+    float t_pixel = 1.0 / length(delta.xy * size);
+    // a pixel out so the ray does not hit where it starts
+    float t = t_pixel;
+    int level = 0;
+
+    for (int i = 0; i < SSR_ITERATIONS && level >= 0; i++) {
+        if (t > t_end)
+            return vec3(0.0);
+
+        vec2 level_size = vec2(textureSize(scene_hiz, level));
+        vec2 cell = floor((start.xy + delta.xy * t) * level_size);
+        float nearest = texelFetch(scene_hiz, ivec2(cell), level).r;
+
+        // where the ray leaves the cell and where it gets as deep as the nearest depth inside it
+        vec2 t_cells = ((cell + step(0.0, delta.xy)) / level_size - start.xy) / safe_delta;
+        float t_exit = min(t_cells.x, t_cells.y);
+        float t_depth = (nearest - start.z) / delta.z;
+
+        if (t_depth > t_exit) {
+            t = t_exit + t_pixel * 0.01;
+            level = min(level + 1, hiz_levels - 1);
+        } else {
+            t = max(t, t_depth);
+            level--;
+        }
+    }
+
+    if (level >= 0)
+        return vec3(0.0);
+
+    vec3 hit = start + delta * t;
+    float scene_depth = texelFetch(scene_hiz, ivec2(hit.xy * size), 0).r;
+    if (scene_depth >= 1.0)
+        return vec3(0.0);
+
+    // the ray went behind whatever it hit rather than into it
+    float behind = view_distance(hit.z) - view_distance(scene_depth);
+    if (behind > 0.5 + 0.05 * view_distance(scene_depth))
+        return vec3(0.0);
+
+    // the screen has nothing past its edges, fade out before them instead of cutting off
+    vec2 edge = smoothstep(0.0, 0.08, hit.xy) * smoothstep(0.0, 0.08, 1.0 - hit.xy);
+    return vec3(hit.xy, edge.x * edge.y);
+}
+#endif
+
 void main()
 {
     vec2 uv_coord = pass_world_position.xz;
 
     vec2 uv_coord1 = vec2(uv_coord.x + uni_phase * 1.53, uv_coord.y + uni_phase * 1.15);
-    vec2 uv_coord2 = vec2(uv_coord.x + uni_phase * 0.97, uv_coord.y + uni_phase * 1.87);
-    vec2 uv_coord3 = vec2(uv_coord.x + uni_phase * 2.03, uv_coord.y + uni_phase * 1.11);
 
-    vec3 accum1 = texture(normal_map, uv_coord1).rgb;
-    vec3 accum2 = texture(normal_map, uv_coord2).rgb;
-    vec3 accum3 = texture(normal_map, uv_coord3).rgb;
-    vec3 total = normalize((accum1 + accum2 + accum3));
-
-    float sky_colour_factor = total.x;
-    sky_colour_factor = clamp(sky_colour_factor, 0.0, 1.0);
+    // the waves come from the simulation, the scrolling normal map only adds ripples finer than its texels
+    vec3 wave_normal = texture(ocean_normal, pass_uv).xyz * 2.0 - 1.0;
+    vec3 ripple = texture(normal_map, uv_coord1).rgb * 2.0 - 1.0;
+    vec3 total = normalize(wave_normal + 0.15 * vec3(ripple.x, 0.0, ripple.y));
 
     vec3 to_camera_vec = normalize(pass_world_position - uni_camera_pos);
 
+    // more sky at grazing angles
+    float sky_colour_factor = 1.0 - max(dot(total, -to_camera_vec), 0.0);
+    sky_colour_factor = clamp(sky_colour_factor, 0.0, 1.0);
+
     float distance = length(pass_world_position - uni_camera_pos);
-    float fog_factor = exp(-fog_density * distance * distance); // Increase fog density effect
-    fog_factor = clamp(fog_factor, 0.0, 1.0);
 
     vec3 lightDir = normalize(light_position - pass_world_position);
     float specular_factor = dot(reflect(-lightDir, total.xyz), to_camera_vec);
     specular_factor = pow(clamp(specular_factor, 0.0, 1.0), 20.0);
 
-    vec3 diffuse_color = mix(vec3(0.02, 0.02, 0.5), vec3(0.4, 0.6, 0.8), sky_colour_factor);
+#ifdef SSR
+    // traced off the simulated waves only, the ripples would scatter neighbouring rays between hits and misses
+    vec3 direction = reflect(to_camera_vec, normalize(wave_normal));
+    direction = normalize(vec3(direction.x, max(direction.y, 0.01), direction.z));
+    vec3 hit = trace_screen_space(pass_world_position, direction);
+    vec3 reflection = texture(skybox, direction).rgb;
+    if (hit.z > 0.0)
+        reflection = mix(reflection, texture(scene_colour, hit.xy).rgb, hit.z);
+#else
+    // the reflection is rendered smaller than the screen, the copy of the main pass has its size
+    vec2 screen_uv = gl_FragCoord.xy / vec2(textureSize(scene_colour, 0));
+    vec3 reflection = texture(reflection_texture, screen_uv + total.xz * 0.02).rgb;
+#endif
+
+    // what is under the surface, from the copy of the opaque pass. A distorted lookup that lands on something in front of the water takes the undistorted one
+    vec2 screen_size = vec2(textureSize(scene_colour, 0));
+    vec2 refraction_uv = (gl_FragCoord.xy + total.xz * 20.0) / screen_size;
+    if (texture(scene_depth, refraction_uv).r < gl_FragCoord.z)
+        refraction_uv = gl_FragCoord.xy / screen_size;
+    vec3 refraction = texture(scene_colour, refraction_uv).rgb;
+
+    // how far the view ray travels under the water before it hits the bottom, the further the more of the deep colour
+    float surface_distance = view_distance(gl_FragCoord.z);
+    float water_depth = max(view_distance(texture(scene_depth, refraction_uv).r) - surface_distance, 0.0) * distance / surface_distance;
+    vec3 transmittance = exp(-WATER_ABSORPTION * water_depth);
+    vec3 under_water = mix(WATER_DEEP_COLOUR, refraction, transmittance);
+
+    vec3 diffuse_color = mix(under_water, reflection, sky_colour_factor);
 
     vec3 final_color = diffuse_color + vec3(1.0, 1.0, 1.0) * specular_factor;
 
+#ifdef FOG
+    float fog_factor = exp(-fog_density * distance * distance); // Increase fog density effect
+    fog_factor = clamp(fog_factor, 0.0, 1.0);
     final_color = mix(fog_colour, final_color, fog_factor);
+#endif
 
-    final_colour = vec4(final_color, 0.5);
+    final_colour = vec4(final_color, 1.0);
 }
\ No newline at end of file
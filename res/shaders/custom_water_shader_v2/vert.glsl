@@ -1,10 +1,7 @@
 #version 330
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 colour;
-layout (location = 2) in float alpha;
-layout (location = 3) in vec2 uv;
-layout (location = 4) in vec3 normal;
+// projected grid: [0, 1] x [0, 1] across the screen
+layout (location = 0) in vec2 grid;
 
 out vec3 pass_colour;
 out vec2 pass_uv;
@@ -13,21 +10,48 @@ out vec3 pass_normal;
 out vec3 pass_world_position;
 out vec3 LightPos;
 
-uniform mat4 uni_M;
 uniform mat4 uni_VP;
+uniform mat4 uni_inverse_view;
+// tan of half the field of view, horizontally and vertically
+uniform vec2 uni_tan_half;
+uniform vec3 uni_camera_pos;
 uniform vec3 light_position;
 
+uniform float water_height;
+uniform float water_distance;
+uniform float grid_margin;
+
+uniform sampler2D ocean_displacement;
+uniform float ocean_length;
+
 void main()
 {
-    vec4 world_position = uni_M * vec4(position, 1.0);
+    // a ray through this point of the screen, a little past the edges so waves lifted in from outside leave no gaps
+    vec2 ndc = (grid * 2.0 - 1.0) * grid_margin;
+    vec3 ray = normalize(mat3(uni_inverse_view) * vec3(ndc * uni_tan_half, -1.0));
+
+    // rays that never reach the plane, or reach it past water_distance, land on the horizon instead
+    float t = (water_height - uni_camera_pos.y) / ray.y;
+    vec2 horizontal = ray.xz / max(length(ray.xz), 1e-4);
+    vec3 surface;
+    if (t > 0.0 && t * length(ray.xz) < water_distance)
+        surface = uni_camera_pos + ray * t;
+    else
+        surface = vec3(uni_camera_pos.x + horizontal.x * water_distance, 0.0, uni_camera_pos.z + horizontal.y * water_distance);
+    surface.y = water_height;
+
+    // the waves flatten out before they get smaller than the spacing of the grid
+    float fade = 1.0 - smoothstep(0.1, 0.4, length(surface.xz - uni_camera_pos.xz) / water_distance);
+    vec3 world_position = surface + textureLod(ocean_displacement, surface.xz / ocean_length, 0.0).xyz * fade;
 
-    pass_world_position = world_position.xyz;
+    pass_world_position = world_position;
 
-    gl_Position = uni_VP * world_position;
+    gl_Position = uni_VP * vec4(world_position, 1.0);
 
-    pass_colour = colour;
-    pass_uv = uv;
-    pass_normal = (uni_M * vec4(normal, 0.0)).xyz;
+    pass_colour = vec3(1.0);
+    // undisplaced, the normals are looked up where the wave came from
+    pass_uv = surface.xz / ocean_length;
+    pass_normal = vec3(0.0, 1.0, 0.0);
 
     LightPos = light_position;
-}
\ No newline at end of file
+}
@@ -0,0 +1,12 @@
+// Phong terms of a point light at a surface point with a unit normal, diffuse in x and specular in y.
+// SPECULAR adds the highlight, without it y stays 0 and none of it is computed
+vec2 phong(vec3 position, vec3 normal, vec3 light_position, vec3 view_position)
+{
+    vec3 to_light = normalize(light_position - position);
+    vec2 terms = vec2(max(dot(normal, to_light), 0.0), 0.0);
+#ifdef SPECULAR
+    vec3 to_view = normalize(view_position - position);
+    terms.y = pow(max(dot(to_view, reflect(-to_light, normal)), 0.0), 32);
+#endif
+    return terms;
+}
@@ -0,0 +1,36 @@
+// shadow_factor(world position) of the sun cascades, pulled into every lit program.
+// SHADOWS when the sun is up and there are cascades to read, without it everything is lit
+#ifdef SHADOWS
+uniform sampler2DArrayShadow shadow_map;
+uniform mat4 light_view_projection[4];
+uniform mat4 shadow_view;
+uniform vec4 cascade_splits;
+uniform vec4 cascade_bias;
+
+// 1 lit, 0 shadowed, the cascade is picked by view depth
+float shadow_factor(vec3 world_position)
+{
+    float depth = -(shadow_view * vec4(world_position, 1.0)).z;
+    if (depth > cascade_splits.w)
+        return 1.0;
+    int cascade = int(depth > cascade_splits.x) + int(depth > cascade_splits.y) + int(depth > cascade_splits.z);
+
+    vec4 light_space = light_view_projection[cascade] * vec4(world_position, 1.0);
+    vec3 coords = light_space.xyz / light_space.w * 0.5 + 0.5;
+    float reference = coords.z - cascade_bias[cascade];
+
+    // four bilinear compares, 4x4 texels of PCF in total
+    vec2 texel = 1.0 / vec2(textureSize(shadow_map, 0).xy);
+    float lit = 0.0;
+    lit += texture(shadow_map, vec4(coords.xy + vec2(-0.5, -0.5) * texel, float(cascade), reference));
+    lit += texture(shadow_map, vec4(coords.xy + vec2( 0.5, -0.5) * texel, float(cascade), reference));
+    lit += texture(shadow_map, vec4(coords.xy + vec2(-0.5,  0.5) * texel, float(cascade), reference));
+    lit += texture(shadow_map, vec4(coords.xy + vec2( 0.5,  0.5) * texel, float(cascade), reference));
+    return lit * 0.25;
+}
+#else
+float shadow_factor(vec3 world_position)
+{
+    return 1.0;
+}
+#endif
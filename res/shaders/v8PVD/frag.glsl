@@ -1,13 +0,0 @@
-#version 330
-
-in vec3 pass_colour;
-
-out vec4 final_colour;
-
-
-
-
-void main()
-{
-	final_colour = vec4(pass_colour, 1.0f);
-}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include <rafgl.h>
+#include <culling.h>
+
+cull_frustum_t cull_frustum_from_matrix(mat4_t m)
+{
+    cull_frustum_t frustum;
+    int i, axis, sign;
+    float length;
+
+    /* Gribb-Hartmann: row 3 plus or minus rows 0, 1 and 2, in the order left, right, bottom, top, near, far */
+    for (i = 0; i < 6; i++) {
+        axis = i / 2;
+        sign = (i % 2) ? -1 : 1;
+        frustum.planes[i][0] = m.m[0][3] + sign * m.m[0][axis];
+        frustum.planes[i][1] = m.m[1][3] + sign * m.m[1][axis];
+        frustum.planes[i][2] = m.m[2][3] + sign * m.m[2][axis];
+        frustum.planes[i][3] = m.m[3][3] + sign * m.m[3][axis];
+
+        length = sqrtf(frustum.planes[i][0] * frustum.planes[i][0] + frustum.planes[i][1] * frustum.planes[i][1] + frustum.planes[i][2] * frustum.planes[i][2]);
+        frustum.planes[i][0] /= length;
+        frustum.planes[i][1] /= length;
+        frustum.planes[i][2] /= length;
+        frustum.planes[i][3] /= length;
+    }
+    frustum.plane_count = 6;
+
+    return frustum;
+}
+
+void cull_frustum_drop_near(cull_frustum_t *frustum)
+{
+    if (frustum->plane_count < 6)
+        return;
+    memcpy(frustum->planes[4], frustum->planes[5], sizeof(frustum->planes[4]));
+    frustum->plane_count = 5;
+}
+
+void cull_set_init(cull_set_t *set)
+{
+    memset(set, 0, sizeof(*set));
+}
+
+int cull_set_add(cull_set_t *set, vec3_t min, vec3_t max)
+{
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 64;
+        set->min_x = realloc(set->min_x, set->capacity * sizeof(float));
+        set->min_y = realloc(set->min_y, set->capacity * sizeof(float));
+        set->min_z = realloc(set->min_z, set->capacity * sizeof(float));
+        set->max_x = realloc(set->max_x, set->capacity * sizeof(float));
+        set->max_y = realloc(set->max_y, set->capacity * sizeof(float));
+        set->max_z = realloc(set->max_z, set->capacity * sizeof(float));
+        set->visible = realloc(set->visible, set->capacity * sizeof(int));
+        set->inside = realloc(set->inside, set->capacity);
+        set->batch_visible = realloc(set->batch_visible, (set->capacity + CULL_BATCH - 1) / CULL_BATCH * sizeof(int));
+    }
+
+    cull_set_move(set, set->count, min, max);
+    return set->count++;
+}
+
+void cull_set_move(cull_set_t *set, int index, vec3_t min, vec3_t max)
+{
+    set->min_x[index] = min.x;
+    set->min_y[index] = min.y;
+    set->min_z[index] = min.z;
+    set->max_x[index] = max.x;
+    set->max_y[index] = max.y;
+    set->max_z[index] = max.z;
+}
+
+void cull_set_clear(cull_set_t *set)
+{
+    set->count = set->visible_count = 0;
+}
+
+typedef struct _cull_job_t
+{
+    cull_set_t *set;
+    const cull_frustum_t *frustum;
+} cull_job_t;
+
+static void __cull_test_job(void *data, int batch)
+{
+    cull_job_t *job = data;
+    cull_set_t *set = job->set;
+    aabbs_t boxes = {set->min_x, set->min_y, set->min_z, set->max_x, set->max_y, set->max_z};
+    int first = batch * CULL_BATCH;
+
+    set->batch_visible[batch] = aabbs_in_planes(job->frustum->planes[0], job->frustum->plane_count, boxes, first,
+                                                rafgl_min_m(CULL_BATCH, set->count - first), set->inside + first);
+}
+
+static void __cull_compact_job(void *data, int batch)
+{
+    cull_job_t *job = data;
+    cull_set_t *set = job->set;
+    int i, first = batch * CULL_BATCH, last = rafgl_min_m(first + CULL_BATCH, set->count);
+    int *visible = set->visible + set->batch_visible[batch];
+
+    for (i = first; i < last; i++) {
+        if (set->inside[i])
+            *visible++ = i;
+    }
+}
+
+int cull_set_test(cull_set_t *set, const cull_frustum_t *frustum, const char *visible_counter, const char *total_counter)
+{
+    cull_job_t job = {set, frustum};
+    int batch, batches = (set->count + CULL_BATCH - 1) / CULL_BATCH, start;
+
+    if (set->count < CULL_PARALLEL_MIN) {
+        for (batch = 0; batch < batches; batch++)
+            __cull_test_job(&job, batch);
+    } else {
+        rafgl_parallel_for(batches, __cull_test_job, &job);
+    }
+
+    /* every batch writes its indices from where the ones before it end, no two touch the same part of visible */
+    set->visible_count = 0;
+    for (batch = 0; batch < batches; batch++) {
+        start = set->visible_count;
+        set->visible_count += set->batch_visible[batch];
+        set->batch_visible[batch] = start;
+    }
+
+    if (set->count < CULL_PARALLEL_MIN) {
+        for (batch = 0; batch < batches; batch++)
+            __cull_compact_job(&job, batch);
+    } else {
+        rafgl_parallel_for(batches, __cull_compact_job, &job);
+    }
+
+    if (visible_counter)
+        rafgl_profiler_count(visible_counter, set->visible_count);
+    if (total_counter)
+        rafgl_profiler_count(total_counter, set->count);
+
+    return set->visible_count;
+}
+
+void cull_set_cleanup(cull_set_t *set)
+{
+    free(set->min_x);
+    free(set->min_y);
+    free(set->min_z);
+    free(set->max_x);
+    free(set->max_y);
+    free(set->max_z);
+    free(set->visible);
+    free(set->inside);
+    free(set->batch_visible);
+    memset(set, 0, sizeof(*set));
+}
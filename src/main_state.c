@@ -5,6 +5,12 @@
 #include <rafgl.h>
 #include <game_constants.h>
 #include <utility.h>
+#include <shadows.h>
+#include <terrain.h>
+#include <ocean.h>
+#include <ssr.h>
+#include <render_queue.h>
+#include <culling.h>
 #include <time.h>
 #include "stb_image_write.h"
 
@@ -31,12 +37,8 @@ vertex_t vertex(vec3_t pos, vec3_t col, float alpha, float u, float v, vec3_t no
     return vert;
 }
 
-static GLuint shaders[6], mesh_uni_M[6], mesh_uni_VP[6], uni_object_colour[6], uni_light_colour[6], uni_light_direction[6], uni_ambient[6], uni_camera_position[6];
-static const char *shader_names[6] = {"v8PVD", "v8PVS", "v8PerVertex", "v8PPD", "v8PPS", "v8PerPixel"};
-static const char *shader_title[6] = {"Per Vertex Diffuse", "Per Vertex Specular", "Per Vertex Combined", "Per Pixel Diffuse", "Per Pixel Specular", "Per Pixel Combined"};
 static const char *mesh_names[6] = {"res/models/monkey.obj", "res/models/monkey-subdiv.obj", "res/models/suzanne.obj", "res/models/bunny.obj", "res/models/armadillo.obj", "res/models/dragon.obj"};
 
-int current_shader = 0;
 int num_meshes;
 
 static int p[512];
@@ -137,9 +139,13 @@ void generate_height_map(vertex_t *vertices, int num_vertices, float height_map[
 }
 
 void save_height_map_as_image(float height_map[HEIGHT_MAP_WIDTH][HEIGHT_MAP_HEIGHT], const char *filename) {
-    unsigned char *image = (unsigned char *)malloc(HEIGHT_MAP_WIDTH * HEIGHT_MAP_HEIGHT);
+    size_t scope = rafgl_arena_mark(rafgl_frame_arena());
+    unsigned char *image = rafgl_arena_alloc(rafgl_frame_arena(), HEIGHT_MAP_WIDTH * HEIGHT_MAP_HEIGHT);
     float max_height = 0.0f;
 
+    if (image == NULL)
+        return;
+
     for (int i = 0; i < HEIGHT_MAP_WIDTH; i++) {
         for (int j = 0; j < HEIGHT_MAP_HEIGHT; j++) {
             if (height_map[i][j] > max_height) {
@@ -155,29 +161,98 @@ void save_height_map_as_image(float height_map[HEIGHT_MAP_WIDTH][HEIGHT_MAP_HEIG
     }
 
     stbi_write_png(filename, HEIGHT_MAP_WIDTH, HEIGHT_MAP_HEIGHT, 1, image, HEIGHT_MAP_WIDTH);
-    free(image);
+    rafgl_arena_reset(rafgl_frame_arena(), scope);
 }
 
 
-vertex_t vertices[6];
-
-static GLuint vao, vbo, shader_program_id, uni_M, uni_VP, uni_phase, uni_camera_pos, uni_time;
-static GLuint location_plane;
-
 // SKYBOX
 static rafgl_texture_t skybox_texture;
 
 static rafgl_raster_t water_normal_raster;
 static rafgl_texture_t water_normal_map_tex;
 
+// wind driven waves, one 64 m patch tiled over the water
+static ocean_t ocean;
+
+// projected grid, the vertex count is the same at any resolution
+#define WATER_GRID_COLUMNS 192
+#define WATER_GRID_ROWS 192
+// the plane the grid is cast onto, the water has always sat at y = 0
+#define WATER_SURFACE_HEIGHT 0.0f
+// half the side of the old water quad, grid vertices past it are pulled in to the horizon
+#define WATER_DISTANCE 1000.0f
+static ocean_grid_t water_grid;
+
+// planar reflections render the whole scene a second time from under the water, screen space ones march through the depth of the main pass
+static int water_reflection_mode = WATER_REFLECTION_PLANAR;
+static const char *water_reflection_names[2] = {"planar", "screen space"};
+static const char *water_scope_names[2] = {"water (planar)", "water (ssr)"};
+static ssr_t ssr;
+
+// draws are recorded into the queue and replayed sorted by pass, program, material and distance, binding only what changed
+#define RENDER_PASS_SKY 0
+#define RENDER_PASS_OPAQUE 1
+#define RENDER_PASS_WATER 2
+#define RENDER_PASS_TRANSPARENT 3
+
+typedef struct _scene_pass_t
+{
+    mat4_t view_projection;
+    vec3_t view_position;
+    // the boxes tested against it go to these profiler counters, visible then total
+    cull_frustum_t frustum;
+    const char *const *cull_counters;
+} scene_pass_t;
+
+// the terrain and cloud grids are drawn in chunks of GRID_CHUNK quads on a side, only the ones inside the pass
+#define GRID_CHUNK 64
+typedef struct _grid_chunks_t
+{
+    cull_set_t bounds;
+    // index count and byte offset into the element buffer per chunk
+    GLsizei *counts;
+    GLvoid **offsets;
+} grid_chunks_t;
+
+static grid_chunks_t hill_chunks, cloud_chunks;
+// what there is of the meshes this frame, refilled every render
+static cull_set_t object_bounds;
+static const char *const scene_cull_counters[2] = {"scene boxes visible", "scene boxes"};
+static const char *const reflection_cull_counters[2] = {"reflection boxes visible", "reflection boxes"};
+static const char *const shadow_cull_counters[][2] = {
+    {"cascade 0 boxes visible", "cascade 0 boxes"}, {"cascade 1 boxes visible", "cascade 1 boxes"},
+    {"cascade 2 boxes visible", "cascade 2 boxes"}, {"cascade 3 boxes visible", "cascade 3 boxes"}
+};
+
+static render_queue_t render_queue;
+static scene_pass_t scene_pass, water_pass, cloud_pass;
+
+// the lit programs are built from one source per effect, with only the features the frame uses compiled in.
+// Bit i of a mask is scene_features[i], every program takes the bits its source has
+#define FEATURE_SHADOWS (1 << 0)
+#define FEATURE_FOG (1 << 1)
+#define FEATURE_SSR (1 << 2)
+#define FEATURE_SPECULAR (1 << 3)
+#define FEATURE_PER_VERTEX (1 << 4)
+#define HILL_FEATURES (FEATURE_SHADOWS | FEATURE_FOG | FEATURE_SPECULAR)
+#define MESH_FEATURES (FEATURE_SHADOWS | FEATURE_SPECULAR | FEATURE_PER_VERTEX)
+#define WATER_FEATURES (FEATURE_SSR | FEATURE_FOG)
+static const char *scene_features[] = {"SHADOWS", "FOG", "SSR", "SPECULAR", "PER_VERTEX"};
+#define SCENE_FEATURE_COUNT (int)(sizeof(scene_features) / sizeof(scene_features[0]))
+
+// L steps through these, per vertex only changes the meshes, the hills are always lit per pixel
+#define LIGHTING_SPECULAR 1
+#define LIGHTING_PER_VERTEX 2
+static int lighting_mode = LIGHTING_SPECULAR;
+static const char *lighting_names[4] = {"per pixel, diffuse", "per pixel, specular", "per vertex, diffuse", "per vertex, specular"};
+static rafgl_program_variants_t hill_programs, mesh_programs, water_programs;
+
 static GLuint skybox_shader, skybox_shader_cell;
 static GLuint skybox_uni_P, skybox_uni_V;
 static GLuint skybox_cell_uni_P, skybox_cell_uni_V;
 
 static rafgl_meshPUN_t skybox_mesh;
 
-static Vector4f plane = {0.0f, -1.0f, 0.0f, 15.0f};
-
 int num_meshes;
 
 float fov = 75.0f;
@@ -194,34 +269,24 @@ float move_speed = 8.8f;
 float hoffset = -0.35f * M_PIf;
 
 float time_tick = 0.0f;
-int reshow_cursor = 0;
-int last_lmb = 0;
 
 mat4_t model, view, projection, view_projection;
 
 int selected_mesh = 0;
 
-static const int REFLECTION_WIDTH = 320;
-static const int REFLECTION_HEIGHT = 180;
-
-static const int REFRACTION_WIDTH = 1280;
-static const int REFRACTION_HEIGHT = 720;
-
-static GLuint reflectionFrameBuffer;
-static GLuint reflectionTexture;
-static GLuint reflectionDepthBuffer;
-
-static GLuint refractionFrameBuffer;
-static GLuint refractionTexture;
-static GLuint refractionDepthTexture;
+// the planar reflection is blurred by the ripples anyway, half the screen in each direction is plenty
+#define PLANAR_REFLECTION_SCALE 0.5f
+// pooled, held from render_reflection until the water that samples it is drawn
+static rafgl_render_target_t *reflection_target;
 
 // HILLS
-GLuint hill_shader_program_id;
 GLuint hill_vao, hill_vbo, hill_ebo;
 int hill_vertex_count, hill_index_count;
 rafgl_raster_t hill_raster, hill_sand_raster, hill_grass_raster;
 rafgl_texture_t hill_texture, hill_sand_texture, hill_grass_texture;
 static GLuint hill_texture_id, hill_sand_texture_id, hill_grass_texture_id;
+// how much sky each terrain vertex sees, baked once at init
+static GLuint hill_ambient_texture_id;
 
 // CLOUDS
 GLuint cloud_shader_program_id;
@@ -236,152 +301,23 @@ float water_level = -4.0f;
 
 // LIGHT SOURCE
 GLuint depthFBO;
-GLuint depthMap;
 GLuint lightning_shader_program_id;
 
+// SHADOWS
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_DISTANCE 100.0f
+static shadow_cascades_t shadows;
+static shadow_grid_t hill_shadow_grid;
+/* terrain lod per cascade (0 = every 2nd vertex) */
+static const int hill_shadow_lod[SHADOW_CASCADES] = {0, 1, 2, 2};
+static const char *shadow_scope_names[SHADOW_CASCADES] = {"shadow cascade 0", "shadow cascade 1", "shadow cascade 2", "shadow cascade 3"};
+
 GLuint fog_color_location;
 GLuint fog_density_location;
 
 float fog_density = 0.05f;
 vec3_t fog_color = {0.1f, 0.1, 0.1f};
 
-GLuint create_framebuffer()
-{
-    GLuint framebuffer;
-
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
-
-    return framebuffer;
-}
-
-GLuint create_texture_attachment(int width, int height) {
-    GLuint texture;
-
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-
-    return texture;
-}
-
-GLuint create_depth_buffer_attachment(int width, int height) {
-    GLuint depthBuffer;
-
-    glGenRenderbuffers(1, &depthBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
-
-    return depthBuffer;
-}
-
-GLuint create_depth_texture_attachment(int width, int height) {
-    GLuint depthTexture;
-    glGenTextures(1, &depthTexture);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
-
-    return depthTexture;
-}
-
-void bindFrameBuffer(GLuint framebuffer, int width, int height)
-{
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glViewport(0, 0, width, height);
-}
-
-void unbindCurrentFrameBuffer(int width, int height)
-{
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, width, height);
-}
-
-void bindReflectionFrameBuffer()
-{
-    bindFrameBuffer(reflectionFrameBuffer, REFLECTION_WIDTH, REFLECTION_HEIGHT);
-}
-
-void bindRefractionFrameBuffer()
-{
-    bindFrameBuffer(refractionFrameBuffer, REFRACTION_WIDTH, REFRACTION_HEIGHT);
-}
-
-void initialize_reflection_refraction_framebuffers(int width, int height)
-{
-    // Reflection init
-    reflectionFrameBuffer = create_framebuffer();
-    reflectionTexture = create_texture_attachment(REFLECTION_WIDTH, REFLECTION_HEIGHT);
-    reflectionDepthBuffer = create_depth_buffer_attachment(REFLECTION_WIDTH, REFLECTION_HEIGHT);
-    unbindCurrentFrameBuffer(width, height);
-
-    // Refraction init
-    refractionFrameBuffer = create_framebuffer();
-    refractionTexture = create_texture_attachment(REFRACTION_WIDTH, REFRACTION_HEIGHT);
-    refractionDepthTexture = create_depth_texture_attachment(REFRACTION_WIDTH, REFRACTION_HEIGHT);
-    unbindCurrentFrameBuffer(width, height);
-}
-
-void initialize_reflection_refraction_framebuffers_v2(int width, int height) {
-    // Reflection framebuffer
-    glGenFramebuffers(1, &reflectionFrameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, reflectionFrameBuffer);
-
-    glGenTextures(1, &reflectionTexture);
-    glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reflectionTexture, 0);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        printf("Reflection Framebuffer not complete!\n");
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // Refraction framebuffer
-    glGenFramebuffers(1, &refractionFrameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, refractionFrameBuffer);
-
-    glGenTextures(1, &refractionTexture);
-    glBindTexture(GL_TEXTURE_2D, refractionTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, refractionTexture, 0);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        printf("Refraction Framebuffer not complete!\n");
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-void frame_buffer_cleanup() {
-    glDeleteFramebuffers(1, &reflectionFrameBuffer);
-    glDeleteTextures(1, &reflectionTexture);
-    glDeleteRenderbuffers(1, &reflectionDepthBuffer);
-    glDeleteFramebuffers(1, &refractionFrameBuffer);
-    glDeleteTextures(1, &refractionTexture);
-    glDeleteTextures(1, &refractionDepthTexture);
-}
-
 float noise(float x, float z) {
     return 0.0f;
 }
@@ -397,8 +333,10 @@ float mix(float x, float x1, float river_mask) {
 
 vertex_t* generate_hills(int width, int height, float scale, int* vertex_count, float water_level, float river_width) {
     int num_vertices = width * height;
-    vertex_t* vertices = (vertex_t*)malloc(num_vertices * sizeof(vertex_t));
-    *vertex_count = num_vertices;
+    vertex_t* vertices = rafgl_arena_alloc(rafgl_frame_arena(), num_vertices * sizeof(vertex_t));
+    *vertex_count = vertices ? num_vertices : 0;
+    if (vertices == NULL)
+        return NULL;
 
     float x_offset = width / 2.0f;
     float z_offset = height / 2.0f;
@@ -446,8 +384,10 @@ vertex_t* generate_hills(int width, int height, float scale, int* vertex_count,
 
 vertex_t* generate_clouds(int width, int height, float cloud_height, int* vertex_count) {
     int num_vertices = width * height;
-    vertex_t* vertices = (vertex_t*)malloc(num_vertices * sizeof(vertex_t));
-    *vertex_count = num_vertices;
+    vertex_t* vertices = rafgl_arena_alloc(rafgl_frame_arena(), num_vertices * sizeof(vertex_t));
+    *vertex_count = vertices ? num_vertices : 0;
+    if (vertices == NULL)
+        return NULL;
 
     float x_offset = width / 2.0f;
     float z_offset = height / 2.0f;
@@ -464,57 +404,72 @@ vertex_t* generate_clouds(int width, int height, float cloud_height, int* vertex
     return vertices;
 }
 
-// Function to generate indices for the grid of vertices
-GLuint* generate_hill_indices(int width, int height, int* index_count) {
+// Indices for the grid of vertices, chunk by chunk so each chunk is one run the culling can leave out
+GLuint* generate_grid_indices(const vertex_t* vertices, int width, int height, int* index_count, grid_chunks_t* chunks) {
     int num_indices = (width - 1) * (height - 1) * 6;
-    GLuint* indices = malloc(num_indices * sizeof(GLuint));
-    *index_count = num_indices;
+    GLuint* indices = vertices ? rafgl_arena_alloc(rafgl_frame_arena(), num_indices * sizeof(GLuint)) : NULL;
+    *index_count = indices ? num_indices : 0;
+    if (indices == NULL)
+        return NULL;
+
+    int chunks_x = (width - 2) / GRID_CHUNK + 1;
+    int chunks_z = (height - 2) / GRID_CHUNK + 1;
+    chunks->counts = malloc(chunks_x * chunks_z * sizeof(GLsizei));
+    chunks->offsets = malloc(chunks_x * chunks_z * sizeof(GLvoid*));
+    cull_set_init(&chunks->bounds);
 
     int index = 0;
-    for (int z = 0; z < height - 1; z++) {
-        for (int x = 0; x < width - 1; x++) {
-            int tl = z * width + x;
-            int tr = z * width + x + 1;
-            int bl = (z + 1) * width + x;
-            int br = (z + 1) * width + x + 1;
-
-            indices[index++] = tl;
-            indices[index++] = bl;
-            indices[index++] = tr;
-
-            indices[index++] = tr;
-            indices[index++] = bl;
-            indices[index++] = br;
+    for (int cz = 0; cz < chunks_z; cz++) {
+        for (int cx = 0; cx < chunks_x; cx++) {
+            int x0 = cx * GRID_CHUNK, x1 = rafgl_min_m(x0 + GRID_CHUNK, width - 1);
+            int z0 = cz * GRID_CHUNK, z1 = rafgl_min_m(z0 + GRID_CHUNK, height - 1);
+            int chunk = cz * chunks_x + cx;
+            vec3_t min = vertices[z0 * width + x0].position, max = min;
+
+            chunks->offsets[chunk] = (GLvoid*)(index * sizeof(GLuint));
+            for (int z = z0; z <= z1; z++) {
+                for (int x = x0; x <= x1; x++) {
+                    vec3_t p = vertices[z * width + x].position;
+                    min = vec3(fminf(min.x, p.x), fminf(min.y, p.y), fminf(min.z, p.z));
+                    max = vec3(fmaxf(max.x, p.x), fmaxf(max.y, p.y), fmaxf(max.z, p.z));
+                    if (z == z1 || x == x1)
+                        continue;
+
+                    int tl = z * width + x;
+                    int tr = z * width + x + 1;
+                    int bl = (z + 1) * width + x;
+                    int br = (z + 1) * width + x + 1;
+
+                    indices[index++] = tl;
+                    indices[index++] = bl;
+                    indices[index++] = tr;
+
+                    indices[index++] = tr;
+                    indices[index++] = bl;
+                    indices[index++] = br;
+                }
+            }
+            chunks->counts[chunk] = index - (int)((size_t)chunks->offsets[chunk] / sizeof(GLuint));
+            cull_set_add(&chunks->bounds, min, max);
         }
     }
 
     return indices;
 }
 
-GLuint* generate_cloud_indices(int width, int height, int* index_count) {
-    int num_indices = (width - 1) * (height - 1) * 6;
-    GLuint* indices = malloc(num_indices * sizeof(GLuint));
-    *index_count = num_indices;
-
-    int index = 0;
-    for (int z = 0; z < height - 1; z++) {
-        for (int x = 0; x < width - 1; x++) {
-            int tl = z * width + x;
-            int tr = z * width + x + 1;
-            int bl = (z + 1) * width + x;
-            int br = (z + 1) * width + x + 1;
-
-            indices[index++] = tl;
-            indices[index++] = bl;
-            indices[index++] = tr;
-
-            indices[index++] = tr;
-            indices[index++] = bl;
-            indices[index++] = br;
-        }
+// the runs of the chunks frustum keeps, in the frame arena until the submit. Returns how many there are
+static int cull_grid(grid_chunks_t *chunks, const cull_frustum_t *frustum, const char *const counters[2], GLsizei **counts, GLvoid ***offsets) {
+    int visible = cull_set_test(&chunks->bounds, frustum, counters[0], counters[1]);
+
+    *counts = rafgl_arena_alloc(rafgl_frame_arena(), visible * sizeof(GLsizei));
+    *offsets = rafgl_arena_alloc(rafgl_frame_arena(), visible * sizeof(GLvoid*));
+    if (*counts == NULL || *offsets == NULL)
+        return 0;
+    for (int i = 0; i < visible; i++) {
+        (*counts)[i] = chunks->counts[chunks->bounds.visible[i]];
+        (*offsets)[i] = chunks->offsets[chunks->bounds.visible[i]];
     }
-
-    return indices;
+    return visible;
 }
 
 vec3_t light_position = {10.0f, 20.0f, 10.0f};
@@ -527,26 +482,136 @@ float reflection_uv_offset = 0.0f;
 
 static rafgl_meshPUN_t meshes[6];
 
-GLuint mesh_shader_program;
-GLuint uni_M_mesh, uni_VP_mesh, light_pos_loc, light_color_loc, view_pos_loc, object_color_loc;
 
 int showing_meshes = 1;
+static int cursor_captured = 0;
+
+/* F9 records a Y4M fly-through, F10 a PNG sequence */
+static rafgl_capture_t capture;
+
+/* scripted camera for headless runs, one image per pose */
+typedef struct _camera_pose_t
+{
+    vec3_t position, target;
+    float time;
+} camera_pose_t;
+
+static camera_pose_t *poses = NULL;
+static int pose_count = 0;
+
+// update moves the simulation on in fixed steps, render draws in between the states the last two updates left
+typedef struct _frame_state_t
+{
+    vec3_t eye, target, light;
+    float time;
+} frame_state_t;
+static frame_state_t previous_frame_state, current_frame_state;
+static int frame_state_count = 0;
+
+// everything render takes from update, with --pipelined the next update fills one while render draws from the other
+typedef struct _main_state_packet_t
+{
+    frame_state_t previous, current;
+    int showing_meshes, selected_mesh, reflection_mode, lighting_mode;
+    // pose the update drew, -1 without a pose script
+    int pose;
+    int cursor_captured;
+    // set when F9 or F10 was pressed, left for render to act on and clear so a second update in the frame cannot drop it
+    int capture_key;
+} main_state_packet_t;
+
+// what the updates move on, only main_state_update touches it and render draws from the globals it fills in from the packet
+typedef struct _simulation_t
+{
+    vec3_t position, light;
+    float time;
+    int showing_meshes, selected_mesh, reflection_mode, lighting_mode;
+    int pose;
+    // cursor at the last update the left button was held in, the view turns by how far it has moved since
+    double cursor_x, cursor_y;
+    int looking;
+} simulation_t;
+static simulation_t simulation;
+
+static vec3_t lerp_v3(vec3_t a, vec3_t b, float t)
+{
+    return v3_add(a, v3_muls(v3_sub(b, a), t));
+}
+
+static int load_camera_poses(const char *path)
+{
+    char line[256];
+    camera_pose_t pose;
+    int capacity = 0, fields;
+    FILE *f = fopen(path, "r");
+
+    if(f == NULL)
+    {
+        rafgl_log(RAFGL_ERROR, "Could not open the pose script %s\n", path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), f))
+    {
+        if(line[0] == '#')
+            continue;
+
+        pose.time = 0.0f;
+        fields = sscanf(line, "%f %f %f %f %f %f %f", &pose.position.x, &pose.position.y, &pose.position.z,
+                        &pose.target.x, &pose.target.y, &pose.target.z, &pose.time);
+        if(fields < 6)
+            continue;
+
+        if(pose_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            poses = realloc(poses, capacity * sizeof(camera_pose_t));
+        }
+        poses[pose_count++] = pose;
+    }
+
+    fclose(f);
+    return pose_count;
+}
+
+// after the programs are created and every time one of them is reloaded
+static void resolve_uniform_locations(void *data)
+{
+    skybox_uni_P = glGetUniformLocation(skybox_shader, "uni_P");
+    skybox_uni_V = glGetUniformLocation(skybox_shader, "uni_V");
+
+    skybox_cell_uni_P = glGetUniformLocation(skybox_shader_cell, "uni_P");
+    skybox_cell_uni_V = glGetUniformLocation(skybox_shader_cell, "uni_V");
+
+    // a new program can get the name a deleted one had
+    render_queue_invalidate(&render_queue);
+}
 
 void main_state_init(GLFWwindow *window, void *args, int width, int height)
 {
+    // every program is submitted before the assets load and only checked once they are in,
+    // with parallel shader compile the driver compiles them in the meantime
+    rafgl_program_batch_t programs;
+    rafgl_program_batch_init(&programs);
+    rafgl_program_variants_init(&mesh_programs, "custom_mesh_shader_v1", scene_features, SCENE_FEATURE_COUNT);
+    rafgl_program_variants_init(&water_programs, "custom_water_shader_v2", scene_features, SCENE_FEATURE_COUNT);
+    rafgl_program_variants_init(&hill_programs, "custom_hills_shader_v2", scene_features, SCENE_FEATURE_COUNT);
+    // the variants of a sunny foggy start in either reflection mode, the rest are compiled the first time they are drawn
+    rafgl_program_variants_add(&programs, &mesh_programs, FEATURE_SHADOWS | FEATURE_SPECULAR);
+    rafgl_program_batch_add_from_name(&programs, "custom_clouds", &cloud_shader_program_id);
+    rafgl_program_variants_add(&programs, &water_programs, FEATURE_FOG);
+    rafgl_program_variants_add(&programs, &water_programs, FEATURE_SSR | FEATURE_FOG);
+    rafgl_program_batch_add_from_name(&programs, "custom_depth_lightning_v1", &lightning_shader_program_id);
+    rafgl_program_variants_add(&programs, &hill_programs, FEATURE_SHADOWS | FEATURE_FOG | FEATURE_SPECULAR);
+    rafgl_program_batch_add_from_name(&programs, "custom_skybox_shader", &skybox_shader);
+    rafgl_program_batch_add_from_name(&programs, "custom_skybox_shader_cell", &skybox_shader_cell);
+
     num_meshes = sizeof(mesh_names) / sizeof(mesh_names[0]);
     for (int i = 0; i < num_meshes; i++) {
         rafgl_log(RAFGL_INFO, "LOADING MESH: %d\n", i + 1);
         rafgl_meshPUN_init(meshes + i);
         rafgl_meshPUN_load_from_OBJ(meshes + i, mesh_names[i]);
     }
-    mesh_shader_program = rafgl_program_create_from_name("custom_mesh_shader_v1");
-    uni_M_mesh = glGetUniformLocation(mesh_shader_program, "uni_M");
-    uni_VP_mesh = glGetUniformLocation(mesh_shader_program, "uni_VP");
-    light_pos_loc = glGetUniformLocation(mesh_shader_program, "light_pos");
-    light_color_loc = glGetUniformLocation(mesh_shader_program, "light_color");
-    view_pos_loc = glGetUniformLocation(mesh_shader_program, "view_pos");
-    object_color_loc = glGetUniformLocation(mesh_shader_program, "object_color");
 
     // CLOUDS
     rafgl_raster_load_from_image(&cloud_raster, "res/images/clouds.png");
@@ -576,17 +641,16 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height)
     // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     // glBindTexture(GL_TEXTURE_2D, 0);
 
-    cloud_shader_program_id = rafgl_program_create_from_name("custom_clouds");
-    if (cloud_shader_program_id == 0) {
-        printf("Failed to create cloud shader program\n");
-    }
-
-    glUniformMatrix4fv(glGetUniformLocation(cloud_shader_program_id, "model"), 1, GL_FALSE, (void*) model.m);
-    glUniformMatrix4fv(glGetUniformLocation(cloud_shader_program_id, "view_projection"), 1, GL_FALSE, (void*) view_projection.m);
-
-    // Generate cloud vertices and indices
+    // Generate cloud vertices and indices, both live in the scratch arena until the upload
+    rafgl_arena_t *scratch = rafgl_frame_arena();
+    size_t scope = rafgl_arena_mark(scratch);
     vertex_t* cloud_vertices = generate_clouds(1000, 1000, 50.0f, &cloud_vertex_count); // Adjust cloud height as needed
-    GLuint* cloud_indices = generate_cloud_indices(1000, 1000, &cloud_index_count);
+    GLuint* cloud_indices = generate_grid_indices(cloud_vertices, 1000, 1000, &cloud_index_count, &cloud_chunks);
+    // the arena logged what did not fit, there is no terrain or sky to draw without it
+    if (cloud_indices == NULL) {
+        glfwSetWindowShouldClose(window, 1);
+        return;
+    }
 
     // Set up VAO, VBO, and EBO for clouds
     glGenVertexArrays(1, &cloud_vao);
@@ -617,15 +681,12 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height)
 
     printf("Initialized clouds with %d vertices and %d indices\n", cloud_vertex_count, cloud_index_count);
 
-    free(cloud_vertices);
-    free(cloud_indices);
+    rafgl_arena_reset(scratch, scope);
 
     // WATER
     rafgl_raster_load_from_image(&water_normal_raster, "res/images/water_normal2.jpg");
     rafgl_texture_init(&water_normal_map_tex);
 
-    initialize_reflection_refraction_framebuffers_v2(width, height);
-
     rafgl_texture_load_from_raster(&water_normal_map_tex, &water_normal_raster);
 
     glBindTexture(GL_TEXTURE_2D, water_normal_map_tex.tex_id); /* bajndujemo doge teksturu */
@@ -641,53 +702,11 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height)
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    vertices[0] = vertex(vec3( -1000.0f,  0.0f,  1000.0f), RAFGL_RED, 1.0f, 0.0f, 0.0f, RAFGL_VEC3_Y);
-    vertices[1] = vertex(vec3( -1000.0f,  0.0f, -1000.0f), RAFGL_GREEN, 1.0f, 0.0f, 1.0f, RAFGL_VEC3_Y);
-    vertices[2] = vertex(vec3(  1000.0f,  0.0f,  1000.0f), RAFGL_GREEN, 1.0f, 1.0f, 0.0f, RAFGL_VEC3_Y);
-
-    vertices[3] = vertex(vec3(  1000.0f,  0.0f,  1000.0f), RAFGL_GREEN, 1.0f, 1.0f, 0.0f, RAFGL_VEC3_Y);
-    vertices[4] = vertex(vec3( -1000.0f,  0.0f, -1000.0f), RAFGL_GREEN, 1.0f, 0.0f, 1.0f, RAFGL_VEC3_Y);
-    vertices[5] = vertex(vec3(  1000.0f,  0.0f, -1000.0f), RAFGL_BLUE, 1.0f, 1.0f, 1.0f, RAFGL_VEC3_Y);
-
-
-    shader_program_id = rafgl_program_create_from_name("custom_water_shader_v2");
-    uni_M = glGetUniformLocation(shader_program_id, "uni_M");
-    uni_VP = glGetUniformLocation(shader_program_id, "uni_VP");
-    uni_phase = glGetUniformLocation(shader_program_id, "uni_phase");
-    uni_camera_pos = glGetUniformLocation(shader_program_id, "uni_camera_pos");
-
-
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(vertex_t), vertices, GL_STATIC_DRAW);
-
-    /* position */
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*) 0);
-
-    /* colour */
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*) (sizeof(vec3_t)));
-
-    /* alpha */
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*) (2 * sizeof(vec3_t)));
-
-    /* UV coords */
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*) (2 * sizeof(vec3_t) + 1 * sizeof(float)));
-
-    /* normal */
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*) (2 * sizeof(vec3_t) + 3 * sizeof(float)));
+    ocean_init(&ocean, 256, 64.0f, vec3(6.0f, 0.0f, 3.0f), 1e-5f, 1.0f);
 
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ocean_grid_init(&water_grid, WATER_GRID_COLUMNS, WATER_GRID_ROWS);
+    ssr_init(&ssr);
+    render_queue_init(&render_queue);
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glEnable(GL_DEPTH_TEST);
@@ -732,41 +751,25 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height)
     glBindTexture(GL_TEXTURE_2D, 0);
 
 
-    lightning_shader_program_id = rafgl_program_create_from_name("custom_depth_lightning_v1");
-
     // LIGHT SOURCE
     glGenFramebuffers(1, &depthFBO);
-
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 1024, 1024, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    shadow_cascades_init(&shadows, depthFBO, SHADOW_MAP_SIZE);
+    // the coarse terrain sits up to a few skipped vertices off the real one
+    for (int c = 0; c < SHADOW_CASCADES; c++)
+        shadows.caster_error[c] = 0.25f * (2 << hill_shadow_lod[c]);
 
     // HILLS
-    hill_shader_program_id = rafgl_program_create_from_name("custom_hills_shader_v2");
-
-    glUniformMatrix4fv(glGetUniformLocation(hill_shader_program_id, "model"), 1, GL_FALSE, (void*) model.m);
-    glUniformMatrix4fv(glGetUniformLocation(hill_shader_program_id, "view"), 1, GL_FALSE, (void*) view.m);
-    glUniformMatrix4fv(glGetUniformLocation(hill_shader_program_id, "projection"), 1, GL_FALSE, (void*) projection.m);
-
-
     vertex_t *hill_vertices = generate_hills(1000, 1000, 75.0f, &hill_vertex_count, water_level, 400);
     int num_hills_vertices = hill_vertex_count;
-    float height_map[HEIGHT_MAP_WIDTH][HEIGHT_MAP_HEIGHT];
-    generate_height_map((float*)hill_vertices, num_hills_vertices, height_map);
+    float (*height_map)[HEIGHT_MAP_HEIGHT] = rafgl_arena_alloc(scratch, HEIGHT_MAP_WIDTH * sizeof(*height_map));
+    GLuint *hill_indices = generate_grid_indices(hill_vertices, 1000, 1000, &hill_index_count, &hill_chunks);
+    if (height_map == NULL || hill_indices == NULL) {
+        glfwSetWindowShouldClose(window, 1);
+        return;
+    }
+    generate_height_map(hill_vertices, num_hills_vertices, height_map);
     save_height_map_as_image(height_map, "height_map.png");
 
-    GLuint *hill_indices = generate_hill_indices(1000, 1000, &hill_index_count);
-
     glGenVertexArrays(1, &hill_vao);
     glBindVertexArray(hill_vao);
 
@@ -797,324 +800,600 @@ void main_state_init(GLFWwindow *window, void *args, int width, int height)
 
     glBindVertexArray(0);
 
-    uni_M = glGetUniformLocation(shader_program_id, "uni_M");
-    uni_VP = glGetUniformLocation(shader_program_id, "uni_VP");
-    uni_phase = glGetUniformLocation(shader_program_id, "uni_phase");
-    uni_camera_pos = glGetUniformLocation(shader_program_id, "uni_camera_pos");
-    location_plane = glGetUniformLocation(shader_program_id, "plane");
-    uni_time = glGetUniformLocation(shader_program_id, "uni_time");
+    shadow_grid_init(&hill_shadow_grid, hill_vbo, hill_vertices, sizeof(vertex_t), 1000, 1000);
+
+    // AMBIENT OCCLUSION
+    float *hill_heights = rafgl_arena_alloc(scratch, hill_vertex_count * sizeof(float));
+    unsigned char *hill_ambient = rafgl_arena_alloc(scratch, hill_vertex_count);
+    if (hill_heights == NULL || hill_ambient == NULL) {
+        glfwSetWindowShouldClose(window, 1);
+        return;
+    }
+    for (int i = 0; i < hill_vertex_count; i++)
+        hill_heights[i] = hill_vertices[i].position.y;
+    terrain_bake_ambient(hill_heights, 1000, 1000, 1.0f, hill_ambient);
+    hill_ambient_texture_id = terrain_ambient_texture(hill_ambient, 1000, 1000);
 
     // SKYBOX
     rafgl_texture_load_cubemap_named(&skybox_texture, "above_the_sea_2", "jpg");
-    skybox_shader = rafgl_program_create_from_name("custom_skybox_shader");
-    skybox_shader_cell = rafgl_program_create_from_name("custom_skybox_shader_cell");
 
-    skybox_uni_P = glGetUniformLocation(skybox_shader, "uni_P");
-    skybox_uni_V = glGetUniformLocation(skybox_shader, "uni_V");
+    rafgl_program_batch_finish(&programs);
+    if (cloud_shader_program_id == 0) {
+        printf("Failed to create cloud shader program\n");
+    }
 
-    skybox_cell_uni_P = glGetUniformLocation(skybox_shader_cell, "uni_P");
-    skybox_cell_uni_V = glGetUniformLocation(skybox_shader_cell, "uni_V");
+    resolve_uniform_locations(NULL);
+
+    // edits to these show up without a restart, the new programs come in between two frames
+    rafgl_program_watch_variants(&mesh_programs);
+    rafgl_program_watch("custom_clouds", &cloud_shader_program_id);
+    rafgl_program_watch_variants(&water_programs);
+    rafgl_program_watch("custom_depth_lightning_v1", &lightning_shader_program_id);
+    rafgl_program_watch_variants(&hill_programs);
+    rafgl_program_watch("custom_skybox_shader", &skybox_shader);
+    rafgl_program_watch("custom_skybox_shader_cell", &skybox_shader_cell);
+    rafgl_program_watch_callback(resolve_uniform_locations, NULL);
+
+    glUniformMatrix4fv(glGetUniformLocation(cloud_shader_program_id, "model"), 1, GL_FALSE, (void*) model.m);
+    glUniformMatrix4fv(glGetUniformLocation(cloud_shader_program_id, "view_projection"), 1, GL_FALSE, (void*) view_projection.m);
 
     rafgl_meshPUN_init(&skybox_mesh);
     rafgl_meshPUN_load_cube(&skybox_mesh, 1.0f);
 
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    rafgl_arena_reset(scratch, scope);
+
+    main_state_args_t *state_args = args;
+    if(state_args != NULL)
+        water_reflection_mode = state_args->reflection_mode;
+
+    rafgl_game_set_packet_size(sizeof(main_state_packet_t));
+    simulation.position = camera_position;
+    simulation.light = light_position;
+    simulation.time = time_tick;
+    simulation.showing_meshes = showing_meshes;
+    simulation.selected_mesh = selected_mesh;
+    simulation.reflection_mode = water_reflection_mode;
+    simulation.lighting_mode = lighting_mode;
+    if(state_args != NULL && state_args->pose_script != NULL)
+    {
+        if(load_camera_poses(state_args->pose_script) <= 0)
+        {
+            rafgl_log(RAFGL_ERROR, "No camera poses to render, closing\n");
+            glfwSetWindowShouldClose(window, 1);
+            return;
+        }
+        rafgl_capture_start(&capture, state_args->output_pattern, RAFGL_CAPTURE_PNG, width, height, 1);
+    }
+}
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+static void cloud_uniforms(GLuint program, void *data) {
+    scene_pass_t *pass = data;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)offsetof(vertex_t, position));
-    glEnableVertexAttribArray(0);
+    glUniformMatrix4fv(glGetUniformLocation(program, "view_projection"), 1, GL_FALSE, (float*)pass->view_projection.m);
+    glUniform3f(glGetUniformLocation(program, "light_color"), light_color.x, light_color.y, light_color.z);
+    glUniform3f(glGetUniformLocation(program, "view_position"), pass->view_position.x, pass->view_position.y, pass->view_position.z);
+    glUniform1f(glGetUniformLocation(program, "fog_density"), fog_density);
+    glUniform3f(glGetUniformLocation(program, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
+    glUniform1f(glGetUniformLocation(program, "time"), glfwGetTime());
+    glUniform1i(glGetUniformLocation(program, "cloudTexture"), 0);
+}
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)offsetof(vertex_t, colour));
-    glEnableVertexAttribArray(1);
+void render_clouds(mat4_t view_projection) {
+    render_command_t *command;
+    GLsizei *counts;
+    GLvoid **offsets;
+
+    cloud_pass.view_projection = view_projection;
+    cloud_pass.view_position = camera_position;
+    cloud_pass.frustum = cull_frustum_from_matrix(view_projection);
+    cloud_pass.cull_counters = scene_cull_counters;
+
+    int visible = cull_grid(&cloud_chunks, &cloud_pass.frustum, cloud_pass.cull_counters, &counts, &offsets);
+    if (visible == 0)
+        return;
+
+    command = render_queue_push(&render_queue, render_queue_key(RENDER_PASS_TRANSPARENT, cloud_shader_program_id, 0, 0.0f, 1));
+    command->program = cloud_shader_program_id;
+    command->vao = cloud_vao;
+    command->flags = RENDER_QUEUE_BLEND;
+    command->texture_targets[0] = GL_TEXTURE_2D;
+    command->textures[0] = cloud_texture_id;
+    command->count = visible;
+    command->counts = counts;
+    command->offsets = (const GLvoid *const *)offsets;
+    command->indexed = 1;
+    command->uniforms = cloud_uniforms;
+    command->data = &cloud_pass;
+
+    render_queue_submit(&render_queue);
+}
 
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)offsetof(vertex_t, alpha));
-    glEnableVertexAttribArray(2);
+void render_shadows(float aspect) {
+    mat4_t identity = m4_identity();
+    mat4_t mesh_model = m4_translation(vec3(2.0f, 0.0f, 0.0f));
+    int c, stale;
 
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)offsetof(vertex_t, u));
-    glEnableVertexAttribArray(3);
+    shadows.enabled = light_position.y > 0.0f;
+    if (!shadows.enabled)
+        return;
 
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)offsetof(vertex_t, normal));
-    glEnableVertexAttribArray(4);
+    // the terrain never changes, it is only drawn into the cascades the cache says are stale
+    stale = shadow_cascades_update(&shadows, view, fov, aspect, 0.1f, SHADOW_DISTANCE, v3_muls(v3_norm(light_position), -1.0f));
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    rafgl_profiler_begin("shadows");
+    glUseProgram(lightning_shader_program_id);
 
-    free(hill_vertices);
-    free(hill_indices);
-}
+    for (c = 0; c < SHADOW_CASCADES; c++) {
+        rafgl_profiler_begin(shadow_scope_names[c]);
+        glUniformMatrix4fv(glGetUniformLocation(lightning_shader_program_id, "lightSpaceMatrix"), 1, GL_FALSE, (float*)shadows.light_view_projection[c].m);
 
-void render_clouds(mat4_t view_projection) {
-    glUseProgram(cloud_shader_program_id);
+        if (stale & (1 << c)) {
+            shadow_cascades_begin(&shadows, c);
+            glUniformMatrix4fv(glGetUniformLocation(lightning_shader_program_id, "model"), 1, GL_FALSE, (float*)identity.m);
+            cull_set_test(&hill_shadow_grid.chunks, &shadows.frustum[c], shadow_cull_counters[c][0], shadow_cull_counters[c][1]);
+            shadow_grid_draw(&hill_shadow_grid, hill_shadow_lod[c]);
+        }
 
-    glUniformMatrix4fv(glGetUniformLocation(cloud_shader_program_id, "view_projection"), 1, GL_FALSE, (float*)&view_projection); // Note: GL_TRUE for row-major
-    glUniform3f(glGetUniformLocation(cloud_shader_program_id, "light_color"), light_color.x, light_color.y, light_color.z);
-    glUniform3f(glGetUniformLocation(cloud_shader_program_id, "view_position"), camera_position.x, camera_position.y, camera_position.z);
-    glUniform1f(glGetUniformLocation(cloud_shader_program_id, "fog_density"), fog_density);
-    glUniform3f(glGetUniformLocation(cloud_shader_program_id, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
-    glUniform1f(glGetUniformLocation(cloud_shader_program_id, "time"), glfwGetTime());
+        // the meshes can be swapped and hidden at any time, they go on top of a fresh copy of the terrain depth
+        if (shadow_cascades_composite(&shadows, c, cull_set_test(&object_bounds, &shadows.frustum[c], shadow_cull_counters[c][0], shadow_cull_counters[c][1]) > 0)) {
+            glUniformMatrix4fv(glGetUniformLocation(lightning_shader_program_id, "model"), 1, GL_FALSE, (float*)mesh_model.m);
+            glBindVertexArray(meshes[selected_mesh].vao_id);
+            glDrawArrays(GL_TRIANGLES, 0, meshes[selected_mesh].vertex_count);
+            glBindVertexArray(0);
+        }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, cloud_texture_id);
-    glUniform1i(glGetUniformLocation(cloud_shader_program_id, "cloudTexture"), 0);
+        rafgl_profiler_end();
+    }
 
-    glBindVertexArray(cloud_vao);
-    glDrawElements(GL_TRIANGLES, cloud_index_count, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    shadow_cascades_end(&shadows);
+    rafgl_profiler_end();
+}
+
+// the features the lit programs of this frame have compiled in, after render_shadows has decided on the cascades
+static unsigned int scene_feature_mask(void) {
+    unsigned int mask = 0;
 
-    //glBindTexture(GL_TEXTURE_2D, 0);
+    if (shadows.enabled)
+        mask |= FEATURE_SHADOWS;
+    if (fog_density > 0.0f)
+        mask |= FEATURE_FOG;
+    if (water_reflection_mode == WATER_REFLECTION_SSR)
+        mask |= FEATURE_SSR;
+    if (lighting_mode & LIGHTING_SPECULAR)
+        mask |= FEATURE_SPECULAR;
+    if (lighting_mode & LIGHTING_PER_VERTEX)
+        mask |= FEATURE_PER_VERTEX;
+    return mask;
 }
 
-void render_hills(mat4_t view_projection) {
-    glUseProgram(hill_shader_program_id);
+static void hill_uniforms(GLuint program, void *data) {
+    scene_pass_t *pass = data;
 
-    glUniformMatrix4fv(glGetUniformLocation(hill_shader_program_id, "view_projection"), 1, GL_FALSE, (void*)view_projection.m);
-    glUniform3f(glGetUniformLocation(hill_shader_program_id, "light_position"), light_position.x, light_position.y, light_position.z);
-    glUniform3f(glGetUniformLocation(hill_shader_program_id, "light_color"), light_color.x, light_color.y, light_color.z);
-    glUniform3f(glGetUniformLocation(hill_shader_program_id, "view_position"), camera_position.x, camera_position.y, camera_position.z);
-    glUniform1f(glGetUniformLocation(hill_shader_program_id, "water_height"), water_level);
+    shadow_cascades_bind_uniforms(&shadows, program, view, 5);
 
-    glUniform3f(glGetUniformLocation(hill_shader_program_id, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
-    glUniform1f(glGetUniformLocation(hill_shader_program_id, "fog_density"), fog_density);
+    glUniformMatrix4fv(glGetUniformLocation(program, "view_projection"), 1, GL_FALSE, (void*)pass->view_projection.m);
+    glUniform3f(glGetUniformLocation(program, "light_position"), light_position.x, light_position.y, light_position.z);
+    glUniform3f(glGetUniformLocation(program, "light_color"), light_color.x, light_color.y, light_color.z);
+    glUniform3f(glGetUniformLocation(program, "view_position"), pass->view_position.x, pass->view_position.y, pass->view_position.z);
+    glUniform1f(glGetUniformLocation(program, "water_height"), water_level);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, hill_texture_id);
-    glUniform1i(glGetUniformLocation(hill_shader_program_id, "hillTexture"), 0);
+    glUniform3f(glGetUniformLocation(program, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
+    glUniform1f(glGetUniformLocation(program, "fog_density"), fog_density);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, hill_sand_texture_id);
-    glUniform1i(glGetUniformLocation(hill_shader_program_id, "sandTexture"), 1);
+    glUniform1i(glGetUniformLocation(program, "hillTexture"), 0);
+    glUniform1i(glGetUniformLocation(program, "sandTexture"), 1);
+    glUniform1i(glGetUniformLocation(program, "grassTexture"), 2);
+    glUniform1i(glGetUniformLocation(program, "cloudTexture"), 3);
+    glUniform1i(glGetUniformLocation(program, "ambientTexture"), 4);
+}
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, hill_grass_texture_id);
-    glUniform1i(glGetUniformLocation(hill_shader_program_id, "grassTexture"), 2);
+void render_hills(scene_pass_t *pass) {
+    GLuint program = rafgl_program_variant(&hill_programs, scene_feature_mask() & HILL_FEATURES);
+    render_command_t *command;
+    GLsizei *counts;
+    GLvoid **offsets;
+    int i, visible;
+
+    visible = cull_grid(&hill_chunks, &pass->frustum, pass->cull_counters, &counts, &offsets);
+    if (visible == 0)
+        return;
+
+    // the terrain is all around the eye, it goes first of the opaque pass
+    command = render_queue_push(&render_queue, render_queue_key(RENDER_PASS_OPAQUE, program, 0, 0.0f, 0));
+
+    command->program = program;
+    command->vao = hill_vao;
+    command->textures[0] = hill_texture_id;
+    command->textures[1] = hill_sand_texture_id;
+    command->textures[2] = hill_grass_texture_id;
+    command->textures[3] = cloud_texture_id;
+    command->textures[4] = hill_ambient_texture_id;
+    for (i = 0; i < 5; i++)
+        command->texture_targets[i] = GL_TEXTURE_2D;
+    command->count = visible;
+    command->counts = counts;
+    command->offsets = (const GLvoid *const *)offsets;
+    command->indexed = 1;
+    command->uniforms = hill_uniforms;
+    command->data = pass;
+}
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, cloud_texture_id);
-    glUniform1i(glGetUniformLocation(hill_shader_program_id, "cloudTexture"), 3);
+static void skybox_uniforms(GLuint program, void *data) {
+    scene_pass_t *pass = data;
 
-    glBindVertexArray(hill_vao);
-    glDrawElements(GL_TRIANGLES, hill_index_count, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    glUniformMatrix4fv(glGetUniformLocation(program, "view_projection"), 1, GL_FALSE, (float*)pass->view_projection.m);
+    glUniform3f(glGetUniformLocation(program, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
+    glUniform1f(glGetUniformLocation(program, "fog_density"), fog_density);
+    glUniform3f(glGetUniformLocation(program, "view_position"), pass->view_position.x, pass->view_position.y, pass->view_position.z);
 }
 
-void render_skybox(mat4_t view_projection, vec3_t view_position) {
-    glUseProgram(skybox_shader);
+void render_skybox(scene_pass_t *pass) {
+    render_command_t *command = render_queue_push(&render_queue, render_queue_key(RENDER_PASS_SKY, skybox_shader, 0, 0.0f, 0));
 
-    glUniformMatrix4fv(glGetUniformLocation(skybox_shader, "view_projection"), 1, GL_FALSE, (float*)&view_projection);
-    glUniform3f(glGetUniformLocation(skybox_shader, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
-    glUniform1f(glGetUniformLocation(skybox_shader, "fog_density"), fog_density);
-    glUniform3f(glGetUniformLocation(skybox_shader, "view_position"), view_position.x, view_position.y, view_position.z);
+    command->program = skybox_shader;
+    command->vao = skybox_mesh.vao_id;
+    command->texture_targets[0] = GL_TEXTURE_CUBE_MAP;
+    command->textures[0] = skybox_texture.tex_id;
+    command->count = 36;
+    command->uniforms = skybox_uniforms;
+    command->data = pass;
+}
 
-    glBindVertexArray(skybox_mesh.vao_id);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture.tex_id);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+static void mesh_uniforms(GLuint program, void *data) {
+    scene_pass_t *pass = data;
+    mat4_t mesh_model = m4_translation(vec3(2.0f, 0.0f, 0.0f));
+
+    shadow_cascades_bind_uniforms(&shadows, program, view, 5);
+
+    glUniformMatrix4fv(glGetUniformLocation(program, "uni_M"), 1, GL_FALSE, (void*) mesh_model.m);
+    glUniformMatrix4fv(glGetUniformLocation(program, "uni_VP"), 1, GL_FALSE, (void*) pass->view_projection.m);
+    glUniform3f(glGetUniformLocation(program, "light_pos"), light_position.x, light_position.y, light_position.z);
+    glUniform3f(glGetUniformLocation(program, "light_color"), light_color.x, light_color.y, light_color.z);
+    glUniform3f(glGetUniformLocation(program, "view_pos"), pass->view_position.x, pass->view_position.y, pass->view_position.z);
+    glUniform3f(glGetUniformLocation(program, "object_color"), 0.0f, 0.3f, 0.7f);
 }
 
-void render_scene(mat4_t view_projection, int width, int height) {
+void render_scene(mat4_t view_projection, vec3_t view_position, int width, int height, const char *const cull_counters[2]) {
     glViewport(0, 0, width, height);
 
     glClearColor(fog_color.x + 0.05, fog_color.y + 0.05, fog_color.z + 0.05, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    scene_pass.view_projection = view_projection;
+    scene_pass.view_position = view_position;
+    scene_pass.frustum = cull_frustum_from_matrix(view_projection);
+    scene_pass.cull_counters = cull_counters;
+
     // SKYBOX
-    float aspect = (float)width / (float)height;
-    projection = m4_perspective(fov, aspect, 0.1f, 1000.0f);
-    view_projection = m4_mul(projection, view);
-    render_skybox(view_projection, camera_position);
+    render_skybox(&scene_pass);
 
     // HILLS
-    render_hills(view_projection);
-
-    if (showing_meshes) {
-        glUseProgram(mesh_shader_program);
-
-        mat4_t mesh_model = m4_translation(vec3(2.0f, 0.0f, 0.0f));
-        glUniformMatrix4fv(uni_M_mesh, 1, GL_FALSE, (void*) mesh_model.m);
+    render_hills(&scene_pass);
+
+    if (cull_set_test(&object_bounds, &scene_pass.frustum, cull_counters[0], cull_counters[1])) {
+        float distance = v3_length(v3_sub(vec3(2.0f, 0.0f, 0.0f), view_position));
+        GLuint program = rafgl_program_variant(&mesh_programs, scene_feature_mask() & MESH_FEATURES);
+        render_command_t *command = render_queue_push(&render_queue, render_queue_key(RENDER_PASS_OPAQUE, program, selected_mesh + 1, distance, 0));
+
+        command->program = program;
+        command->vao = meshes[selected_mesh].vao_id;
+        command->count = meshes[selected_mesh].vertex_count;
+        command->uniforms = mesh_uniforms;
+        command->data = &scene_pass;
+    }
 
-        glUniformMatrix4fv(uni_VP_mesh, 1, GL_FALSE, (void*) view_projection.m);
-        glUniform3f(light_pos_loc, light_position.x, light_position.y, light_position.z);
-        glUniform3f(light_color_loc, light_color.x, light_color.y, light_color.z);
-        glUniform3f(view_pos_loc, camera_position.x, camera_position.y, camera_position.z);
-        glUniform3f(object_color_loc, 0.0f, 0.3f, 0.7f);
+    render_queue_submit(&render_queue);
+}
 
-        glBindVertexArray(meshes[selected_mesh].vao_id);
-        glDrawArrays(GL_TRIANGLES, 0, meshes[selected_mesh].vertex_count);
-        glBindVertexArray(0);
-    }
+// the camera mirrored in the water plane. The near plane is tilted onto the water (Lengyel's oblique frustum)
+// so nothing under the surface gets into the reflection, and no shader needs a clip plane of its own
+void render_reflection(int width, int height) {
+    mat4_t mirror = m4_identity();
+    mirror.m11 = -1.0f;
+    mirror.m31 = 2.0f * WATER_SURFACE_HEIGHT;
+
+    mat4_t reflected_view = m4_mul(view, mirror);
+    vec3_t reflected_position = vec3(camera_position.x, 2.0f * WATER_SURFACE_HEIGHT - camera_position.y, camera_position.z);
+
+    // the water plane in view space, mirroring keeps the view matrix orthonormal so normals go through it like directions
+    vec3_t normal = m4_mul_dir(reflected_view, vec3(0.0f, 1.0f, 0.0f));
+    vec3_t point = m4_mul_pos(reflected_view, vec3(0.0f, WATER_SURFACE_HEIGHT, 0.0f));
+    float clip[4] = {normal.x, normal.y, normal.z, -v3_dot(normal, point)};
+
+    mat4_t oblique = projection;
+    float q[4], scale;
+    q[0] = ((clip[0] > 0.0f) - (clip[0] < 0.0f) + oblique.m20) / oblique.m00;
+    q[1] = ((clip[1] > 0.0f) - (clip[1] < 0.0f) + oblique.m21) / oblique.m11;
+    q[2] = -1.0f;
+    q[3] = (1.0f + oblique.m22) / oblique.m32;
+    scale = 2.0f / (clip[0] * q[0] + clip[1] * q[1] + clip[2] * q[2] + clip[3] * q[3]);
+    oblique.m02 = clip[0] * scale;
+    oblique.m12 = clip[1] * scale;
+    oblique.m22 = clip[2] * scale + 1.0f;
+    oblique.m32 = clip[3] * scale;
+
+    reflection_target = rafgl_render_target_acquire_scaled(GL_RGBA8, GL_DEPTH24_STENCIL8, PLANAR_REFLECTION_SCALE, 0);
+    if (reflection_target == NULL)
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, reflection_target->fbo_id);
+    render_scene(m4_mul(oblique, reflected_view), reflected_position, reflection_target->width, reflection_target->height, reflection_cull_counters);
+    glBindFramebuffer(GL_FRAMEBUFFER, rafgl_framebuffer_default());
+    glViewport(0, 0, width, height);
 }
 
+static void water_uniforms(GLuint program, void *data) {
+    scene_pass_t *pass = data;
+    mat4_t inverse_view = m4_invert_affine(view);
+
+    glUniform1i(glGetUniformLocation(program, "normal_map"), 0);
+    glUniform1i(glGetUniformLocation(program, "reflection_texture"), 1);
+    glUniform1i(glGetUniformLocation(program, "skybox"), 8);
+
+    ocean_bind_uniforms(&ocean, program, 3);
+
+    // the opaque pass under the water, refracted in both modes and marched through by the screen space reflections
+    ssr_bind_uniforms(&ssr, program, 5);
+
+    glUniform3f(glGetUniformLocation(program, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
+    glUniform1f(glGetUniformLocation(program, "fog_density"), fog_density);
+
+    glUniformMatrix4fv(glGetUniformLocation(program, "uni_VP"), 1, GL_FALSE, (void*) pass->view_projection.m);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, (void*) projection.m);
+    glUniformMatrix4fv(glGetUniformLocation(program, "uni_inverse_view"), 1, GL_FALSE, (void*) inverse_view.m);
+    glUniform2f(glGetUniformLocation(program, "uni_tan_half"), 1.0f / projection.m[0][0], 1.0f / projection.m[1][1]);
+    glUniform1f(glGetUniformLocation(program, "water_height"), WATER_SURFACE_HEIGHT);
+    glUniform1f(glGetUniformLocation(program, "water_distance"), WATER_DISTANCE);
+    glUniform1f(glGetUniformLocation(program, "grid_margin"), 1.1f);
+    glUniform1f(glGetUniformLocation(program, "uni_phase"), time_tick * 0.1f);
+    glUniform3f(glGetUniformLocation(program, "uni_camera_pos"), pass->view_position.x, pass->view_position.y, pass->view_position.z);
+    glUniform3f(glGetUniformLocation(program, "light_position"), light_position.x, light_position.y, light_position.z);
+    glUniform3f(glGetUniformLocation(program, "light_color"), light_color.x, light_color.y, light_color.z);
+}
 
 void render_water(mat4_t view_projection) {
-    glUseProgram(shader_program_id);
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // Bind the normal map texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, water_normal_map_tex.tex_id);
-    glUniform1i(glGetUniformLocation(shader_program_id, "normal_map"), 0);
-
-    // Bind the reflection texture
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-    glUniform1i(glGetUniformLocation(shader_program_id, "reflection_texture"), 1);
-
-    // Bind the refraction texture
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, refractionTexture);
-    glUniform1i(glGetUniformLocation(shader_program_id, "refraction_texture"), 2);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-    glBindVertexArray(vao);
-
-    glUniformMatrix4fv(uni_M, 1, GL_FALSE, (void*) model.m);
-    glUniformMatrix4fv(uni_VP, 1, GL_FALSE, (void*) view_projection.m);
-    glUniform1f(uni_phase, time_tick * 0.1f);
-    glUniform3f(uni_camera_pos, camera_position.x, camera_position.y, camera_position.z);
-    glUniform3f(glGetUniformLocation(shader_program_id, "light_position"), light_position.x, light_position.y, light_position.z);
-    glUniform3f(glGetUniformLocation(shader_program_id, "light_color"), light_color.x, light_color.y, light_color.z);
-
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    GLuint program = rafgl_program_variant(&water_programs, scene_feature_mask() & WATER_FEATURES);
+    render_command_t *command = render_queue_push(&render_queue, render_queue_key(RENDER_PASS_WATER, program, 0, 0.0f, 1));
+
+    water_pass.view_projection = view_projection;
+    water_pass.view_position = camera_position;
+
+    command->program = program;
+    command->vao = water_grid.vao;
+    command->flags = RENDER_QUEUE_BLEND;
+    command->texture_targets[0] = GL_TEXTURE_2D;
+    command->textures[0] = water_normal_map_tex.tex_id;
+    command->texture_targets[1] = GL_TEXTURE_2D;
+    command->textures[1] = reflection_target ? reflection_target->colour_id : 0;
+    // its own unit, a cube map sampler left on unit 0 next to the 2D ones would fail validation
+    command->texture_targets[8] = GL_TEXTURE_CUBE_MAP;
+    command->textures[8] = skybox_texture.tex_id;
+    command->count = water_grid.index_count;
+    command->indexed = 1;
+    command->uniforms = water_uniforms;
+    command->data = &water_pass;
+
+    render_queue_submit(&render_queue);
+}
 
-    glBindVertexArray(0);
-    glDisableVertexAttribArray(4);
-    glDisableVertexAttribArray(3);
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+static void fill_packet(main_state_packet_t *packet, vec3_t target)
+{
+    current_frame_state.eye = simulation.position;
+    current_frame_state.target = target;
+    current_frame_state.light = simulation.light;
+    current_frame_state.time = simulation.time;
+
+    // nothing to blend from on the first update
+    if (frame_state_count++ == 0)
+        previous_frame_state = current_frame_state;
+
+    packet->previous = previous_frame_state;
+    packet->current = current_frame_state;
+    packet->showing_meshes = simulation.showing_meshes;
+    packet->selected_mesh = simulation.selected_mesh;
+    packet->reflection_mode = simulation.reflection_mode;
+    packet->lighting_mode = simulation.lighting_mode;
+    packet->pose = pose_count ? simulation.pose : -1;
+    packet->cursor_captured = simulation.looking;
 }
 
-
 void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args) {
-    time_tick += delta_time;
-
-    // rotate light source
-    light_position.x = 10000.0f * cosf(time_tick / 20.0f);
-    light_position.y = 10000.0f * sinf(time_tick / 20.0f);
+    // may run on its own thread while render draws the last packet, so no GL, no window and none of the globals render reads
+    main_state_packet_t *packet = rafgl_game_update_packet();
+    previous_frame_state = current_frame_state;
 
+    if(pose_count)
+    {
+        simulation.position = poses[simulation.pose].position;
+        camera_target = poses[simulation.pose].target;
+        simulation.time = poses[simulation.pose].time;
+    }
+    else
+    {
+        simulation.time += delta_time;
+    }
 
-    model = m4_identity();
-    view = m4_look_at(camera_position, camera_target, camera_up);
-    projection = m4_perspective(fov, (float)game_data->raster_width / game_data->raster_height, 0.1f, 1000.0f);
-    view_projection = m4_mul(projection, view);
+    // rotate light source
+    simulation.light.x = 10000.0f * cosf(simulation.time / 20.0f);
+    simulation.light.y = 10000.0f * sinf(simulation.time / 20.0f);
 
     if (game_data->keys_down['M'])
-        showing_meshes = !showing_meshes;
-
-    // REFLECTION
-    bindReflectionFrameBuffer();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glUniform4f(location_plane, 0.0f, 1.0f, 0.0f, 1.0f);
-    vec3_t reflected_camera_pos = camera_position;
-    reflected_camera_pos.y = -camera_position.y;
-    mat4_t reflected_view = m4_look_at(reflected_camera_pos, camera_target, camera_up);
+        simulation.showing_meshes = !simulation.showing_meshes;
 
-    //render_scene(reflected_view, delta_time);
-    //render_water(view_projection, delta_time);
-
-    // REFRACTION
-    bindRefractionFrameBuffer();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glUniform4f(location_plane, 0.0f, -1.0f, 0.0f, 1.0f);
-    render_scene(view_projection, game_data->raster_width, game_data->raster_height);
-
-    unbindCurrentFrameBuffer(game_data->raster_width, game_data->raster_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glUniform4f(location_plane, 0.0f, -1.0f, 0.0f, 1.0f);
-    render_scene(view_projection, game_data->raster_width, game_data->raster_height);
-
-    // ASSIGN FOG UNIFORMS
-    glUseProgram(shader_program_id);
-    glUniform3f(glGetUniformLocation(shader_program_id, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
-    glUniform1f(glGetUniformLocation(shader_program_id, "fog_density"), fog_density);
+    if (game_data->keys_pressed['R']) {
+        simulation.reflection_mode = simulation.reflection_mode == WATER_REFLECTION_PLANAR ? WATER_REFLECTION_SSR : WATER_REFLECTION_PLANAR;
+        rafgl_log(RAFGL_INFO, "Water reflections: %s\n", water_reflection_names[simulation.reflection_mode]);
+    }
 
-    glUseProgram(hill_shader_program_id);
-    glUniform3f(glGetUniformLocation(hill_shader_program_id, "fog_color"), fog_color.x, fog_color.y, fog_color.z);
-    glUniform1f(glGetUniformLocation(hill_shader_program_id, "fog_density"), fog_density);
+    if (game_data->keys_pressed['L']) {
+        simulation.lighting_mode = (simulation.lighting_mode + 1) % 4;
+        rafgl_log(RAFGL_INFO, "Lighting: %s\n", lighting_names[simulation.lighting_mode]);
+    }
 
-    // RENDER LIGHT SOURCE
-    mat4_t light_projection = m4_ortho(-10.0f, 10.0f, -10.0f, 10.0f, 1.0f, 20.0f);
-    mat4_t light_view = m4_look_at(vec3(0.0f, 10.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, -1.0f));
-    mat4_t light_space_matrix = m4_mul(light_projection, light_view);
+    if(pose_count)
+    {
+        // scripted run, the pose decides the view and input is ignored. The last one repeats until render has drawn it
+        fill_packet(packet, camera_target);
+        if(simulation.pose < pose_count - 1)
+            simulation.pose++;
+        return;
+    }
 
     if (game_data->keys_down['D'])
-        camera_position = v3_sub(camera_position, v3_muls(v3_cross(camera_up, aim_dir), move_speed * delta_time));
+        simulation.position = v3_sub(simulation.position, v3_muls(v3_cross(camera_up, aim_dir), move_speed * delta_time));
     if (game_data->keys_down['A'])
-        camera_position = v3_add(camera_position, v3_muls(v3_cross(camera_up, aim_dir), move_speed * delta_time));
+        simulation.position = v3_add(simulation.position, v3_muls(v3_cross(camera_up, aim_dir), move_speed * delta_time));
 
+    // render hides and captures the cursor while the button is held, the view turns by how far it moved since the last update
     if (game_data->is_lmb_down) {
-        if (reshow_cursor == 0)
-            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
-
-        float dx = game_data->mouse_pos_x - game_data->raster_width / 2;
-        float dy = game_data->mouse_pos_y - game_data->raster_height / 2;
-
-        if (!last_lmb) {
-            dx = 0;
-            dy = 0;
+        if (simulation.looking) {
+            hoffset -= (game_data->mouse_pos_y - simulation.cursor_y) / game_data->raster_height;
+            camera_angle += (game_data->mouse_pos_x - simulation.cursor_x) / game_data->raster_width;
         }
-
-        hoffset -= dy / game_data->raster_height;
-        camera_angle += dx / game_data->raster_width;
-
-        glfwSetCursorPos(window, game_data->raster_width / 2, game_data->raster_height / 2);
-        reshow_cursor = 1;
-    } else if (reshow_cursor) {
-        reshow_cursor = 0;
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+        simulation.cursor_x = game_data->mouse_pos_x;
+        simulation.cursor_y = game_data->mouse_pos_y;
     }
-    last_lmb = game_data->is_lmb_down;
+    simulation.looking = game_data->is_lmb_down;
 
     aim_dir = vec3(cosf(camera_angle), 0.0f, sinf(camera_angle));
 
-    if (game_data->keys_down['W']) camera_position = v3_add(camera_position, v3_muls(aim_dir, move_speed * delta_time));
-    if (game_data->keys_down['S']) camera_position = v3_sub(camera_position, v3_muls(aim_dir, move_speed * delta_time));
+    if (game_data->keys_down['W']) simulation.position = v3_add(simulation.position, v3_muls(aim_dir, move_speed * delta_time));
+    if (game_data->keys_down['S']) simulation.position = v3_sub(simulation.position, v3_muls(aim_dir, move_speed * delta_time));
 
-    if (game_data->keys_down[RAFGL_KEY_LEFT_SHIFT]) camera_position.y += move_speed * delta_time;
-    if (game_data->keys_down[RAFGL_KEY_LEFT_CONTROL]) camera_position.y -= move_speed * delta_time;
-
-    float aspect = ((float)(game_data->raster_width)) / game_data->raster_height;
-    projection = m4_perspective(fov, aspect, 0.1f, 100.0f);
+    if (game_data->keys_down[RAFGL_KEY_LEFT_SHIFT]) simulation.position.y += move_speed * delta_time;
+    if (game_data->keys_down[RAFGL_KEY_LEFT_CONTROL]) simulation.position.y -= move_speed * delta_time;
 
+    vec3_t look_target;
     if(!game_data->keys_down['T'])
     {
-        view = m4_look_at(camera_position, v3_add(camera_position, v3_add(aim_dir, vec3(0.0f, hoffset, 0.0f))), camera_up);
+        look_target = v3_add(simulation.position, v3_add(aim_dir, vec3(0.0f, hoffset, 0.0f)));
     }
     else
     {
-        view = m4_look_at(camera_position, vec3(0.0f, 0.0f, 0.0f), camera_up);
+        look_target = vec3(0.0f, 0.0f, 0.0f);
     }
 
-    if(game_data->keys_pressed[RAFGL_KEY_KP_ADD]) selected_mesh = (selected_mesh + 1) % num_meshes;
-    if(game_data->keys_pressed[RAFGL_KEY_KP_SUBTRACT]) selected_mesh = (selected_mesh + num_meshes - 1) % num_meshes;
+    if(game_data->keys_pressed[RAFGL_KEY_KP_ADD]) simulation.selected_mesh = (simulation.selected_mesh + 1) % num_meshes;
+    if(game_data->keys_pressed[RAFGL_KEY_KP_SUBTRACT]) simulation.selected_mesh = (simulation.selected_mesh + num_meshes - 1) % num_meshes;
+
+    if(game_data->keys_pressed[RAFGL_KEY_F9])
+        packet->capture_key = RAFGL_KEY_F9;
+    if(game_data->keys_pressed[RAFGL_KEY_F10])
+        packet->capture_key = RAFGL_KEY_F10;
+
+    fill_packet(packet, look_target);
 }
 
 void main_state_render(GLFWwindow *window, void *args) {
     int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    render_scene(m4_mul(projection, view), width, height);
+    rafgl_framebuffer_size(&width, &height);
+
+    // drawn from in between the last two updates the packet carries
+    main_state_packet_t *packet = rafgl_game_render_packet();
+    float alpha = rafgl_game_interpolation();
+    camera_position = lerp_v3(packet->previous.eye, packet->current.eye, alpha);
+    light_position = lerp_v3(packet->previous.light, packet->current.light, alpha);
+    time_tick = packet->previous.time + (packet->current.time - packet->previous.time) * alpha;
+    view = m4_look_at(camera_position, lerp_v3(packet->previous.target, packet->current.target, alpha), camera_up);
+    showing_meshes = packet->showing_meshes;
+    selected_mesh = packet->selected_mesh;
+    water_reflection_mode = packet->reflection_mode;
+    lighting_mode = packet->lighting_mode;
+
+    // the meshes are all that comes and goes, their bounds are put together again every frame
+    cull_set_clear(&object_bounds);
+    if (showing_meshes)
+        cull_set_add(&object_bounds, v3_add(meshes[selected_mesh].bounds_min, vec3(2.0f, 0.0f, 0.0f)), v3_add(meshes[selected_mesh].bounds_max, vec3(2.0f, 0.0f, 0.0f)));
+
+    if (packet->cursor_captured != cursor_captured) {
+        cursor_captured = packet->cursor_captured;
+        glfwSetInputMode(window, GLFW_CURSOR, cursor_captured ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
+    }
+
+    if(packet->capture_key)
+    {
+        if(capture.running)
+            rafgl_capture_stop(&capture);
+        else if(packet->capture_key == RAFGL_KEY_F9)
+            rafgl_capture_start(&capture, "Screenshots/capture.y4m", RAFGL_CAPTURE_Y4M, width, height, 60);
+        else
+            rafgl_capture_start(&capture, "Screenshots/frame_%05d.png", RAFGL_CAPTURE_PNG, width, height, 60);
+        packet->capture_key = 0;
+    }
+
+    // the waves are only seen, they follow the render rate rather than the update rate
+    ocean_step(&ocean, time_tick);
+    projection = m4_perspective(fov, (float)width / height, 0.1f, 1000.0f);
+    render_shadows((float)width / height);
+    // the ocean upload and the shadow passes bind outside the queue
+    render_queue_invalidate(&render_queue);
+
+    // the reflection costs are in these scopes plus the water one of the mode, R toggles between them to compare
+    if (water_reflection_mode == WATER_REFLECTION_PLANAR) {
+        rafgl_profiler_begin("planar reflection");
+        render_reflection(width, height);
+        rafgl_profiler_end();
+    }
+
+    rafgl_profiler_begin("scene");
+    render_scene(m4_mul(projection, view), camera_position, width, height, scene_cull_counters);
+    rafgl_profiler_end();
+
+    // colour and depth of the opaque pass for the water to refract, and to find how deep it is under every pixel
+    rafgl_profiler_begin("scene copy");
+    ssr_capture(&ssr, rafgl_framebuffer_default(), width, height);
+    rafgl_profiler_end();
+
+    if (water_reflection_mode == WATER_REFLECTION_SSR) {
+        rafgl_profiler_begin("ssr depth pyramid");
+        ssr_build_pyramid(&ssr, rafgl_framebuffer_default());
+        render_queue_invalidate(&render_queue);
+        rafgl_profiler_end();
+    }
+
+    rafgl_profiler_begin(water_scope_names[water_reflection_mode]);
     render_water(m4_mul(projection, view));
-    if (fog_density > 0.0f)
+    rafgl_profiler_end();
+
+    // the next pass that wants targets of these sizes gets the same ones back
+    rafgl_render_target_release(reflection_target);
+    reflection_target = NULL;
+    ssr_release(&ssr);
+
+    if (fog_density > 0.0f) {
+        rafgl_profiler_begin("clouds");
         render_clouds(m4_mul(projection, view));
+        rafgl_profiler_end();
+    }
+
+    if(capture.running)
+        rafgl_capture_frame(&capture);
+    render_queue_frame(&render_queue);
+
+    if(pose_count && packet->pose == pose_count - 1)
+        glfwSetWindowShouldClose(window, 1);
 }
 
 void main_state_cleanup(GLFWwindow *window, void *args)
 {
-    frame_buffer_cleanup();
+    rafgl_capture_stop(&capture);
+    rafgl_log(RAFGL_INFO, "Shadow cache: %d cascade renders and %d composites over %d frames\n", shadows.static_renders, shadows.composites, shadows.frame);
+    shadow_grid_cleanup(&hill_shadow_grid);
+    cull_set_cleanup(&hill_chunks.bounds);
+    free(hill_chunks.counts);
+    free(hill_chunks.offsets);
+    cull_set_cleanup(&cloud_chunks.bounds);
+    free(cloud_chunks.counts);
+    free(cloud_chunks.offsets);
+    cull_set_cleanup(&object_bounds);
+    shadow_cascades_cleanup(&shadows);
+    glDeleteTextures(1, &hill_ambient_texture_id);
+    ocean_cleanup(&ocean);
+    ocean_grid_cleanup(&water_grid);
+    ssr_cleanup(&ssr);
+    rafgl_program_variants_cleanup(&hill_programs);
+    rafgl_program_variants_cleanup(&mesh_programs);
+    rafgl_program_variants_cleanup(&water_programs);
+    render_queue_cleanup(&render_queue);
 }
\ No newline at end of file
@@ -0,0 +1,515 @@
+#include <rafgl.h>
+#include <ocean.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#define OCEAN_GRAVITY 9.81f
+/* waves shorter than this fraction of the largest wind wave are damped away */
+#define OCEAN_SMALL_WAVE 0.001f
+
+typedef struct _ocean_pass_t
+{
+    ocean_t *ocean;
+    float time;
+    float *displacement;
+    unsigned char *normals;
+} ocean_pass_t;
+
+static unsigned int __ocean_random_state = 0x9e3779b9u;
+
+/* xorshift, the spectrum comes out the same on every run whatever else uses rand() */
+static float __ocean_random(void)
+{
+    __ocean_random_state ^= __ocean_random_state << 13;
+    __ocean_random_state ^= __ocean_random_state >> 17;
+    __ocean_random_state ^= __ocean_random_state << 5;
+    return (__ocean_random_state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float __ocean_gaussian(void)
+{
+    float u = fmaxf(__ocean_random(), 1e-7f);
+    return sqrtf(-2.0f * logf(u)) * cosf(2.0f * M_PI * __ocean_random());
+}
+
+/* signed wave number of index i, [0, size / 2) positive, the rest negative */
+static float __ocean_wave_number(const ocean_t *ocean, int i)
+{
+    return 2.0f * M_PI * (i < ocean->size / 2 ? i : i - ocean->size) / ocean->length;
+}
+
+static float __ocean_phillips(float kx, float kz, vec3_t wind, float amplitude)
+{
+    float k2 = kx * kx + kz * kz, speed = sqrtf(wind.x * wind.x + wind.z * wind.z);
+    float largest = speed * speed / OCEAN_GRAVITY, small = largest * OCEAN_SMALL_WAVE;
+    float alignment;
+
+    if (k2 < 1e-12f || speed < 1e-6f)
+        return 0.0f;
+
+    alignment = (kx * wind.x + kz * wind.z) / (sqrtf(k2) * speed);
+    return amplitude * expf(-1.0f / (k2 * largest * largest)) / (k2 * k2) * alignment * alignment * expf(-k2 * small * small);
+}
+
+static void __ocean_spectrum_init(ocean_t *ocean, int size, float length, vec3_t wind, float amplitude, float choppiness)
+{
+    int cells = size * size, x, z, g, mirror;
+    float kx, kz, p;
+
+    memset(ocean, 0, sizeof(*ocean));
+    ocean->size = size;
+    ocean->length = length;
+    ocean->choppiness = choppiness;
+    ocean->pitch = size + OCEAN_STRIP;
+
+    ocean->h0_re = malloc(cells * sizeof(float));
+    ocean->h0_im = malloc(cells * sizeof(float));
+    ocean->h0_mirror_re = malloc(cells * sizeof(float));
+    ocean->h0_mirror_im = malloc(cells * sizeof(float));
+    ocean->omega = malloc(cells * sizeof(float));
+    for (g = 0; g < OCEAN_GRIDS; g++) {
+        ocean->re[g] = malloc(size * ocean->pitch * sizeof(float));
+        ocean->im[g] = malloc(size * ocean->pitch * sizeof(float));
+        ocean->scratch_re[g] = malloc(size * ocean->pitch * sizeof(float));
+        ocean->scratch_im[g] = malloc(size * ocean->pitch * sizeof(float));
+    }
+
+    ocean->twiddle_re = malloc(size / 2 * sizeof(float));
+    ocean->twiddle_im = malloc(size / 2 * sizeof(float));
+    for (x = 0; x < size / 2; x++) {
+        ocean->twiddle_re[x] = cosf(2.0f * M_PI * x / size);
+        ocean->twiddle_im[x] = sinf(2.0f * M_PI * x / size);
+    }
+
+    __ocean_random_state = 0x9e3779b9u;
+    for (x = 0; x < size; x++) {
+        kx = __ocean_wave_number(ocean, x);
+        for (z = 0; z < size; z++) {
+            kz = __ocean_wave_number(ocean, z);
+            /* the Nyquist row and column are their own mirror, they would break the symmetry the packed grids rely on */
+            p = (x == size / 2 || z == size / 2) ? 0.0f : sqrtf(__ocean_phillips(kx, kz, wind, amplitude) * 0.5f);
+            ocean->h0_re[x * size + z] = __ocean_gaussian() * p;
+            ocean->h0_im[x * size + z] = __ocean_gaussian() * p;
+            ocean->omega[x * size + z] = sqrtf(OCEAN_GRAVITY * sqrtf(kx * kx + kz * kz));
+        }
+    }
+
+    /* conj(h0(-k)) next to h0(k) keeps the evolution loop free of gathers */
+    for (x = 0; x < size; x++) {
+        for (z = 0; z < size; z++) {
+            mirror = ((size - x) % size) * size + (size - z) % size;
+            ocean->h0_mirror_re[x * size + z] = ocean->h0_re[mirror];
+            ocean->h0_mirror_im[x * size + z] = -ocean->h0_im[mirror];
+        }
+    }
+}
+
+/* h(k, t) and the four spectra derived from it, packed two real fields per complex grid, one row of kx per job */
+static void __ocean_evolve_job(void *ctx, int x)
+{
+    ocean_pass_t *pass = ctx;
+    ocean_t *ocean = pass->ocean;
+    int z, i, j, size = ocean->size;
+    float kx = __ocean_wave_number(ocean, x), kz, k, c, s, hr, hi, chop_x, chop_z;
+
+    for (z = 0; z < size; z++) {
+        i = x * size + z;
+        j = x * ocean->pitch + z;
+        kz = __ocean_wave_number(ocean, z);
+        k = sqrtf(kx * kx + kz * kz);
+        c = cosf(ocean->omega[i] * pass->time);
+        s = sinf(ocean->omega[i] * pass->time);
+
+        /* h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt) */
+        hr = (ocean->h0_re[i] + ocean->h0_mirror_re[i]) * c - (ocean->h0_im[i] - ocean->h0_mirror_im[i]) * s;
+        hi = (ocean->h0_re[i] - ocean->h0_mirror_re[i]) * s + (ocean->h0_im[i] + ocean->h0_mirror_im[i]) * c;
+
+        chop_x = k > 0.0f ? ocean->choppiness * kx / k : 0.0f;
+        chop_z = k > 0.0f ? ocean->choppiness * kz / k : 0.0f;
+
+        /* height + i * dx, where dx = -i chop_x h */
+        ocean->re[0][j] = hr * (1.0f + chop_x);
+        ocean->im[0][j] = hi * (1.0f + chop_x);
+        /* dz + i * slope x, where dz = -i chop_z h and slope x = i kx h */
+        ocean->re[1][j] = chop_z * hi - kx * hr;
+        ocean->im[1][j] = -chop_z * hr - kx * hi;
+        /* slope z = i kz h */
+        ocean->re[2][j] = -kz * hi;
+        ocean->im[2][j] = kz * hr;
+    }
+}
+
+static unsigned int __ocean_reverse_bits(unsigned int value, int bits)
+{
+    unsigned int reversed = 0;
+    int b;
+
+    for (b = 0; b < bits; b++) {
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+
+    return reversed;
+}
+
+/* inverse radix 2 FFT down the rows of a strip of OCEAN_STRIP columns, every butterfly works on whole strip rows */
+static void __ocean_fft_strip(const ocean_t *ocean, float *re, float *im, int x0)
+{
+    int size = ocean->size, pitch = ocean->pitch, bits = 0, r, j, i, len, half, x, a, b;
+    unsigned int swap;
+    float t, wr, wi, vr, vi;
+
+    while ((1 << bits) < size)
+        bits++;
+
+    for (r = 0; r < size; r++) {
+        swap = __ocean_reverse_bits(r, bits);
+        if (swap <= (unsigned int)r)
+            continue;
+        for (x = x0; x < x0 + OCEAN_STRIP; x++) {
+            t = re[r * pitch + x]; re[r * pitch + x] = re[swap * pitch + x]; re[swap * pitch + x] = t;
+            t = im[r * pitch + x]; im[r * pitch + x] = im[swap * pitch + x]; im[swap * pitch + x] = t;
+        }
+    }
+
+    for (len = 2; len <= size; len <<= 1) {
+        half = len / 2;
+        for (j = 0; j < half; j++) {
+            wr = ocean->twiddle_re[j * (size / len)];
+            wi = ocean->twiddle_im[j * (size / len)];
+
+            for (i = 0; i < size; i += len) {
+                a = (i + j) * pitch + x0;
+                b = a + half * pitch;
+                x = 0;
+
+#if defined(__SSE2__)
+                {
+                    __m128 w_re = _mm_set1_ps(wr), w_im = _mm_set1_ps(wi);
+                    __m128 ar, ai, br, bi, v_re, v_im;
+                    for (; x < OCEAN_STRIP; x += 4) {
+                        ar = _mm_loadu_ps(re + a + x);
+                        ai = _mm_loadu_ps(im + a + x);
+                        br = _mm_loadu_ps(re + b + x);
+                        bi = _mm_loadu_ps(im + b + x);
+                        v_re = _mm_sub_ps(_mm_mul_ps(br, w_re), _mm_mul_ps(bi, w_im));
+                        v_im = _mm_add_ps(_mm_mul_ps(br, w_im), _mm_mul_ps(bi, w_re));
+                        _mm_storeu_ps(re + a + x, _mm_add_ps(ar, v_re));
+                        _mm_storeu_ps(im + a + x, _mm_add_ps(ai, v_im));
+                        _mm_storeu_ps(re + b + x, _mm_sub_ps(ar, v_re));
+                        _mm_storeu_ps(im + b + x, _mm_sub_ps(ai, v_im));
+                    }
+                }
+#endif // __SSE2__
+
+                for (; x < OCEAN_STRIP; x++) {
+                    vr = re[b + x] * wr - im[b + x] * wi;
+                    vi = re[b + x] * wi + im[b + x] * wr;
+                    re[b + x] = re[a + x] - vr;
+                    im[b + x] = im[a + x] - vi;
+                    re[a + x] += vr;
+                    im[a + x] += vi;
+                }
+            }
+        }
+    }
+}
+
+static void __ocean_fft_job(void *ctx, int index)
+{
+    ocean_pass_t *pass = ctx;
+    int strips = pass->ocean->size / OCEAN_STRIP, g = index / strips;
+
+    __ocean_fft_strip(pass->ocean, pass->ocean->re[g], pass->ocean->im[g], (index % strips) * OCEAN_STRIP);
+}
+
+/* one band of OCEAN_STRIP rows of every grid into its scratch, then the two swap */
+static void __ocean_transpose_job(void *ctx, int index)
+{
+    ocean_pass_t *pass = ctx;
+    ocean_t *ocean = pass->ocean;
+    int size = ocean->size, strips = size / OCEAN_STRIP, g = index / strips;
+    int r0 = (index % strips) * OCEAN_STRIP, c0, r, c;
+
+    /* square tiles keep both the reads and the writes inside a few cache lines */
+    for (c0 = 0; c0 < size; c0 += OCEAN_STRIP) {
+        for (r = r0; r < r0 + OCEAN_STRIP; r++) {
+            for (c = c0; c < c0 + OCEAN_STRIP; c++) {
+                ocean->scratch_re[g][c * ocean->pitch + r] = ocean->re[g][r * ocean->pitch + c];
+                ocean->scratch_im[g][c * ocean->pitch + r] = ocean->im[g][r * ocean->pitch + c];
+            }
+        }
+    }
+}
+
+/* the real parts now hold height, dz and slope z, the imaginary ones dx and slope x */
+static void __ocean_output_job(void *ctx, int z)
+{
+    ocean_pass_t *pass = ctx;
+    ocean_t *ocean = pass->ocean;
+    int x, i, size = ocean->size;
+    float sx, sz, inverse;
+    float *displacement = pass->displacement + z * size * 4;
+    unsigned char *normal = pass->normals + z * size * 4;
+
+    for (x = 0; x < size; x++) {
+        i = z * ocean->pitch + x;
+        displacement[x * 4 + 0] = ocean->im[0][i];
+        displacement[x * 4 + 1] = ocean->re[0][i];
+        displacement[x * 4 + 2] = ocean->re[1][i];
+        displacement[x * 4 + 3] = 0.0f;
+
+        sx = ocean->im[1][i];
+        sz = ocean->re[2][i];
+        inverse = 1.0f / sqrtf(sx * sx + 1.0f + sz * sz);
+        normal[x * 4 + 0] = (unsigned char)((-sx * inverse * 0.5f + 0.5f) * 255.0f + 0.5f);
+        normal[x * 4 + 1] = (unsigned char)((inverse * 0.5f + 0.5f) * 255.0f + 0.5f);
+        normal[x * 4 + 2] = (unsigned char)((-sz * inverse * 0.5f + 0.5f) * 255.0f + 0.5f);
+        normal[x * 4 + 3] = 255;
+    }
+}
+
+static void __ocean_swap_scratch(ocean_t *ocean)
+{
+    float *t;
+    int g;
+
+    for (g = 0; g < OCEAN_GRIDS; g++) {
+        t = ocean->re[g]; ocean->re[g] = ocean->scratch_re[g]; ocean->scratch_re[g] = t;
+        t = ocean->im[g]; ocean->im[g] = ocean->scratch_im[g]; ocean->scratch_im[g] = t;
+    }
+}
+
+void ocean_simulate(ocean_t *ocean, float time, float *displacement, unsigned char *normals)
+{
+    ocean_pass_t pass;
+    int jobs = OCEAN_GRIDS * (ocean->size / OCEAN_STRIP);
+    double start = glfwGetTime();
+
+    pass.ocean = ocean;
+    pass.time = time;
+    pass.displacement = displacement;
+    pass.normals = normals;
+
+    /* spectrum in [kx][kz]: down the rows takes kx to x, after the transpose down the rows again takes kz to z */
+    rafgl_parallel_for(ocean->size, __ocean_evolve_job, &pass);
+    rafgl_parallel_for(jobs, __ocean_fft_job, &pass);
+    rafgl_parallel_for(jobs, __ocean_transpose_job, &pass);
+    __ocean_swap_scratch(ocean);
+    rafgl_parallel_for(jobs, __ocean_fft_job, &pass);
+    rafgl_parallel_for(ocean->size, __ocean_output_job, &pass);
+
+    ocean->steps++;
+    ocean->total_ms += (glfwGetTime() - start) * 1000.0;
+}
+
+static GLuint __ocean_texture(GLint internal_format, GLenum type, int size)
+{
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size, size, 0, GL_RGBA, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
+void ocean_init(ocean_t *ocean, int size, float length, vec3_t wind, float amplitude, float choppiness)
+{
+    int i;
+
+    if (size < OCEAN_STRIP || (size & (size - 1))) {
+        rafgl_log(RAFGL_ERROR, "Ocean size %d is not a power of two of at least %d!\n", size, OCEAN_STRIP);
+        size = 256;
+    }
+
+    __ocean_spectrum_init(ocean, size, length, wind, amplitude, choppiness);
+
+    ocean->displacement_texture = __ocean_texture(GL_RGBA32F, GL_FLOAT, size);
+    ocean->normal_texture = __ocean_texture(GL_RGBA8, GL_UNSIGNED_BYTE, size);
+
+    /* displacement then normals, one buffer per frame in flight */
+    glGenBuffers(2, ocean->pbos);
+    for (i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ocean->pbos[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size * size * (4 * sizeof(float) + 4), NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void ocean_step(ocean_t *ocean, float time)
+{
+    size_t displacement_bytes = ocean->size * ocean->size * 4 * sizeof(float);
+    char *mapped;
+
+    /* invalidating hands back fresh storage while the upload from the last use of this buffer may still be in flight */
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ocean->pbos[ocean->pbo_index]);
+    mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, displacement_bytes + ocean->size * ocean->size * 4, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped == NULL) {
+        rafgl_log(RAFGL_ERROR, "Could not map the ocean upload buffer!\n");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    ocean_simulate(ocean, time, (float*)mapped, (unsigned char*)mapped + displacement_bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, ocean->displacement_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ocean->size, ocean->size, GL_RGBA, GL_FLOAT, (void*)0);
+    glBindTexture(GL_TEXTURE_2D, ocean->normal_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ocean->size, ocean->size, GL_RGBA, GL_UNSIGNED_BYTE, (void*)displacement_bytes);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    ocean->pbo_index ^= 1;
+}
+
+void ocean_bind_uniforms(ocean_t *ocean, GLuint program, int texture_unit)
+{
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D, ocean->displacement_texture);
+    glUniform1i(glGetUniformLocation(program, "ocean_displacement"), texture_unit);
+    glActiveTexture(GL_TEXTURE0 + texture_unit + 1);
+    glBindTexture(GL_TEXTURE_2D, ocean->normal_texture);
+    glUniform1i(glGetUniformLocation(program, "ocean_normal"), texture_unit + 1);
+    glUniform1f(glGetUniformLocation(program, "ocean_length"), ocean->length);
+}
+
+void ocean_grid_init(ocean_grid_t *grid, int columns, int rows)
+{
+    rafgl_arena_t *scratch = rafgl_frame_arena();
+    size_t scope = rafgl_arena_mark(scratch);
+    float *vertices = rafgl_arena_alloc(scratch, columns * rows * 2 * sizeof(float)), *vertex = vertices;
+    GLuint *indices = rafgl_arena_alloc(scratch, (columns - 1) * (rows - 1) * 6 * sizeof(GLuint)), *index = indices;
+    int x, y;
+
+    memset(grid, 0, sizeof(*grid));
+    if (vertices == NULL || indices == NULL) {
+        rafgl_arena_reset(scratch, scope);
+        return;
+    }
+
+    grid->columns = columns;
+    grid->rows = rows;
+
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < columns; x++) {
+            *vertex++ = (float)x / (columns - 1);
+            *vertex++ = (float)y / (rows - 1);
+        }
+    }
+
+    for (y = 0; y < rows - 1; y++) {
+        for (x = 0; x < columns - 1; x++) {
+            *index++ = y * columns + x;
+            *index++ = y * columns + x + 1;
+            *index++ = (y + 1) * columns + x;
+
+            *index++ = (y + 1) * columns + x;
+            *index++ = y * columns + x + 1;
+            *index++ = (y + 1) * columns + x + 1;
+        }
+    }
+    grid->index_count = index - indices;
+
+    glGenVertexArrays(1, &grid->vao);
+    glBindVertexArray(grid->vao);
+
+    glGenBuffers(1, &grid->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, grid->vbo);
+    glBufferData(GL_ARRAY_BUFFER, columns * rows * 2 * sizeof(float), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &grid->ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, grid->index_count * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    rafgl_arena_reset(scratch, scope);
+}
+
+void ocean_grid_draw(ocean_grid_t *grid)
+{
+    glBindVertexArray(grid->vao);
+    glDrawElements(GL_TRIANGLES, grid->index_count, GL_UNSIGNED_INT, (void*)0);
+    glBindVertexArray(0);
+}
+
+void ocean_grid_cleanup(ocean_grid_t *grid)
+{
+    glDeleteVertexArrays(1, &grid->vao);
+    glDeleteBuffers(1, &grid->vbo);
+    glDeleteBuffers(1, &grid->ebo);
+}
+
+static void __ocean_free(ocean_t *ocean)
+{
+    int g;
+
+    free(ocean->h0_re);
+    free(ocean->h0_im);
+    free(ocean->h0_mirror_re);
+    free(ocean->h0_mirror_im);
+    free(ocean->omega);
+    free(ocean->twiddle_re);
+    free(ocean->twiddle_im);
+    for (g = 0; g < OCEAN_GRIDS; g++) {
+        free(ocean->re[g]);
+        free(ocean->im[g]);
+        free(ocean->scratch_re[g]);
+        free(ocean->scratch_im[g]);
+    }
+}
+
+void ocean_cleanup(ocean_t *ocean)
+{
+    if (ocean->steps)
+        rafgl_log(RAFGL_INFO, "Ocean %dx%d: %.3f ms per step over %d steps\n", ocean->size, ocean->size, ocean->total_ms / ocean->steps, ocean->steps);
+
+    glDeleteTextures(1, &ocean->displacement_texture);
+    glDeleteTextures(1, &ocean->normal_texture);
+    glDeleteBuffers(2, ocean->pbos);
+    __ocean_free(ocean);
+}
+
+void ocean_benchmark(int size, int steps)
+{
+    ocean_t ocean;
+    float *displacement = malloc(size * size * 4 * sizeof(float));
+    unsigned char *normals = malloc(size * size * 4);
+    int threads, all = rafgl_parallel_thread_count(), i;
+    double single_ms = 0.0, ms;
+
+    __ocean_spectrum_init(&ocean, size, 250.0f, vec3(20.0f, 0.0f, 10.0f), 4e-3f, 1.0f);
+
+    for (threads = 1; ; threads = rafgl_min_m(threads * 2, all)) {
+        rafgl_parallel_set_thread_limit(threads);
+        ocean.steps = 0;
+        ocean.total_ms = 0.0;
+        for (i = 0; i < steps; i++)
+            ocean_simulate(&ocean, i / 60.0f, displacement, normals);
+
+        ms = ocean.total_ms / steps;
+        if (threads == 1)
+            single_ms = ms;
+        rafgl_log(RAFGL_INFO, "[OCEAN %dx%d, %d threads] %.3f ms per step, %.2fx\n", size, size, threads, ms, single_ms / ms);
+
+        if (threads == all)
+            break;
+    }
+
+    rafgl_parallel_set_thread_limit(0);
+    __ocean_free(&ocean);
+    free(displacement);
+    free(normals);
+}
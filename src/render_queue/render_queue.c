@@ -0,0 +1,157 @@
+#include <rafgl.h>
+#include <render_queue.h>
+
+uint64_t render_queue_key(int pass, GLuint program, int material, float distance, int back_to_front)
+{
+    uint32_t depth;
+
+    /* the bits of a float that is not negative grow with it */
+    if (!(distance > 0.0f))
+        distance = 0.0f;
+    memcpy(&depth, &distance, sizeof(depth));
+    if (back_to_front)
+        depth = ~depth;
+
+    return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(program & 0xFFF) << 48) | ((uint64_t)(material & 0xFFFF) << 32) | depth;
+}
+
+void render_queue_init(render_queue_t *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+}
+
+render_command_t* render_queue_push(render_queue_t *queue, uint64_t key)
+{
+    render_command_t *command;
+
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 64;
+        queue->commands = realloc(queue->commands, queue->capacity * sizeof(render_command_t));
+    }
+
+    command = &queue->commands[queue->count];
+    memset(command, 0, sizeof(*command));
+    command->key = key;
+    command->sequence = queue->count++;
+    return command;
+}
+
+/* equal keys keep the order they were pushed in */
+static int __render_command_compare(const void *a, const void *b)
+{
+    const render_command_t *x = a, *y = b;
+
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->sequence - y->sequence;
+}
+
+static void __render_queue_texture(render_queue_t *queue, int unit, GLenum target, GLuint texture)
+{
+    if (queue->valid && queue->texture_targets[unit] == target && queue->textures[unit] == texture) {
+        queue->redundant_changes++;
+        return;
+    }
+
+    if (!queue->valid || queue->active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        queue->active_unit = unit;
+        queue->state_changes++;
+    }
+    glBindTexture(target, texture);
+    queue->texture_targets[unit] = target;
+    queue->textures[unit] = texture;
+    queue->state_changes++;
+}
+
+static void __render_queue_flags(render_queue_t *queue, int flags)
+{
+    if (queue->valid && queue->flags == flags) {
+        queue->redundant_changes++;
+        return;
+    }
+
+    if (flags & RENDER_QUEUE_BLEND) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        glDisable(GL_BLEND);
+    }
+    queue->flags = flags;
+    queue->state_changes++;
+}
+
+void render_queue_submit(render_queue_t *queue)
+{
+    render_command_t *command;
+    int i, unit;
+
+    qsort(queue->commands, queue->count, sizeof(render_command_t), __render_command_compare);
+
+    for (i = 0; i < queue->count; i++) {
+        command = &queue->commands[i];
+
+        __render_queue_flags(queue, command->flags);
+
+        if (queue->valid && queue->program == command->program) {
+            queue->redundant_changes++;
+        } else {
+            glUseProgram(command->program);
+            queue->program = command->program;
+            queue->state_changes++;
+        }
+
+        for (unit = 0; unit < RENDER_QUEUE_TEXTURES; unit++) {
+            if (command->textures[unit])
+                __render_queue_texture(queue, unit, command->texture_targets[unit], command->textures[unit]);
+        }
+
+        if (queue->valid && queue->vao == command->vao) {
+            queue->redundant_changes++;
+        } else {
+            glBindVertexArray(command->vao);
+            queue->vao = command->vao;
+            queue->state_changes++;
+        }
+
+        /* a unit the command does not list holds whatever was there before the queue or what the callback binds, 0 never matches a texture the next command wants */
+        if (command->uniforms) {
+            command->uniforms(command->program, command->data);
+            queue->active_unit = -1;
+        }
+        for (unit = 0; unit < RENDER_QUEUE_TEXTURES; unit++) {
+            if (!command->textures[unit])
+                queue->texture_targets[unit] = queue->textures[unit] = 0;
+        }
+        queue->valid = 1;
+
+        if (command->counts)
+            glMultiDrawElements(GL_TRIANGLES, command->counts, GL_UNSIGNED_INT, command->offsets, command->count);
+        else if (command->indexed)
+            glDrawElements(GL_TRIANGLES, command->count, GL_UNSIGNED_INT, (void*)0);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, command->count);
+        queue->draws++;
+    }
+
+    queue->count = 0;
+}
+
+void render_queue_invalidate(render_queue_t *queue)
+{
+    queue->valid = 0;
+}
+
+void render_queue_frame(render_queue_t *queue)
+{
+    rafgl_profiler_count("draws", queue->draws);
+    rafgl_profiler_count("state changes", queue->state_changes);
+    rafgl_profiler_count("redundant state skipped", queue->redundant_changes);
+    queue->draws = queue->state_changes = queue->redundant_changes = 0;
+}
+
+void render_queue_cleanup(render_queue_t *queue)
+{
+    free(queue->commands);
+    memset(queue, 0, sizeof(*queue));
+}
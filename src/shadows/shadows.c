@@ -0,0 +1,363 @@
+#include <rafgl.h>
+#include <shadows.h>
+
+/* how far the cascade splits lean towards logarithmic (1) over uniform (0) spacing */
+#define SHADOW_SPLIT_LAMBDA 0.75f
+
+static GLuint __shadow_depth_array(int size)
+{
+    float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    /* hardware 2x2 PCF on every lookup */
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    return texture;
+}
+
+static void __shadow_attach(GLenum target, GLuint fbo, GLuint texture, int layer)
+{
+    glBindFramebuffer(target, fbo);
+    glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+}
+
+void shadow_cascades_init(shadow_cascades_t *shadows, GLuint fbo, int size)
+{
+    GLuint *fbos[2], textures[2];
+    int i, c;
+
+    memset(shadows, 0, sizeof(*shadows));
+    shadows->fbo = fbo;
+    shadows->size = size;
+    shadows->depth_array = __shadow_depth_array(size);
+    shadows->static_array = __shadow_depth_array(size);
+    glGenFramebuffers(1, &shadows->static_fbo);
+
+    fbos[0] = &shadows->fbo;
+    fbos[1] = &shadows->static_fbo;
+    textures[0] = shadows->depth_array;
+    textures[1] = shadows->static_array;
+
+    /* layers nothing has been rendered to yet read as fully lit */
+    for (i = 0; i < 2; i++) {
+        for (c = SHADOW_CASCADES - 1; c >= 0; c--) {
+            __shadow_attach(GL_FRAMEBUFFER, *fbos[i], textures[i], c);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                rafgl_log(RAFGL_ERROR, "Shadow framebuffer not complete!\n");
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, rafgl_framebuffer_default());
+}
+
+/* texel snapped projection of the cascade around the sphere, light_center in light view space */
+static void __shadow_cascade_fit(shadow_cascades_t *shadows, int c, mat4_t light_view, vec3_t light_direction, vec3_t light_center, float radius)
+{
+    /* rounding keeps the size of the projection the same while the slice sphere changes by a hair */
+    float texel;
+
+    radius = ceilf(radius * SHADOW_CACHE_MARGIN * 16.0f) / 16.0f;
+
+    /* moving the projection in whole texels keeps the rasterised casters from crawling as the camera moves */
+    texel = 2.0f * radius / shadows->size;
+    light_center.x = floorf(light_center.x / texel) * texel;
+    light_center.y = floorf(light_center.y / texel) * texel;
+
+    /* casters between the sun and the slice fall in front of the near plane, depth clamp flattens them onto it */
+    shadows->light_view_projection[c] = m4_mul(m4_ortho(light_center.x - radius, light_center.x + radius,
+                                                        light_center.y - radius, light_center.y + radius,
+                                                        light_center.z - radius, light_center.z + radius), light_view);
+    /* depth clamp keeps casters in front of the near plane, so only the sides and the far plane cull */
+    shadows->frustum[c] = cull_frustum_from_matrix(shadows->light_view_projection[c]);
+    cull_frustum_drop_near(&shadows->frustum[c]);
+    shadows->texel_size[c] = texel;
+    shadows->depth_range[c] = 2.0f * radius;
+
+    shadows->cached[c] = 1;
+    shadows->cached_light_view[c] = light_view;
+    shadows->cached_light_direction[c] = light_direction;
+    shadows->cached_center[c] = light_center;
+    shadows->cached_radius[c] = radius;
+    shadows->cached_frame[c] = shadows->frame;
+}
+
+int shadow_cascades_update(shadow_cascades_t *shadows, mat4_t view, float fov, float aspect, float near, float distance, vec3_t light_direction)
+{
+    mat4_t camera = m4_invert_affine(view);
+    float tan_half = tanf(fov * M_PI / 360.0f);
+    float light_cos = cosf(SHADOW_CACHE_LIGHT_ANGLE * M_PI / 180.0f);
+    vec3_t up = fabsf(light_direction.z) > 0.99f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 0.0f, 1.0f);
+    mat4_t light_view = m4_look_at(vec3(0.0f, 0.0f, 0.0f), light_direction, up);
+    vec3_t corners[8], center, light_center, offset, slice_centers[SHADOW_CASCADES];
+    float slice_near = near, slice_far, ratio, d, radius, slice_radii[SHADOW_CASCADES];
+    int c, i, stale = -1, dirty = 0;
+
+    shadows->light_direction = light_direction;
+    shadows->frame++;
+
+    for (c = 0; c < SHADOW_CASCADES; c++) {
+        ratio = (float)(c + 1) / SHADOW_CASCADES;
+        slice_far = SHADOW_SPLIT_LAMBDA * near * powf(distance / near, ratio) + (1.0f - SHADOW_SPLIT_LAMBDA) * (near + (distance - near) * ratio);
+
+        center = vec3(0.0f, 0.0f, 0.0f);
+        for (i = 0; i < 8; i++) {
+            d = (i < 4) ? slice_near : slice_far;
+            corners[i] = m4_mul_pos(camera, vec3(((i & 1) ? 1.0f : -1.0f) * d * tan_half * aspect, ((i & 2) ? 1.0f : -1.0f) * d * tan_half, -d));
+            center = v3_add(center, corners[i]);
+        }
+        center = v3_muls(center, 1.0f / 8.0f);
+
+        /* a sphere keeps the projection the same size however the camera turns */
+        radius = 0.0f;
+        for (i = 0; i < 8; i++)
+            radius = fmaxf(radius, v3_length(v3_sub(corners[i], center)));
+
+        slice_centers[c] = center;
+        slice_radii[c] = radius;
+        shadows->splits[c] = slice_far;
+        slice_near = slice_far;
+
+        /* a cascade that no longer covers its slice is re-rendered right away, one that only lags the sun waits its turn */
+        if (shadows->cached[c]) {
+            offset = v3_sub(m4_mul_pos(shadows->cached_light_view[c], center), shadows->cached_center[c]);
+            if (fmaxf(fabsf(offset.x), fmaxf(fabsf(offset.y), fabsf(offset.z))) + radius <= shadows->cached_radius[c]) {
+                if (v3_dot(light_direction, shadows->cached_light_direction[c]) < light_cos && (stale < 0 || shadows->cached_frame[c] < shadows->cached_frame[stale]))
+                    stale = c;
+                continue;
+            }
+        }
+        dirty |= 1 << c;
+    }
+
+    if (!dirty && stale >= 0)
+        dirty = 1 << stale;
+
+    for (c = 0; c < SHADOW_CASCADES; c++) {
+        if (!(dirty & (1 << c)))
+            continue;
+        light_center = m4_mul_pos(light_view, slice_centers[c]);
+        __shadow_cascade_fit(shadows, c, light_view, light_direction, light_center, slice_radii[c]);
+        shadows->static_renders++;
+    }
+
+    return dirty;
+}
+
+void shadow_cascades_begin(shadow_cascades_t *shadows, int cascade)
+{
+    __shadow_attach(GL_FRAMEBUFFER, shadows->static_fbo, shadows->static_array, cascade);
+    glViewport(0, 0, shadows->size, shadows->size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    shadows->composite_clean[cascade] = 0;
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 2.0f);
+}
+
+int shadow_cascades_composite(shadow_cascades_t *shadows, int cascade, int dynamic_casters)
+{
+    if (!dynamic_casters && shadows->composite_clean[cascade])
+        return 0;
+
+    __shadow_attach(GL_READ_FRAMEBUFFER, shadows->static_fbo, shadows->static_array, cascade);
+    __shadow_attach(GL_DRAW_FRAMEBUFFER, shadows->fbo, shadows->depth_array, cascade);
+    glBlitFramebuffer(0, 0, shadows->size, shadows->size, 0, 0, shadows->size, shadows->size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadows->fbo);
+    shadows->composite_clean[cascade] = !dynamic_casters;
+    shadows->composites++;
+
+    glViewport(0, 0, shadows->size, shadows->size);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 2.0f);
+
+    return dynamic_casters;
+}
+
+void shadow_cascades_end(shadow_cascades_t *shadows)
+{
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, rafgl_framebuffer_default());
+}
+
+void shadow_cascades_bind_uniforms(shadow_cascades_t *shadows, GLuint program, mat4_t view, int texture_unit)
+{
+    float bias[SHADOW_CASCADES];
+    int c;
+
+    /* two texels plus whatever the casters are off by */
+    for (c = 0; c < SHADOW_CASCADES; c++)
+        bias[c] = (2.0f * shadows->texel_size[c] + shadows->caster_error[c]) / shadows->depth_range[c];
+
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadows->depth_array);
+    /* binds after this one expect unit 0 to be active */
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(program, "shadow_map"), texture_unit);
+    glUniformMatrix4fv(glGetUniformLocation(program, "light_view_projection"), SHADOW_CASCADES, GL_FALSE, (float*)shadows->light_view_projection);
+    glUniform4fv(glGetUniformLocation(program, "cascade_splits"), 1, shadows->splits);
+    glUniform4fv(glGetUniformLocation(program, "cascade_bias"), 1, bias);
+    glUniformMatrix4fv(glGetUniformLocation(program, "shadow_view"), 1, GL_FALSE, (float*)view.m);
+}
+
+void shadow_cascades_cleanup(shadow_cascades_t *shadows)
+{
+    glDeleteTextures(1, &shadows->depth_array);
+    glDeleteTextures(1, &shadows->static_array);
+    glDeleteFramebuffers(1, &shadows->static_fbo);
+    shadows->depth_array = shadows->static_array = shadows->static_fbo = 0;
+}
+
+void shadow_grid_init(shadow_grid_t *grid, GLuint vbo, const void *vertices, int stride, int width, int height)
+{
+    int lod, step, chunk, cx, cz, x, z, xn, zn, x0, z0, x1, z1;
+    int chunk_count, max_quads, total = 0;
+    rafgl_arena_t *scratch = rafgl_frame_arena();
+    size_t scope = rafgl_arena_mark(scratch);
+    GLuint *indices, *index;
+    const vec3_t *position;
+    vec3_t min, max;
+
+    memset(grid, 0, sizeof(*grid));
+    grid->chunks_x = (width - 2) / SHADOW_GRID_CHUNK + 1;
+    grid->chunks_z = (height - 2) / SHADOW_GRID_CHUNK + 1;
+    chunk_count = grid->chunks_x * grid->chunks_z;
+
+    cull_set_init(&grid->chunks);
+    grid->visible_counts = malloc(chunk_count * sizeof(GLsizei));
+    grid->visible_offsets = malloc(chunk_count * sizeof(GLvoid*));
+
+    /* bounds come from every vertex of the chunk, not only the ones the lods keep */
+    for (cz = 0; cz < grid->chunks_z; cz++) {
+        for (cx = 0; cx < grid->chunks_x; cx++) {
+            chunk = cz * grid->chunks_x + cx;
+            x0 = cx * SHADOW_GRID_CHUNK;
+            z0 = cz * SHADOW_GRID_CHUNK;
+            x1 = rafgl_min_m(x0 + SHADOW_GRID_CHUNK, width - 1);
+            z1 = rafgl_min_m(z0 + SHADOW_GRID_CHUNK, height - 1);
+
+            position = (const vec3_t*)((const char*)vertices + (z0 * width + x0) * stride);
+            min = max = *position;
+            for (z = z0; z <= z1; z++) {
+                for (x = x0; x <= x1; x++) {
+                    position = (const vec3_t*)((const char*)vertices + (z * width + x) * stride);
+                    min = vec3(fminf(min.x, position->x), fminf(min.y, position->y), fminf(min.z, position->z));
+                    max = vec3(fmaxf(max.x, position->x), fmaxf(max.y, position->y), fmaxf(max.z, position->z));
+                }
+            }
+            cull_set_add(&grid->chunks, min, max);
+        }
+    }
+
+    for (lod = 0; lod < SHADOW_GRID_LODS; lod++) {
+        step = 2 << lod;
+        max_quads = (SHADOW_GRID_CHUNK + step - 1) / step;
+        total += chunk_count * max_quads * max_quads * 6;
+    }
+    indices = index = rafgl_arena_alloc(scratch, total * sizeof(GLuint));
+    if (indices == NULL) {
+        /* no chunks to test, the grid draws nothing */
+        cull_set_clear(&grid->chunks);
+        return;
+    }
+
+    /* each chunk is one contiguous run of indices per lod, same winding as generate_hill_indices */
+    for (lod = 0; lod < SHADOW_GRID_LODS; lod++) {
+        step = 2 << lod;
+        grid->counts[lod] = malloc(chunk_count * sizeof(GLsizei));
+        grid->offsets[lod] = malloc(chunk_count * sizeof(GLvoid*));
+
+        for (cz = 0; cz < grid->chunks_z; cz++) {
+            for (cx = 0; cx < grid->chunks_x; cx++) {
+                chunk = cz * grid->chunks_x + cx;
+                x0 = cx * SHADOW_GRID_CHUNK;
+                z0 = cz * SHADOW_GRID_CHUNK;
+                x1 = rafgl_min_m(x0 + SHADOW_GRID_CHUNK, width - 1);
+                z1 = rafgl_min_m(z0 + SHADOW_GRID_CHUNK, height - 1);
+
+                grid->offsets[lod][chunk] = (GLvoid*)((index - indices) * sizeof(GLuint));
+                for (z = z0; z < z1; z = zn) {
+                    zn = rafgl_min_m(z + step, z1);
+                    for (x = x0; x < x1; x = xn) {
+                        xn = rafgl_min_m(x + step, x1);
+
+                        *index++ = z * width + x;
+                        *index++ = zn * width + x;
+                        *index++ = z * width + xn;
+
+                        *index++ = z * width + xn;
+                        *index++ = zn * width + x;
+                        *index++ = zn * width + xn;
+                    }
+                }
+                grid->counts[lod][chunk] = (index - indices) - (GLsizei)((size_t)grid->offsets[lod][chunk] / sizeof(GLuint));
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &grid->vao);
+    glBindVertexArray(grid->vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &grid->ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (index - indices) * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    rafgl_arena_reset(scratch, scope);
+}
+
+int shadow_grid_draw(shadow_grid_t *grid, int lod)
+{
+    int i, chunk, visible = grid->chunks.visible_count;
+
+    for (i = 0; i < visible; i++) {
+        chunk = grid->chunks.visible[i];
+        grid->visible_counts[i] = grid->counts[lod][chunk];
+        grid->visible_offsets[i] = grid->offsets[lod][chunk];
+    }
+
+    if (visible) {
+        glBindVertexArray(grid->vao);
+        glMultiDrawElements(GL_TRIANGLES, grid->visible_counts, GL_UNSIGNED_INT, (const GLvoid* const*)grid->visible_offsets, visible);
+        glBindVertexArray(0);
+    }
+
+    return visible;
+}
+
+void shadow_grid_cleanup(shadow_grid_t *grid)
+{
+    int lod;
+
+    glDeleteVertexArrays(1, &grid->vao);
+    glDeleteBuffers(1, &grid->ebo);
+    for (lod = 0; lod < SHADOW_GRID_LODS; lod++) {
+        free(grid->counts[lod]);
+        free(grid->offsets[lod]);
+    }
+    cull_set_cleanup(&grid->chunks);
+    free(grid->visible_counts);
+    free(grid->visible_offsets);
+}
@@ -0,0 +1,141 @@
+#include <rafgl.h>
+#include <ssr.h>
+
+static GLuint __ssr_texture(GLint internal_format, GLenum format, GLenum type, int width, int height, int levels)
+{
+    GLuint texture;
+    int level;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (level = 0; level < levels; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, internal_format, rafgl_max_m(width >> level, 1), rafgl_max_m(height >> level, 1), 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, levels > 1 ? GL_NEAREST : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
+void ssr_init(ssr_t *ssr)
+{
+    memset(ssr, 0, sizeof(*ssr));
+
+    /* the pyramid is built with full screen triangles made up from gl_VertexID, the core profile still wants a vertex array bound */
+    ssr->hiz_program = rafgl_program_create_from_name("custom_hiz");
+    glGenVertexArrays(1, &ssr->vao);
+}
+
+void ssr_capture(ssr_t *ssr, GLuint framebuffer, int width, int height)
+{
+    /* the formats of the default framebuffer, a multisampled blit only resolves into identical ones */
+    ssr->scene = rafgl_render_target_acquire(GL_RGBA8, GL_DEPTH24_STENCIL8, width, height, 0);
+    if (ssr->scene == NULL)
+        return;
+    ssr->width = width;
+    ssr->height = height;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ssr->scene->fbo_id);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+static void __ssr_pyramid_resize(ssr_t *ssr)
+{
+    int size = rafgl_max_m(ssr->width, ssr->height);
+
+    glDeleteFramebuffers(1, &ssr->hiz_fbo);
+    glDeleteTextures(1, &ssr->hiz_texture);
+
+    ssr->hiz_width = ssr->width;
+    ssr->hiz_height = ssr->height;
+    for (ssr->levels = 1; (size >> ssr->levels) > 0 && ssr->levels < SSR_MAX_LEVELS; ssr->levels++);
+
+    ssr->hiz_texture = __ssr_texture(GL_R32F, GL_RED, GL_FLOAT, ssr->width, ssr->height, ssr->levels);
+    glGenFramebuffers(1, &ssr->hiz_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, ssr->hiz_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssr->hiz_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        rafgl_log(RAFGL_ERROR, "SSR depth pyramid framebuffer not complete!\n");
+}
+
+void ssr_build_pyramid(ssr_t *ssr, GLuint framebuffer)
+{
+    int level;
+
+    if (ssr->scene == NULL)
+        return;
+    if (ssr->hiz_width != ssr->width || ssr->hiz_height != ssr->height)
+        __ssr_pyramid_resize(ssr);
+
+    glUseProgram(ssr->hiz_program);
+    glUniform1i(glGetUniformLocation(ssr->hiz_program, "source"), 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, ssr->hiz_fbo);
+    glBindVertexArray(ssr->vao);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glActiveTexture(GL_TEXTURE0);
+
+    /* every level reads the one above it, which is the only level the sampler can see so nothing reads what is being written */
+    for (level = 0; level < ssr->levels; level++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssr->hiz_texture, level);
+        glViewport(0, 0, rafgl_max_m(ssr->width >> level, 1), rafgl_max_m(ssr->height >> level, 1));
+
+        if (level == 0) {
+            glBindTexture(GL_TEXTURE_2D, ssr->scene->depth_id);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, ssr->hiz_texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        }
+        glUniform1i(glGetUniformLocation(ssr->hiz_program, "copy"), level == 0);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, ssr->hiz_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ssr->levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, ssr->width, ssr->height);
+}
+
+void ssr_bind_uniforms(ssr_t *ssr, GLuint program, int texture_unit)
+{
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D, ssr->scene ? ssr->scene->colour_id : 0);
+    glUniform1i(glGetUniformLocation(program, "scene_colour"), texture_unit);
+
+    glActiveTexture(GL_TEXTURE0 + texture_unit + 1);
+    glBindTexture(GL_TEXTURE_2D, ssr->scene ? ssr->scene->depth_id : 0);
+    glUniform1i(glGetUniformLocation(program, "scene_depth"), texture_unit + 1);
+
+    glActiveTexture(GL_TEXTURE0 + texture_unit + 2);
+    glBindTexture(GL_TEXTURE_2D, ssr->hiz_texture);
+    glUniform1i(glGetUniformLocation(program, "scene_hiz"), texture_unit + 2);
+
+    glUniform1i(glGetUniformLocation(program, "hiz_levels"), ssr->levels);
+}
+
+void ssr_release(ssr_t *ssr)
+{
+    rafgl_render_target_release(ssr->scene);
+    ssr->scene = NULL;
+}
+
+void ssr_cleanup(ssr_t *ssr)
+{
+    ssr_release(ssr);
+    glDeleteFramebuffers(1, &ssr->hiz_fbo);
+    glDeleteTextures(1, &ssr->hiz_texture);
+    glDeleteVertexArrays(1, &ssr->vao);
+    glDeleteProgram(ssr->hiz_program);
+}
@@ -0,0 +1,160 @@
+#include <rafgl.h>
+#include <terrain.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif // __SSE2__
+
+typedef struct _terrain_ambient_job_t
+{
+    /* heights with TERRAIN_AO_RADIUS samples of clamped border on every side */
+    const float *padded;
+    int padded_width;
+    int width, height;
+    unsigned char *ambient;
+    /* two rows of width per band, slopes then open sky. From the frame arena, the workers can not allocate from it themselves */
+    float *rows;
+
+    /* per direction and step: offset into padded and 1 / horizontal distance */
+    int offsets[TERRAIN_AO_DIRECTIONS][TERRAIN_AO_STEPS];
+    float inverse_distances[TERRAIN_AO_DIRECTIONS][TERRAIN_AO_STEPS];
+} terrain_ambient_job_t;
+
+/* steepest slope towards the horizon, for every sample of the row at once */
+static void __terrain_horizon_row(const terrain_ambient_job_t *job, const float *row, int direction, float *slopes)
+{
+    int x, s, offset;
+    float inverse_distance, slope;
+
+    for (x = 0; x < job->width; x++)
+        slopes[x] = 0.0f;
+
+    for (s = 0; s < TERRAIN_AO_STEPS; s++) {
+        offset = job->offsets[direction][s];
+        inverse_distance = job->inverse_distances[direction][s];
+        x = 0;
+
+#if defined(__SSE2__)
+        {
+            __m128 inverse = _mm_set1_ps(inverse_distance);
+            for (; x + 4 <= job->width; x += 4) {
+                __m128 rise = _mm_sub_ps(_mm_loadu_ps(row + x + offset), _mm_loadu_ps(row + x));
+                _mm_storeu_ps(slopes + x, _mm_max_ps(_mm_loadu_ps(slopes + x), _mm_mul_ps(rise, inverse)));
+            }
+        }
+#endif // __SSE2__
+
+        for (; x < job->width; x++) {
+            slope = (row[x + offset] - row[x]) * inverse_distance;
+            if (slope > slopes[x])
+                slopes[x] = slope;
+        }
+    }
+}
+
+static void __terrain_ambient_band_job(void *ctx, int band)
+{
+    terrain_ambient_job_t *job = ctx;
+    int z, z_end = rafgl_min_m((band + 1) * TERRAIN_AO_BAND_ROWS, job->height);
+    int x, d;
+    float *slopes = job->rows + 2 * band * job->width;
+    float *open = slopes + job->width;
+    const float *row;
+
+    for (z = band * TERRAIN_AO_BAND_ROWS; z < z_end; z++) {
+        row = job->padded + (z + TERRAIN_AO_RADIUS) * job->padded_width + TERRAIN_AO_RADIUS;
+
+        for (x = 0; x < job->width; x++)
+            open[x] = 0.0f;
+
+        /* each direction leaves 1 - sin(horizon angle) of its slice of the sky open */
+        for (d = 0; d < TERRAIN_AO_DIRECTIONS; d++) {
+            __terrain_horizon_row(job, row, d, slopes);
+            x = 0;
+
+#if defined(__SSE2__)
+            {
+                __m128 one = _mm_set1_ps(1.0f);
+                for (; x + 4 <= job->width; x += 4) {
+                    __m128 slope = _mm_loadu_ps(slopes + x);
+                    __m128 sine = _mm_div_ps(slope, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(slope, slope))));
+                    _mm_storeu_ps(open + x, _mm_add_ps(_mm_loadu_ps(open + x), _mm_sub_ps(one, sine)));
+                }
+            }
+#endif // __SSE2__
+
+            for (; x < job->width; x++)
+                open[x] += 1.0f - slopes[x] / sqrtf(1.0f + slopes[x] * slopes[x]);
+        }
+
+        for (x = 0; x < job->width; x++)
+            job->ambient[z * job->width + x] = (unsigned char)(open[x] * (255.0f / TERRAIN_AO_DIRECTIONS) + 0.5f);
+    }
+}
+
+void terrain_bake_ambient(const float *heights, int width, int height, float spacing, unsigned char *ambient)
+{
+    terrain_ambient_job_t job;
+    rafgl_arena_t *scratch = rafgl_frame_arena();
+    size_t scope = rafgl_arena_mark(scratch);
+    float *padded, angle, radius;
+    int x, z, d, s, dx, dz, bands = (height + TERRAIN_AO_BAND_ROWS - 1) / TERRAIN_AO_BAND_ROWS;
+    double start = glfwGetTime();
+
+    job.padded_width = width + 2 * TERRAIN_AO_RADIUS;
+    job.width = width;
+    job.height = height;
+    job.ambient = ambient;
+
+    /* a clamped border keeps every sample of the sweep in bounds without a branch */
+    padded = rafgl_arena_alloc(scratch, job.padded_width * (height + 2 * TERRAIN_AO_RADIUS) * sizeof(float));
+    job.rows = rafgl_arena_alloc(scratch, bands * 2 * width * sizeof(float));
+    if (padded == NULL || job.rows == NULL) {
+        memset(ambient, 255, (size_t)width * height);
+        rafgl_arena_reset(scratch, scope);
+        return;
+    }
+
+    for (z = 0; z < height + 2 * TERRAIN_AO_RADIUS; z++) {
+        for (x = 0; x < job.padded_width; x++) {
+            padded[z * job.padded_width + x] = heights[rafgl_clampi(z - TERRAIN_AO_RADIUS, 0, height - 1) * width + rafgl_clampi(x - TERRAIN_AO_RADIUS, 0, width - 1)];
+        }
+    }
+    job.padded = padded;
+
+    for (d = 0; d < TERRAIN_AO_DIRECTIONS; d++) {
+        angle = 2.0f * M_PI * d / TERRAIN_AO_DIRECTIONS;
+        for (s = 0; s < TERRAIN_AO_STEPS; s++) {
+            radius = powf(TERRAIN_AO_RADIUS, (float)(s + 1) / TERRAIN_AO_STEPS);
+            dx = (int)roundf(cosf(angle) * radius);
+            dz = (int)roundf(sinf(angle) * radius);
+            if (dx == 0 && dz == 0)
+                dx = 1;
+            job.offsets[d][s] = dz * job.padded_width + dx;
+            job.inverse_distances[d][s] = 1.0f / (spacing * sqrtf(dx * dx + dz * dz));
+        }
+    }
+
+    rafgl_parallel_for(bands, __terrain_ambient_band_job, &job);
+    rafgl_arena_reset(scratch, scope);
+
+    rafgl_log(RAFGL_INFO, "Baked %dx%d terrain ambient in %.1f ms on %d threads\n", width, height, (glfwGetTime() - start) * 1000.0, rafgl_parallel_thread_count());
+}
+
+GLuint terrain_ambient_texture(const unsigned char *ambient, int width, int height)
+{
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, ambient);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}